@@ -0,0 +1,294 @@
+#include "autofocus.h"
+#include "focuser.h"
+#include "event_loop.h"
+#include "util.h"
+#include "string.h"
+#include "stdlib.h"
+#include "math.h"
+
+#define TAG "AUTOFOCUS"
+
+#define STATE_IDLE 0
+#define STATE_MOVING 1
+#define STATE_WAITING_METRIC 2
+#define STATE_FINISHING 3
+#define STATE_FITTING 4
+
+autofocus_event_callback autofocus_callback;
+portMUX_TYPE autofocusMux = portMUX_INITIALIZER_UNLOCKED;
+int autofocusState = STATE_IDLE;
+int32_t sweepStart, sweepStep;
+uint16_t sweepCount;
+uint16_t sweepIndex;
+int32_t sweepPositions[AUTOFOCUS_MAX_SAMPLES];
+float sweepMetrics[AUTOFOCUS_MAX_SAMPLES];
+// set while taking up backlash, the real target follows it
+bool approachPending;
+int32_t approachTarget;
+
+/*
+ * Every position is approached in the sweep direction. A target behind the
+ * focuser is first overshot by one step so gear backlash is taken up the
+ * same way for the samples and the final position.
+ *
+ * With autofocusMux held, returns where to move the focuser once it is
+ * released; starting the focuser timer is not allowed inside the mux.
+ */
+int32_t autofocus_approach(int32_t target) {
+    int32_t current = focuser_get_target();
+    approachPending = (int64_t)(target - current) * sweepStep < 0;
+    approachTarget = target;
+    return approachPending ? target - sweepStep : target;
+}
+
+/* the sweep runs on the event loop with the commands that drive it */
+void autofocus_arrived_work(const void* data) {
+    int32_t position = *(const int32_t*) data;
+    uint8_t event = 0;
+    uint16_t index = 0;
+    bool move = false;
+    int32_t target = 0;
+    portENTER_CRITICAL(&autofocusMux);
+    if (approachPending && (autofocusState == STATE_MOVING || autofocusState == STATE_FINISHING)) {
+        approachPending = false;
+        move = true;
+        target = approachTarget;
+    } else if (autofocusState == STATE_MOVING) {
+        autofocusState = STATE_WAITING_METRIC;
+        sweepPositions[sweepIndex] = position;
+        event = AUTOFOCUS_EVENT_IN_POSITION;
+        index = sweepIndex;
+    } else if (autofocusState == STATE_FINISHING) {
+        autofocusState = STATE_IDLE;
+        event = AUTOFOCUS_EVENT_FINISHED;
+        index = sweepCount;
+    }
+    portEXIT_CRITICAL(&autofocusMux);
+    if (move) {
+        focuser_move_to(target);
+    }
+    if (event && autofocus_callback) {
+        autofocus_callback(event, index, position);
+    }
+}
+
+/* on the focuser timer task */
+void autofocus_arrived(int32_t position) {
+    event_loop_post(autofocus_arrived_work, &position, sizeof(position));
+}
+
+esp_err_t init_autofocus(autofocus_event_callback callback) {
+    autofocus_callback = callback;
+    focuser_set_arrived_callback(autofocus_arrived);
+    return ESP_OK;
+}
+
+esp_err_t autofocus_start(int32_t start, int32_t step, uint16_t count) {
+    if (step == 0 || count < 3 || count > AUTOFOCUS_MAX_SAMPLES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t end = (int64_t) start + (int64_t) step * (count - 1);
+    if (llabs(start) > focuser_get_max_steps() || llabs(end) > focuser_get_max_steps()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&autofocusMux);
+    sweepStart = start;
+    sweepStep = step;
+    sweepCount = count;
+    sweepIndex = 0;
+    autofocusState = STATE_MOVING;
+    int32_t target = autofocus_approach(start);
+    portEXIT_CRITICAL(&autofocusMux);
+    focuser_move_to(target);
+    LOGI(TAG, "sweep %d points from %d by %d", count, start, step);
+    return ESP_OK;
+}
+
+esp_err_t autofocus_report(uint16_t index, float metric) {
+    int32_t positions[AUTOFOCUS_MAX_SAMPLES];
+    float metrics[AUTOFOCUS_MAX_SAMPLES];
+    int32_t target;
+    portENTER_CRITICAL(&autofocusMux);
+    if (autofocusState != STATE_WAITING_METRIC || index != sweepIndex) {
+        portEXIT_CRITICAL(&autofocusMux);
+        return ESP_ERR_INVALID_STATE;
+    }
+    sweepMetrics[sweepIndex++] = metric;
+    bool finished = sweepIndex == sweepCount;
+    uint16_t count = sweepCount;
+    if (finished) {
+        // the fit is soft-float double, it runs on copies outside the mux
+        memcpy(positions, sweepPositions, count * sizeof(int32_t));
+        memcpy(metrics, sweepMetrics, count * sizeof(float));
+        autofocusState = STATE_FITTING;
+    } else {
+        autofocusState = STATE_MOVING;
+        target = autofocus_approach(sweepStart + sweepStep * sweepIndex);
+    }
+    portEXIT_CRITICAL(&autofocusMux);
+    if (!finished) {
+        focuser_move_to(target);
+        return ESP_OK;
+    }
+
+    int32_t best = 0;
+    int fit = autofocus_fit(positions, metrics, count, &best);
+    portENTER_CRITICAL(&autofocusMux);
+    // an abort while fitting wins
+    bool current = autofocusState == STATE_FITTING;
+    if (current && fit != AUTOFOCUS_FIT_NONE) {
+        autofocusState = STATE_FINISHING;
+        target = autofocus_approach(best);
+    } else if (current) {
+        autofocusState = STATE_IDLE;
+    }
+    portEXIT_CRITICAL(&autofocusMux);
+    if (!current) {
+        return ESP_OK;
+    }
+    LOGI(TAG, "fit %d best %d", fit, best);
+    if (fit != AUTOFOCUS_FIT_NONE) {
+        focuser_move_to(target);
+    } else if (autofocus_callback) {
+        autofocus_callback(AUTOFOCUS_EVENT_FAILED, index, focuser_get_position());
+    }
+    return ESP_OK;
+}
+
+bool is_autofocusing() {
+    return autofocusState != STATE_IDLE;
+}
+
+void abort_autofocus() {
+    portENTER_CRITICAL(&autofocusMux);
+    bool running = autofocusState != STATE_IDLE;
+    autofocusState = STATE_IDLE;
+    approachPending = false;
+    portEXIT_CRITICAL(&autofocusMux);
+    if (running) {
+        focuser_abort_move();
+        if (autofocus_callback) {
+            autofocus_callback(AUTOFOCUS_EVENT_FAILED, sweepIndex, focuser_get_position());
+        }
+    }
+}
+
+/* least-squares line y = m x + b over [from, to), false when degenerate */
+bool fit_line(const double *x, const double *y, int from, int to, double *m, double *b, double *sse) {
+    int n = to - from;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = from; i < to; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    double d = n * sxx - sx * sx;
+    if (n < 2 || d <= 0) {
+        return false;
+    }
+    *m = (n * sxy - sx * sy) / d;
+    *b = (sy - *m * sx) / n;
+    *sse = 0;
+    for (int i = from; i < to; i++) {
+        double r = y[i] - (*m * x[i] + *b);
+        *sse += r * r;
+    }
+    return true;
+}
+
+int autofocus_fit(const int32_t *positions, const float *metrics, int count, int32_t *best) {
+    double x[AUTOFOCUS_MAX_SAMPLES], y[AUTOFOCUS_MAX_SAMPLES];
+    int n = 0;
+    if (count > AUTOFOCUS_MAX_SAMPLES) {
+        count = AUTOFOCUS_MAX_SAMPLES;
+    }
+    // valid samples sorted by position
+    for (int i = 0; i < count; i++) {
+        if (!(metrics[i] > 0)) {
+            continue;
+        }
+        int j = n++;
+        while (j > 0 && x[j - 1] > positions[i]) {
+            x[j] = x[j - 1];
+            y[j] = y[j - 1];
+            j--;
+        }
+        x[j] = positions[i];
+        y[j] = metrics[i];
+    }
+    if (n < 3) {
+        return AUTOFOCUS_FIT_NONE;
+    }
+    int minIndex = 0;
+    for (int i = 1; i < n; i++) {
+        if (y[i] < y[minIndex]) minIndex = i;
+    }
+    double lo = x[0], hi = x[n - 1];
+    if (hi <= lo) {
+        *best = (int32_t) x[minIndex];
+        return AUTOFOCUS_FIT_MINIMUM;
+    }
+
+    // V-curve, the split with the smallest residual whose flanks fall and rise
+    double bestSse = -1, bestX = 0;
+    for (int k = 2; k <= n - 2; k++) {
+        double m1, b1, e1, m2, b2, e2;
+        if (!fit_line(x, y, 0, k, &m1, &b1, &e1) || !fit_line(x, y, k, n, &m2, &b2, &e2)) {
+            continue;
+        }
+        if (m1 >= 0 || m2 <= 0) {
+            continue;
+        }
+        double vertex = (b2 - b1) / (m1 - m2);
+        if (vertex < lo || vertex > hi) {
+            continue;
+        }
+        if (bestSse < 0 || e1 + e2 < bestSse) {
+            bestSse = e1 + e2;
+            bestX = vertex;
+        }
+    }
+
+    // parabola on positions centered and scaled to [-1, 1] for conditioning
+    double center = (lo + hi) / 2, scale = (hi - lo) / 2;
+    double s[5] = { 0 }, t[3] = { 0 };
+    for (int i = 0; i < n; i++) {
+        double u = (x[i] - center) / scale, p = 1;
+        for (int j = 0; j < 5; j++) {
+            if (j < 3) t[j] += p * y[i];
+            s[j] += p;
+            p *= u;
+        }
+    }
+    // normal equations [s4 s3 s2; s3 s2 s1; s2 s1 s0] [a b c] = [t2 t1 t0], Cramer's rule
+    double parabolaSse = -1, parabolaX = 0;
+    double det = s[4] * (s[2] * s[0] - s[1] * s[1]) - s[3] * (s[3] * s[0] - s[1] * s[2]) + s[2] * (s[3] * s[1] - s[2] * s[2]);
+    if (fabs(det) > 1e-12) {
+        double a = (t[2] * (s[2] * s[0] - s[1] * s[1]) - s[3] * (t[1] * s[0] - s[1] * t[0]) + s[2] * (t[1] * s[1] - s[2] * t[0])) / det;
+        double b = (s[4] * (t[1] * s[0] - s[1] * t[0]) - t[2] * (s[3] * s[0] - s[1] * s[2]) + s[2] * (s[3] * t[0] - t[1] * s[2])) / det;
+        double c = (s[4] * (s[2] * t[0] - t[1] * s[1]) - s[3] * (s[3] * t[0] - t[1] * s[2]) + t[2] * (s[3] * s[1] - s[2] * s[2])) / det;
+        double vertex = center - b / (2 * a) * scale;
+        if (a > 0 && vertex >= lo && vertex <= hi) {
+            parabolaSse = 0;
+            for (int i = 0; i < n; i++) {
+                double u = (x[i] - center) / scale;
+                double r = y[i] - (a * u * u + b * u + c);
+                parabolaSse += r * r;
+            }
+            parabolaX = vertex;
+        }
+    }
+
+    // the model that explains the samples better wins
+    if (bestSse >= 0 && (parabolaSse < 0 || bestSse <= parabolaSse)) {
+        *best = (int32_t) lround(bestX);
+        return AUTOFOCUS_FIT_V_CURVE;
+    }
+    if (parabolaSse >= 0) {
+        *best = (int32_t) lround(parabolaX);
+        return AUTOFOCUS_FIT_PARABOLA;
+    }
+    *best = (int32_t) x[minIndex];
+    return AUTOFOCUS_FIT_MINIMUM;
+}
\ No newline at end of file
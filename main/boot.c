@@ -0,0 +1,66 @@
+#include "boot.h"
+#include "esp_timer.h"
+#include "util.h"
+
+#define TAG "BOOT"
+
+const char* bootStageNames[BOOT_STAGES] = {
+    [BOOT_STAGE_NVS] = "nvs",
+    [BOOT_STAGE_SETTINGS] = "settings",
+    [BOOT_STAGE_WIFI_INIT] = "wifi_init",
+    [BOOT_STAGE_MOTION] = "motion",
+    [BOOT_STAGE_DISPLAY] = "display",
+    [BOOT_STAGE_NETWORK] = "network",
+    [BOOT_STAGE_SERVER] = "server",
+};
+
+portMUX_TYPE bootMux = portMUX_INITIALIZER_UNLOCKED;
+// zero until recorded, esp_timer starts counting before app_main
+int64_t bootBegin[BOOT_STAGES];
+int64_t bootEnd[BOOT_STAGES];
+
+void boot_stage_begin(boot_stage_t stage) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&bootMux);
+    if (!bootBegin[stage]) {
+        bootBegin[stage] = now;
+    }
+    portEXIT_CRITICAL(&bootMux);
+}
+
+void boot_stage_end(boot_stage_t stage) {
+    int64_t now = esp_timer_get_time();
+    bool first = false;
+    portENTER_CRITICAL(&bootMux);
+    if (bootBegin[stage] && !bootEnd[stage]) {
+        bootEnd[stage] = now;
+        first = true;
+    }
+    portEXIT_CRITICAL(&bootMux);
+    if (first) {
+        LOGI(TAG, "%s ready at %lld us, took %lld us", bootStageNames[stage], now, now - bootBegin[stage]);
+    }
+}
+
+void boot_get_timeline(int32_t begin[BOOT_STAGES], int32_t end[BOOT_STAGES]) {
+    portENTER_CRITICAL(&bootMux);
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        begin[i] = bootBegin[i] ? (int32_t) bootBegin[i] : -1;
+        end[i] = bootEnd[i] ? (int32_t) bootEnd[i] : -1;
+    }
+    portEXIT_CRITICAL(&bootMux);
+}
+
+bool boot_is_complete() {
+    bool complete = true;
+    portENTER_CRITICAL(&bootMux);
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        complete = complete && bootEnd[i];
+    }
+    portEXIT_CRITICAL(&bootMux);
+    return complete;
+}
+
+const char* boot_stage_name(boot_stage_t stage) {
+    return stage < BOOT_STAGES ? bootStageNames[stage] : "unknown";
+}
@@ -0,0 +1,132 @@
+#include "checkpoint.h"
+#include "mount_encoder.h"
+#include "motion_loop.h"
+#include "settings.h"
+#include "clock_sync.h"
+#include "esp_timer.h"
+#include "astro.h"
+#include "util.h"
+
+#define TAG "CHECKPOINT"
+
+#define POLL_MILLIS 1000
+#define INTERVAL_POLLS (CONFIG_CHECKPOINT_INTERVAL_SECONDS)
+#define TOLERANCE_MILLIS (CONFIG_CHECKPOINT_TOLERANCE_MILLIS)
+
+portMUX_TYPE checkpointMux = portMUX_INITIALIZER_UNLOCKED;
+bool positionKnown = false;
+bool restorePending = false;
+int checkpointPolls = 0;
+motion_timer_t checkpointTimer;
+
+int32_t sidereal_mod(int64_t millis) {
+    int64_t m = millis % SIDEREAL_DAY_MILLIS;
+    return (int32_t)(m < 0 ? m + SIDEREAL_DAY_MILLIS : m);
+}
+
+int32_t checkpoint_ra_offset(int32_t ra_sidereal_millis, int64_t wall_millis) {
+    return sidereal_mod(ra_sidereal_millis - wall_millis);
+}
+
+int32_t checkpoint_ra_restore(int32_t ra_offset_millis, int64_t wall_millis) {
+    return sidereal_mod(ra_offset_millis + wall_millis);
+}
+
+/* false unless the client clock is synced and reads as Unix time */
+bool wall_millis(int64_t* target) {
+    if (!clock_sync_is_synced()) {
+        return false;
+    }
+    *target = clock_sync_to_client_micros(esp_timer_get_time()) / 1000;
+    return *target >= (int64_t) CHECKPOINT_MIN_UNIX_SECONDS * 1000;
+}
+
+void checkpoint_save() {
+    int64_t wall;
+    if (!positionKnown || !wall_millis(&wall)) {
+        return;
+    }
+    int32_t offset = checkpoint_ra_offset(get_ra_sidereal_millis(), wall);
+    int32_t dec = get_dec_mechnical_angle_millis();
+    // clock sync jitter moves the offset by a few millis, that is not worth a flash write
+    int32_t raDiff = sidereal_mod(offset - settings_get(SETTING_CHECKPOINT_RA_OFFSET));
+    if (raDiff > SIDEREAL_DAY_MILLIS / 2) raDiff = SIDEREAL_DAY_MILLIS - raDiff;
+    int32_t decDiff = dec - settings_get(SETTING_CHECKPOINT_DEC);
+    if (settings_get(SETTING_CHECKPOINT_VALID) && raDiff <= TOLERANCE_MILLIS && decDiff <= TOLERANCE_MILLIS && decDiff >= -TOLERANCE_MILLIS) {
+        return;
+    }
+    settings_set(SETTING_CHECKPOINT_RA_OFFSET, offset);
+    settings_set(SETTING_CHECKPOINT_DEC, dec);
+    settings_set(SETTING_CHECKPOINT_SAVED_AT, (int32_t)(wall / 1000));
+    settings_set(SETTING_CHECKPOINT_VALID, 1);
+}
+
+/* on the motion task, it owns the position */
+void checkpoint_apply(const void* data) {
+    const int32_t* angles = data;
+    set_mechanical_angles(angles[0], angles[1]);
+}
+
+/* false if the checkpoint does not belong to this clock */
+bool checkpoint_restore(int64_t wall) {
+    if (wall / 1000 < settings_get(SETTING_CHECKPOINT_SAVED_AT)) {
+        LOGE(TAG, "client clock %lld s is before the checkpoint, dropped", wall / 1000);
+        settings_set(SETTING_CHECKPOINT_VALID, 0);
+        return false;
+    }
+    int32_t angles[2] = {
+        checkpoint_ra_restore(settings_get(SETTING_CHECKPOINT_RA_OFFSET), wall),
+        settings_get(SETTING_CHECKPOINT_DEC)
+    };
+    motion_post(checkpoint_apply, angles, sizeof(angles));
+    LOGI(TAG, "restored ra %d dec %d", angles[0], angles[1]);
+    return true;
+}
+
+/* on the motion task, the position it saves is only consistent there */
+void checkpoint_timer_listener(void* args) {
+    int64_t wall;
+    if (!wall_millis(&wall)) {
+        return;
+    }
+    portENTER_CRITICAL(&checkpointMux);
+    bool restore = restorePending;
+    restorePending = false;
+    bool save = ++checkpointPolls >= INTERVAL_POLLS;
+    if (save) {
+        checkpointPolls = 0;
+    }
+    portEXIT_CRITICAL(&checkpointMux);
+    if (restore) {
+        if (checkpoint_restore(wall)) {
+            portENTER_CRITICAL(&checkpointMux);
+            positionKnown = true;
+            portEXIT_CRITICAL(&checkpointMux);
+        }
+    } else if (save) {
+        checkpoint_save();
+    }
+}
+
+esp_err_t init_checkpoint() {
+    restorePending = settings_get(SETTING_CHECKPOINT_VALID) != 0;
+    positionKnown = false;
+    checkpointPolls = 0;
+    motion_timer_init(&checkpointTimer, checkpoint_timer_listener, NULL);
+    if (!motion_timer_start_periodic(&checkpointTimer, POLL_MILLIS)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void checkpoint_position_synced() {
+    portENTER_CRITICAL(&checkpointMux);
+    restorePending = false;
+    positionKnown = true;
+    portEXIT_CRITICAL(&checkpointMux);
+    checkpoint_save();
+}
+
+bool checkpoint_is_position_known() {
+    return positionKnown;
+}
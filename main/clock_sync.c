@@ -0,0 +1,131 @@
+#include "clock_sync.h"
+#include "util.h"
+
+#define TAG "CLOCK_SYNC"
+
+#define SAMPLES 16
+#define WINDOWS 8
+#define MAX_DELAY_MICROS 1000000
+
+typedef struct {
+    int64_t local;
+    int64_t offset;
+    int64_t delay;
+} clock_sample_t;
+
+/* recent samples, and the lowest delay sample of each of the last windows of SAMPLES */
+clock_sample_t clockSamples[SAMPLES];
+int clockSampleCount;
+int clockSampleNext;
+clock_sample_t windowBests[WINDOWS];
+int windowCount;
+int windowNext;
+int windowSamples;
+
+int64_t syncRefLocal;
+int64_t syncRefOffset;
+double syncDrift;
+bool synced;
+portMUX_TYPE syncMux = portMUX_INITIALIZER_UNLOCKED;
+
+void clock_sync_init() {
+    clockSampleCount = 0;
+    clockSampleNext = 0;
+    windowCount = 0;
+    windowNext = 0;
+    windowSamples = 0;
+    syncRefLocal = 0;
+    syncRefOffset = 0;
+    syncDrift = 0;
+    synced = false;
+}
+
+/* the lowest delay sample has the least asymmetric queuing in it */
+static clock_sample_t* best_sample(clock_sample_t* samples, int count) {
+    clock_sample_t* best = NULL;
+    for (int i = 0; i < count; i++) {
+        if (best == NULL || samples[i].delay < best->delay) {
+            best = &samples[i];
+        }
+    }
+    return best;
+}
+
+/* least squares line through the window bests gives both offset and drift */
+static void fit_windows() {
+    int64_t base = windowBests[0].local;
+    int64_t offsetBase = windowBests[0].offset;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < windowCount; i++) {
+        double x = windowBests[i].local - base;
+        double y = windowBests[i].offset - offsetBase;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double n = windowCount;
+    double denominator = n * sxx - sx * sx;
+    if (denominator <= 0) {
+        return;
+    }
+    syncDrift = (n * sxy - sx * sy) / denominator;
+    syncRefLocal = base + (int64_t)(sx / n);
+    syncRefOffset = offsetBase + (int64_t)(sy / n);
+}
+
+void clock_sync_add_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    int64_t delay = (t4 - t1) - (t3 - t2);
+    if (delay < 0 || delay > MAX_DELAY_MICROS) {
+        LOGI(TAG, "Reject sample, delay %lld", delay);
+        return;
+    }
+    clock_sample_t* s = &clockSamples[clockSampleNext];
+    s->local = t2 + (t3 - t2) / 2;
+    s->offset = ((t1 - t2) + (t4 - t3)) / 2;
+    s->delay = delay;
+    clockSampleNext = (clockSampleNext + 1) % SAMPLES;
+    if (clockSampleCount < SAMPLES) clockSampleCount++;
+
+    portENTER_CRITICAL(&syncMux);
+    if (++windowSamples == SAMPLES) {
+        windowSamples = 0;
+        windowBests[windowNext] = *best_sample(clockSamples, clockSampleCount);
+        windowNext = (windowNext + 1) % WINDOWS;
+        if (windowCount < WINDOWS) windowCount++;
+    }
+    if (windowCount >= 2) {
+        fit_windows();
+    } else {
+        clock_sample_t* best = best_sample(clockSamples, clockSampleCount);
+        syncRefLocal = best->local;
+        syncRefOffset = best->offset;
+    }
+    synced = true;
+    portEXIT_CRITICAL(&syncMux);
+    LOGI(TAG, "offset %lld delay %lld drift %d ppb", s->offset, s->delay, clock_sync_get_drift_ppb());
+}
+bool clock_sync_is_synced() {
+    return synced;
+}
+
+int64_t clock_sync_to_client_micros(int64_t local_micros) {
+    portENTER_CRITICAL(&syncMux);
+    int64_t offset = syncRefOffset + (int64_t)(syncDrift * (local_micros - syncRefLocal));
+    portEXIT_CRITICAL(&syncMux);
+    return local_micros + offset;
+}
+
+int64_t clock_sync_to_local_micros(int64_t client_micros) {
+    int64_t local = client_micros - clock_sync_get_offset_micros();
+    return local - (clock_sync_to_client_micros(local) - client_micros);
+}
+
+int64_t clock_sync_get_offset_micros() {
+    int64_t now = esp_timer_get_time();
+    return clock_sync_to_client_micros(now) - now;
+}
+
+int32_t clock_sync_get_drift_ppb() {
+    return (int32_t)(syncDrift * 1000000000.0);
+}
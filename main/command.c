@@ -0,0 +1,40 @@
+#include "command.h"
+#include "command_stats.h"
+#include "util.h"
+
+#define TAG "COMMAND"
+
+void command_net_to_host(void* field, size_t size) {
+    if (htonl(1) == 1) return;
+    uint8_t* bytes = field;
+    for (size_t i = 0; i < size / 2; i++) {
+        uint8_t b = bytes[i];
+        bytes[i] = bytes[size - 1 - i];
+        bytes[size - 1 - i] = b;
+    }
+}
+
+int command_dispatch(const command_t* table, char* buf, unsigned int len, uint8_t state, command_context_t* ctx) {
+    if (len == 0 || len > COMMAND_MAX_SIZE) return 0;
+    const command_t* cmd = &table[(uint8_t) buf[0]];
+    if (cmd->handler == NULL) {
+        LOGI(TAG, "Unknown command: %d", (uint8_t) buf[0]);
+        return 0;
+    }
+    command_stats_received((uint8_t) buf[0]);
+    unsigned int size = cmd->payload_size + 1;
+    if (cmd->variable_length ? len < size : len != size) return 0;
+    if (cmd->preconditions & state) {
+        command_stats_rejected((uint8_t) buf[0]);
+        return 0;
+    }
+    /* copy out so handlers always see an aligned payload */
+    uint32_t payload[COMMAND_MAX_SIZE / sizeof(uint32_t)];
+    memcpy(payload, buf + 1, cmd->payload_size);
+    if (cmd->decode != NULL) {
+        cmd->decode(payload);
+    }
+    ctx->tail = buf + size;
+    ctx->tail_len = len - size;
+    return cmd->handler(payload, ctx);
+}
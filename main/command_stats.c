@@ -0,0 +1,182 @@
+#include "command_stats.h"
+#include "esp_timer.h"
+#include "string.h"
+
+#define NO_SLOT 0xff
+
+typedef struct command_histogram {
+    uint16_t counts[COMMAND_STATS_BUCKETS];
+    uint32_t max_micros;
+} command_histogram_t;
+
+typedef struct command_slot {
+    uint32_t received;
+    uint32_t rejected;
+    command_histogram_t effect;
+    command_histogram_t ack;
+} command_slot_t;
+
+portMUX_TYPE commandStatsMux = portMUX_INITIALIZER_UNLOCKED;
+// slot + 1 per command id, 0 until the command first arrives
+uint8_t commandSlotOf[256];
+uint8_t commandSlotCmd[COMMAND_STATS_SLOTS];
+command_slot_t commandSlots[COMMAND_STATS_SLOTS];
+int commandSlotCount = 0;
+network_stats_t networkStats;
+
+int command_stats_bucket(uint32_t micros) {
+    if (micros < 4) {
+        return micros;
+    }
+    int exponent = 31 - __builtin_clz(micros);
+    int bucket = (exponent - 1) * 4 + ((micros >> (exponent - 2)) & 3);
+    return bucket < COMMAND_STATS_BUCKETS ? bucket : COMMAND_STATS_BUCKETS - 1;
+}
+
+uint32_t command_stats_bucket_middle(int bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    int exponent = bucket / 4 + 1;
+    uint32_t width = 1u << (exponent - 2);
+    return (4 + bucket % 4) * width + width / 2;
+}
+
+/* called with commandStatsMux held, only known commands take a slot so garbage cannot use them up */
+static int slot_of(uint8_t cmd, bool assign) {
+    if (commandSlotOf[cmd]) {
+        return commandSlotOf[cmd] - 1;
+    }
+    if (!assign || commandSlotCount >= COMMAND_STATS_SLOTS) {
+        return NO_SLOT;
+    }
+    int slot = commandSlotCount++;
+    commandSlotCmd[slot] = cmd;
+    commandSlotOf[cmd] = slot + 1;
+    return slot;
+}
+
+static void histogram_add(command_histogram_t* histogram, int64_t micros) {
+    uint32_t value = micros > 0 ? (uint32_t) micros : 0;
+    int bucket = command_stats_bucket(value);
+    if (histogram->counts[bucket] == UINT16_MAX) {
+        for (int i = 0; i < COMMAND_STATS_BUCKETS; i++) {
+            histogram->counts[i] >>= 1;
+        }
+    }
+    histogram->counts[bucket]++;
+    if (value > histogram->max_micros) {
+        histogram->max_micros = value;
+    }
+}
+
+static void histogram_latency(const command_histogram_t* histogram, command_latency_t* target) {
+    uint32_t total = 0;
+    for (int i = 0; i < COMMAND_STATS_BUCKETS; i++) {
+        total += histogram->counts[i];
+    }
+    target->p50_micros = 0;
+    target->p99_micros = 0;
+    target->max_micros = histogram->max_micros;
+    if (total == 0) {
+        return;
+    }
+    // the smallest bucket where the running count reaches the rank
+    uint32_t rank50 = (total + 1) / 2, rank99 = total - total / 100;
+    uint32_t seen = 0;
+    bool found50 = false;
+    for (int i = 0; i < COMMAND_STATS_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (!found50 && seen >= rank50) {
+            target->p50_micros = command_stats_bucket_middle(i);
+            found50 = true;
+        }
+        if (seen >= rank99) {
+            target->p99_micros = command_stats_bucket_middle(i);
+            break;
+        }
+    }
+    // the bucket middle may be past the largest sample
+    if (target->p50_micros > target->max_micros) target->p50_micros = target->max_micros;
+    if (target->p99_micros > target->max_micros) target->p99_micros = target->max_micros;
+}
+
+void command_stats_received(uint8_t cmd) {
+    portENTER_CRITICAL(&commandStatsMux);
+    int slot = slot_of(cmd, true);
+    if (slot == NO_SLOT) {
+        networkStats.untracked++;
+    } else {
+        commandSlots[slot].received++;
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+void command_stats_rejected(uint8_t cmd) {
+    portENTER_CRITICAL(&commandStatsMux);
+    int slot = slot_of(cmd, false);
+    if (slot != NO_SLOT) {
+        commandSlots[slot].rejected++;
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+void command_stats_effect(uint8_t cmd, int64_t received_at) {
+    int64_t micros = esp_timer_get_time() - received_at;
+    portENTER_CRITICAL(&commandStatsMux);
+    int slot = slot_of(cmd, false);
+    if (slot != NO_SLOT) {
+        histogram_add(&commandSlots[slot].effect, micros);
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+void command_stats_acked(uint8_t cmd, int64_t received_at) {
+    int64_t micros = esp_timer_get_time() - received_at;
+    portENTER_CRITICAL(&commandStatsMux);
+    int slot = slot_of(cmd, false);
+    if (slot != NO_SLOT) {
+        histogram_add(&commandSlots[slot].ack, micros);
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+void command_stats_datagram_in(bool ok) {
+    portENTER_CRITICAL(&commandStatsMux);
+    if (ok) {
+        networkStats.datagrams_in++;
+    } else {
+        networkStats.receive_errors++;
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+void command_stats_datagram_out(int result) {
+    portENTER_CRITICAL(&commandStatsMux);
+    if (result >= 0) {
+        networkStats.datagrams_out++;
+    } else {
+        networkStats.send_failures++;
+    }
+    portEXIT_CRITICAL(&commandStatsMux);
+}
+
+int command_stats_get(command_type_stats_t* target, network_stats_t* network) {
+    portENTER_CRITICAL(&commandStatsMux);
+    int count = commandSlotCount;
+    *network = networkStats;
+    portEXIT_CRITICAL(&commandStatsMux);
+    // a slot at a time under the lock, the percentiles are walked outside it
+    command_slot_t slot;
+    for (int i = 0; i < count; i++) {
+        portENTER_CRITICAL(&commandStatsMux);
+        slot = commandSlots[i];
+        target[i].cmd = commandSlotCmd[i];
+        portEXIT_CRITICAL(&commandStatsMux);
+        target[i].received = slot.received;
+        target[i].rejected = slot.rejected;
+        histogram_latency(&slot.effect, &target[i].effect);
+        histogram_latency(&slot.ack, &target[i].ack);
+    }
+    return count;
+}
@@ -2,3 +2,13 @@
 # "main" pseudo-component makefile.
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
+
+# Axis and focuser conversions as exact constants from the configuration,
+# see gen_kinematics.py. It fails the build for settings that overflow.
+COMPONENT_EXTRA_INCLUDES := $(COMPONENT_BUILD_DIR)
+COMPONENT_EXTRA_CLEAN := axis_kinematics.h
+
+focuser.o mount.o mount_encoder.o satellite.o slew.o telescope.o: axis_kinematics.h
+
+axis_kinematics.h: $(COMPONENT_PATH)/gen_kinematics.py $(SDKCONFIG_MAKEFILE)
+	$(PYTHON) $< $(SDKCONFIG_MAKEFILE) > $@.tmp && mv $@.tmp $@
@@ -0,0 +1,207 @@
+#include "cpu_monitor.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "event_loop.h"
+#include "util.h"
+#include "string.h"
+#include "sdkconfig.h"
+
+#define TAG "CPU"
+
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+#define RUN_TIME_STATS 1
+#else
+#define RUN_TIME_STATS 0
+#endif
+
+// the port counts run time in esp_timer microseconds unless the CPU clock is selected
+#ifdef CONFIG_FREERTOS_RUN_TIME_STATS_USING_CPU_CLK
+#define RUN_TIME_TICKS_PER_MICRO CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#else
+#define RUN_TIME_TICKS_PER_MICRO 1
+#endif
+
+// every task of the system, WiFi and lwIP included, uxTaskGetSystemState fails on fewer
+#define MAX_SYSTEM_TASKS 24
+#define NOT_PINNED 0xff
+
+_Static_assert(portNUM_PROCESSORS <= CPU_MONITOR_CORES, "every core fits in the report");
+
+typedef struct cpu_task_sample {
+    TaskHandle_t handle;
+    uint32_t run_time; // counter at the last sample
+    uint16_t peak;
+} cpu_task_sample_t;
+
+#if RUN_TIME_STATS
+TaskStatus_t cpuTaskStatus[MAX_SYSTEM_TASKS];
+#endif
+cpu_task_sample_t cpuSamples[MAX_SYSTEM_TASKS];
+int cpuSampleCount = 0;
+int64_t cpuSampledAt = 0;
+uint16_t cpuCorePeak[CPU_MONITOR_CORES];
+cpu_monitor_report_t cpuReport;
+portMUX_TYPE cpuMonitorMux = portMUX_INITIALIZER_UNLOCKED;
+portMUX_TYPE timerMonitorMux = portMUX_INITIALIZER_UNLOCKED;
+event_timer_t cpuMonitorTimer;
+
+#if RUN_TIME_STATS
+static cpu_task_sample_t* previous_sample(TaskHandle_t handle) {
+    for (int i = 0; i < cpuSampleCount; i++) {
+        if (cpuSamples[i].handle == handle) {
+            return &cpuSamples[i];
+        }
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * The counters are 32 bits, a window must stay below 2^32 ticks: 71 min on
+ * the esp_timer clock, 26 s on the CPU clock at 160 MHz.
+ */
+void cpu_monitor_sample(void* _) {
+#if RUN_TIME_STATS
+    int64_t now = esp_timer_get_time();
+    uint32_t total;
+    UBaseType_t count = uxTaskGetSystemState(cpuTaskStatus, MAX_SYSTEM_TASKS, &total);
+    if (count == 0) {
+        LOGE(TAG, "More than %d tasks", MAX_SYSTEM_TASKS);
+        return;
+    }
+    uint32_t window = (uint32_t)(now - cpuSampledAt);
+    uint64_t ticks = (uint64_t) window * RUN_TIME_TICKS_PER_MICRO;
+    bool first = cpuSampledAt == 0;
+    if (!first && ticks == 0) {
+        return;
+    }
+    cpu_task_sample_t samples[MAX_SYSTEM_TASKS];
+    cpu_monitor_report_t report;
+    bzero(&report, sizeof(report));
+    report.window_micros = first ? 0 : window;
+    report.cpu_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    for (int i = 0; i < count; i++) {
+        TaskStatus_t* status = &cpuTaskStatus[i];
+        cpu_task_sample_t* previous = previous_sample(status->xHandle);
+        uint32_t load = 0;
+        if (previous && !first) {
+            load = (uint64_t)(status->ulRunTimeCounter - previous->run_time) * 1000 / ticks;
+            if (load > 1000) load = 1000;
+        }
+        samples[i].handle = status->xHandle;
+        samples[i].run_time = status->ulRunTimeCounter;
+        samples[i].peak = previous && previous->peak > load ? previous->peak : load;
+
+        int idleOf = -1;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (status->xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+                idleOf = core;
+            }
+        }
+        if (idleOf >= 0) {
+            report.core_load[idleOf] = first ? 0 : 1000 - load;
+            continue;
+        }
+        // busiest first, the frame holds CPU_MONITOR_MAX_TASKS
+        int at = report.task_count;
+        while (at > 0 && report.tasks[at - 1].load < load) {
+            at--;
+        }
+        if (at >= CPU_MONITOR_MAX_TASKS) {
+            continue;
+        }
+        int moved = report.task_count < CPU_MONITOR_MAX_TASKS ? report.task_count - at : CPU_MONITOR_MAX_TASKS - 1 - at;
+        memmove(&report.tasks[at + 1], &report.tasks[at], moved * sizeof(cpu_task_load_t));
+        if (report.task_count < CPU_MONITOR_MAX_TASKS) {
+            report.task_count++;
+        }
+        cpu_task_load_t* task = &report.tasks[at];
+        strncpy(task->name, status->pcTaskName, CPU_MONITOR_NAME_LENGTH - 1);
+        task->name[CPU_MONITOR_NAME_LENGTH - 1] = 0;
+#if configTASKLIST_INCLUDE_COREID
+        task->core = status->xCoreID < CPU_MONITOR_CORES ? status->xCoreID : NOT_PINNED;
+#else
+        task->core = NOT_PINNED;
+#endif
+        task->priority = status->uxCurrentPriority;
+        task->load = load;
+        task->peak = samples[i].peak;
+    }
+    for (int core = 0; core < CPU_MONITOR_CORES; core++) {
+        if (report.core_load[core] > cpuCorePeak[core]) {
+            cpuCorePeak[core] = report.core_load[core];
+        }
+        report.core_peak[core] = cpuCorePeak[core];
+    }
+    memcpy(cpuSamples, samples, count * sizeof(cpu_task_sample_t));
+    cpuSampleCount = count;
+    cpuSampledAt = now;
+    portENTER_CRITICAL(&cpuMonitorMux);
+    cpuReport = report;
+    portEXIT_CRITICAL(&cpuMonitorMux);
+#endif
+}
+
+esp_err_t init_cpu_monitor() {
+    bzero(&cpuReport, sizeof(cpuReport));
+    cpuReport.cpu_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    if (!RUN_TIME_STATS) {
+        LOGI(TAG, "No run time stats, task loads are not reported");
+        return ESP_OK;
+    }
+    event_timer_init(&cpuMonitorTimer, cpu_monitor_sample, NULL);
+    event_timer_start_periodic(&cpuMonitorTimer, CONFIG_CPU_MONITOR_WINDOW_MILLIS);
+    cpu_monitor_sample(NULL);
+    return ESP_OK;
+}
+
+void cpu_monitor_get_report(cpu_monitor_report_t* target) {
+    portENTER_CRITICAL(&cpuMonitorMux);
+    *target = cpuReport;
+    portEXIT_CRITICAL(&cpuMonitorMux);
+}
+
+void timer_monitor_init(timer_monitor_t* monitor) {
+    bzero(monitor, sizeof(timer_monitor_t));
+}
+
+void timer_monitor_armed(timer_monitor_t* monitor, uint32_t intended_micros) {
+    int64_t due = esp_timer_get_time() + intended_micros;
+    portENTER_CRITICAL(&timerMonitorMux);
+    monitor->due = due;
+    portEXIT_CRITICAL(&timerMonitorMux);
+}
+
+void timer_monitor_stopped(timer_monitor_t* monitor) {
+    portENTER_CRITICAL(&timerMonitorMux);
+    monitor->due = 0;
+    portEXIT_CRITICAL(&timerMonitorMux);
+}
+
+void timer_monitor_fired(timer_monitor_t* monitor) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&timerMonitorMux);
+    if (monitor->due) {
+        monitor->lateness[monitor->count % TIMER_MONITOR_WINDOW] = (int32_t)(now - monitor->due);
+        monitor->count++;
+        monitor->due = 0;
+    }
+    portEXIT_CRITICAL(&timerMonitorMux);
+}
+
+void timer_monitor_get(timer_monitor_t* monitor, timer_monitor_stats_t* target) {
+    bzero(target, sizeof(timer_monitor_stats_t));
+    portENTER_CRITICAL(&timerMonitorMux);
+    uint32_t count = monitor->count;
+    int n = count < TIMER_MONITOR_WINDOW ? count : TIMER_MONITOR_WINDOW;
+    int64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        int32_t lateness = monitor->lateness[i];
+        if (i == 0 || lateness < target->min_micros) target->min_micros = lateness;
+        if (i == 0 || lateness > target->max_micros) target->max_micros = lateness;
+        total += lateness;
+    }
+    portEXIT_CRITICAL(&timerMonitorMux);
+    target->samples = count;
+    target->avg_micros = n ? (int32_t)(total / n) : 0;
+}
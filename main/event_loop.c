@@ -0,0 +1,177 @@
+#include "event_loop.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "util.h"
+#include "string.h"
+
+#define TAG "EVENT_LOOP"
+
+// longest select, so a lost wake datagram only delays a timer this much
+#define MAX_WAIT_MILLIS 1000
+
+typedef struct event_socket {
+    int fd;
+    event_socket_callback callback;
+    void* arg;
+} event_socket_t;
+
+timer_wheel_t eventWheel;
+// recursive, timer callbacks on the loop task start and stop timers too
+SemaphoreHandle_t eventLock;
+StaticSemaphore_t eventLockBuffer;
+TaskHandle_t eventTask = NULL;
+event_socket_t eventSockets[EVENT_LOOP_MAX_SOCKETS];
+int eventSocketCount = 0;
+// a datagram to itself ends the select early for a timer started by another task
+int wakeFd = -1;
+struct sockaddr_in wakeAddr;
+work_item_t eventItems[EVENT_LOOP_QUEUE_SIZE];
+work_queue_t eventQueue;
+// posts wake the loop from the esp_timer task, so the poster stays out of lwIP
+esp_timer_handle_t eventPostTimer;
+
+uint32_t event_loop_now() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void event_loop_wake() {
+    if (xTaskGetCurrentTaskHandle() == eventTask || wakeFd < 0) {
+        return;
+    }
+    char b = 0;
+    sendto(wakeFd, &b, 1, 0, (struct sockaddr *) &wakeAddr, sizeof(wakeAddr));
+}
+
+void event_loop_drain_wake(int fd, void* arg) {
+    char buf[8];
+    recv(fd, buf, sizeof(buf), 0);
+}
+
+void event_loop_post_wake(void* arg) {
+    event_loop_wake();
+}
+
+bool event_loop_post(work_f work, const void* data, size_t size) {
+    if (xTaskGetCurrentTaskHandle() == eventTask) {
+        work(data);
+        return true;
+    }
+    if (!work_queue_push(&eventQueue, work, data, size)) {
+        LOGE(TAG, "Event queue full");
+        return false;
+    }
+    // fails harmlessly while a wake is already pending
+    esp_timer_start_once(eventPostTimer, 0);
+    return true;
+}
+
+esp_err_t event_loop_add_socket(int fd, event_socket_callback callback, void* arg) {
+    xSemaphoreTakeRecursive(eventLock, portMAX_DELAY);
+    bool full = eventSocketCount >= EVENT_LOOP_MAX_SOCKETS;
+    if (!full) {
+        eventSockets[eventSocketCount++] = (event_socket_t) { fd, callback, arg };
+    }
+    xSemaphoreGiveRecursive(eventLock);
+    if (full) {
+        return ESP_ERR_NO_MEM;
+    }
+    event_loop_wake();
+    return ESP_OK;
+}
+
+esp_err_t init_event_loop() {
+    eventLock = xSemaphoreCreateRecursiveMutexStatic(&eventLockBuffer);
+    if (!eventLock) {
+        return ESP_ERR_NO_MEM;
+    }
+    wheel_init(&eventWheel, event_loop_now());
+    work_queue_init(&eventQueue, eventItems, EVENT_LOOP_QUEUE_SIZE);
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = event_loop_post_wake
+    };
+    esp_err_t err = esp_timer_create(&args, &eventPostTimer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    wakeFd = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (wakeFd < 0) {
+        LOGE(TAG, "Failed to create wake socket: %d", errno);
+        return ESP_FAIL;
+    }
+    memset(&wakeAddr, 0, sizeof(wakeAddr));
+    wakeAddr.sin_family = AF_INET;
+    wakeAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(wakeAddr);
+    if (bind(wakeFd, (struct sockaddr *) &wakeAddr, sizeof(wakeAddr)) < 0
+        || getsockname(wakeFd, (struct sockaddr *) &wakeAddr, &len) < 0) {
+        LOGE(TAG, "Failed to bind wake socket: %d", errno);
+        close(wakeFd);
+        wakeFd = -1;
+        return ESP_FAIL;
+    }
+    return event_loop_add_socket(wakeFd, event_loop_drain_wake, NULL);
+}
+
+void event_timer_init(event_timer_t* timer, wheel_callback callback, void* arg) {
+    wheel_timer_init(timer, callback, arg);
+}
+
+void event_timer_start(event_timer_t* timer, uint32_t millis, uint32_t period) {
+    xSemaphoreTakeRecursive(eventLock, portMAX_DELAY);
+    timer->period = period;
+    // ticks are whole milliseconds, a timer never fires early
+    wheel_add(&eventWheel, timer, event_loop_now() + millis + 1);
+    xSemaphoreGiveRecursive(eventLock);
+    event_loop_wake();
+}
+
+void event_timer_start_once(event_timer_t* timer, uint32_t millis) {
+    event_timer_start(timer, millis, 0);
+}
+
+void event_timer_start_periodic(event_timer_t* timer, uint32_t millis) {
+    event_timer_start(timer, millis, millis > 0 ? millis : 1);
+}
+
+void event_timer_stop(event_timer_t* timer) {
+    xSemaphoreTakeRecursive(eventLock, portMAX_DELAY);
+    wheel_cancel(&eventWheel, timer);
+    xSemaphoreGiveRecursive(eventLock);
+}
+
+void event_loop_run(void* p) {
+    eventTask = xTaskGetCurrentTaskHandle();
+    LOGI(TAG, "Event loop started");
+    while (1) {
+        work_queue_run(&eventQueue);
+        fd_set readable;
+        FD_ZERO(&readable);
+        int maxFd = -1;
+        xSemaphoreTakeRecursive(eventLock, portMAX_DELAY);
+        uint32_t now = event_loop_now();
+        wheel_advance(&eventWheel, now);
+        uint32_t wait = wheel_next_tick(&eventWheel, MAX_WAIT_MILLIS);
+        for (int i = 0; i < eventSocketCount; i++) {
+            FD_SET(eventSockets[i].fd, &readable);
+            if (eventSockets[i].fd > maxFd) maxFd = eventSockets[i].fd;
+        }
+        xSemaphoreGiveRecursive(eventLock);
+
+        // the wheel wants tick now + wait, which starts (wait - 1) ms after this tick began
+        int64_t waitMicros = ((int64_t)(now + wait) * 1000) - esp_timer_get_time();
+        if (waitMicros < 0) waitMicros = 0;
+        struct timeval timeout = { .tv_sec = waitMicros / 1000000, .tv_usec = waitMicros % 1000000 };
+        int count = select(maxFd + 1, &readable, NULL, NULL, &timeout);
+        if (count <= 0) {
+            continue;
+        }
+        for (int i = 0; i < eventSocketCount; i++) {
+            if (FD_ISSET(eventSockets[i].fd, &readable)) {
+                eventSockets[i].callback(eventSockets[i].fd, eventSockets[i].arg);
+            }
+        }
+    }
+}
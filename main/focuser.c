@@ -2,6 +2,17 @@
 #include "esp_timer.h"
 #include "util.h"
 #include "driver/gpio.h"
+#include "math.h"
+#include "freertos/FreeRTOS.h"
+#include "soc/gpio_reg.h"
+#include "string.h"
+#include "trace.h"
+#include "cpu_monitor.h"
+#include "axis_kinematics.h"
+
+#ifndef CONFIG_FOCUS_FULL_STEP
+#define CONFIG_FOCUS_FULL_STEP false
+#endif
 
 int focuser_gpio_nums[4] = {
     CONFIG_GPIO_FOCUS_IN1,
@@ -10,6 +21,7 @@ int focuser_gpio_nums[4] = {
     CONFIG_GPIO_FOCUS_IN4
 };
 
+// odd indexes energize two coils, they are the full-step phases
 bool focuser_step_config[][4] = {
     { 1, 0, 0, 0 },
     { 1, 1, 0, 0 },
@@ -21,74 +33,249 @@ bool focuser_step_config[][4] = {
     { 1, 0, 0, 1 }
 };
 
+/*
+ * focuser_step_config compiled into register masks for the configured pins.
+ * A phase change clears first and sets second, so a full-step transition
+ * passes through the half-step phase between them and never energizes
+ * three coils.
+ */
+typedef struct focuser_phase_mask {
+    uint32_t set;
+    uint32_t clear;
+    uint32_t set_high; // GPIO 32-39
+    uint32_t clear_high;
+} focuser_phase_mask_t;
+
+focuser_phase_mask_t focuser_phase_masks[8];
+focuser_phase_mask_t focuser_release_mask;
+
 int32_t focuser_step;
 int32_t focuser_target_step;
 bool focuser_is_moving;
+// keeps the coil phase continuous when the position is re-zeroed
+int32_t focuser_phase_offset;
+
+// current speed and direction of the ramp, speed in half steps per second
+float focuser_speed;
+int8_t focuser_direction;
+
+portMUX_TYPE focuser_mux = portMUX_INITIALIZER_UNLOCKED;
+
+focuser_arrived_callback focuser_arrived = NULL;
 
 void focuser_timer_listener(void* args);
 
 esp_timer_handle_t focuser_timer;
+timer_monitor_t focuser_timer_monitor;
 
 esp_timer_create_args_t focuser_timer_args = {
     .dispatch_method = ESP_TIMER_TASK,
     .callback = focuser_timer_listener
 };
 
-void focuser_timer_listener(void* args) {
-    if (focuser_step > focuser_target_step) {
-        focuser_step --;
-    } else if (focuser_step < focuser_target_step)  {
-        focuser_step ++;
-    } else {//reach target
-        for (int i = 0; i < 4; i++) {            
-            gpio_set_level(focuser_gpio_nums[i], 0);
+#define MICRONS_TO_STEPS(m) ((float)(m) * FOCUS_STEPS_PER_MICRON_NUM / FOCUS_STEPS_PER_MICRON_DEN)
+#define START_SPEED MICRONS_TO_STEPS(CONFIG_FOCUS_START_SPEED_MICRONS_PER_SECOND)
+#define CRUISE_SPEED MICRONS_TO_STEPS(CONFIG_FOCUS_MOVEMENT_SPEED_MICRONS_PER_SECOND)
+#define ACCELERATION MICRONS_TO_STEPS(CONFIG_FOCUS_ACCELERATION_MICRONS_PER_SECOND2)
+
+void focuser_build_masks(const int gpio_nums[4], focuser_phase_mask_t masks[8], focuser_phase_mask_t *release) {
+    memset(masks, 0, sizeof(focuser_phase_mask_t) * 8);
+    memset(release, 0, sizeof(focuser_phase_mask_t));
+    for (int i = 0; i < 4; i++) {
+        bool high = gpio_nums[i] >= 32;
+        uint32_t bit = 1u << (gpio_nums[i] & 31);
+        for (int phase = 0; phase < 8; phase++) {
+            focuser_phase_mask_t *mask = &masks[phase];
+            if (focuser_step_config[phase][i]) {
+                *(high ? &mask->set_high : &mask->set) |= bit;
+            } else {
+                *(high ? &mask->clear_high : &mask->clear) |= bit;
+            }
         }
-        focuser_is_moving = 0;
-        esp_timer_stop(focuser_timer);
+        *(high ? &release->clear_high : &release->clear) |= bit;
+    }
+}
+
+void focuser_apply(const focuser_phase_mask_t *mask) {
+    if (mask->clear) REG_WRITE(GPIO_OUT_W1TC_REG, mask->clear);
+    if (mask->clear_high) REG_WRITE(GPIO_OUT1_W1TC_REG, mask->clear_high);
+    if (mask->set) REG_WRITE(GPIO_OUT_W1TS_REG, mask->set);
+    if (mask->set_high) REG_WRITE(GPIO_OUT1_W1TS_REG, mask->set_high);
+}
+
+void focuser_output(int32_t step) {
+    focuser_apply(&focuser_phase_masks[(step + focuser_phase_offset) & 7]);
+}
+
+void focuser_release() {
+    focuser_apply(&focuser_release_mask);
+}
+
+/*
+ * Advances one tick of the ramp and returns the delay to the next tick in
+ * microseconds, or 0 when the target is reached. Speed follows
+ * v^2 = v0^2 + 2ad, braking starts once the stopping distance at the
+ * current speed covers what is left. A reversed target first brakes down
+ * to the start speed in the old direction.
+ */
+uint32_t focuser_advance() {
+    int32_t remaining = focuser_target_step - focuser_step;
+    if (remaining == 0 && focuser_speed <= START_SPEED) {
+        return 0;
+    }
+    int8_t direction = remaining > 0 ? 1 : (remaining < 0 ? -1 : focuser_direction);
+    if (direction != focuser_direction && focuser_speed > START_SPEED) {
+        direction = focuser_direction;
+        remaining = 0;
+    }
+    int32_t distance = remaining * direction;
+    int32_t stride = 1;
+    if (CONFIG_FOCUS_FULL_STEP && ((focuser_step + focuser_phase_offset) & 1) && distance > CONFIG_FOCUS_FINAL_APPROACH_STEPS) {
+        stride = 2;
+    }
+    focuser_step += stride * direction;
+    focuser_direction = direction;
+    distance -= stride;
+
+    float speed2 = focuser_speed * focuser_speed;
+    if (speed2 >= 2 * ACCELERATION * distance) {
+        speed2 -= 2 * ACCELERATION * stride;
+    } else {
+        speed2 += 2 * ACCELERATION * stride;
+    }
+    focuser_speed = sqrtf(speed2 > START_SPEED * START_SPEED ? speed2 : START_SPEED * START_SPEED);
+    if (focuser_speed > CRUISE_SPEED) {
+        focuser_speed = CRUISE_SPEED;
+    }
+    return (uint32_t)(1000000 * stride / focuser_speed);
+}
+
+void focuser_timer_listener(void* args) {
+    TRACE_BEGIN(TRACE_FOCUSER_TIMER, 0);
+    timer_monitor_fired(&focuser_timer_monitor);
+    portENTER_CRITICAL(&focuser_mux);
+    if (!focuser_is_moving) {
+        portEXIT_CRITICAL(&focuser_mux);
+        TRACE_END(TRACE_FOCUSER_TIMER, 0);
         return;
     }
-    int32_t index = focuser_step % 8;
-    if (index < 0) {
-        index += 8;
+    uint32_t interval = focuser_advance();
+    int32_t step = focuser_step;
+    if (interval == 0) {
+        focuser_is_moving = 0;
+        focuser_speed = 0;
     }
-    bool *output = focuser_step_config[index];
-    for (int i = 0; i < 4; i++) {            
-        gpio_set_level(focuser_gpio_nums[i], output[i]);
+    portEXIT_CRITICAL(&focuser_mux);
+    if (interval == 0) {//reach target
+        focuser_release();
+        if (focuser_arrived) {
+            focuser_arrived(step);
+        }
+        TRACE_END(TRACE_FOCUSER_TIMER, 0);
+        return;
     }
+    focuser_output(step);
+    timer_monitor_armed(&focuser_timer_monitor, interval);
+    esp_timer_start_once(focuser_timer, interval);
+    TRACE_END(TRACE_FOCUSER_TIMER, 0);
 }
 
 void focuser_init() {
     ESP_ERROR_CHECK(esp_timer_create(&focuser_timer_args, &focuser_timer));
+    timer_monitor_init(&focuser_timer_monitor);
+    focuser_build_masks(focuser_gpio_nums, focuser_phase_masks, &focuser_release_mask);
     for (int i = 0; i < 4; i ++) {
         gpio_pad_select_gpio(focuser_gpio_nums[i]);
         gpio_set_direction(focuser_gpio_nums[i], GPIO_MODE_OUTPUT);
-        gpio_set_level(focuser_gpio_nums[i], 0);
     }
+    focuser_release();
     focuser_step = 0;
     focuser_target_step = 0;
+    focuser_phase_offset = 0;
     focuser_is_moving = 0;
+    focuser_speed = 0;
+    focuser_direction = 1;
 }
 
+void focuser_set_arrived_callback(focuser_arrived_callback callback) {
+    focuser_arrived = callback;
+}
+
+_Static_assert(FOCUS_NANOS_PER_STEP <= UINT16_MAX, "a focuser step does not fit the 16 bit status field");
+// the target is an int32_t that still takes a whole move either side of the limit
+_Static_assert(FOCUS_MAX_STEPS <= INT32_MAX / 2, "focuser movement has too many steps");
+
 uint16_t focuser_get_movement_nanos_per_step() {
-    return CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE * 1000 / CONFIG_FOCUS_STEPS_PER_CYCLE;
+    return FOCUS_NANOS_PER_STEP;
 }
 
-#define MAX_STEPS (CONFIG_FOCUS_TOTAL_MOVEMENT_MICRONS * CONFIG_FOCUS_STEPS_PER_CYCLE / CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE)
+#define MAX_STEPS ((int32_t) FOCUS_MAX_STEPS)
 
 uint32_t focuser_get_max_steps() {
     return MAX_STEPS;
 }
 
-#define STEP_INTERVAL_MICROSECONDS (1000000 / (CONFIG_FOCUS_MOVEMENT_SPEED_MICRONS_PER_SECOND * CONFIG_FOCUS_STEPS_PER_CYCLE / CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE))
+// called with focuser_mux held, true when the timer has to be started
+bool focuser_set_target(int32_t target) {
+    if (target > MAX_STEPS) target = MAX_STEPS;
+    if (target < -MAX_STEPS) target = -MAX_STEPS;
+    focuser_target_step = target;
+    bool start = !focuser_is_moving;
+    if (start) {
+        focuser_is_moving = 1;
+        focuser_speed = 0;
+    }
+    return start;
+}
 
 void focuser_move(int32_t steps) {
     if (steps > MAX_STEPS) steps = MAX_STEPS;
     if (steps < -MAX_STEPS) steps = -MAX_STEPS;
-    focuser_target_step += steps;
-    if (focuser_target_step > MAX_STEPS) focuser_target_step = MAX_STEPS;
-    if (focuser_target_step < -MAX_STEPS) focuser_target_step = -MAX_STEPS;
-    focuser_is_moving = 1;
-    esp_timer_start_periodic(focuser_timer, STEP_INTERVAL_MICROSECONDS);
+    portENTER_CRITICAL(&focuser_mux);
+    bool start = focuser_set_target(focuser_target_step + steps);
+    portEXIT_CRITICAL(&focuser_mux);
+    if (start) {
+        timer_monitor_armed(&focuser_timer_monitor, 0);
+        esp_timer_start_once(focuser_timer, 0);
+    }
+}
+
+void focuser_move_to(int32_t step) {
+    portENTER_CRITICAL(&focuser_mux);
+    bool start = focuser_set_target(step);
+    portEXIT_CRITICAL(&focuser_mux);
+    if (start) {
+        timer_monitor_armed(&focuser_timer_monitor, 0);
+        esp_timer_start_once(focuser_timer, 0);
+    }
+}
+
+void focuser_get_timer_stats(timer_monitor_stats_t* target) {
+    timer_monitor_get(&focuser_timer_monitor, target);
+}
+
+int32_t focuser_get_position() {
+    return focuser_step;
+}
+
+int32_t focuser_get_target() {
+    return focuser_target_step;
+}
+
+bool focuser_set_position(int32_t step) {
+    portENTER_CRITICAL(&focuser_mux);
+    bool idle = !focuser_is_moving;
+    if (idle) {
+        focuser_phase_offset += focuser_step - step;
+        focuser_step = step;
+        focuser_target_step = step;
+    }
+    portEXIT_CRITICAL(&focuser_mux);
+    return idle;
+}
+
+bool focuser_set_zero() {
+    return focuser_set_position(0);
 }
 
 bool focuser_get_is_moving() {
@@ -96,7 +283,11 @@ bool focuser_get_is_moving() {
 }
 
 void focuser_abort_move() {
+    portENTER_CRITICAL(&focuser_mux);
     focuser_is_moving = 0;
-    esp_timer_stop(focuser_timer);
+    focuser_speed = 0;
     focuser_target_step = focuser_step;
+    portEXIT_CRITICAL(&focuser_mux);
+    esp_timer_stop(focuser_timer);
+    timer_monitor_stopped(&focuser_timer_monitor);
 }
\ No newline at end of file
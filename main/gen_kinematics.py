@@ -0,0 +1,144 @@
+#!/usr/bin/env python
+#
+# Writes axis_kinematics.h from the project configuration: the pulse, angle
+# and rate conversions of the mount axes and the focuser as reduced
+# rationals and rounded fixed point constants, computed exactly from the
+# Kconfig integers instead of in doubles at run time.
+#
+#   gen_kinematics.py sdkconfig > axis_kinematics.h
+#
+# Configurations whose constants do not fit are rejected here, checks that
+# need the firmware's own limits are _Static_asserts next to the code.
+#
+from __future__ import print_function
+import sys
+
+# astro.h and motion_math.h, motion_math.h checks they agree
+SIDEREAL_DAY_MILLIS = 86164092
+DAY_MILLIS = 86400000
+SPEED_PER_CYCLE = 15000
+UAS_PER_MILLI = 15000
+UAS_PER_CYCLE = UAS_PER_MILLI * DAY_MILLIS
+
+lines = []
+
+
+def fail(message):
+    sys.stderr.write('gen_kinematics.py: %s\n' % message)
+    sys.exit(1)
+
+
+def gcd(a, b):
+    while b:
+        a, b = b, a % b
+    return a
+
+
+def read_config(path):
+    config = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('CONFIG_') and '=' in line:
+                key, value = line.split('=', 1)
+                config[key[len('CONFIG_'):]] = value
+    return config
+
+
+def positive(config, key):
+    try:
+        value = int(config[key], 0)
+    except (KeyError, ValueError):
+        fail('CONFIG_%s is not set' % key)
+    if value <= 0:
+        fail('CONFIG_%s must be positive, is %d' % (key, value))
+    return value
+
+
+def out(line=''):
+    lines.append(line)
+
+
+def integer(name, value, comment=None):
+    if value >= 2 ** 63:
+        fail('%s = %d does not fit 64 bits' % (name, value))
+    if comment:
+        out('/* %s */' % comment)
+    out('#define %s %dLL' % (name, value))
+
+
+def rational(name, num, den, comment):
+    g = gcd(num, den)
+    out('/* %s, %d/%d reduced */' % (comment, num, den))
+    integer(name + '_NUM', num // g)
+    integer(name + '_DEN', den // g)
+
+
+def fixed(name, num, den, bits, comment):
+    """num/den scaled by 2^bits, rounded to nearest"""
+    value = (num * 2 ** (bits + 1) + den) // (2 * den)
+    if value >= 2 ** 64:
+        fail('%s does not fit 64 bits as Q%d' % (name, bits))
+    if value < 2 ** 16:
+        fail('%s is %d as Q%d, under 16 significant bits' % (name, value, bits))
+    out('/* %s, Q%d */' % (comment, bits))
+    out('#define %s %dULL' % (name, value))
+
+
+def axis(config, name, cycle_millis, cycle):
+    pulses = positive(config, name + '_CYCLE_STEPS') * positive(config, name + '_RESOLUTION') \
+        * positive(config, name + '_GEAR_RATIO')
+    if pulses >= 2 ** 31:
+        fail('%s has %d pulses per cycle, the step counters take up to 2^31' % (name, pulses))
+    out('/* ---------- %s ---------- */' % name)
+    integer(name + '_PULSES_PER_CYCLE', pulses)
+    rational(name + '_UAS_PER_PULSE', UAS_PER_CYCLE, pulses, 'micro arcseconds per pulse')
+    fixed(name + '_UAS_PER_PULSE', UAS_PER_CYCLE, pulses, 32, 'micro arcseconds per pulse')
+    # a speed unit is 1/SPEED_PER_CYCLE cycle per cycle_millis
+    rational(name + '_RATE_PER_SPEED', pulses, SPEED_PER_CYCLE * cycle_millis * 1000,
+             'pulses per microsecond per unit of speed, a cycle per %s' % cycle)
+    fixed(name + '_RATE_PER_SPEED', pulses, SPEED_PER_CYCLE * cycle_millis * 1000, 64,
+          'pulses per microsecond per unit of speed')
+    if config.get(name + '_ENCODER') == 'y':
+        counts = positive(config, name + '_ENCODER_COUNTS_PER_CYCLE')
+        fixed(name + '_UAS_PER_COUNT', UAS_PER_CYCLE, counts, 32, 'micro arcseconds per encoder count')
+    out()
+
+
+def focuser(config):
+    total = positive(config, 'FOCUS_TOTAL_MOVEMENT_MICRONS')
+    microns = positive(config, 'FOCUS_MOVEMENT_MICRONS_PER_CYCLE')
+    steps = positive(config, 'FOCUS_STEPS_PER_CYCLE')
+    out('/* ---------- focuser ---------- */')
+    rational('FOCUS_STEPS_PER_MICRON', steps, microns, 'steps per micron')
+    integer('FOCUS_MAX_STEPS', total * steps // microns, 'whole steps in the total movement')
+    integer('FOCUS_NANOS_PER_STEP', (microns * 1000 * 2 + steps) // (2 * steps), 'nanometers per step, rounded')
+    out()
+
+
+def main():
+    if len(sys.argv) != 2:
+        fail('usage: gen_kinematics.py sdkconfig')
+    config = read_config(sys.argv[1])
+    out('/* Generated by main/gen_kinematics.py from %s, do not edit */' % sys.argv[1])
+    out('#ifndef __AXIS_KINEMATICS_H')
+    out('#define __AXIS_KINEMATICS_H')
+    out()
+    integer('KINEMATICS_SIDEREAL_DAY_MILLIS', SIDEREAL_DAY_MILLIS)
+    integer('KINEMATICS_DAY_MILLIS', DAY_MILLIS)
+    integer('KINEMATICS_SPEED_PER_CYCLE', SPEED_PER_CYCLE)
+    integer('KINEMATICS_UAS_PER_MILLI', UAS_PER_MILLI)
+    out()
+    rational('UAS_PER_SIDEREAL_MILLI', UAS_PER_CYCLE, SIDEREAL_DAY_MILLIS, 'how far the sky turns in a millisecond')
+    fixed('UAS_PER_SIDEREAL_MILLI', UAS_PER_CYCLE, SIDEREAL_DAY_MILLIS, 32, 'how far the sky turns in a millisecond')
+    rational('SIDEREAL_MILLIS_PER_UAS', SIDEREAL_DAY_MILLIS, UAS_PER_CYCLE, 'sidereal millis per micro arcsecond')
+    out()
+    axis(config, 'RA', SIDEREAL_DAY_MILLIS, 'sidereal day')
+    axis(config, 'DEC', DAY_MILLIS, 'day')
+    focuser(config)
+    out('#endif')
+    print('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,141 @@
+#include "hand_controller.h"
+#include "input.h"
+#include "rencoder.h"
+#include "focuser.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "util.h"
+#include "math.h"
+#include "string.h"
+#include "stdlib.h"
+
+#define TAG "HAND"
+
+#define UPDATE_MICROS ((CONFIG_HAND_UPDATE_MILLIS) * 1000)
+#define FULL_SPEED ((float)(CONFIG_HAND_FULL_SPEED_COUNTS_PER_SECOND))
+
+hand_jog_callback handCallback = NULL;
+rencoder_t* handEncoder = NULL;
+uint8_t handAxis = HAND_AXIS_RA;
+int32_t handRate = 0;
+hand_stats_t handStats;
+portMUX_TYPE handMux = portMUX_INITIALIZER_UNLOCKED;
+// rotations and the decay timer both change the rate, the callback sees them in order
+SemaphoreHandle_t handLock;
+StaticSemaphore_t handLockBuffer;
+esp_timer_handle_t handTimer;
+bool handTimerRunning = false;
+
+int32_t hand_jog_rate(float counts_per_second, int32_t min_rate, int32_t max_rate, float full_speed) {
+    float speed = fabsf(counts_per_second);
+    if (speed < 0.5f) {
+        return 0;
+    }
+    float t = speed / full_speed;
+    if (t > 1) t = 1;
+    int32_t rate = min_rate + (int32_t)((max_rate - min_rate) * t * t);
+    return counts_per_second > 0 ? rate : -rate;
+}
+
+void hand_record_latency() {
+    uint32_t micros = rencoder_cycles_since_step(handEncoder) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    portENTER_CRITICAL(&handMux);
+    if (handStats.jogs == 0 || micros < handStats.min_latency_micros) handStats.min_latency_micros = micros;
+    if (micros > handStats.max_latency_micros) handStats.max_latency_micros = micros;
+    handStats.total_latency_micros += micros;
+    handStats.jogs++;
+    portEXIT_CRITICAL(&handMux);
+}
+
+/* called with handLock held, a rate the callback did not take is not kept */
+bool hand_set_rate(int32_t rate, bool measured) {
+    if (rate == handRate) {
+        return true;
+    }
+    if (handCallback && !handCallback(handAxis, rate)) {
+        return false;
+    }
+    handRate = rate;
+    if (measured) {
+        hand_record_latency();
+    }
+    return true;
+}
+
+void hand_timer_listener(void* args) {
+    xSemaphoreTake(handLock, portMAX_DELAY);
+    if (handAxis != HAND_AXIS_FOCUSER) {
+        hand_set_rate(hand_jog_rate(rencoder_velocity(handEncoder), CONFIG_HAND_MIN_RATE, CONFIG_HAND_MAX_RATE, FULL_SPEED), false);
+    }
+    if (handRate == 0) {
+        esp_timer_stop(handTimer);
+        handTimerRunning = false;
+    }
+    xSemaphoreGive(handLock);
+}
+
+void hand_rotated(int8_t steps) {
+    if (!handEncoder) {
+        return;
+    }
+    float velocity = rencoder_velocity(handEncoder);
+    xSemaphoreTake(handLock, portMAX_DELAY);
+    if (handAxis == HAND_AXIS_FOCUSER) {
+        int32_t multiplier = hand_jog_rate(velocity, 1, CONFIG_HAND_FOCUS_MAX_STEPS_PER_COUNT, FULL_SPEED);
+        focuser_move(steps * (multiplier ? abs(multiplier) : 1));
+        hand_record_latency();
+    } else {
+        bool set = hand_set_rate(hand_jog_rate(velocity, CONFIG_HAND_MIN_RATE, CONFIG_HAND_MAX_RATE, FULL_SPEED), true);
+        // the velocity decays once the knob stops, the timer brings the rate down with it and retries one not taken
+        if ((handRate != 0 || !set) && !handTimerRunning) {
+            handTimerRunning = esp_timer_start_periodic(handTimer, UPDATE_MICROS) == ESP_OK;
+        }
+    }
+    xSemaphoreGive(handLock);
+}
+
+void hand_select_next_axis() {
+    xSemaphoreTake(handLock, portMAX_DELAY);
+    if (!hand_set_rate(0, false)) {
+        xSemaphoreGive(handLock);
+        LOGE(TAG, "jog not stopped, staying on axis %d", handAxis);
+        return;
+    }
+    handAxis = (handAxis + 1) % HAND_AXES;
+    xSemaphoreGive(handLock);
+    LOGI(TAG, "jogging axis %d", handAxis);
+}
+
+uint8_t hand_get_axis() {
+    return handAxis;
+}
+
+int32_t hand_get_rate() {
+    return handRate;
+}
+
+void hand_get_stats(hand_stats_t* target) {
+    portENTER_CRITICAL(&handMux);
+    *target = handStats;
+    portEXIT_CRITICAL(&handMux);
+}
+
+esp_err_t init_hand_controller(uint8_t encoder_id, hand_jog_callback callback) {
+    handEncoder = input_get_encoder(encoder_id);
+    if (!handEncoder) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    handLock = xSemaphoreCreateMutexStatic(&handLockBuffer);
+    if (!handLock) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&handStats, 0, sizeof(handStats));
+    handCallback = callback;
+    handAxis = HAND_AXIS_RA;
+    handRate = 0;
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = hand_timer_listener
+    };
+    return esp_timer_create(&args, &handTimer);
+}
@@ -0,0 +1,41 @@
+#ifndef __AUTOFOCUS_H
+#define __AUTOFOCUS_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define AUTOFOCUS_MAX_SAMPLES 32
+
+#define AUTOFOCUS_EVENT_IN_POSITION 1
+#define AUTOFOCUS_EVENT_FINISHED 2
+#define AUTOFOCUS_EVENT_FAILED 3
+
+#define AUTOFOCUS_FIT_NONE 0
+#define AUTOFOCUS_FIT_V_CURVE 1
+#define AUTOFOCUS_FIT_PARABOLA 2
+#define AUTOFOCUS_FIT_MINIMUM 3
+
+/*
+ * Called on the event loop. The sweep runs there too: autofocus_start,
+ * autofocus_report and abort_autofocus are event loop calls, arrivals of
+ * the focuser are posted to it.
+ */
+typedef void (*autofocus_event_callback)(uint8_t event, uint16_t index, int32_t position);
+
+esp_err_t init_autofocus(autofocus_event_callback callback);
+/* sweeps count positions from start, step apart, waiting for a metric at each */
+esp_err_t autofocus_start(int32_t start, int32_t step, uint16_t count);
+/* metric of the sample at index, e.g. HFR, lower is better, <= 0 skips the sample */
+esp_err_t autofocus_report(uint16_t index, float metric);
+bool is_autofocusing();
+void abort_autofocus();
+
+/*
+ * Best focus from a sweep. Fits two lines to the flanks of the V-curve and
+ * a least-squares parabola, takes the vertex of whichever leaves the smaller
+ * residual, and falls back to the best sample when neither has a minimum
+ * inside the sweep. Returns one of AUTOFOCUS_FIT_*.
+ */
+int autofocus_fit(const int32_t *positions, const float *metrics, int count, int32_t *best);
+
+#endif
\ No newline at end of file
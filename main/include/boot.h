@@ -0,0 +1,25 @@
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    BOOT_STAGE_NVS = 0,
+    BOOT_STAGE_SETTINGS,
+    BOOT_STAGE_WIFI_INIT,
+    BOOT_STAGE_MOTION, // mount, encoder, slew, scheduler, satellite, focuser
+    BOOT_STAGE_DISPLAY, // panel probe, runs in its own task
+    BOOT_STAGE_NETWORK, // wifi start until an address is assigned
+    BOOT_STAGE_SERVER, // udp server task start until bound
+    BOOT_STAGES
+} boot_stage_t;
+
+/* only the first begin and end of a stage are kept, times are esp_timer micros */
+void boot_stage_begin(boot_stage_t stage);
+void boot_stage_end(boot_stage_t stage);
+/* -1 for a stage that has not begun or ended yet */
+void boot_get_timeline(int32_t begin[BOOT_STAGES], int32_t end[BOOT_STAGES]);
+bool boot_is_complete();
+const char* boot_stage_name(boot_stage_t stage);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/*
+ * Axis position checkpoints. A stopped RA axis points at a fixed hour
+ * angle, so what is stored is the RA minus the client wall clock, which
+ * stays constant however long the controller is off.
+ *
+ * The controller has no clock of its own across a reboot, the offset only
+ * means something against a clock with a fixed epoch. Checkpoints are
+ * therefore taken and restored only while the client clock is synced and
+ * reads as Unix time, i.e. after CHECKPOINT_MIN_UNIX_SECONDS. The restore
+ * waits for the first such sync after boot. A clock behind the saved time
+ * of the checkpoint is not the one it was taken against, the checkpoint is
+ * dropped then and the position stays unknown until a sync.
+ */
+#define CHECKPOINT_MIN_UNIX_SECONDS 1577836800 // 2020-01-01
+
+/* call after init_settings, init_motion_loop and init_mount_encoder, polls on the motion task */
+esp_err_t init_checkpoint();
+/* on the motion task, stores the current position if it is known and moved beyond the tolerance */
+void checkpoint_save();
+/* the position was set by a sync, a pending restore is dropped */
+void checkpoint_position_synced();
+bool checkpoint_is_position_known();
+
+/* sidereal offset of the axis from the wall clock, both in millis */
+int32_t checkpoint_ra_offset(int32_t ra_sidereal_millis, int64_t wall_millis);
+int32_t checkpoint_ra_restore(int32_t ra_offset_millis, int64_t wall_millis);
+
+#endif
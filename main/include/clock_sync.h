@@ -0,0 +1,18 @@
+#ifndef __CLOCK_SYNC_H
+#define __CLOCK_SYNC_H
+
+#include "freertos/FreeRTOS.h"
+
+void clock_sync_init();
+/*
+ * One completed exchange: t1 client send, t2 controller receive,
+ * t3 controller send, t4 client receive. t2/t3 are esp_timer micros.
+ */
+void clock_sync_add_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+bool clock_sync_is_synced();
+int64_t clock_sync_to_client_micros(int64_t local_micros);
+int64_t clock_sync_to_local_micros(int64_t client_micros);
+int64_t clock_sync_get_offset_micros();
+int32_t clock_sync_get_drift_ppb();
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __COMMAND_H
+#define __COMMAND_H
+
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+
+#define COMMAND_TABLE_SIZE 256
+#define COMMAND_MAX_SIZE 128
+
+/* preconditions, a command is rejected while any of its bits is in the current state */
+#define COMMAND_NOT_SLEWING 1
+#define COMMAND_NOT_GUIDING 2
+#define COMMAND_NOT_HARDWARE_TRACKING 4
+
+typedef struct command_context {
+    int fromSocket;
+    struct sockaddr_in* from;
+    socklen_t fromlen;
+    char* tail; // bytes after the fixed payload of a variable length command
+    unsigned int tail_len;
+} command_context_t;
+
+typedef int (*command_handler_f)(void* payload, command_context_t* ctx);
+typedef void (*command_decode_f)(void* payload);
+
+typedef struct command {
+    const char* name;
+    command_handler_f handler;
+    command_decode_f decode;
+    uint8_t payload_size;
+    uint8_t preconditions;
+    bool variable_length;
+} command_t;
+
+/*
+ * Payloads are declared once as a list of fields, e.g.
+ *   #define SPEED_FIELDS(F) F(int32_t, speed)
+ *   COMMAND_PAYLOAD(speed, SPEED_FIELDS)
+ * which gives speed_payload_t, its network to host decoder and a build
+ * time check that the datagram fits the receive buffer.
+ */
+#define COMMAND_PAYLOAD_MEMBER(type, field) type field;
+#define COMMAND_PAYLOAD_DECODE(type, field) command_net_to_host(&payload->field, sizeof(type));
+#define COMMAND_PAYLOAD(name, FIELDS) \
+    typedef struct __attribute__((packed)) { FIELDS(COMMAND_PAYLOAD_MEMBER) } name##_payload_t; \
+    static void name##_decode(void* p) { name##_payload_t* payload = p; FIELDS(COMMAND_PAYLOAD_DECODE) } \
+    _Static_assert(sizeof(name##_payload_t) + 1 <= COMMAND_MAX_SIZE, #name " payload does not fit a datagram");
+
+#define COMMAND(id, handler, payload, preconditions) \
+    [id] = { #handler, (command_handler_f) handler, payload##_decode, sizeof(payload##_payload_t), preconditions, false }
+#define COMMAND_VARIABLE(id, handler, payload, preconditions) \
+    [id] = { #handler, (command_handler_f) handler, payload##_decode, sizeof(payload##_payload_t), preconditions, true }
+#define COMMAND_NO_PAYLOAD(id, handler, preconditions) \
+    [id] = { #handler, (command_handler_f) handler, NULL, 0, preconditions, false }
+
+void command_net_to_host(void* field, size_t size);
+int command_dispatch(const command_t* table, char* buf, unsigned int len, uint8_t state, command_context_t* ctx);
+
+#endif
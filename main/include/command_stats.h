@@ -0,0 +1,53 @@
+#ifndef __COMMAND_STATS_H
+#define __COMMAND_STATS_H
+
+#include "freertos/FreeRTOS.h"
+
+#define COMMAND_STATS_SLOTS 16
+// 4 linear steps per power of two, the last bucket holds everything from about 2 s
+#define COMMAND_STATS_BUCKETS 80
+
+/*
+ * Counters and latency histograms per command type. A known command gets a
+ * slot the first time it arrives, commands beyond the slots are only counted in
+ * untracked. Histogram buckets are 1/4 of a power of two wide, percentiles
+ * come from the bucket middle, and a full bucket halves the whole histogram
+ * so it leans to recent commands.
+ */
+typedef struct command_latency {
+    uint32_t p50_micros;
+    uint32_t p99_micros;
+    uint32_t max_micros;
+} command_latency_t;
+
+typedef struct command_type_stats {
+    uint8_t cmd;
+    uint32_t received;
+    uint32_t rejected; // by a precondition
+    command_latency_t effect; // recvfrom returned to the command done, on the motion task if it went there
+    command_latency_t ack; // recvfrom returned to the ack sent
+} command_type_stats_t;
+
+typedef struct network_stats {
+    uint32_t datagrams_in;
+    uint32_t datagrams_out;
+    uint32_t send_failures;
+    uint32_t receive_errors;
+    uint32_t untracked; // commands without a slot
+} network_stats_t;
+
+void command_stats_received(uint8_t cmd);
+void command_stats_rejected(uint8_t cmd);
+void command_stats_effect(uint8_t cmd, int64_t received_at);
+void command_stats_acked(uint8_t cmd, int64_t received_at);
+void command_stats_datagram_in(bool ok);
+/* result of sendto */
+void command_stats_datagram_out(int result);
+/* fills up to COMMAND_STATS_SLOTS, returns how many */
+int command_stats_get(command_type_stats_t* target, network_stats_t* network);
+
+/* the bucket a latency is counted in and the middle of a bucket, both in micros */
+int command_stats_bucket(uint32_t micros);
+uint32_t command_stats_bucket_middle(int bucket);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __CPU_MONITOR_H
+#define __CPU_MONITOR_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define CPU_MONITOR_MAX_TASKS 16
+#define CPU_MONITOR_NAME_LENGTH 16
+#define CPU_MONITOR_CORES 2
+// lateness samples a timer monitor keeps
+#define TIMER_MONITOR_WINDOW 64
+
+/*
+ * Loads from the FreeRTOS run time counters, sampled on the event loop
+ * every CONFIG_CPU_MONITOR_WINDOW_MILLIS. A task load is its share of one
+ * core over the last window; a core load is what its idle task left. Needs
+ * CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS,
+ * without them no task is reported.
+ */
+typedef struct cpu_task_load {
+    char name[CPU_MONITOR_NAME_LENGTH];
+    uint8_t core; // 0xff when not pinned or not known
+    uint8_t priority;
+    uint16_t load; // permille of one core
+    uint16_t peak; // highest window load since boot
+} cpu_task_load_t;
+
+typedef struct cpu_monitor_report {
+    uint32_t window_micros; // 0 before the first window closed
+    uint16_t cpu_mhz;
+    uint16_t core_load[CPU_MONITOR_CORES]; // permille, not idle
+    uint16_t core_peak[CPU_MONITOR_CORES];
+    uint8_t task_count;
+    cpu_task_load_t tasks[CPU_MONITOR_MAX_TASKS];
+} cpu_monitor_report_t;
+
+/*
+ * Actual against intended interval of a one-shot timer that is re-armed,
+ * e.g. the focuser step timer. Armed and fired may be called from
+ * different tasks.
+ */
+typedef struct timer_monitor {
+    int64_t due; // 0 while not armed
+    uint32_t count;
+    int32_t lateness[TIMER_MONITOR_WINDOW]; // actual minus intended, in micros
+} timer_monitor_t;
+
+typedef struct timer_monitor_stats {
+    uint32_t samples; // since boot, min, avg and max cover the last TIMER_MONITOR_WINDOW
+    int32_t min_micros;
+    int32_t avg_micros;
+    int32_t max_micros;
+} timer_monitor_stats_t;
+
+/* after init_event_loop */
+esp_err_t init_cpu_monitor();
+void cpu_monitor_get_report(cpu_monitor_report_t* target);
+
+void timer_monitor_init(timer_monitor_t* monitor);
+void timer_monitor_armed(timer_monitor_t* monitor, uint32_t intended_micros);
+/* the timer was stopped, it will not fire for the last arm */
+void timer_monitor_stopped(timer_monitor_t* monitor);
+/* first thing in the callback, ignored when the timer was not armed through the monitor */
+void timer_monitor_fired(timer_monitor_t* monitor);
+void timer_monitor_get(timer_monitor_t* monitor, timer_monitor_stats_t* target);
+
+#endif
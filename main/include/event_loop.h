@@ -0,0 +1,37 @@
+#ifndef __EVENT_LOOP_H
+#define __EVENT_LOOP_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "timer_wheel.h"
+#include "work_queue.h"
+
+#define EVENT_LOOP_MAX_SOCKETS 4
+#define EVENT_LOOP_QUEUE_SIZE 16
+
+/*
+ * One task waits in select on the registered sockets until the next timer
+ * of a millisecond timer wheel is due, then runs socket and timer callbacks
+ * in order. Timers may be started and stopped from any task, callbacks
+ * always run on the loop task.
+ */
+typedef wheel_timer_t event_timer_t;
+typedef void (*event_socket_callback)(int fd, void* arg);
+
+esp_err_t init_event_loop();
+/* the loop task body */
+void event_loop_run(void* p);
+void event_timer_init(event_timer_t* timer, wheel_callback callback, void* arg);
+/* restarts a pending timer */
+void event_timer_start_once(event_timer_t* timer, uint32_t millis);
+void event_timer_start_periodic(event_timer_t* timer, uint32_t millis);
+void event_timer_stop(event_timer_t* timer);
+/* called on the loop task whenever fd is readable */
+esp_err_t event_loop_add_socket(int fd, event_socket_callback callback, void* arg);
+/*
+ * Any task, the call runs on the loop task. Never blocks and never enters
+ * lwIP, the motion task hands display and broadcast work over with it.
+ */
+bool event_loop_post(work_f work, const void* data, size_t size);
+
+#endif
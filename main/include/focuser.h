@@ -2,12 +2,24 @@
 #define FOCUSER_H
 #include "stdint.h"
 #include "stdbool.h"
+#include "cpu_monitor.h"
+
+typedef void (*focuser_arrived_callback)(int32_t position);
 
 void focuser_init();
+/* called from the timer task whenever a move reaches its target, not on abort */
+void focuser_set_arrived_callback(focuser_arrived_callback callback);
 uint16_t focuser_get_movement_nanos_per_step();
 uint32_t focuser_get_max_steps();
 void focuser_move(int32_t steps);
+void focuser_move_to(int32_t step);
+int32_t focuser_get_position();
+int32_t focuser_get_target();
+bool focuser_set_position(int32_t step); // false while moving
+bool focuser_set_zero();
 bool focuser_get_is_moving();
 void focuser_abort_move();
+/* how late the step timer fires */
+void focuser_get_timer_stats(timer_monitor_stats_t* target);
 
 #endif
\ No newline at end of file
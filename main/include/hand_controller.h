@@ -0,0 +1,38 @@
+#ifndef __HAND_CONTROLLER_H
+#define __HAND_CONTROLLER_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define HAND_AXIS_RA 0
+#define HAND_AXIS_DEC 1
+#define HAND_AXIS_FOCUSER 2
+#define HAND_AXES 3
+
+/* RA and Dec jogs, rate in milli seconds per second like the speed commands, 0 stops; false when not taken */
+typedef bool (*hand_jog_callback)(uint8_t axis, int32_t rate);
+
+typedef struct hand_stats {
+    uint32_t jogs; // rate changes and focuser moves
+    uint32_t min_latency_micros; // encoder edge to motion
+    uint32_t max_latency_micros;
+    uint64_t total_latency_micros;
+} hand_stats_t;
+
+esp_err_t init_hand_controller(uint8_t encoder_id, hand_jog_callback callback);
+/* RA, Dec, focuser, RA, ... a running jog is stopped first, the axis stays if it would not stop */
+void hand_select_next_axis();
+uint8_t hand_get_axis();
+int32_t hand_get_rate();
+/* called for every encoder event from the input loop */
+void hand_rotated(int8_t steps);
+void hand_get_stats(hand_stats_t* target);
+
+/*
+ * Jog rate for an encoder spin velocity in counts per second. Grows with
+ * the square of the velocity from min_rate to max_rate, reached at
+ * full_speed, so slow turns are fine and fast spins slew. Stopped is 0.
+ */
+int32_t hand_jog_rate(float counts_per_second, int32_t min_rate, int32_t max_rate, float full_speed);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "rencoder.h"
+
+#define INPUT_MAX_BUTTONS 4
+#define INPUT_MAX_ENCODERS 2
+#define INPUT_QUEUE_LENGTH 32
+
+#define INPUT_EVENT_RELEASED 0
+#define INPUT_EVENT_PRESSED 1
+#define INPUT_EVENT_ROTATED 2
+
+typedef struct input_event {
+    uint8_t source; // id given when the input was added
+    uint8_t type; // INPUT_EVENT_*
+    int8_t value; // steps for a rotation
+    int64_t at; // esp_timer micros
+} input_event_t;
+
+/*
+ * Quiet-period debounce. Every raw edge restarts the settling time, the
+ * level read once it passed is the new debounced level. Times are micros.
+ */
+typedef struct input_debounce {
+    bool level; // debounced
+    bool settling;
+    int64_t deadline;
+} input_debounce_t;
+
+void input_debounce_edge(input_debounce_t* d, int64_t now, int64_t settle_micros);
+/* micros left to settle, 0 once settled; *changed is set when the level flipped */
+int64_t input_debounce_poll(input_debounce_t* d, bool raw, int64_t now, bool* changed);
+
+esp_err_t init_input();
+/* buttons report PRESSED and RELEASED, pressed_level is the pin level while held */
+esp_err_t input_add_button(uint8_t id, gpio_num_t pin, bool pressed_level);
+/* encoders report ROTATED with the signed step */
+esp_err_t input_add_encoder(uint8_t id, gpio_num_t a, gpio_num_t b, bool reverse);
+bool input_is_pressed(uint8_t id);
+/* the decoder behind an encoder input, e.g. for its velocity, NULL if unknown */
+rencoder_t* input_get_encoder(uint8_t id);
+/* the single queue every input posts to */
+bool input_receive(input_event_t* event, TickType_t wait);
+
+#endif
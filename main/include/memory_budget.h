@@ -0,0 +1,41 @@
+#ifndef __MEMORY_BUDGET_H
+#define __MEMORY_BUDGET_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MEMORY_MAX_TASKS 8
+
+/*
+ * Storage of a task that runs until restart, the stack in bytes like
+ * xTaskCreate. Declared at file scope so the RAM shows up in the image
+ * size instead of the heap.
+ */
+#define STATIC_TASK(NAME, STACK_BYTES) \
+    StackType_t NAME##Stack[(STACK_BYTES) / sizeof(StackType_t)]; \
+    StaticTask_t NAME##Task
+
+#define STATIC_TASK_CREATE(NAME, CODE, LABEL, PARAM, PRIORITY) \
+    STATIC_TASK_CREATE_PINNED(NAME, CODE, LABEL, PARAM, PRIORITY, tskNO_AFFINITY)
+#define STATIC_TASK_CREATE_PINNED(NAME, CODE, LABEL, PARAM, PRIORITY, CORE) \
+    memory_create_task(CODE, LABEL, sizeof(NAME##Stack), PARAM, PRIORITY, NAME##Stack, &NAME##Task, CORE)
+
+typedef struct memory_task {
+    const char* name;
+    uint32_t stack_size; // in bytes
+    uint32_t headroom; // stack never used so far, in bytes
+} memory_task_t;
+
+typedef struct memory_report {
+    uint32_t free_heap;
+    uint32_t min_free_heap; // since boot
+    uint8_t task_count;
+    memory_task_t tasks[MEMORY_MAX_TASKS];
+} memory_report_t;
+
+/* xTaskCreateStaticPinnedToCore, and keeps the task for the report, NULL on failure */
+TaskHandle_t memory_create_task(TaskFunction_t code, const char* name, uint32_t stack_size, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task, BaseType_t core);
+void memory_get_report(memory_report_t* target);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __MOTION_LOOP_H
+#define __MOTION_LOOP_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "timer_wheel.h"
+#include "work_queue.h"
+
+#define MOTION_QUEUE_SIZE 32
+
+/*
+ * The motion task, pinned to its own core away from WiFi and lwIP. It owns
+ * the step rate outputs, the position integrator and the slew, pulse guide,
+ * satellite, checkpoint and encoder fusion timers; no other task changes
+ * them, others read the position through a copy taken under a mux. Other
+ * tasks post calls to it through a lock-free queue, and it hands display
+ * and network work back to the event loop the same way.
+ */
+typedef struct motion_timer {
+    wheel_timer_t wheel; // in RTOS ticks
+    wheel_callback callback;
+    void* arg;
+    int64_t fired_at; // for the jitter of periodic timers
+} motion_timer_t;
+
+typedef struct motion_stats {
+    uint32_t intervals; // between two firings of a periodic timer
+    uint32_t max_jitter_micros; // interval off its period
+    uint64_t total_jitter_micros;
+    uint32_t posts;
+    uint32_t overflows; // posts dropped on a full queue
+} motion_stats_t;
+
+/* before anything posts or starts a motion timer */
+esp_err_t init_motion_loop();
+bool motion_is_current_task();
+/* any task, the call runs on the motion task, right away when already there */
+bool motion_post(work_f work, const void* data, size_t size);
+void motion_timer_init(motion_timer_t* timer, wheel_callback callback, void* arg);
+/* any task, restarts a pending timer; false when the queue was full, never on the motion task */
+bool motion_timer_start_once(motion_timer_t* timer, uint32_t millis);
+bool motion_timer_start_periodic(motion_timer_t* timer, uint32_t millis);
+bool motion_timer_stop(motion_timer_t* timer);
+void motion_get_stats(motion_stats_t* target);
+/* calls queued so far, a change tells a caller it posted something */
+uint32_t motion_post_count();
+
+#endif
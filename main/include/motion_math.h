@@ -0,0 +1,75 @@
+#ifndef __MOTION_MATH_H
+#define __MOTION_MATH_H
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include "astro.h"
+#include "axis_kinematics.h"
+
+/*
+ * Integer units of the rate and angle path. The ESP32 FPU is single
+ * precision only, a double there is a software library call.
+ *
+ * speed: milli arcseconds per second as the protocol has it, 15000 is one
+ *        cycle per day, for R.A. per sidereal day
+ * rate:  step pulses per microsecond scaled by 2^32
+ * angle: micro arcseconds, a milli of the protocol is exactly 15000
+ *
+ * The ratios between them come from axis_kinematics.h, generated from the
+ * Kconfig axis settings by gen_kinematics.py: _NUM and _DEN as reduced
+ * rationals, the bare name as the exactly rounded Q32 (angles) or Q64
+ * (rates, so a rate keeps Q32) constant. It also rejects configurations
+ * whose constants do not fit.
+ */
+#define SPEED_PER_CYCLE 15000
+#define UAS_PER_MILLI 15000
+#define UAS_PER_CYCLE ((int64_t) UAS_PER_MILLI * DAY_MILLIS)
+
+_Static_assert(KINEMATICS_SIDEREAL_DAY_MILLIS == SIDEREAL_DAY_MILLIS && KINEMATICS_DAY_MILLIS == DAY_MILLIS
+    && KINEMATICS_SPEED_PER_CYCLE == SPEED_PER_CYCLE && KINEMATICS_UAS_PER_MILLI == UAS_PER_MILLI,
+    "gen_kinematics.py disagrees with astro.h or motion_math.h");
+
+/* a * q / 2^32, rounded toward zero, without a 96 bit product */
+static inline int64_t mul_q32(int64_t a, uint64_t q) {
+    uint64_t m = a < 0 ? -(uint64_t) a : (uint64_t) a;
+    uint32_t mh = m >> 32, ml = (uint32_t) m;
+    uint32_t qh = q >> 32, ql = (uint32_t) q;
+    uint64_t r = (((uint64_t) mh * qh) << 32) + (uint64_t) mh * ql + (uint64_t) ml * qh
+        + (((uint64_t) ml * ql) >> 32);
+    return a < 0 ? -(int64_t) r : (int64_t) r;
+}
+
+/* rate of a positive speed rounded to the Q32 unit, time_ratio is Q32 */
+static inline int64_t speed_to_rate(int32_t speed, uint64_t rate_per_speed, uint64_t time_ratio) {
+    // Q64 at time ratio 1, Q48 after the ratio so even the largest ratio stays within 64 bits
+    uint64_t rate = (uint64_t) speed * rate_per_speed;
+    return (mul_q32(rate >> 16, time_ratio) + (1 << 15)) >> 16;
+}
+
+static inline int32_t rate_to_millihertz(int64_t rate) {
+    return (int32_t) mul_q32(rate, 1000000000);
+}
+
+/* pulses per second of a positive rate, rounded */
+static inline int32_t rate_to_hz(int64_t rate) {
+    return (int32_t)((mul_q32(rate, 2000000) + 1) / 2);
+}
+
+/* x / d in 32 bit divides, 16 bits of x at a time, there is no 64 bit divider */
+static inline uint64_t div_u64_u16(uint64_t x, uint16_t d) {
+    uint32_t high = x >> 32;
+    uint32_t qh = high / d;
+    uint32_t middle = ((high % d) << 16) | ((uint32_t) x >> 16);
+    uint32_t qm = middle / d;
+    uint32_t low = ((middle % d) << 16) | ((uint32_t) x & 0xffff);
+    return ((uint64_t) qh << 32) | (qm << 16) | (low / d);
+}
+
+/* to the nearest milli, halves away from zero */
+static inline int32_t uas_to_millis(int64_t uas) {
+    uint64_t m = uas < 0 ? -(uint64_t) uas : (uint64_t) uas;
+    int32_t millis = (int32_t) div_u64_u16(m + UAS_PER_MILLI / 2, UAS_PER_MILLI);
+    return uas < 0 ? -millis : millis;
+}
+
+#endif
@@ -2,10 +2,6 @@
 #define __MOUNT_H
 #include "esp_err.h"
 
-#define RA_CYCLE_MAX 30
-#define RA_CYCLE_MIN 0.01
-#define DEC_CYCLE_MAX 30
-#define DEC_CYCLE_MIN 0.01
 #define RA_SPEED_MAX 450000
 #define RA_SPEED_MIN 150
 #define DEC_SPEED_MAX 450000
@@ -13,13 +9,15 @@
 
 esp_err_t init_mount();
 
-void set_ra_cycles_per_sidereal_day(double raCyclesPerSiderealDay);
-void set_dec_cycles_per_day(double decCyclesPerDay);
+/* speeds in milli arcseconds per second, SPEED_PER_CYCLE is a cycle per sidereal day for R.A., per day for Dec */
+void set_ra_speed(int32_t raSpeed);
+void set_dec_speed(int32_t decSpeed);
 
-double get_ra_cycles_per_sidereal_day();
-double get_dec_cycles_per_day();
+int32_t get_ra_speed();
+int32_t get_dec_speed();
 
-void set_mount_time_ratio_persist(double ratio);
-double get_mount_time_ratio();
+/* in millionths */
+void set_mount_time_ratio_persist(int32_t ratio);
+int32_t get_mount_time_ratio();
 
 #endif
\ No newline at end of file
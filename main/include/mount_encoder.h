@@ -2,6 +2,10 @@
 
 void init_mount_encoder();
 
+/*
+ * The position is integrated on the motion task, the getters may be called
+ * from any task and read a consistent copy.
+ */
 int32_t get_ra_angle_millis();
 int32_t get_dec_angle_millis();
 int32_t get_dec_mechnical_angle_millis();
@@ -9,4 +13,24 @@ int32_t get_dec_mechnical_angle_millis();
 void ra_pulse_freq_changed(int32_t raFreq);
 void dec_pulse_freq_changed(int32_t decFreq);
 
-void set_angles(int32_t ra_angle_millis, int32_t dec_angle_millis);
\ No newline at end of file
+void set_angles(int32_t ra_angle_millis, int32_t dec_angle_millis);
+
+/* RA the axis points at in sidereal millis, in [0, SIDEREAL_DAY_MILLIS), advances 1:1 with time while stopped */
+int32_t get_ra_sidereal_millis();
+/* restores the axes without converting through the side of pier */
+void set_mechanical_angles(int32_t ra_sidereal_millis, int32_t dec_mechanical_millis);
+
+#define MOUNT_ENCODER_RA 1
+#define MOUNT_ENCODER_DEC 2
+#define MOUNT_ENCODER_RA_SLIPPED 4 // since the last sync
+#define MOUNT_ENCODER_DEC_SLIPPED 8
+
+uint8_t get_mount_encoder_flags();
+void get_mount_encoder_slips(uint32_t* ra, uint32_t* dec);
+
+/*
+ * One complementary filter step for an axis, positions are displacements
+ * since the last sync in micro arcseconds. Returns the new correction to add
+ * to the step estimate, *slip is set when step and encoder diverged.
+ */
+int64_t axis_fusion_update(int64_t correction, int64_t step_uas, int64_t encoder_uas, int32_t gain_permille, int64_t slip_uas, bool* slip);
\ No newline at end of file
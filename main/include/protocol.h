@@ -15,7 +15,12 @@
 #define BROADCAST_FOCUSER_MAX_STEPS(B) (*((uint32_t*)((B) + 25)))
 #define BROADCAST_FOCUSER_NANOS_PER_STEP(B) (*((uint16_t*)((B) + 29)))
 #define BROADCAST_FOCUSER_RUNNING(B) (*((uint8_t*)((B) + 31)))
-#define BROADCAST_SIZE 32
+#define BROADCAST_TIMESTAMP(B) (*((int64_t*)((B) + 32)))
+#define BROADCAST_CLOCK_SYNCED(B) (*((uint8_t*)((B) + 40)))
+#define BROADCAST_FOCUSER_POSITION(B) (*((int32_t*)((B) + 41)))
+#define BROADCAST_FOCUSER_TARGET(B) (*((int32_t*)((B) + 45)))
+#define BROADCAST_ENCODER_FLAGS(B) (*((uint8_t*)((B) + 49)))
+#define BROADCAST_SIZE 50
 
 typedef struct broadcast {
     uint8_t buffer[BROADCAST_SIZE];
@@ -34,12 +39,19 @@ void set_broadcast_fields(
     uint8_t side_of_pier, // 0: Normal (East); 1: Beyond the pole (West)
     uint32_t focuser_max_steps,
     uint16_t focuser_nanos_per_step,
-    bool focuser_running
+    bool focuser_running,
+    int64_t timestamp, // in micros, client clock when synced, otherwise controller clock
+    bool clock_synced,
+    int32_t focuser_position, // in steps from zero
+    int32_t focuser_target,
+    uint8_t encoder_flags // MOUNT_ENCODER_*, which axes have encoders and whether they slipped
 );
 
-#define ACK_SIZE 6
+#define ACK_SIZE 22
 #define ACK_CMD_ID(B) (*((uint32_t*)(B)))
 #define ACK_ZERO(B) (*((uint16_t*)((B) + 4)))
+#define ACK_RECEIVED_AT(B) (*((int64_t*)((B) + 6)))
+#define ACK_TIMESTAMP(B) (*((int64_t*)((B) + 14)))
 
 typedef struct ack {
     uint8_t buffer[ACK_SIZE];
@@ -47,7 +59,306 @@ typedef struct ack {
 
 void set_ack_fields(
     ack_t *target,
-    uint32_t cmd_id
+    uint32_t cmd_id,
+    int64_t received_at, // controller micros when the command was received
+    int64_t timestamp // controller micros when the ack is sent
 );
 
+#define SCHEDULE_STATS_CMD(B) (*((uint8_t*)(B)))
+#define SCHEDULE_STATS_SCHEDULED(B) (*((uint32_t*)((B) + 1)))
+#define SCHEDULE_STATS_EXECUTED(B) (*((uint32_t*)((B) + 5)))
+#define SCHEDULE_STATS_REJECTED_LATE(B) (*((uint32_t*)((B) + 9)))
+#define SCHEDULE_STATS_REJECTED_FULL(B) (*((uint32_t*)((B) + 13)))
+#define SCHEDULE_STATS_MIN_ERROR(B) (*((int32_t*)((B) + 17)))
+#define SCHEDULE_STATS_MAX_ERROR(B) (*((int32_t*)((B) + 21)))
+#define SCHEDULE_STATS_MEAN_ERROR(B) (*((int32_t*)((B) + 25)))
+#define SCHEDULE_STATS_SIZE 29
+
+typedef struct schedule_stats {
+    uint8_t buffer[SCHEDULE_STATS_SIZE];
+} schedule_stats_t;
+
+void set_schedule_stats_fields(
+    schedule_stats_t *target,
+    uint8_t cmd,
+    uint32_t scheduled,
+    uint32_t executed,
+    uint32_t rejected_late,
+    uint32_t rejected_full,
+    int32_t min_error, // in micros, execution time minus requested time
+    int32_t max_error,
+    int32_t mean_error
+);
+
+#define FOCUSER_POSITION_CMD(B) (*((uint8_t*)(B)))
+#define FOCUSER_POSITION_POSITION(B) (*((int32_t*)((B) + 1)))
+#define FOCUSER_POSITION_TARGET(B) (*((int32_t*)((B) + 5)))
+#define FOCUSER_POSITION_RUNNING(B) (*((uint8_t*)((B) + 9)))
+#define FOCUSER_POSITION_SIZE 10
+
+typedef struct focuser_position {
+    uint8_t buffer[FOCUSER_POSITION_SIZE];
+} focuser_position_t;
+
+void set_focuser_position_fields(
+    focuser_position_t *target,
+    uint8_t cmd,
+    int32_t position, // in steps from zero
+    int32_t target_position,
+    bool running
+);
+
+#define AUTOFOCUS_EVENT_CMD(B) (*((uint8_t*)(B)))
+#define AUTOFOCUS_EVENT_TYPE(B) (*((uint8_t*)((B) + 1)))
+#define AUTOFOCUS_EVENT_INDEX(B) (*((uint16_t*)((B) + 2)))
+#define AUTOFOCUS_EVENT_POSITION(B) (*((int32_t*)((B) + 4)))
+#define AUTOFOCUS_EVENT_SIZE 8
+
+typedef struct autofocus_event {
+    uint8_t buffer[AUTOFOCUS_EVENT_SIZE];
+} autofocus_event_t;
+
+void set_autofocus_event_fields(
+    autofocus_event_t *target,
+    uint8_t cmd,
+    uint8_t type, // 1: in position, 2: finished at best focus, 3: failed or aborted
+    uint16_t index,
+    int32_t position // in steps from zero
+);
+
+#define BOOT_TIMELINE_MAX_STAGES 8
+#define BOOT_TIMELINE_CMD(B) (*((uint8_t*)(B)))
+#define BOOT_TIMELINE_COUNT(B) (*((uint8_t*)((B) + 1)))
+#define BOOT_TIMELINE_BEGIN(B, I) (*((int32_t*)((B) + 2 + (I) * 8)))
+#define BOOT_TIMELINE_END(B, I) (*((int32_t*)((B) + 6 + (I) * 8)))
+#define BOOT_TIMELINE_SIZE (2 + BOOT_TIMELINE_MAX_STAGES * 8)
+
+typedef struct boot_timeline {
+    uint8_t buffer[BOOT_TIMELINE_SIZE];
+} boot_timeline_t;
+
+void set_boot_timeline_fields(
+    boot_timeline_t *target,
+    uint8_t cmd,
+    uint8_t count, // stages in the order of boot_stage_t, the rest is zero
+    const int32_t *begin, // in micros since boot, -1 when not reached
+    const int32_t *end
+);
+
+#define HAND_STATS_CMD(B) (*((uint8_t*)(B)))
+#define HAND_STATS_AXIS(B) (*((uint8_t*)((B) + 1)))
+#define HAND_STATS_RATE(B) (*((int32_t*)((B) + 2)))
+#define HAND_STATS_JOGS(B) (*((uint32_t*)((B) + 6)))
+#define HAND_STATS_MIN_LATENCY(B) (*((uint32_t*)((B) + 10)))
+#define HAND_STATS_MAX_LATENCY(B) (*((uint32_t*)((B) + 14)))
+#define HAND_STATS_MEAN_LATENCY(B) (*((uint32_t*)((B) + 18)))
+#define HAND_STATS_SIZE 22
+
+typedef struct hand_stats_frame {
+    uint8_t buffer[HAND_STATS_SIZE];
+} hand_stats_frame_t;
+
+void set_hand_stats_fields(
+    hand_stats_frame_t *target,
+    uint8_t cmd,
+    uint8_t axis, // 0: RA, 1: Dec, 2: focuser
+    int32_t rate, // current jog, in milli seconds per second
+    uint32_t jogs,
+    uint32_t min_latency, // encoder edge to motion, in micros
+    uint32_t max_latency,
+    uint32_t mean_latency
+);
+
+#define MEMORY_REPORT_MAX_TASKS 8
+#define MEMORY_REPORT_NAME_LENGTH 16
+#define MEMORY_REPORT_CMD(B) (*((uint8_t*)(B)))
+#define MEMORY_REPORT_FREE_HEAP(B) (*((uint32_t*)((B) + 1)))
+#define MEMORY_REPORT_MIN_FREE_HEAP(B) (*((uint32_t*)((B) + 5)))
+#define MEMORY_REPORT_COUNT(B) (*((uint8_t*)((B) + 9)))
+#define MEMORY_REPORT_NAME(B, I) ((char*)((B) + 10 + (I) * 20))
+#define MEMORY_REPORT_STACK_SIZE(B, I) (*((uint16_t*)((B) + 26 + (I) * 20)))
+#define MEMORY_REPORT_HEADROOM(B, I) (*((uint16_t*)((B) + 28 + (I) * 20)))
+#define MEMORY_REPORT_SIZE (10 + MEMORY_REPORT_MAX_TASKS * 20)
+
+typedef struct memory_report_frame {
+    uint8_t buffer[MEMORY_REPORT_SIZE];
+} memory_report_frame_t;
+
+void set_memory_report_fields(
+    memory_report_frame_t *target,
+    uint8_t cmd,
+    uint32_t free_heap, // in bytes
+    uint32_t min_free_heap, // lowest since boot
+    uint8_t count // tasks filled in with set_memory_report_task, the rest is zero
+);
+
+void set_memory_report_task(
+    memory_report_frame_t *target,
+    uint8_t index,
+    const char *name, // cut to 15 characters, zero terminated
+    uint16_t stack_size, // in bytes
+    uint16_t headroom // stack never used so far
+);
+
+#define COMMAND_STATS_MAX_ENTRIES 16
+#define COMMAND_STATS_CMD(B) (*((uint8_t*)(B)))
+#define COMMAND_STATS_DATAGRAMS_IN(B) (*((uint32_t*)((B) + 1)))
+#define COMMAND_STATS_DATAGRAMS_OUT(B) (*((uint32_t*)((B) + 5)))
+#define COMMAND_STATS_SEND_FAILURES(B) (*((uint32_t*)((B) + 9)))
+#define COMMAND_STATS_RECEIVE_ERRORS(B) (*((uint32_t*)((B) + 13)))
+#define COMMAND_STATS_UNTRACKED(B) (*((uint32_t*)((B) + 17)))
+#define COMMAND_STATS_COUNT(B) (*((uint8_t*)((B) + 21)))
+#define COMMAND_STATS_ENTRY_CMD(B, I) (*((uint8_t*)((B) + 22 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_RECEIVED(B, I) (*((uint32_t*)((B) + 23 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_REJECTED(B, I) (*((uint32_t*)((B) + 27 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_EFFECT_P50(B, I) (*((uint32_t*)((B) + 31 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_EFFECT_P99(B, I) (*((uint32_t*)((B) + 35 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_EFFECT_MAX(B, I) (*((uint32_t*)((B) + 39 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_ACK_P50(B, I) (*((uint32_t*)((B) + 43 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_ACK_P99(B, I) (*((uint32_t*)((B) + 47 + (I) * 33)))
+#define COMMAND_STATS_ENTRY_ACK_MAX(B, I) (*((uint32_t*)((B) + 51 + (I) * 33)))
+// only the filled entries are sent
+#define COMMAND_STATS_SIZE(COUNT) (22 + (COUNT) * 33)
+
+typedef struct command_stats_frame {
+    uint8_t buffer[COMMAND_STATS_SIZE(COMMAND_STATS_MAX_ENTRIES)];
+} command_stats_frame_t;
+
+void set_command_stats_fields(
+    command_stats_frame_t *target,
+    uint8_t cmd,
+    uint32_t datagrams_in,
+    uint32_t datagrams_out,
+    uint32_t send_failures,
+    uint32_t receive_errors,
+    uint32_t untracked, // commands received beyond the entries
+    uint8_t count
+);
+
+void set_command_stats_entry(
+    command_stats_frame_t *target,
+    uint8_t index,
+    uint8_t cmd,
+    uint32_t received,
+    uint32_t rejected, // by a precondition
+    uint32_t effect_p50, // recvfrom to the command done, in micros
+    uint32_t effect_p99,
+    uint32_t effect_max,
+    uint32_t ack_p50, // recvfrom to the ack sent
+    uint32_t ack_p99,
+    uint32_t ack_max
+);
+
+#define TRACE_FRAME_MAX_TASKS 12
+#define TRACE_FRAME_MAX_EVENTS 64
+#define TRACE_FRAME_NAME_LENGTH 16
+// request flags
+#define TRACE_FRAME_PAUSE 1 // stop recording before reading, so a dump is one consistent window
+#define TRACE_FRAME_RESUME 2 // record again after reading
+#define TRACE_FRAME_CMD(B) (*((uint8_t*)(B)))
+#define TRACE_FRAME_HEAD(B) (*((uint32_t*)((B) + 1)))
+#define TRACE_FRAME_FIRST(B) (*((uint32_t*)((B) + 5)))
+#define TRACE_FRAME_CAPACITY(B) (*((uint32_t*)((B) + 9)))
+#define TRACE_FRAME_TASK_COUNT(B) (*((uint8_t*)((B) + 13)))
+#define TRACE_FRAME_COUNT(B) (*((uint8_t*)((B) + 14)))
+#define TRACE_FRAME_TASK_NAME(B, I) ((char*)((B) + 15 + (I) * 16))
+#define TRACE_FRAME_EVENT_TIME(B, I) (*((uint32_t*)((B) + 207 + (I) * 8)))
+#define TRACE_FRAME_EVENT_ARG(B, I) (*((uint16_t*)((B) + 211 + (I) * 8)))
+#define TRACE_FRAME_EVENT_ID(B, I) (*((uint8_t*)((B) + 213 + (I) * 8)))
+#define TRACE_FRAME_EVENT_TASK(B, I) (*((uint8_t*)((B) + 214 + (I) * 8)))
+// only the filled events are sent
+#define TRACE_FRAME_SIZE(COUNT) (207 + (COUNT) * 8)
+
+typedef struct trace_frame {
+    uint8_t buffer[TRACE_FRAME_SIZE(TRACE_FRAME_MAX_EVENTS)];
+} trace_frame_t;
+
+void set_trace_fields(
+    trace_frame_t *target,
+    uint8_t cmd,
+    uint32_t head, // sequence of the next event recorded
+    uint32_t first, // sequence of the first event in this frame
+    uint32_t capacity, // of the ring, 0 when tracing is not built in
+    uint8_t task_count,
+    uint8_t count
+);
+
+void set_trace_task(
+    trace_frame_t *target,
+    uint8_t index,
+    const char *name // cut to 15 characters, zero terminated
+);
+
+void set_trace_event(
+    trace_frame_t *target,
+    uint8_t index,
+    uint32_t time, // in micros, low bits of the clock
+    uint16_t arg,
+    uint8_t event, // id, phase in the top 2 bits
+    uint8_t task // task index, core in the top bit
+);
+
+#define CPU_MONITOR_MAX_ENTRIES 16
+#define CPU_MONITOR_FRAME_NAME_LENGTH 16
+#define CPU_MONITOR_TIMER_FOCUSER 0
+#define CPU_MONITOR_TIMER_SLEW 1
+#define CPU_MONITOR_CMD(B) (*((uint8_t*)(B)))
+#define CPU_MONITOR_WINDOW(B) (*((uint32_t*)((B) + 1)))
+#define CPU_MONITOR_CPU_MHZ(B) (*((uint16_t*)((B) + 5)))
+#define CPU_MONITOR_CORE_LOAD(B, I) (*((uint16_t*)((B) + 7 + (I) * 4)))
+#define CPU_MONITOR_CORE_PEAK(B, I) (*((uint16_t*)((B) + 9 + (I) * 4)))
+#define CPU_MONITOR_TIMER_SAMPLES(B, I) (*((uint32_t*)((B) + 15 + (I) * 16)))
+#define CPU_MONITOR_TIMER_MIN(B, I) (*((int32_t*)((B) + 19 + (I) * 16)))
+#define CPU_MONITOR_TIMER_AVG(B, I) (*((int32_t*)((B) + 23 + (I) * 16)))
+#define CPU_MONITOR_TIMER_MAX(B, I) (*((int32_t*)((B) + 27 + (I) * 16)))
+#define CPU_MONITOR_TASK_COUNT(B) (*((uint8_t*)((B) + 47)))
+#define CPU_MONITOR_TASK_NAME(B, I) ((char*)((B) + 48 + (I) * 22))
+#define CPU_MONITOR_TASK_CORE(B, I) (*((uint8_t*)((B) + 64 + (I) * 22)))
+#define CPU_MONITOR_TASK_PRIORITY(B, I) (*((uint8_t*)((B) + 65 + (I) * 22)))
+#define CPU_MONITOR_TASK_LOAD(B, I) (*((uint16_t*)((B) + 66 + (I) * 22)))
+#define CPU_MONITOR_TASK_PEAK(B, I) (*((uint16_t*)((B) + 68 + (I) * 22)))
+// only the filled tasks are sent
+#define CPU_MONITOR_SIZE(COUNT) (48 + (COUNT) * 22)
+
+typedef struct cpu_monitor_frame {
+    uint8_t buffer[CPU_MONITOR_SIZE(CPU_MONITOR_MAX_ENTRIES)];
+} cpu_monitor_frame_t;
+
+void set_cpu_monitor_fields(
+    cpu_monitor_frame_t *target,
+    uint8_t cmd,
+    uint32_t window, // in micros the loads cover, 0 before the first window
+    uint16_t cpu_mhz,
+    uint8_t task_count
+);
+
+void set_cpu_monitor_core(
+    cpu_monitor_frame_t *target,
+    uint8_t index, // 0 PRO_CPU, 1 APP_CPU
+    uint16_t load, // permille, not idle
+    uint16_t peak // highest window since boot
+);
+
+void set_cpu_monitor_timer(
+    cpu_monitor_frame_t *target,
+    uint8_t index, // CPU_MONITOR_TIMER_*
+    uint32_t samples,
+    int32_t min, // fired minus due, in micros, over the last samples
+    int32_t avg,
+    int32_t max
+);
+
+void set_cpu_monitor_task(
+    cpu_monitor_frame_t *target,
+    uint8_t index,
+    const char *name, // cut to 15 characters, zero terminated
+    uint8_t core, // 0xff when not pinned
+    uint8_t priority,
+    uint16_t load, // permille of one core
+    uint16_t peak
+);
+
+uint64_t htonll(uint64_t value);
+uint64_t ntohll(uint64_t value);
+
 #endif
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include "driver/gpio.h"
 #include "esp_err.h"
 
+#define RENCODER_RING_SIZE 256 // power of two
+#define RENCODER_VELOCITY_STEPS 5 // four intervals span one quadrature cycle, evens out phase error
+#define RENCODER_STOP_MICROS 500000 // no step for this long reads as stopped
+
+/* installs the isr service and starts the worker that decodes captured edges */
 esp_err_t rencoder_init();
 
 struct rencoder;
@@ -13,6 +18,12 @@ typedef void (*direction_callback_f)(struct rencoder* target, bool next_directio
 typedef struct rencoder {
     gpio_num_t a, b;
     int32_t count;
+    uint8_t state; // last A B levels, A in bit 1
+    uint32_t illegal; // transitions that skipped a state, both pins changed between reads
+    uint32_t step_cycles[RENCODER_VELOCITY_STEPS]; // cycle counter at the last steps
+    uint8_t step_index; // where the next step goes
+    uint8_t steps_seen; // in the current direction, up to RENCODER_VELOCITY_STEPS
+    int64_t last_step_micros;
     bool reverse;
     bool direction;
     bool working;
@@ -29,5 +40,25 @@ void rencoder_clear(rencoder_t *rencoder);
 void rencoder_resume(rencoder_t *rencoder);
 bool rencoder_getdirection(rencoder_t *rencoder);
 int32_t rencoder_value(rencoder_t *rencoder);
+uint32_t rencoder_illegal_transitions(rencoder_t *rencoder);
+/* counts per second, signed, 0 once stopped */
+float rencoder_velocity(rencoder_t *rencoder);
+/* the same at a given cycle counter, for recorded traces */
+float rencoder_velocity_at(rencoder_t *rencoder, uint32_t now_cycles);
+/* cpu cycles since the last decoded step was captured */
+uint32_t rencoder_cycles_since_step(rencoder_t *rencoder);
+/* edges dropped because the worker fell behind */
+uint32_t rencoder_overflows();
+
+/*
+ * The interrupt only captures the pin levels (A in bit 1) with the cycle
+ * counter into a ring, false when the ring is full. rencoder_process drains
+ * the ring on the worker, decoding counts and velocity and calling the
+ * callbacks, and returns the number of edges it decoded.
+ */
+bool rencoder_capture(rencoder_t *rencoder, uint8_t ab, uint32_t cycles);
+int rencoder_process();
+/* decodes one captured sample */
+void rencoder_feed(rencoder_t *rencoder, uint8_t ab, uint32_t cycles);
 
 #endif
\ No newline at end of file
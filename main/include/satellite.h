@@ -0,0 +1,20 @@
+#ifndef __SATELLITE_H
+#define __SATELLITE_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "slew.h"
+#include "sgp4.h"
+
+esp_err_t init_satellite(slew_set_motor_speed_callback callback);
+/*
+ * Latitude and longitude in radians, altitude in meters. The pass is handed
+ * to the motion task, which updates the axis speeds from then on.
+ */
+esp_err_t satellite_track(const sgp4_tle_t *tle, double latitude, double longitude, double altitude, int64_t now_unix_millis);
+bool is_tracking_satellite();
+/* not tracking from now on, the motion task stops the axes */
+void abort_satellite();
+int32_t get_satellite_elevation_millis();
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "lwip/sockets.h"
+
+#define SCHEDULER_CAPACITY 16
+#define SCHEDULER_MAX_COMMAND 128
+
+typedef int (*scheduler_execute_f)(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen);
+
+typedef struct scheduler_stats {
+    uint32_t scheduled;
+    uint32_t executed;
+    uint32_t rejected_late;
+    uint32_t rejected_full;
+    int32_t min_error_micros;
+    int32_t max_error_micros;
+    int64_t total_error_micros;
+} scheduler_stats_t;
+
+/* after init_event_loop, execute runs on the event loop when a command is due */
+esp_err_t init_scheduler(scheduler_execute_f execute);
+/*
+ * event loop only; at is in esp_timer micros, ESP_ERR_TIMEOUT if it is already too late.
+ * A command that comes off the queue that late is dropped and counted the same way.
+ */
+esp_err_t scheduler_add(int64_t at, char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen);
+void scheduler_get_stats(scheduler_stats_t* target);
+
+#endif
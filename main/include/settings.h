@@ -0,0 +1,45 @@
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/*
+ * Persistent settings. The schema is append-only: new keys go at the end
+ * and SETTINGS_VERSION is bumped, older blobs keep their values and the
+ * new keys start at their defaults.
+ */
+#define SETTINGS_VERSION 3
+
+typedef enum {
+    SETTING_TIME_RATIO = 0, // in millionths
+    SETTING_RA_GUIDE_SPEED, // in milli seconds per second
+    SETTING_DEC_GUIDE_SPEED,
+    SETTING_SIDE_OF_PIER,
+    SETTING_FOCUSER_POSITION, // in steps from zero
+    SETTING_SYNCED, // the two below are valid
+    SETTING_SYNCED_RA, // in millis
+    SETTING_SYNCED_DEC,
+    SETTING_CHECKPOINT_VALID, // the two below are valid
+    SETTING_CHECKPOINT_RA_OFFSET, // sidereal RA minus client wall clock, in millis
+    SETTING_CHECKPOINT_DEC, // mechanical, in millis
+    SETTING_CHECKPOINT_SAVED_AT, // client wall clock of the checkpoint, in Unix seconds
+    SETTINGS_COUNT
+} setting_key_t;
+
+typedef struct settings_stats {
+    uint32_t sets;
+    uint32_t commits;
+    uint32_t failures;
+} settings_stats_t;
+
+/* loads all settings with one read, call after nvs_flash_init */
+esp_err_t init_settings();
+int32_t settings_get(setting_key_t key);
+/* never blocks on flash, changed values are committed together once settings are quiet */
+void settings_set(setting_key_t key, int32_t value);
+/* commits pending changes now, e.g. before a restart */
+esp_err_t settings_flush();
+void settings_get_stats(settings_stats_t* target);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef __SGP4_H
+#define __SGP4_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/* Mean elements as found in a two-line element set. Angles in radians. */
+typedef struct sgp4_tle {
+    int64_t epoch_unix_millis;
+    double inclination;
+    double raan;
+    double eccentricity;
+    double arg_perigee;
+    double mean_anomaly;
+    double mean_motion; // revolutions per day
+    double bstar;       // per earth radii
+} sgp4_tle_t;
+
+/*
+ * Near-earth SGP4 state. Initialization runs in double precision once,
+ * the secular angles are advanced in double and reduced to [0, 2pi), and
+ * everything else in the propagation step runs in single precision, which
+ * is all the ESP32 FPU handles in hardware.
+ */
+typedef struct sgp4 {
+    int64_t epoch_unix_millis;
+    bool simple;
+    double mo, argpo, nodeo;
+    double mdot, argpdot, nodedot;
+    float no, ecco, inclo, sinio, cosio, bstar;
+    float eta, delmo, sinmao;
+    float cc1, cc4, cc5, d2, d3, d4;
+    float t2cof, t3cof, t4cof, t5cof;
+    float omgcof, xmcof, nodecf, xlcof, aycof;
+    float con41, x1mth2, x7thm1;
+} sgp4_t;
+
+#define SGP4_OK 0
+#define SGP4_ERR_DEEP_SPACE 1
+#define SGP4_ERR_ECCENTRICITY 2
+#define SGP4_ERR_SEMI_LATUS 3
+#define SGP4_ERR_DECAYED 4
+
+int sgp4_init(sgp4_t *target, const sgp4_tle_t *tle);
+
+/* Position (km) and velocity (km/s) in TEME, tsince in minutes from epoch. */
+int sgp4_propagate(const sgp4_t *target, double tsince, float r[3], float v[3]);
+
+/* Greenwich mean sidereal angle in radians. */
+double sgp4_gmst(int64_t unix_millis);
+
+#endif
@@ -3,13 +3,20 @@
 
 #include "freertos/FreeRTOS.h"
 #include "esp_err.h"
+#include "cpu_monitor.h"
 
-typedef void (*slew_set_motor_speed_callback)(double raCyclesPerSiderealDay, double decCyclesPerDay);
+/* speeds as set_ra_speed and set_dec_speed take them */
+typedef void (*slew_set_motor_speed_callback)(int32_t raSpeed, int32_t decSpeed);
 
 esp_err_t init_slew(slew_set_motor_speed_callback callback);
 bool is_slewing();
-void abort_slew();
-void slew_to_coordinates(int32_t raMillis, int32_t decMillis);
-double get_slew_progress();
+/* both fail when the motion queue is full, nothing changed then */
+esp_err_t abort_slew();
+esp_err_t slew_to_coordinates(int32_t raMillis, int32_t decMillis);
+/* of the distance at the start, negative when further away now */
+int32_t get_slew_progress_percent();
 uint32_t get_slew_time_to_go_millis();
+int32_t getRaDiff(int32_t target, int32_t current);
+/* how late the slew check timer fires, on the motion tick */
+void slew_get_timer_stats(timer_monitor_stats_t* target);
 #endif
\ No newline at end of file
@@ -1,6 +1,13 @@
 #include "freertos/FreeRTOS.h"
+#include "command.h"
 
 uint8_t getSideOfPier();
 int32_t decMillis2decMecMillis(int32_t decMillis);
 int32_t decMecMillis2decMillis(int32_t decMecMillis, uint8_t* parseSideOfPier);
-void setSideOfPierWithDecMecMillis(int32_t decMecMillis);
\ No newline at end of file
+void setSideOfPierWithDecMecMillis(int32_t decMecMillis);
+
+/* the protocol's commands and the preconditions they are checked against */
+extern const command_t commands[COMMAND_TABLE_SIZE];
+uint8_t commandState();
+/* event loop only, what a received datagram goes through */
+int parse_command(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen);
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/*
+ * Hierarchical timer wheel. Four levels of 64 slots cover 2^24 ticks, a
+ * timer sits in the level its distance falls in and moves down a level
+ * each time the level below wraps. Add and cancel are O(1), timers due
+ * on the same tick fire in the order they reached the lowest level.
+ * Not thread safe, the owner serializes access.
+ */
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_MAX_TICKS ((1u << (WHEEL_LEVELS * WHEEL_SLOT_BITS)) - 1)
+
+typedef void (*wheel_callback)(void* arg);
+
+typedef struct wheel_timer {
+    struct wheel_timer *next, *prev;
+    uint32_t expires; // in ticks
+    uint32_t period; // in ticks, 0 fires once
+    wheel_callback callback;
+    void* arg;
+    uint8_t level, slot;
+    bool pending;
+} wheel_timer_t;
+
+typedef struct timer_wheel {
+    uint32_t now; // the last tick advanced to
+    uint32_t pending;
+    uint64_t occupied[WHEEL_LEVELS]; // a bit per non-empty slot
+    wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+} timer_wheel_t;
+
+void wheel_init(timer_wheel_t* wheel, uint32_t now);
+void wheel_timer_init(wheel_timer_t* timer, wheel_callback callback, void* arg);
+/* expires at an absolute tick, one in the past fires on the next tick, a pending timer is moved */
+void wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer, uint32_t expires);
+void wheel_cancel(timer_wheel_t* wheel, wheel_timer_t* timer);
+/* fires every timer due up to now, returns how many fired */
+uint32_t wheel_advance(timer_wheel_t* wheel, uint32_t now);
+/* ticks until the wheel has work, a timer or a cascade, at most limit */
+uint32_t wheel_next_tick(const timer_wheel_t* wheel, uint32_t limit);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+/*
+ * Begin, end and instant events in a RAM ring, read out over UDP and turned
+ * into a Chrome trace by sim/tools/trace.c. Without CONFIG_TRACE the
+ * TRACE_* macros compile to nothing and the ring is empty.
+ *
+ * Events are listed once, the id and the name shown in the trace:
+ */
+#define TRACE_EVENTS(E) \
+    E(TRACE_PARSE_COMMAND, "parse_command") \
+    E(TRACE_UPDATE_STEPPER, "updateStepper") \
+    E(TRACE_DISPLAY_REFRESH, "ssd1306_refresh") \
+    E(TRACE_SET_RA_SPEED, "set_ra_speed") \
+    E(TRACE_SET_DEC_SPEED, "set_dec_speed") \
+    E(TRACE_SLEW_TIMER, "slew_timer_callback") \
+    E(TRACE_FOCUSER_TIMER, "focuser_timer_listener") \
+    E(TRACE_BROADCAST_STATUS, "broadcastStatus") \
+    E(TRACE_PULSE_GUIDE_START, "pulse_guide_start") \
+    E(TRACE_PULSE_GUIDE_END, "pulse_guide_end")
+
+#define TRACE_EVENT_ID(id, name) id,
+typedef enum {
+    TRACE_EVENTS(TRACE_EVENT_ID)
+    TRACE_EVENT_COUNT
+} trace_event_id_t;
+
+#define TRACE_PHASE_BEGIN 0
+#define TRACE_PHASE_END 1
+#define TRACE_PHASE_INSTANT 2
+
+#define TRACE_MAX_TASKS 12
+#define TRACE_TASK_NAME_LENGTH 16
+
+typedef struct trace_event {
+    uint32_t time; // low bits of esp_timer_get_time, wraps every 71 minutes
+    uint16_t arg; // e.g. the command id
+    uint8_t event; // trace_event_id_t, phase in the top 2 bits
+    uint8_t task; // index into the task table, core in the top bit
+} trace_event_t;
+
+#define TRACE_EVENT_OF(E) ((E) & 0x3f)
+#define TRACE_PHASE_OF(E) ((E) >> 6)
+#define TRACE_TASK_OF(T) ((T) & 0x7f)
+#define TRACE_CORE_OF(T) ((T) >> 7)
+
+#ifdef CONFIG_TRACE
+#define TRACE_BEGIN(EVENT, ARG) trace_record(EVENT, TRACE_PHASE_BEGIN, ARG)
+#define TRACE_END(EVENT, ARG) trace_record(EVENT, TRACE_PHASE_END, ARG)
+#define TRACE_INSTANT(EVENT, ARG) trace_record(EVENT, TRACE_PHASE_INSTANT, ARG)
+#else
+#define TRACE_BEGIN(EVENT, ARG) do { } while (0)
+#define TRACE_END(EVENT, ARG) do { } while (0)
+#define TRACE_INSTANT(EVENT, ARG) do { } while (0)
+#endif
+
+/* any task, lock-free, the oldest events are overwritten */
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg);
+/* a paused ring keeps what it has, e.g. while a client reads it */
+void trace_set_recording(bool recording);
+/* events recorded since boot, the sequence number of the next one */
+uint32_t trace_head();
+/* 0 without CONFIG_TRACE */
+uint32_t trace_capacity();
+/*
+ * Copies up to count events from sequence from on, skipping ahead to the
+ * oldest still in the ring. Returns how many, *first is the sequence of the
+ * first one copied.
+ */
+int trace_read(uint32_t from, trace_event_t* target, int count, uint32_t* first);
+/* names of the tasks events were recorded on, returns how many */
+int trace_get_tasks(char names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH]);
+
+#endif
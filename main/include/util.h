@@ -16,5 +16,7 @@
 #define LEN(arr) (sizeof(arr) / sizeof(arr[0]))
 
 uint64_t currentTimeMillis();
+/* floor of the square root, without the FPU */
+uint32_t isqrt64(uint64_t value);
 
 #endif
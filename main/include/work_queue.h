@@ -0,0 +1,41 @@
+#ifndef __WORK_QUEUE_H
+#define __WORK_QUEUE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+#define WORK_DATA_SIZE 16
+
+/*
+ * Bounded lock-free queue of function calls, any number of producers and
+ * one consumer. A producer claims a cell with compare-and-swap on the head,
+ * copies the call in and publishes it through the cell's sequence number,
+ * so a producer never waits on another task and the consumer never blocks
+ * a producer. Calls run on the consumer in the order their cells were
+ * claimed.
+ */
+typedef void (*work_f)(const void* data);
+
+typedef struct work_item {
+    uint32_t sequence;
+    work_f work;
+    uint64_t data[WORK_DATA_SIZE / sizeof(uint64_t)]; // aligned for any field
+} work_item_t;
+
+typedef struct work_queue {
+    work_item_t* items;
+    uint32_t mask;
+    uint32_t head; // next cell a producer claims
+    uint32_t tail; // next cell the consumer runs
+    uint32_t overflows;
+} work_queue_t;
+
+/* size is a power of two */
+void work_queue_init(work_queue_t* queue, work_item_t* items, uint32_t size);
+/* copies size bytes of data, false when the queue is full or data too big */
+bool work_queue_push(work_queue_t* queue, work_f work, const void* data, size_t size);
+/* consumer only, runs every published call and returns how many ran */
+uint32_t work_queue_run(work_queue_t* queue);
+
+#endif
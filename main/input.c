@@ -0,0 +1,175 @@
+#include "input.h"
+#include "rencoder.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "util.h"
+#include "string.h"
+#include "memory_budget.h"
+
+#define TAG "INPUT"
+
+#define SETTLE_MICROS ((int64_t)(CONFIG_INPUT_DEBOUNCE_MILLIS) * 1000)
+
+typedef struct input_button {
+    uint8_t id;
+    gpio_num_t pin;
+    bool pressed_level;
+    input_debounce_t debounce;
+    esp_timer_handle_t timer;
+} input_button_t;
+
+typedef struct input_encoder {
+    rencoder_t rencoder; // first, the count callback gets its address
+    uint8_t id;
+} input_encoder_t;
+
+QueueHandle_t inputQueue = NULL;
+StaticQueue_t inputQueueBuffer;
+uint8_t inputQueueStorage[INPUT_QUEUE_LENGTH * sizeof(input_event_t)];
+portMUX_TYPE inputMux = portMUX_INITIALIZER_UNLOCKED;
+input_button_t inputButtons[INPUT_MAX_BUTTONS];
+int inputButtonCount = 0;
+input_encoder_t inputEncoders[INPUT_MAX_ENCODERS];
+int inputEncoderCount = 0;
+
+void input_debounce_edge(input_debounce_t* d, int64_t now, int64_t settle_micros) {
+    d->settling = true;
+    d->deadline = now + settle_micros;
+}
+
+int64_t input_debounce_poll(input_debounce_t* d, bool raw, int64_t now, bool* changed) {
+    *changed = false;
+    if (!d->settling) {
+        return 0;
+    }
+    if (now < d->deadline) {
+        return d->deadline - now;
+    }
+    d->settling = false;
+    if (raw != d->level) {
+        d->level = raw;
+        *changed = true;
+    }
+    return 0;
+}
+
+void IRAM_ATTR input_button_isr(void* arg) {
+    input_button_t* button = (input_button_t*) arg;
+    portENTER_CRITICAL_ISR(&inputMux);
+    bool start = !button->debounce.settling;
+    input_debounce_edge(&button->debounce, esp_timer_get_time(), SETTLE_MICROS);
+    portEXIT_CRITICAL_ISR(&inputMux);
+    // a running timer sees the moved deadline when it fires and waits the rest
+    if (start) {
+        esp_timer_start_once(button->timer, SETTLE_MICROS);
+    }
+}
+
+void input_button_settled(void* arg) {
+    input_button_t* button = (input_button_t*) arg;
+    bool raw = gpio_get_level(button->pin);
+    int64_t now = esp_timer_get_time();
+    bool changed;
+    portENTER_CRITICAL(&inputMux);
+    int64_t left = input_debounce_poll(&button->debounce, raw, now, &changed);
+    portEXIT_CRITICAL(&inputMux);
+    if (left > 0) {
+        esp_timer_start_once(button->timer, left);
+        return;
+    }
+    if (changed) {
+        input_event_t event = {
+            .source = button->id,
+            .type = raw == button->pressed_level ? INPUT_EVENT_PRESSED : INPUT_EVENT_RELEASED,
+            .value = 0,
+            .at = now
+        };
+        if (xQueueSend(inputQueue, &event, 0) != pdTRUE) {
+            LOGE(TAG, "event queue full, button %d dropped", button->id);
+        }
+    }
+}
+
+/* called on the rencoder worker */
+void input_encoder_count(rencoder_t* target, int32_t next_count, int8_t difference, void* args) {
+    input_encoder_t* encoder = (input_encoder_t*) target;
+    input_event_t event = {
+        .source = encoder->id,
+        .type = INPUT_EVENT_ROTATED,
+        .value = difference,
+        .at = esp_timer_get_time()
+    };
+    xQueueSend(inputQueue, &event, 0);
+}
+
+esp_err_t init_input() {
+    inputQueue = xQueueCreateStatic(INPUT_QUEUE_LENGTH, sizeof(input_event_t), inputQueueStorage, &inputQueueBuffer);
+    if (!inputQueue) {
+        return ESP_ERR_NO_MEM;
+    }
+    inputButtonCount = 0;
+    inputEncoderCount = 0;
+    // installs the gpio isr service the buttons share with the encoders
+    return rencoder_init();
+}
+
+esp_err_t input_add_button(uint8_t id, gpio_num_t pin, bool pressed_level) {
+    if (inputButtonCount >= INPUT_MAX_BUTTONS) {
+        return ESP_ERR_NO_MEM;
+    }
+    input_button_t* button = &inputButtons[inputButtonCount];
+    memset(button, 0, sizeof(input_button_t));
+    button->id = id;
+    button->pin = pin;
+    button->pressed_level = pressed_level;
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = input_button_settled,
+        .arg = button
+    };
+    esp_err_t err = esp_timer_create(&args, &button->timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    gpio_config_t conf;
+    conf.intr_type = GPIO_INTR_ANYEDGE;
+    conf.mode = GPIO_MODE_INPUT;
+    conf.pin_bit_mask = 1ULL << pin;
+    conf.pull_up_en = pressed_level ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
+    conf.pull_down_en = pressed_level ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
+    gpio_config(&conf);
+    button->debounce.level = gpio_get_level(pin);
+    inputButtonCount++;
+    return gpio_isr_handler_add(pin, input_button_isr, button);
+}
+
+esp_err_t input_add_encoder(uint8_t id, gpio_num_t a, gpio_num_t b, bool reverse) {
+    if (inputEncoderCount >= INPUT_MAX_ENCODERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    input_encoder_t* encoder = &inputEncoders[inputEncoderCount++];
+    encoder->id = id;
+    return rencoder_start(&encoder->rencoder, a, b, input_encoder_count, NULL, reverse);
+}
+
+bool input_is_pressed(uint8_t id) {
+    for (int i = 0; i < inputButtonCount; i++) {
+        if (inputButtons[i].id == id) {
+            return inputButtons[i].debounce.level == inputButtons[i].pressed_level;
+        }
+    }
+    return false;
+}
+
+rencoder_t* input_get_encoder(uint8_t id) {
+    for (int i = 0; i < inputEncoderCount; i++) {
+        if (inputEncoders[i].id == id) {
+            return &inputEncoders[i].rencoder;
+        }
+    }
+    return NULL;
+}
+
+bool input_receive(input_event_t* event, TickType_t wait) {
+    return xQueueReceive(inputQueue, event, wait) == pdTRUE;
+}
@@ -0,0 +1,48 @@
+#include "memory_budget.h"
+#include "esp_system.h"
+#include "util.h"
+
+#define TAG "MEMORY"
+
+typedef struct memory_task_entry {
+    TaskHandle_t handle;
+    const char* name;
+    uint32_t stack_size;
+} memory_task_entry_t;
+
+memory_task_entry_t memoryTasks[MEMORY_MAX_TASKS];
+uint8_t memoryTaskCount = 0;
+portMUX_TYPE memoryMux = portMUX_INITIALIZER_UNLOCKED;
+
+TaskHandle_t memory_create_task(TaskFunction_t code, const char* name, uint32_t stack_size, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task, BaseType_t core) {
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(code, name, stack_size, param, priority, stack, task, core);
+    if (!handle) {
+        LOGE(TAG, "Failed to create task %s", name);
+        return NULL;
+    }
+    portENTER_CRITICAL(&memoryMux);
+    if (memoryTaskCount < MEMORY_MAX_TASKS) {
+        memory_task_entry_t* entry = &memoryTasks[memoryTaskCount++];
+        entry->handle = handle;
+        entry->name = name;
+        entry->stack_size = stack_size;
+    }
+    portEXIT_CRITICAL(&memoryMux);
+    return handle;
+}
+
+void memory_get_report(memory_report_t* target) {
+    target->free_heap = esp_get_free_heap_size();
+    target->min_free_heap = esp_get_minimum_free_heap_size();
+    portENTER_CRITICAL(&memoryMux);
+    uint8_t count = memoryTaskCount;
+    portEXIT_CRITICAL(&memoryMux);
+    target->task_count = count;
+    for (int i = 0; i < count; i++) {
+        target->tasks[i].name = memoryTasks[i].name;
+        target->tasks[i].stack_size = memoryTasks[i].stack_size;
+        // in bytes on the ESP32 port, StackType_t is uint8_t
+        target->tasks[i].headroom = uxTaskGetStackHighWaterMark(memoryTasks[i].handle) * sizeof(StackType_t);
+    }
+}
@@ -0,0 +1,144 @@
+#include "motion_loop.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "memory_budget.h"
+#include "util.h"
+#include "string.h"
+#include "sdkconfig.h"
+
+#define TAG "MOTION"
+
+// longest sleep without work, only bounds how stale the loop can get
+#define MAX_WAIT_TICKS (1000 / portTICK_PERIOD_MS)
+
+typedef struct motion_timer_request {
+    motion_timer_t* timer;
+    uint32_t ticks;
+    uint32_t period;
+} motion_timer_request_t;
+
+timer_wheel_t motionWheel;
+work_item_t motionItems[MOTION_QUEUE_SIZE];
+work_queue_t motionQueue;
+SemaphoreHandle_t motionReady;
+StaticSemaphore_t motionReadyBuffer;
+TaskHandle_t motionHandle = NULL;
+motion_stats_t motionStats;
+portMUX_TYPE motionStatsMux = portMUX_INITIALIZER_UNLOCKED;
+STATIC_TASK(motionLoop, 4096);
+
+/*
+ * The wheel runs on RTOS ticks, so a wait ends on the tick interrupt a timer
+ * is due at and periodic timers stay phase locked to the tick.
+ */
+uint32_t motion_now() {
+    return xTaskGetTickCount();
+}
+
+bool motion_is_current_task() {
+    return xTaskGetCurrentTaskHandle() == motionHandle;
+}
+
+bool motion_post(work_f work, const void* data, size_t size) {
+    if (motion_is_current_task()) {
+        work(data);
+        return true;
+    }
+    if (!work_queue_push(&motionQueue, work, data, size)) {
+        LOGE(TAG, "Motion queue full");
+        return false;
+    }
+    __atomic_add_fetch(&motionStats.posts, 1, __ATOMIC_RELAXED);
+    xSemaphoreGive(motionReady);
+    return true;
+}
+
+void motion_timer_fire(void* arg) {
+    motion_timer_t* timer = arg;
+    int64_t now = esp_timer_get_time();
+    if (timer->wheel.period && timer->fired_at) {
+        int64_t jitter = now - timer->fired_at - (int64_t) timer->wheel.period * portTICK_PERIOD_MS * 1000;
+        uint32_t micros = (uint32_t)(jitter < 0 ? -jitter : jitter);
+        portENTER_CRITICAL(&motionStatsMux);
+        if (micros > motionStats.max_jitter_micros) motionStats.max_jitter_micros = micros;
+        motionStats.total_jitter_micros += micros;
+        motionStats.intervals++;
+        portEXIT_CRITICAL(&motionStatsMux);
+    }
+    timer->fired_at = timer->wheel.period ? now : 0;
+    timer->callback(timer->arg);
+}
+
+void motion_timer_init(motion_timer_t* timer, wheel_callback callback, void* arg) {
+    wheel_timer_init(&timer->wheel, motion_timer_fire, timer);
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->fired_at = 0;
+}
+
+void motion_timer_apply(const void* data) {
+    const motion_timer_request_t* request = data;
+    request->timer->wheel.period = request->period;
+    request->timer->fired_at = 0;
+    // the current tick already started, one more so a timer never fires early
+    wheel_add(&motionWheel, &request->timer->wheel, motion_now() + request->ticks + 1);
+}
+
+void motion_timer_cancel(const void* data) {
+    motion_timer_t* const* timer = data;
+    wheel_cancel(&motionWheel, &(*timer)->wheel);
+}
+
+bool motion_timer_start_once(motion_timer_t* timer, uint32_t millis) {
+    motion_timer_request_t request = { timer, millis / portTICK_PERIOD_MS, 0 };
+    return motion_post(motion_timer_apply, &request, sizeof(request));
+}
+
+bool motion_timer_start_periodic(motion_timer_t* timer, uint32_t millis) {
+    uint32_t ticks = millis / portTICK_PERIOD_MS;
+    motion_timer_request_t request = { timer, ticks, ticks > 0 ? ticks : 1 };
+    return motion_post(motion_timer_apply, &request, sizeof(request));
+}
+
+bool motion_timer_stop(motion_timer_t* timer) {
+    return motion_post(motion_timer_cancel, &timer, sizeof(timer));
+}
+
+void motion_loop_run(void* p) {
+    motionHandle = xTaskGetCurrentTaskHandle();
+    LOGI(TAG, "Motion loop started on core %d", xPortGetCoreID());
+    while (1) {
+        work_queue_run(&motionQueue);
+        uint32_t now = motion_now();
+        wheel_advance(&motionWheel, now);
+        uint32_t due = now + wheel_next_tick(&motionWheel, MAX_WAIT_TICKS);
+        // callbacks may have used up some ticks
+        int32_t wait = (int32_t)(due - motion_now());
+        xSemaphoreTake(motionReady, wait > 0 ? wait : 0);
+    }
+}
+
+esp_err_t init_motion_loop() {
+    bzero(&motionStats, sizeof(motionStats));
+    work_queue_init(&motionQueue, motionItems, MOTION_QUEUE_SIZE);
+    wheel_init(&motionWheel, motion_now());
+    motionReady = xSemaphoreCreateBinaryStatic(&motionReadyBuffer);
+    if (!motionReady) {
+        return ESP_ERR_NO_MEM;
+    }
+    motionHandle = STATIC_TASK_CREATE_PINNED(motionLoop, motion_loop_run, "motion", NULL,
+        CONFIG_MOTION_TASK_PRIORITY, CONFIG_MOTION_TASK_CORE);
+    return motionHandle ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+uint32_t motion_post_count() {
+    return __atomic_load_n(&motionStats.posts, __ATOMIC_RELAXED);
+}
+
+void motion_get_stats(motion_stats_t* target) {
+    portENTER_CRITICAL(&motionStatsMux);
+    *target = motionStats;
+    portEXIT_CRITICAL(&motionStatsMux);
+    target->overflows = __atomic_load_n(&motionQueue.overflows, __ATOMIC_RELAXED);
+}
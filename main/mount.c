@@ -2,10 +2,10 @@
 #include "driver/ledc.h"
 #include "util.h"
 #include "astro.h"
-#include "nvs_flash.h"
-#include "nvs.h"
-#include "math.h"
+#include "settings.h"
 #include "mount_encoder.h"
+#include "motion_math.h"
+#include "trace.h"
 
 /* ------ utils ----------- */
 #define DUTY_RES LEDC_TIMER_13_BIT
@@ -15,18 +15,10 @@
 #define GPIO_RA_DIR (CONFIG_GPIO_RA_DIR)
 #define GPIO_RA_PUL (CONFIG_GPIO_RA_PUL)
 
-#define RA_GEAR_RATIO ((double)(CONFIG_RA_GEAR_RATIO))
-#define RA_RESOLUTION ((double)(CONFIG_RA_RESOLUTION))
-#define RA_CYCLE_STEPS ((double)(CONFIG_RA_CYCLE_STEPS))
-
 #define GPIO_DEC_EN  (CONFIG_GPIO_DEC_EN)
 #define GPIO_DEC_DIR (CONFIG_GPIO_DEC_DIR)
 #define GPIO_DEC_PUL (CONFIG_GPIO_DEC_PUL)
 
-#define DEC_GEAR_RATIO ((double)(CONFIG_DEC_GEAR_RATIO))
-#define DEC_RESOLUTION ((double)(CONFIG_DEC_RESOLUTION))
-#define DEC_CYCLE_STEPS ((double)(CONFIG_DEC_CYCLE_STEPS))
-
 #ifndef CONFIG_RA_REVERSE
 #define CONFIG_RA_REVERSE false
 #endif
@@ -36,14 +28,28 @@
 #endif
 
 /* ---------- FREQS ---------- */
-#define RA_FREQ(cyclesPerSiderealDay) (RA_CYCLE_STEPS * RA_GEAR_RATIO * RA_RESOLUTION * (cyclesPerSiderealDay) * 1000 / SIDEREAL_DAY_MILLIS)
-#define DEC_FREQ(cyclesPerDay) (DEC_CYCLE_STEPS * DEC_GEAR_RATIO * DEC_RESOLUTION * (cyclesPerDay) * 1000 / DAY_MILLIS)
+#define RA_FREQ(cyclesPerSiderealDay) ((cyclesPerSiderealDay) * RA_PULSES_PER_CYCLE * 1000 / SIDEREAL_DAY_MILLIS)
+#define DEC_FREQ(cyclesPerDay) ((cyclesPerDay) * DEC_PULSES_PER_CYCLE * 1000 / DAY_MILLIS)
+// the LEDC divider of the 80 MHz APB clock is at least 1 with DUTY_RES bits of duty
+#define LEDC_FREQ_MAX (80000000 >> DUTY_RES)
+// largest ratio set_mount_time_ratio_persist takes, in millionths up to INT32_MAX
+#define TIME_RATIO_MAX (INT32_MAX / 1000000 + 1)
+
+/* speed_to_rate of the clamped speeds stays within 64 bits up to the largest time ratio */
+_Static_assert(RA_SPEED_MAX <= UINT64_MAX / RA_RATE_PER_SPEED, "RA_SPEED_MAX overflows the Q64 rate");
+_Static_assert(DEC_SPEED_MAX <= UINT64_MAX / DEC_RATE_PER_SPEED, "DEC_SPEED_MAX overflows the Q64 rate");
+_Static_assert((RA_SPEED_MAX * RA_RATE_PER_SPEED >> 16) <= INT64_MAX / TIME_RATIO_MAX, "RA rate overflows at the largest time ratio");
+_Static_assert((DEC_SPEED_MAX * DEC_RATE_PER_SPEED >> 16) <= INT64_MAX / TIME_RATIO_MAX, "DEC rate overflows at the largest time ratio");
+/* and the LEDC makes the fastest of them at time ratio 1 */
+_Static_assert(RA_FREQ(RA_SPEED_MAX / SPEED_PER_CYCLE) <= LEDC_FREQ_MAX, "RA steps faster at RA_SPEED_MAX than the LEDC can");
+_Static_assert(DEC_FREQ(DEC_SPEED_MAX / SPEED_PER_CYCLE) <= LEDC_FREQ_MAX, "DEC steps faster at DEC_SPEED_MAX than the LEDC can");
 
 const static char *TAG = "Mount";
 
-double raCyclesPerSiderealDay;
-double decCyclesPerDay;
-double timeRatio;
+int32_t raAxisSpeed;
+int32_t decAxisSpeed;
+int32_t timeRatio; // in millionths
+uint64_t timeRatioQ32;
 
 ledc_channel_config_t ra_pmw_channel = {
     .channel = LEDC_CHANNEL_0,
@@ -76,33 +82,12 @@ ledc_timer_config_t dec_pmw_timer = {
 };
 
 esp_err_t init_mount() {
-    raCyclesPerSiderealDay = 0;
-    decCyclesPerDay = 0;
+    raAxisSpeed = 0;
+    decAxisSpeed = 0;
     
-    nvs_handle my_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &my_handle);
-
-    if (err == ESP_OK) {
-        int32_t timeRatioMillion = 0;
-        err = nvs_get_i32(my_handle, "time_ratio", &timeRatioMillion);
-        switch (err) {
-            case ESP_OK:
-                timeRatio = timeRatioMillion / 1000000.0; 
-                LOGI(TAG, "Read time ratio: %f", timeRatio);
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                timeRatio = 1;
-                LOGI(TAG, "Time ratio not set");                
-                break;
-            default :
-                timeRatio = 1;
-                LOGI(TAG, "Time ratio read error: %d", err);
-        }
-        nvs_close(my_handle);
-    } else {
-        LOGI(TAG, "Time ratio storage error: %d", err);
-        timeRatio = 1;
-    }
+    timeRatio = settings_get(SETTING_TIME_RATIO);
+    timeRatioQ32 = (((uint64_t) timeRatio << 32) + 500000) / 1000000;
+    LOGI(TAG, "Time ratio: %d.%06d", timeRatio / 1000000, timeRatio % 1000000);
     
     gpio_pad_select_gpio(GPIO_RA_DIR);
     gpio_set_direction(GPIO_RA_DIR, GPIO_MODE_OUTPUT);
@@ -128,37 +113,24 @@ esp_err_t init_mount() {
     return ESP_OK;
 }
 
-void set_mount_time_ratio_persist(double ratio) {
+void set_mount_time_ratio_persist(int32_t ratio) {
     timeRatio = ratio;
-    set_ra_cycles_per_sidereal_day(raCyclesPerSiderealDay);
-    set_dec_cycles_per_day(decCyclesPerDay);
-
-    nvs_handle my_handle;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &my_handle);
-
-    if (err == ESP_OK) {
-        int32_t timeRatioMillion = (int32_t)(timeRatio * 1000000.0);
-        err = nvs_set_i32(my_handle, "time_ratio", timeRatioMillion);
-        if (err == ESP_OK) {
-            LOGI(TAG, "Set time ratio success");
-        } else {
-            LOGE(TAG, "Set time ratio failed: %d", err);
-        }
-        nvs_close(my_handle);
-    } else {
-        LOGE(TAG, "Time ratio storage error: %d", err);
-    }
+    timeRatioQ32 = (((uint64_t) ratio << 32) + 500000) / 1000000;
+    set_ra_speed(raAxisSpeed);
+    set_dec_speed(decAxisSpeed);
+    settings_set(SETTING_TIME_RATIO, timeRatio);
 }
 
-double get_mount_time_ratio() {
+int32_t get_mount_time_ratio() {
     return timeRatio;
 }
 
-void set_ra_cycles_per_sidereal_day(double value) {
-    raCyclesPerSiderealDay = value;
+void set_ra_speed(int32_t value) {
+    TRACE_BEGIN(TRACE_SET_RA_SPEED, 0);
+    raAxisSpeed = value;
     bool freqIsNeg = false;
-    if (raCyclesPerSiderealDay < 0) {
-        raCyclesPerSiderealDay = -raCyclesPerSiderealDay;
+    if (raAxisSpeed < 0) {
+        raAxisSpeed = -raAxisSpeed;
         freqIsNeg = true;
         if (CONFIG_RA_REVERSE) {
             gpio_set_level(GPIO_RA_DIR, 1);
@@ -172,31 +144,34 @@ void set_ra_cycles_per_sidereal_day(double value) {
             gpio_set_level(GPIO_RA_DIR, 1);
         }
     }
+    if (raAxisSpeed > RA_SPEED_MAX) raAxisSpeed = RA_SPEED_MAX;
 
-    double raActualFreq = timeRatio * RA_FREQ(raCyclesPerSiderealDay);
-    int rafreq = (int) round(raActualFreq);
-    if (raCyclesPerSiderealDay < RA_CYCLE_MIN || rafreq == 0) {
+    int64_t raRate = speed_to_rate(raAxisSpeed, RA_RATE_PER_SPEED, timeRatioQ32);
+    int rafreq = rate_to_hz(raRate);
+    if (raAxisSpeed < RA_SPEED_MIN || rafreq == 0) {
         LOGI(TAG, "RA Stop");
         ledc_set_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel, 0);
         ledc_update_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel);
         gpio_set_level(GPIO_RA_EN, 1);
         ra_pulse_freq_changed(0);
     } else {
-        if (raCyclesPerSiderealDay > RA_CYCLE_MAX) raCyclesPerSiderealDay = RA_CYCLE_MAX;        
-        LOGI(TAG, "RA Freq: %d (%f)", rafreq, raActualFreq);
+        int32_t raMilliHz = rate_to_millihertz(raRate);
+        LOGI(TAG, "RA Freq: %d (%d.%03d)", rafreq, raMilliHz / 1000, raMilliHz % 1000);
         ledc_set_freq(LEDC_HIGH_SPEED_MODE, ra_pmw_timer.timer_num, rafreq);
         ledc_set_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel, DUTY);        
         ledc_update_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel);
         gpio_set_level(GPIO_RA_EN, 0);
         ra_pulse_freq_changed(freqIsNeg ? -rafreq : rafreq);
     }
+    TRACE_END(TRACE_SET_RA_SPEED, 0);
 }
 
-void set_dec_cycles_per_day(double value) {
-    decCyclesPerDay = value;
+void set_dec_speed(int32_t value) {
+    TRACE_BEGIN(TRACE_SET_DEC_SPEED, 0);
+    decAxisSpeed = value;
     bool freqIsNeg = false;
-    if (decCyclesPerDay < 0) {
-        decCyclesPerDay = -decCyclesPerDay;
+    if (decAxisSpeed < 0) {
+        decAxisSpeed = -decAxisSpeed;
         freqIsNeg = true;
         if (CONFIG_DEC_REVERSE) {
             gpio_set_level(GPIO_DEC_DIR, 1);
@@ -210,30 +185,32 @@ void set_dec_cycles_per_day(double value) {
             gpio_set_level(GPIO_DEC_DIR, 1);
         } 
     }
+    if (decAxisSpeed > DEC_SPEED_MAX) decAxisSpeed = DEC_SPEED_MAX;
 
-    double decActualFreq = timeRatio * DEC_FREQ(decCyclesPerDay);
-    int decfreq = (int) round(decActualFreq);
-    if (decCyclesPerDay < DEC_CYCLE_MIN || decfreq == 0) {
+    int64_t decRate = speed_to_rate(decAxisSpeed, DEC_RATE_PER_SPEED, timeRatioQ32);
+    int decfreq = rate_to_hz(decRate);
+    if (decAxisSpeed < DEC_SPEED_MIN || decfreq == 0) {
         LOGI(TAG, "DEC Stop");
         ledc_set_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel, 0);
         ledc_update_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel);
         gpio_set_level(GPIO_DEC_EN, 1);
         dec_pulse_freq_changed(0);
     } else {
-        if (decCyclesPerDay > DEC_CYCLE_MAX) decCyclesPerDay = DEC_CYCLE_MAX;        
-        LOGI(TAG, "DEC Freq: %d (%f)", decfreq, decActualFreq);
+        int32_t decMilliHz = rate_to_millihertz(decRate);
+        LOGI(TAG, "DEC Freq: %d (%d.%03d)", decfreq, decMilliHz / 1000, decMilliHz % 1000);
         ledc_set_freq(LEDC_HIGH_SPEED_MODE, dec_pmw_timer.timer_num, decfreq);
         ledc_set_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel, DUTY);        
         ledc_update_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel);
         gpio_set_level(GPIO_DEC_EN, 0);
         dec_pulse_freq_changed(freqIsNeg ? -decfreq : decfreq);
     }
+    TRACE_END(TRACE_SET_DEC_SPEED, 0);
 }
 
-double get_ra_cycles_per_sidereal_day() {
-    return raCyclesPerSiderealDay;
+int32_t get_ra_speed() {
+    return raAxisSpeed;
 }
 
-double get_dec_cycles_per_day(){
-    return decCyclesPerDay;
+int32_t get_dec_speed(){
+    return decAxisSpeed;
 }
\ No newline at end of file
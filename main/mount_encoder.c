@@ -4,73 +4,210 @@
 #include "rencoder.h"
 #include "astro.h"
 #include "telescope.h"
+#include "motion_loop.h"
+#include "motion_math.h"
+#include "stdlib.h"
 
-uint64_t encoder_reset_time;
-int32_t reset_ra_angle_millis, reset_dec_angle_millis;
+#ifndef CONFIG_RA_ENCODER
+#define CONFIG_RA_ENCODER false
+#endif
+#ifndef CONFIG_DEC_ENCODER
+#define CONFIG_DEC_ENCODER false
+#endif
+#ifndef CONFIG_RA_ENCODER_REVERSE
+#define CONFIG_RA_ENCODER_REVERSE false
+#endif
+#ifndef CONFIG_DEC_ENCODER_REVERSE
+#define CONFIG_DEC_ENCODER_REVERSE false
+#endif
 
 #define TAG "MOUNT_ENCODER"
 
-int64_t raPulses;
-uint64_t raFreqSyncTime;
-int32_t raFreq;
+typedef struct axis_position {
+    int64_t pulses; // up to sync_time, signed, a reversed axis counts down
+    uint64_t sync_time;
+    int32_t freq;
+    int64_t correction; // fused minus step estimate, in micro arcseconds
+} axis_position_t;
 
-int64_t decPulses;
-uint64_t decFreqSyncTime;
-int32_t decFreq;
+/*
+ * Where the mount points, integrated from the step rates. Only the motion
+ * task changes it, always under positionMux, and the getters work on a copy
+ * taken under the mux, so any task reads a consistent position.
+ */
+typedef struct mount_position {
+    uint64_t reset_time;
+    // R.A. in day millis and mechanical Dec at reset_time, in micro arcseconds
+    int64_t reset_ra_uas, reset_dec_uas;
+    axis_position_t ra, dec;
+    uint64_t now; // when a copy was taken
+} mount_position_t;
 
-void init_mount_encoder(){
-    encoder_reset_time = currentTimeMillis();
-    reset_ra_angle_millis = 0;
-    reset_dec_angle_millis = 0;
-    raPulses = 0;
-    decPulses = 0;
-    raFreq = 0;
-    decFreq = 0;
-    raFreqSyncTime = currentTimeMillis();;
-    decFreqSyncTime = currentTimeMillis();;
+mount_position_t position;
+portMUX_TYPE positionMux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Optional axis encoders. The step count is what the motor was told to do,
+ * the encoder what the axis did. A complementary filter keeps a correction
+ * on top of the step estimate that follows the encoder slowly, so encoder
+ * quantization and jitter are smoothed while gear error is taken out. A
+ * difference beyond the slip threshold means lost steps, the correction
+ * then jumps to the encoder at once.
+ */
+typedef struct axis_encoder {
+    rencoder_t rencoder;
+    axis_position_t* axis;
+    bool enabled;
+    uint64_t uas_per_count; // Q32
+    int32_t reset_count;
+    bool slipped; // since the last reset
+    uint32_t slips;
+} axis_encoder_t;
+
+axis_encoder_t raEncoder = { .axis = &position.ra }, decEncoder = { .axis = &position.dec };
+motion_timer_t fusionTimer;
+
+void get_position(mount_position_t* target) {
+    portENTER_CRITICAL(&positionMux);
+    *target = position;
+    target->now = currentTimeMillis();
+    portEXIT_CRITICAL(&positionMux);
 }
 
-void ra_pulse_freq_changed(int32_t newRaFreq) {
-    uint64_t currTime = currentTimeMillis();
-    raPulses += (currTime - raFreqSyncTime) * raFreq / 1000;
-    raFreqSyncTime = currTime;
-    raFreq = newRaFreq;
+int64_t axis_pulses(const axis_position_t* axis, uint64_t now) {
+    return axis->pulses + (int64_t)(now - axis->sync_time) * axis->freq / 1000;
 }
-void dec_pulse_freq_changed(int32_t newDecFreq) {
-    uint64_t currTime = currentTimeMillis();
-    decPulses += (currTime - decFreqSyncTime) * decFreq / 1000;
-    decFreqSyncTime = currTime;
-    decFreq = newDecFreq;
+
+int64_t axis_fusion_update(int64_t correction, int64_t step_uas, int64_t encoder_uas, int32_t gain_permille, int64_t slip_uas, bool* slip) {
+    int64_t innovation = encoder_uas - (step_uas + correction);
+    *slip = llabs(innovation) > slip_uas;
+    if (*slip) {
+        return encoder_uas - step_uas;
+    }
+    return correction + innovation * gain_permille / 1000;
+}
+
+/* on the motion task */
+void axis_encoder_update(axis_encoder_t* encoder, uint64_t uas_per_pulse, const char* name) {
+    if (!encoder->enabled) {
+        return;
+    }
+    bool slip;
+    portENTER_CRITICAL(&positionMux);
+    int64_t step_uas = mul_q32(axis_pulses(encoder->axis, currentTimeMillis()), uas_per_pulse);
+    int64_t encoder_uas = mul_q32(rencoder_value(&encoder->rencoder) - encoder->reset_count, encoder->uas_per_count);
+    encoder->axis->correction = axis_fusion_update(encoder->axis->correction, step_uas, encoder_uas,
+        CONFIG_ENCODER_FUSION_PERMILLE, (int64_t) CONFIG_ENCODER_SLIP_THRESHOLD_MILLIS * UAS_PER_MILLI, &slip);
+    if (slip) {
+        encoder->slipped = true;
+        encoder->slips++;
+    }
+    portEXIT_CRITICAL(&positionMux);
+    if (slip) {
+        LOGE(TAG, "%s slipped, steps %d encoder %d millis", name, uas_to_millis(step_uas), uas_to_millis(encoder_uas));
+    }
 }
 
-void reset_ra_actual_pulses(){
-    raPulses = 0;
-    raFreqSyncTime = currentTimeMillis();
+void fusion_timer_listener(void* args) {
+    axis_encoder_update(&raEncoder, RA_UAS_PER_PULSE, "RA");
+    axis_encoder_update(&decEncoder, DEC_UAS_PER_PULSE, "Dec");
 }
 
-void reset_dec_actual_pulses(){
-    decPulses = 0;
-    decFreqSyncTime = currentTimeMillis();
+/* with positionMux held, the axis counts from here on */
+void reset_axis(axis_encoder_t* encoder, uint64_t now) {
+    encoder->axis->pulses = 0;
+    encoder->axis->sync_time = now;
+    encoder->axis->correction = 0;
+    if (encoder->enabled) {
+        encoder->reset_count = rencoder_value(&encoder->rencoder);
+    }
+    encoder->slipped = false;
 }
 
-int64_t get_ra_actual_pulses(){
-    uint64_t currTime = currentTimeMillis();
-    return raPulses + (currTime - raFreqSyncTime) * raFreq / 1000;
+esp_err_t start_axis_encoder(axis_encoder_t* encoder, gpio_num_t a, gpio_num_t b, bool reverse, uint64_t uas_per_count) {
+    esp_err_t err = rencoder_init();
+    if (err == ESP_OK) {
+        err = rencoder_start(&encoder->rencoder, a, b, NULL, NULL, reverse);
+    }
+    if (err != ESP_OK) {
+        LOGE(TAG, "encoder on %d/%d failed: %d", a, b, err);
+        return err;
+    }
+    portENTER_CRITICAL(&positionMux);
+    encoder->uas_per_count = uas_per_count;
+    encoder->enabled = true;
+    encoder->reset_count = rencoder_value(&encoder->rencoder);
+    portEXIT_CRITICAL(&positionMux);
+    return ESP_OK;
 }
 
-int64_t get_dec_actual_pulses(){
-    uint64_t currTime = currentTimeMillis();
-    return decPulses + (currTime - decFreqSyncTime) * decFreq / 1000;
+void init_mount_encoder(){
+    uint64_t now = currentTimeMillis();
+    portENTER_CRITICAL(&positionMux);
+    position.reset_time = now;
+    position.reset_ra_uas = 0;
+    position.reset_dec_uas = 0;
+    raEncoder.enabled = false;
+    decEncoder.enabled = false;
+    raEncoder.slips = 0;
+    decEncoder.slips = 0;
+    reset_axis(&raEncoder, now);
+    reset_axis(&decEncoder, now);
+    position.ra.freq = 0;
+    position.dec.freq = 0;
+    portEXIT_CRITICAL(&positionMux);
+#if CONFIG_RA_ENCODER
+    start_axis_encoder(&raEncoder, CONFIG_GPIO_RA_ENCODER_A, CONFIG_GPIO_RA_ENCODER_B, CONFIG_RA_ENCODER_REVERSE,
+        RA_UAS_PER_COUNT);
+#endif
+#if CONFIG_DEC_ENCODER
+    start_axis_encoder(&decEncoder, CONFIG_GPIO_DEC_ENCODER_A, CONFIG_GPIO_DEC_ENCODER_B, CONFIG_DEC_ENCODER_REVERSE,
+        DEC_UAS_PER_COUNT);
+#endif
+    if (raEncoder.enabled || decEncoder.enabled) {
+        motion_timer_init(&fusionTimer, fusion_timer_listener, NULL);
+        if (!motion_timer_start_periodic(&fusionTimer, CONFIG_ENCODER_FUSION_PERIOD_MILLIS)) {
+            LOGE(TAG, "fusion timer not started");
+        }
+    }
+}
+
+void axis_freq_changed(axis_position_t* axis, int32_t freq) {
+    portENTER_CRITICAL(&positionMux);
+    uint64_t now = currentTimeMillis();
+    axis->pulses = axis_pulses(axis, now);
+    axis->sync_time = now;
+    axis->freq = freq;
+    portEXIT_CRITICAL(&positionMux);
 }
 
-double ra_pulse_ratio = ((double) SIDEREAL_DAY_MILLIS) / (CONFIG_RA_CYCLE_STEPS * CONFIG_RA_RESOLUTION * CONFIG_RA_GEAR_RATIO);
-double dec_pulse_ratio = ((double) DAY_MILLIS) / (CONFIG_DEC_CYCLE_STEPS * CONFIG_DEC_RESOLUTION * CONFIG_DEC_GEAR_RATIO);
-double ra_time_ratio = ((double) DAY_MILLIS / (double) SIDEREAL_DAY_MILLIS);
+void ra_pulse_freq_changed(int32_t newRaFreq) {
+    axis_freq_changed(&position.ra, newRaFreq);
+}
+
+void dec_pulse_freq_changed(int32_t newDecFreq) {
+    axis_freq_changed(&position.dec, newDecFreq);
+}
+
+/* step estimate plus the encoder correction */
+int64_t get_ra_moved_uas(const mount_position_t* p) {
+    return mul_q32(axis_pulses(&p->ra, p->now), RA_UAS_PER_PULSE) + p->ra.correction;
+}
+
+int64_t get_dec_moved_uas(const mount_position_t* p) {
+    return mul_q32(axis_pulses(&p->dec, p->now), DEC_UAS_PER_PULSE) + p->dec.correction;
+}
+
+/* the sky turned on by the time since the reset, the axis back by what it moved */
+int64_t get_ra_angle_uas(const mount_position_t* p) {
+    int64_t time_offset_millis = p->now - p->reset_time;
+    return p->reset_ra_uas + mul_q32(time_offset_millis, UAS_PER_SIDEREAL_MILLI) - get_ra_moved_uas(p);
+}
 
 int32_t get_ra_angle_millis() {
-    double time_offset_millis = currentTimeMillis() - encoder_reset_time;
-    double ra_moved_millis = (double)(ra_pulse_ratio * get_ra_actual_pulses());
-    return (int32_t)(ra_time_ratio * (reset_ra_angle_millis + time_offset_millis - ra_moved_millis));
+    mount_position_t p;
+    get_position(&p);
+    return uas_to_millis(get_ra_angle_uas(&p));
 }
 
 int32_t get_dec_angle_millis() {
@@ -78,15 +215,61 @@ int32_t get_dec_angle_millis() {
 }
 
 int32_t get_dec_mechnical_angle_millis() {
-    int32_t dec_moved_millis = (int32_t)(dec_pulse_ratio * get_dec_actual_pulses());
-    return reset_dec_angle_millis + dec_moved_millis;
+    mount_position_t p;
+    get_position(&p);
+    return uas_to_millis(p.reset_dec_uas + get_dec_moved_uas(&p));
+}
+
+/* on the motion task, both axes count from the new angles */
+void reset_angles(int64_t ra_uas, int64_t dec_uas) {
+    portENTER_CRITICAL(&positionMux);
+    uint64_t now = currentTimeMillis();
+    position.reset_time = now;
+    position.reset_ra_uas = ra_uas;
+    position.reset_dec_uas = dec_uas;
+    reset_axis(&raEncoder, now);
+    reset_axis(&decEncoder, now);
+    portEXIT_CRITICAL(&positionMux);
 }
 
 void set_angles(int32_t ra_angle_day_millis, int32_t dec_angle_day_millis) {
-    encoder_reset_time = currentTimeMillis();
-    int32_t ra_angle_sidereal_millis = (int32_t)((double)ra_angle_day_millis / ra_time_ratio);
-    reset_ra_angle_millis = ra_angle_sidereal_millis;
-    reset_dec_angle_millis = decMillis2decMecMillis(dec_angle_day_millis);
-    reset_ra_actual_pulses();
-    reset_dec_actual_pulses();
-}
\ No newline at end of file
+    reset_angles((int64_t) ra_angle_day_millis * UAS_PER_MILLI,
+        (int64_t) decMillis2decMecMillis(dec_angle_day_millis) * UAS_PER_MILLI);
+}
+
+// both ways exact to the rounding, with the reduced rational one product stays within 64 bits
+_Static_assert(UAS_PER_CYCLE <= INT64_MAX / SIDEREAL_MILLIS_PER_UAS_NUM, "sidereal millis of an angle overflow");
+_Static_assert(SIDEREAL_DAY_MILLIS <= INT64_MAX / UAS_PER_SIDEREAL_MILLI_NUM, "angle of sidereal millis overflows");
+
+int32_t get_ra_sidereal_millis() {
+    mount_position_t p;
+    get_position(&p);
+    int64_t uas = get_ra_angle_uas(&p) % UAS_PER_CYCLE;
+    if (uas < 0) uas += UAS_PER_CYCLE;
+    int64_t ra = (uas * SIDEREAL_MILLIS_PER_UAS_NUM + SIDEREAL_MILLIS_PER_UAS_DEN / 2) / SIDEREAL_MILLIS_PER_UAS_DEN;
+    return (int32_t)(ra < SIDEREAL_DAY_MILLIS ? ra : ra - SIDEREAL_DAY_MILLIS);
+}
+
+void set_mechanical_angles(int32_t ra_sidereal_millis, int32_t dec_mechanical_millis) {
+    // within a sidereal day, not negative
+    reset_angles(((int64_t) ra_sidereal_millis * UAS_PER_SIDEREAL_MILLI_NUM + UAS_PER_SIDEREAL_MILLI_DEN / 2)
+        / UAS_PER_SIDEREAL_MILLI_DEN, (int64_t) dec_mechanical_millis * UAS_PER_MILLI);
+}
+
+uint8_t get_mount_encoder_flags() {
+    uint8_t flags = 0;
+    portENTER_CRITICAL(&positionMux);
+    if (raEncoder.enabled) flags |= MOUNT_ENCODER_RA;
+    if (decEncoder.enabled) flags |= MOUNT_ENCODER_DEC;
+    if (raEncoder.slipped) flags |= MOUNT_ENCODER_RA_SLIPPED;
+    if (decEncoder.slipped) flags |= MOUNT_ENCODER_DEC_SLIPPED;
+    portEXIT_CRITICAL(&positionMux);
+    return flags;
+}
+
+void get_mount_encoder_slips(uint32_t* ra, uint32_t* dec) {
+    portENTER_CRITICAL(&positionMux);
+    *ra = raEncoder.slips;
+    *dec = decEncoder.slips;
+    portEXIT_CRITICAL(&positionMux);
+}
@@ -1,5 +1,6 @@
 #include "protocol.h"
 #include "lwip/sockets.h"
+#include "string.h"
 
 void set_broadcast_fields(
     broadcast_t *target,
@@ -14,7 +15,12 @@ void set_broadcast_fields(
     uint8_t side_of_pier, // 0: Normal (East); 1: Beyond the pole (West)
     uint32_t focuser_max_steps,
     uint16_t focuser_nanos_per_step,
-    bool focuser_running
+    bool focuser_running,
+    int64_t timestamp,
+    bool clock_synced,
+    int32_t focuser_position,
+    int32_t focuser_target,
+    uint8_t encoder_flags
 ) {
     BROADCAST_IP(target->buffer) = htonl(ip);
     BROADCAST_PORT(target->buffer) = htons(port);
@@ -28,12 +34,289 @@ void set_broadcast_fields(
     BROADCAST_FOCUSER_MAX_STEPS(target->buffer) = htonl(focuser_max_steps);
     BROADCAST_FOCUSER_NANOS_PER_STEP(target->buffer) = htons(focuser_nanos_per_step);
     BROADCAST_FOCUSER_RUNNING(target->buffer) = focuser_running;
+    BROADCAST_TIMESTAMP(target->buffer) = htonll(timestamp);
+    BROADCAST_CLOCK_SYNCED(target->buffer) = clock_synced;
+    BROADCAST_FOCUSER_POSITION(target->buffer) = htonl(focuser_position);
+    BROADCAST_FOCUSER_TARGET(target->buffer) = htonl(focuser_target);
+    BROADCAST_ENCODER_FLAGS(target->buffer) = encoder_flags;
 }
 
 void set_ack_fields(
     ack_t *target,
-    uint32_t cmd_id
+    uint32_t cmd_id,
+    int64_t received_at,
+    int64_t timestamp
 ) {
     ACK_CMD_ID(target->buffer) = htonl(cmd_id);
     ACK_ZERO(target->buffer) = 0;
+    ACK_RECEIVED_AT(target->buffer) = htonll(received_at);
+    ACK_TIMESTAMP(target->buffer) = htonll(timestamp);
+}
+
+void set_schedule_stats_fields(
+    schedule_stats_t *target,
+    uint8_t cmd,
+    uint32_t scheduled,
+    uint32_t executed,
+    uint32_t rejected_late,
+    uint32_t rejected_full,
+    int32_t min_error,
+    int32_t max_error,
+    int32_t mean_error
+) {
+    SCHEDULE_STATS_CMD(target->buffer) = cmd;
+    SCHEDULE_STATS_SCHEDULED(target->buffer) = htonl(scheduled);
+    SCHEDULE_STATS_EXECUTED(target->buffer) = htonl(executed);
+    SCHEDULE_STATS_REJECTED_LATE(target->buffer) = htonl(rejected_late);
+    SCHEDULE_STATS_REJECTED_FULL(target->buffer) = htonl(rejected_full);
+    SCHEDULE_STATS_MIN_ERROR(target->buffer) = htonl(min_error);
+    SCHEDULE_STATS_MAX_ERROR(target->buffer) = htonl(max_error);
+    SCHEDULE_STATS_MEAN_ERROR(target->buffer) = htonl(mean_error);
+}
+
+void set_focuser_position_fields(
+    focuser_position_t *target,
+    uint8_t cmd,
+    int32_t position,
+    int32_t target_position,
+    bool running
+) {
+    FOCUSER_POSITION_CMD(target->buffer) = cmd;
+    FOCUSER_POSITION_POSITION(target->buffer) = htonl(position);
+    FOCUSER_POSITION_TARGET(target->buffer) = htonl(target_position);
+    FOCUSER_POSITION_RUNNING(target->buffer) = running;
+}
+
+void set_autofocus_event_fields(
+    autofocus_event_t *target,
+    uint8_t cmd,
+    uint8_t type,
+    uint16_t index,
+    int32_t position
+) {
+    AUTOFOCUS_EVENT_CMD(target->buffer) = cmd;
+    AUTOFOCUS_EVENT_TYPE(target->buffer) = type;
+    AUTOFOCUS_EVENT_INDEX(target->buffer) = htons(index);
+    AUTOFOCUS_EVENT_POSITION(target->buffer) = htonl(position);
+}
+
+void set_boot_timeline_fields(
+    boot_timeline_t *target,
+    uint8_t cmd,
+    uint8_t count,
+    const int32_t *begin,
+    const int32_t *end
+) {
+    memset(target->buffer, 0, BOOT_TIMELINE_SIZE);
+    if (count > BOOT_TIMELINE_MAX_STAGES) count = BOOT_TIMELINE_MAX_STAGES;
+    BOOT_TIMELINE_CMD(target->buffer) = cmd;
+    BOOT_TIMELINE_COUNT(target->buffer) = count;
+    for (int i = 0; i < count; i++) {
+        BOOT_TIMELINE_BEGIN(target->buffer, i) = htonl(begin[i]);
+        BOOT_TIMELINE_END(target->buffer, i) = htonl(end[i]);
+    }
+}
+
+void set_hand_stats_fields(
+    hand_stats_frame_t *target,
+    uint8_t cmd,
+    uint8_t axis,
+    int32_t rate,
+    uint32_t jogs,
+    uint32_t min_latency,
+    uint32_t max_latency,
+    uint32_t mean_latency
+) {
+    HAND_STATS_CMD(target->buffer) = cmd;
+    HAND_STATS_AXIS(target->buffer) = axis;
+    HAND_STATS_RATE(target->buffer) = htonl(rate);
+    HAND_STATS_JOGS(target->buffer) = htonl(jogs);
+    HAND_STATS_MIN_LATENCY(target->buffer) = htonl(min_latency);
+    HAND_STATS_MAX_LATENCY(target->buffer) = htonl(max_latency);
+    HAND_STATS_MEAN_LATENCY(target->buffer) = htonl(mean_latency);
+}
+
+void set_memory_report_fields(
+    memory_report_frame_t *target,
+    uint8_t cmd,
+    uint32_t free_heap,
+    uint32_t min_free_heap,
+    uint8_t count
+) {
+    memset(target->buffer, 0, MEMORY_REPORT_SIZE);
+    if (count > MEMORY_REPORT_MAX_TASKS) count = MEMORY_REPORT_MAX_TASKS;
+    MEMORY_REPORT_CMD(target->buffer) = cmd;
+    MEMORY_REPORT_FREE_HEAP(target->buffer) = htonl(free_heap);
+    MEMORY_REPORT_MIN_FREE_HEAP(target->buffer) = htonl(min_free_heap);
+    MEMORY_REPORT_COUNT(target->buffer) = count;
+}
+
+void set_memory_report_task(
+    memory_report_frame_t *target,
+    uint8_t index,
+    const char *name,
+    uint16_t stack_size,
+    uint16_t headroom
+) {
+    if (index >= MEMORY_REPORT_MAX_TASKS) return;
+    strncpy(MEMORY_REPORT_NAME(target->buffer, index), name, MEMORY_REPORT_NAME_LENGTH - 1);
+    MEMORY_REPORT_STACK_SIZE(target->buffer, index) = htons(stack_size);
+    MEMORY_REPORT_HEADROOM(target->buffer, index) = htons(headroom);
+}
+
+void set_command_stats_fields(
+    command_stats_frame_t *target,
+    uint8_t cmd,
+    uint32_t datagrams_in,
+    uint32_t datagrams_out,
+    uint32_t send_failures,
+    uint32_t receive_errors,
+    uint32_t untracked,
+    uint8_t count
+) {
+    if (count > COMMAND_STATS_MAX_ENTRIES) count = COMMAND_STATS_MAX_ENTRIES;
+    COMMAND_STATS_CMD(target->buffer) = cmd;
+    COMMAND_STATS_DATAGRAMS_IN(target->buffer) = htonl(datagrams_in);
+    COMMAND_STATS_DATAGRAMS_OUT(target->buffer) = htonl(datagrams_out);
+    COMMAND_STATS_SEND_FAILURES(target->buffer) = htonl(send_failures);
+    COMMAND_STATS_RECEIVE_ERRORS(target->buffer) = htonl(receive_errors);
+    COMMAND_STATS_UNTRACKED(target->buffer) = htonl(untracked);
+    COMMAND_STATS_COUNT(target->buffer) = count;
+}
+
+void set_command_stats_entry(
+    command_stats_frame_t *target,
+    uint8_t index,
+    uint8_t cmd,
+    uint32_t received,
+    uint32_t rejected,
+    uint32_t effect_p50,
+    uint32_t effect_p99,
+    uint32_t effect_max,
+    uint32_t ack_p50,
+    uint32_t ack_p99,
+    uint32_t ack_max
+) {
+    if (index >= COMMAND_STATS_MAX_ENTRIES) return;
+    COMMAND_STATS_ENTRY_CMD(target->buffer, index) = cmd;
+    COMMAND_STATS_ENTRY_RECEIVED(target->buffer, index) = htonl(received);
+    COMMAND_STATS_ENTRY_REJECTED(target->buffer, index) = htonl(rejected);
+    COMMAND_STATS_ENTRY_EFFECT_P50(target->buffer, index) = htonl(effect_p50);
+    COMMAND_STATS_ENTRY_EFFECT_P99(target->buffer, index) = htonl(effect_p99);
+    COMMAND_STATS_ENTRY_EFFECT_MAX(target->buffer, index) = htonl(effect_max);
+    COMMAND_STATS_ENTRY_ACK_P50(target->buffer, index) = htonl(ack_p50);
+    COMMAND_STATS_ENTRY_ACK_P99(target->buffer, index) = htonl(ack_p99);
+    COMMAND_STATS_ENTRY_ACK_MAX(target->buffer, index) = htonl(ack_max);
+}
+
+void set_trace_fields(
+    trace_frame_t *target,
+    uint8_t cmd,
+    uint32_t head,
+    uint32_t first,
+    uint32_t capacity,
+    uint8_t task_count,
+    uint8_t count
+) {
+    memset(target->buffer, 0, TRACE_FRAME_SIZE(0));
+    if (task_count > TRACE_FRAME_MAX_TASKS) task_count = TRACE_FRAME_MAX_TASKS;
+    if (count > TRACE_FRAME_MAX_EVENTS) count = TRACE_FRAME_MAX_EVENTS;
+    TRACE_FRAME_CMD(target->buffer) = cmd;
+    TRACE_FRAME_HEAD(target->buffer) = htonl(head);
+    TRACE_FRAME_FIRST(target->buffer) = htonl(first);
+    TRACE_FRAME_CAPACITY(target->buffer) = htonl(capacity);
+    TRACE_FRAME_TASK_COUNT(target->buffer) = task_count;
+    TRACE_FRAME_COUNT(target->buffer) = count;
+}
+
+void set_trace_task(
+    trace_frame_t *target,
+    uint8_t index,
+    const char *name
+) {
+    if (index >= TRACE_FRAME_MAX_TASKS) return;
+    strncpy(TRACE_FRAME_TASK_NAME(target->buffer, index), name, TRACE_FRAME_NAME_LENGTH - 1);
+}
+
+void set_trace_event(
+    trace_frame_t *target,
+    uint8_t index,
+    uint32_t time,
+    uint16_t arg,
+    uint8_t event,
+    uint8_t task
+) {
+    if (index >= TRACE_FRAME_MAX_EVENTS) return;
+    TRACE_FRAME_EVENT_TIME(target->buffer, index) = htonl(time);
+    TRACE_FRAME_EVENT_ARG(target->buffer, index) = htons(arg);
+    TRACE_FRAME_EVENT_ID(target->buffer, index) = event;
+    TRACE_FRAME_EVENT_TASK(target->buffer, index) = task;
+}
+
+void set_cpu_monitor_fields(
+    cpu_monitor_frame_t *target,
+    uint8_t cmd,
+    uint32_t window,
+    uint16_t cpu_mhz,
+    uint8_t task_count
+) {
+    memset(target->buffer, 0, CPU_MONITOR_SIZE(0));
+    if (task_count > CPU_MONITOR_MAX_ENTRIES) task_count = CPU_MONITOR_MAX_ENTRIES;
+    CPU_MONITOR_CMD(target->buffer) = cmd;
+    CPU_MONITOR_WINDOW(target->buffer) = htonl(window);
+    CPU_MONITOR_CPU_MHZ(target->buffer) = htons(cpu_mhz);
+    CPU_MONITOR_TASK_COUNT(target->buffer) = task_count;
+}
+
+void set_cpu_monitor_core(
+    cpu_monitor_frame_t *target,
+    uint8_t index,
+    uint16_t load,
+    uint16_t peak
+) {
+    if (index >= 2) return;
+    CPU_MONITOR_CORE_LOAD(target->buffer, index) = htons(load);
+    CPU_MONITOR_CORE_PEAK(target->buffer, index) = htons(peak);
+}
+
+void set_cpu_monitor_timer(
+    cpu_monitor_frame_t *target,
+    uint8_t index,
+    uint32_t samples,
+    int32_t min,
+    int32_t avg,
+    int32_t max
+) {
+    if (index > CPU_MONITOR_TIMER_SLEW) return;
+    CPU_MONITOR_TIMER_SAMPLES(target->buffer, index) = htonl(samples);
+    CPU_MONITOR_TIMER_MIN(target->buffer, index) = htonl(min);
+    CPU_MONITOR_TIMER_AVG(target->buffer, index) = htonl(avg);
+    CPU_MONITOR_TIMER_MAX(target->buffer, index) = htonl(max);
+}
+
+void set_cpu_monitor_task(
+    cpu_monitor_frame_t *target,
+    uint8_t index,
+    const char *name,
+    uint8_t core,
+    uint8_t priority,
+    uint16_t load,
+    uint16_t peak
+) {
+    if (index >= CPU_MONITOR_MAX_ENTRIES) return;
+    strncpy(CPU_MONITOR_TASK_NAME(target->buffer, index), name, CPU_MONITOR_FRAME_NAME_LENGTH - 1);
+    CPU_MONITOR_TASK_NAME(target->buffer, index)[CPU_MONITOR_FRAME_NAME_LENGTH - 1] = 0;
+    CPU_MONITOR_TASK_CORE(target->buffer, index) = core;
+    CPU_MONITOR_TASK_PRIORITY(target->buffer, index) = priority;
+    CPU_MONITOR_TASK_LOAD(target->buffer, index) = htons(load);
+    CPU_MONITOR_TASK_PEAK(target->buffer, index) = htons(peak);
+}
+
+uint64_t htonll(uint64_t value) {
+    if (htonl(1) == 1) return value;
+    return ((uint64_t)htonl(value & 0xffffffff) << 32) | htonl(value >> 32);
+}
+
+uint64_t ntohll(uint64_t value) {
+    return htonll(value);
 }
\ No newline at end of file
@@ -1,50 +1,160 @@
 #include "rencoder.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "string.h"
+#include "soc/gpio_reg.h"
+#include "xtensa/core-macros.h"
+#include "esp_timer.h"
+#include "memory_budget.h"
+#include "sdkconfig.h"
+
+#define CYCLES_PER_SECOND (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000.0f)
+
+#define ILLEGAL 2
+
+/*
+ * Steps by (previous A B << 2) | current A B. B leading A counts up:
+ * 00 -> 01 -> 11 -> 10 -> 00. Both pins changing at once is illegal, the
+ * step is lost and the state resynchronizes.
+ */
+static const int8_t transitions[16] = {
+    0, 1, -1, ILLEGAL,
+    -1, 0, ILLEGAL, 1,
+    1, ILLEGAL, 0, -1,
+    ILLEGAL, -1, 1, 0
+};
+
+typedef struct rencoder_edge {
+    rencoder_t *encoder;
+    uint32_t cycles;
+    uint8_t ab;
+} rencoder_edge_t;
 
 static rencoder_t *gpio2enc[48];
-static xQueueHandle gpio_evt_queue = NULL;
+/* single producer (the gpio isr) and single consumer (the worker) */
+static rencoder_edge_t ring[RENCODER_RING_SIZE];
+static uint32_t ringHead = 0, ringTail = 0;
+static uint32_t ringOverflows = 0;
+static SemaphoreHandle_t ringReady = NULL;
+static StaticSemaphore_t ringReadyBuffer;
+STATIC_TASK(rencoder, 2048);
 
 void interrupt(rencoder_t* self, gpio_num_t gpio);
 
 static void IRAM_ATTR gpio_isr_handler(void* arg) {
-    gpio_num_t gpio_num = (gpio_num_t)(int) arg;
+    gpio_num_t gpio_num = (gpio_num_t)(intptr_t) arg;
     if(gpio2enc[gpio_num] != NULL)
         interrupt(gpio2enc[gpio_num], gpio_num);
 }
 
+static void rencoder_task(void* p) {
+    while (1) {
+        xSemaphoreTake(ringReady, portMAX_DELAY);
+        rencoder_process();
+    }
+}
+
+/* shared by every user of the isr service, only the first call installs it */
 esp_err_t rencoder_init() {
+    static bool initialized = false;
+    if (initialized) {
+        return ESP_OK;
+    }
     bzero(gpio2enc, sizeof(gpio2enc));
-    gpio_evt_queue = xQueueCreate(16, sizeof(uint32_t));
-    return gpio_install_isr_service(0);
+    ringReady = xSemaphoreCreateBinaryStatic(&ringReadyBuffer);
+    if (!ringReady || !STATIC_TASK_CREATE(rencoder, rencoder_task, "rencoder", NULL, 10)) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = gpio_install_isr_service(0);
+    initialized = err == ESP_OK;
+    return err;
 }
 
-void interrupt(rencoder_t* self, gpio_num_t gpio) {
-    if(self->working) {
-        if (gpio == self->a && gpio_get_level(self->a)) {
-            bool dir = gpio_get_level(self->b);
-            if (self->reverse) {
-                dir = !dir;
-            }
-            if (dir != self->direction && self->direction_callback != NULL) {
-                self->direction_callback(self, dir, self->direction_callback_args);
-            }
-            self->direction = dir;
+/* both pins with one register read when they are in the same bank */
+static inline uint8_t IRAM_ATTR read_state(rencoder_t* self) {
+    uint32_t low = (self->a < 32 || self->b < 32) ? REG_READ(GPIO_IN_REG) : 0;
+    uint32_t high = (self->a >= 32 || self->b >= 32) ? REG_READ(GPIO_IN1_REG) : 0;
+    uint8_t a = ((self->a < 32 ? low : high) >> (self->a & 31)) & 1;
+    uint8_t b = ((self->b < 32 ? low : high) >> (self->b & 31)) & 1;
+    return (a << 1) | b;
+}
+
+bool IRAM_ATTR rencoder_capture(rencoder_t* self, uint8_t ab, uint32_t cycles) {
+    uint32_t head = ringHead;
+    if (head - __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE) >= RENCODER_RING_SIZE) {
+        ringOverflows++;
+        return false;
+    }
+    rencoder_edge_t* edge = &ring[head & (RENCODER_RING_SIZE - 1)];
+    edge->encoder = self;
+    edge->cycles = cycles;
+    edge->ab = ab;
+    __atomic_store_n(&ringHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+int rencoder_process() {
+    int count = 0;
+    uint32_t tail = ringTail;
+    uint32_t head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        rencoder_edge_t edge = ring[tail & (RENCODER_RING_SIZE - 1)];
+        __atomic_store_n(&ringTail, ++tail, __ATOMIC_RELEASE);
+        if (edge.encoder->working) {
+            rencoder_feed(edge.encoder, edge.ab, edge.cycles);
         }
-        int32_t next;
-        int8_t diff;
-        if(self->direction) {
-            next = self->count + 1;
-            diff = 1;
-        } else {
-            next = self->count - 1;
-            diff = -1;
+        count++;
+        if (tail == head) {
+            head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
         }
-        if (self->count_callback != NULL) {
-            self->count_callback(self, next, diff, self->count_callback_args);
+    }
+    return count;
+}
+
+void rencoder_feed(rencoder_t* self, uint8_t ab, uint32_t cycles) {
+    int8_t diff = transitions[(self->state << 2) | ab];
+    self->state = ab;
+    if (diff == 0) {
+        return;
+    }
+    if (diff == ILLEGAL) {
+        self->illegal++;
+        return;
+    }
+    if (self->reverse) {
+        diff = -diff;
+    }
+    bool dir = diff > 0;
+    if (dir != self->direction) {
+        self->steps_seen = 0;
+        if (self->direction_callback != NULL) {
+            self->direction_callback(self, dir, self->direction_callback_args);
+        }
+    }
+    self->direction = dir;
+    self->step_cycles[self->step_index] = cycles;
+    self->step_index = (self->step_index + 1) % RENCODER_VELOCITY_STEPS;
+    if (self->steps_seen < RENCODER_VELOCITY_STEPS) {
+        self->steps_seen++;
+    }
+    self->last_step_micros = esp_timer_get_time();
+    int32_t next = self->count + diff;
+    if (self->count_callback != NULL) {
+        self->count_callback(self, next, diff, self->count_callback_args);
+    }
+    self->count = next;
+}
+
+/* constant time: two register reads and a ring slot */
+void IRAM_ATTR interrupt(rencoder_t* self, gpio_num_t gpio) {
+    if(self->working) {
+        rencoder_capture(self, read_state(self), XTHAL_GET_CCOUNT());
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(ringReady, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
         }
-        self->count = next;
     }
 }
 
@@ -58,21 +168,26 @@ esp_err_t rencoder_start(rencoder_t *self, gpio_num_t a, gpio_num_t b, count_cal
     gpio2enc[a] = self;
     gpio2enc[b] = self;
     self -> count = 0;
-    self -> working = true;
+    self -> illegal = 0;
+    self -> step_index = 0;
+    self -> steps_seen = 0;
+    self -> last_step_micros = 0;
     gpio_config_t conf;
     conf.intr_type = GPIO_INTR_ANYEDGE;
     conf.mode = GPIO_MODE_INPUT;
-    conf.pin_bit_mask = (1 << a) | (1 << b);
+    conf.pin_bit_mask = (1ULL << a) | (1ULL << b);
     conf.pull_up_en = GPIO_PULLUP_ENABLE;
     conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
     gpio_config(&conf);
-    
+    self -> state = read_state(self);
+    self -> working = true;
+
     esp_err_t err;
-    err = gpio_isr_handler_add(a, gpio_isr_handler, (void*)a);
+    err = gpio_isr_handler_add(a, gpio_isr_handler, (void*)(intptr_t) a);
     if (err != ESP_OK) {
         return err;
     }
-    return gpio_isr_handler_add(b, gpio_isr_handler, (void*)b);
+    return gpio_isr_handler_add(b, gpio_isr_handler, (void*)(intptr_t) b);
 }
 
 esp_err_t rencoder_stop(rencoder_t *self) {
@@ -103,4 +218,45 @@ bool rencoder_getdirection(rencoder_t *self) {
 
 int32_t rencoder_value(rencoder_t *self) {
     return self -> count;
+}
+
+uint32_t rencoder_illegal_transitions(rencoder_t *self) {
+    return self -> illegal;
+}
+
+/* 1/T over the last steps in the current direction, bounded by the time since the last one */
+float rencoder_velocity_at(rencoder_t *self, uint32_t now_cycles) {
+    uint8_t seen = self -> steps_seen;
+    if (seen < 2) {
+        return 0;
+    }
+    uint8_t latest = (self -> step_index + RENCODER_VELOCITY_STEPS - 1) % RENCODER_VELOCITY_STEPS;
+    uint8_t oldest = (self -> step_index + RENCODER_VELOCITY_STEPS - seen) % RENCODER_VELOCITY_STEPS;
+    uint32_t span = self -> step_cycles[latest] - self -> step_cycles[oldest];
+    uint32_t since = now_cycles - self -> step_cycles[latest];
+    if (span == 0) {
+        return 0;
+    }
+    float velocity = (seen - 1) * CYCLES_PER_SECOND / span;
+    if (since > span / (seen - 1)) {
+        float bound = CYCLES_PER_SECOND / since;
+        if (bound < velocity) velocity = bound;
+    }
+    return self -> direction ? velocity : -velocity;
+}
+
+float rencoder_velocity(rencoder_t *self) {
+    if (esp_timer_get_time() - self -> last_step_micros > RENCODER_STOP_MICROS) {
+        return 0;
+    }
+    return rencoder_velocity_at(self, XTHAL_GET_CCOUNT());
+}
+
+uint32_t rencoder_overflows() {
+    return ringOverflows;
+}
+
+uint32_t rencoder_cycles_since_step(rencoder_t *self) {
+    uint8_t latest = (self -> step_index + RENCODER_VELOCITY_STEPS - 1) % RENCODER_VELOCITY_STEPS;
+    return XTHAL_GET_CCOUNT() - self -> step_cycles[latest];
 }
\ No newline at end of file
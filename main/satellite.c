@@ -0,0 +1,182 @@
+#include "esp_timer.h"
+#include "satellite.h"
+#include "motion_loop.h"
+#include "mount.h"
+#include "mount_encoder.h"
+#include "motion_math.h"
+#include "math.h"
+#include "util.h"
+#include "astro.h"
+#include "telescope.h"
+
+#define TAG "SATELLITE"
+
+#define UPDATE_INTERVAL_MILLIS (CONFIG_SATELLITE_UPDATE_INTERVAL_MILLIS)
+#define MIN_ELEVATION ((float)(CONFIG_SATELLITE_MIN_ELEVATION_DEGREES) * (float)M_PI / 180.0f)
+
+/* WGS-72 ellipsoid, matching the constants the element sets are fitted with */
+#define EARTH_RADIUS_KM 6378.135
+#define EARTH_FLATTENING (1.0 / 298.26)
+#define EARTH_ROTATION_RADIANS_PER_MINUTE (7.29211514670698e-5 * 60.0)
+#define TWO_PI 6.283185307179586
+
+/* what a pass is computed from, the motion task tracks with its own copy */
+typedef struct satellite_pass {
+    sgp4_t satellite;
+    double gmstAtEpoch;
+    int64_t unixOffsetMicros;
+    float observerLongitude;
+    float observerSinLat, observerCosLat;
+    float observerXY, observerZ;
+} satellite_pass_t;
+
+slew_set_motor_speed_callback satellite_motor_callback;
+motion_timer_t satelliteTimer;
+// set by the caller right away, so the next command sees it
+bool trackingSatellite = false;
+bool satelliteHolding = false;
+satellite_pass_t satellitePass;
+// handed from satellite_track to the motion task under satelliteMux
+satellite_pass_t pendingPass;
+portMUX_TYPE satelliteMux = portMUX_INITIALIZER_UNLOCKED;
+float satelliteElevation;
+
+static int satellite_position(const satellite_pass_t* pass, int64_t unixMicros, int32_t *raMillis, int32_t *decMillis, float *elevation) {
+    double tsince = (double)(unixMicros - pass->satellite.epoch_unix_millis * 1000) / 60000000.0;
+    float r[3];
+    int err = sgp4_propagate(&pass->satellite, tsince, r, NULL);
+    if (err != SGP4_OK) {
+        return err;
+    }
+    double lst = fmod(pass->gmstAtEpoch + EARTH_ROTATION_RADIANS_PER_MINUTE * tsince + pass->observerLongitude, TWO_PI);
+    float c = cosf((float) lst);
+    float s = sinf((float) lst);
+    float rho0 = r[0] - pass->observerXY * c;
+    float rho1 = r[1] - pass->observerXY * s;
+    float rho2 = r[2] - pass->observerZ;
+    float range = sqrtf(rho0 * rho0 + rho1 * rho1 + rho2 * rho2);
+    float up = (rho0 * pass->observerCosLat * c + rho1 * pass->observerCosLat * s + rho2 * pass->observerSinLat) / range;
+    float ra = atan2f(rho1, rho0);
+    if (ra < 0) {
+        ra += (float) TWO_PI;
+    }
+    *elevation = asinf(up);
+    *raMillis = (int32_t)(ra * (float)(DAY_MILLIS / TWO_PI));
+    *decMillis = (int32_t)(asinf(rho2 / range) * (float)(DAY_MILLIS / TWO_PI));
+    return SGP4_OK;
+}
+
+/* on the motion task */
+void satellite_stop_motion(const void* _) {
+    motion_timer_stop(&satelliteTimer);
+    satellite_motor_callback(0, 0);
+}
+
+/* on the motion task, it owns the position the speeds are worked out from */
+void satellite_timer_callback(void* _) {
+    if (!trackingSatellite) {
+        // aborted, also when the stop could not be posted
+        satellite_stop_motion(NULL);
+        return;
+    }
+    /* aim where the satellite will be when the next update lands */
+    int64_t targetMicros = esp_timer_get_time() + satellitePass.unixOffsetMicros + UPDATE_INTERVAL_MILLIS * 1000;
+    int32_t raTarget, decTarget;
+    int err = satellite_position(&satellitePass, targetMicros, &raTarget, &decTarget, &satelliteElevation);
+    if (err != SGP4_OK) {
+        LOGE(TAG, "Propagation failed: %d", err);
+        trackingSatellite = false;
+        satellite_stop_motion(NULL);
+        return;
+    }
+    if (satelliteElevation < MIN_ELEVATION) {
+        if (!satelliteHolding) {
+            LOGI(TAG, "Below horizon, hold");
+            satelliteHolding = true;
+            satellite_motor_callback(0, 0);
+        }
+        return;
+    }
+    satelliteHolding = false;
+    int32_t raDiff = getRaDiff(raTarget, get_ra_angle_millis());
+    int32_t decDiff = decMillis2decMecMillis(decTarget) - get_dec_mechnical_angle_millis();
+    // cover the difference by the next update, R.A. in sidereal cycles
+    int64_t raSpeed = (int64_t) raDiff * SIDEREAL_DAY_MILLIS / (DAY_MILLIS / SPEED_PER_CYCLE) / UPDATE_INTERVAL_MILLIS;
+    int64_t decSpeed = (int64_t) decDiff * SPEED_PER_CYCLE / UPDATE_INTERVAL_MILLIS;
+    if (raSpeed > RA_SPEED_MAX) raSpeed = RA_SPEED_MAX;
+    if (raSpeed < -RA_SPEED_MAX) raSpeed = -RA_SPEED_MAX;
+    if (decSpeed > DEC_SPEED_MAX) decSpeed = DEC_SPEED_MAX;
+    if (decSpeed < -DEC_SPEED_MAX) decSpeed = -DEC_SPEED_MAX;
+    satellite_motor_callback(raSpeed, decSpeed);
+}
+
+esp_err_t init_satellite(slew_set_motor_speed_callback callback) {
+    satellite_motor_callback = callback;
+    motion_timer_init(&satelliteTimer, satellite_timer_callback, NULL);
+    return ESP_OK;
+}
+
+/* on the motion task, takes over the pass satellite_track prepared */
+void satellite_start_motion(const void* _) {
+    portENTER_CRITICAL(&satelliteMux);
+    satellitePass = pendingPass;
+    portEXIT_CRITICAL(&satelliteMux);
+    satelliteHolding = false;
+    satellite_timer_callback(NULL);
+    if (trackingSatellite) {
+        motion_timer_start_periodic(&satelliteTimer, UPDATE_INTERVAL_MILLIS);
+    }
+}
+
+esp_err_t satellite_track(const sgp4_tle_t *tle, double latitude, double longitude, double altitude, int64_t now_unix_millis) {
+    satellite_pass_t pass;
+    int err = sgp4_init(&pass.satellite, tle);
+    if (err != SGP4_OK) {
+        LOGE(TAG, "Unsupported elements: %d", err);
+        return ESP_ERR_INVALID_ARG;
+    }
+    pass.unixOffsetMicros = now_unix_millis * 1000 - esp_timer_get_time();
+    pass.gmstAtEpoch = sgp4_gmst(tle->epoch_unix_millis);
+
+    double e2 = EARTH_FLATTENING * (2.0 - EARTH_FLATTENING);
+    double sinLat = sin(latitude);
+    double c = 1.0 / sqrt(1.0 - e2 * sinLat * sinLat);
+    double altitudeKm = altitude / 1000.0;
+    pass.observerLongitude = longitude;
+    pass.observerSinLat = sinLat;
+    pass.observerCosLat = cos(latitude);
+    pass.observerXY = (EARTH_RADIUS_KM * c + altitudeKm) * cos(latitude);
+    pass.observerZ = (EARTH_RADIUS_KM * c * (1.0 - e2) + altitudeKm) * sinLat;
+
+    // elements that do not propagate now are refused here, not on the first update
+    int32_t ra, dec;
+    float elevation;
+    err = satellite_position(&pass, esp_timer_get_time() + pass.unixOffsetMicros, &ra, &dec, &elevation);
+    if (err != SGP4_OK) {
+        LOGE(TAG, "Propagation failed: %d", err);
+        return ESP_FAIL;
+    }
+    portENTER_CRITICAL(&satelliteMux);
+    pendingPass = pass;
+    portEXIT_CRITICAL(&satelliteMux);
+    trackingSatellite = true;
+    if (!motion_post(satellite_start_motion, NULL, 0)) {
+        trackingSatellite = false;
+        return ESP_FAIL;
+    }
+    LOGI(TAG, "Track satellite, elements age %lld min", (now_unix_millis - tle->epoch_unix_millis) / 60000);
+    return ESP_OK;
+}
+
+bool is_tracking_satellite() {
+    return trackingSatellite;
+}
+
+void abort_satellite() {
+    trackingSatellite = false;
+    motion_post(satellite_stop_motion, NULL, 0);
+}
+
+int32_t get_satellite_elevation_millis() {
+    return (int32_t)(satelliteElevation * (float)(DAY_MILLIS / TWO_PI));
+}
@@ -0,0 +1,142 @@
+#include "scheduler.h"
+#include "esp_timer.h"
+#include "event_loop.h"
+#include "util.h"
+
+#define TAG "SCHEDULER"
+
+#define LATE_TOLERANCE_MICROS 1000
+#define MAX_AHEAD_MICROS 60000000
+// a due command waits this long for room in the event queue
+#define RETRY_MICROS 1000
+
+typedef struct {
+    int64_t at;
+    char buf[SCHEDULER_MAX_COMMAND];
+    unsigned int len;
+    int fromSocket;
+    struct sockaddr_in from;
+    socklen_t fromlen;
+} scheduled_command_t;
+
+scheduler_execute_f scheduler_execute;
+esp_timer_handle_t schedulerTimer;
+portMUX_TYPE schedulerMux = portMUX_INITIALIZER_UNLOCKED;
+
+/* sorted by execution time, earliest first */
+scheduled_command_t scheduledCommands[SCHEDULER_CAPACITY];
+int scheduledCount = 0;
+scheduler_stats_t schedulerStats;
+
+/*
+ * Event loop only, so two re-arms can't reorder. The deadline is read under
+ * schedulerMux, the esp_timer calls are not allowed inside it.
+ */
+static void arm_timer() {
+    portENTER_CRITICAL(&schedulerMux);
+    bool pending = scheduledCount > 0;
+    int64_t at = pending ? scheduledCommands[0].at : 0;
+    portEXIT_CRITICAL(&schedulerMux);
+    esp_timer_stop(schedulerTimer);
+    if (pending) {
+        int64_t wait = at - esp_timer_get_time();
+        esp_timer_start_once(schedulerTimer, wait > 0 ? wait : 0);
+    }
+}
+
+/* on the event loop, like every other command */
+void scheduler_run_due(const void* _) {
+    scheduled_command_t command;
+    while (1) {
+        portENTER_CRITICAL(&schedulerMux);
+        int64_t now = esp_timer_get_time();
+        if (scheduledCount == 0 || scheduledCommands[0].at > now) {
+            portEXIT_CRITICAL(&schedulerMux);
+            break;
+        }
+        command = scheduledCommands[0];
+        scheduledCount--;
+        memmove(&scheduledCommands[0], &scheduledCommands[1], scheduledCount * sizeof(scheduled_command_t));
+        int32_t error = (int32_t)(now - command.at);
+        if (error > LATE_TOLERANCE_MICROS) {
+            // the event loop was held up past the deadline, as late as one refused when added
+            schedulerStats.rejected_late++;
+            portEXIT_CRITICAL(&schedulerMux);
+            LOGI(TAG, "Drop command %d, %d us late", command.buf[0], error);
+            continue;
+        }
+        if (schedulerStats.executed == 0 || error < schedulerStats.min_error_micros) schedulerStats.min_error_micros = error;
+        if (schedulerStats.executed == 0 || error > schedulerStats.max_error_micros) schedulerStats.max_error_micros = error;
+        schedulerStats.total_error_micros += error;
+        schedulerStats.executed++;
+        portEXIT_CRITICAL(&schedulerMux);
+
+        scheduler_execute(command.buf, command.len, command.fromSocket, &command.from, command.fromlen);
+    }
+    arm_timer();
+}
+
+/* esp_timer keeps the microsecond deadline, the commands run on the event loop */
+void scheduler_timer_callback(void* _) {
+    if (!event_loop_post(scheduler_run_due, NULL, 0)) {
+        esp_timer_start_once(schedulerTimer, RETRY_MICROS);
+    }
+}
+
+esp_err_t init_scheduler(scheduler_execute_f execute) {
+    scheduler_execute = execute;
+    bzero(&schedulerStats, sizeof(schedulerStats));
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = scheduler_timer_callback
+    };
+    return esp_timer_create(&args, &schedulerTimer);
+}
+
+esp_err_t scheduler_add(int64_t at, char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
+    if (len == 0 || len > SCHEDULER_MAX_COMMAND || fromlen > sizeof(struct sockaddr_in)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int64_t now = esp_timer_get_time();
+    if (at < now - LATE_TOLERANCE_MICROS) {
+        portENTER_CRITICAL(&schedulerMux);
+        schedulerStats.rejected_late++;
+        portEXIT_CRITICAL(&schedulerMux);
+        LOGI(TAG, "Reject command %d, %lld us late", *buf, now - at);
+        return ESP_ERR_TIMEOUT;
+    }
+    if (at > now + MAX_AHEAD_MICROS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&schedulerMux);
+    if (scheduledCount == SCHEDULER_CAPACITY) {
+        schedulerStats.rejected_full++;
+        portEXIT_CRITICAL(&schedulerMux);
+        return ESP_ERR_NO_MEM;
+    }
+    int i = scheduledCount;
+    while (i > 0 && scheduledCommands[i - 1].at > at) {
+        scheduledCommands[i] = scheduledCommands[i - 1];
+        i--;
+    }
+    scheduled_command_t* command = &scheduledCommands[i];
+    command->at = at;
+    memcpy(command->buf, buf, len);
+    command->len = len;
+    command->fromSocket = fromSocket;
+    memcpy(&command->from, from, fromlen);
+    command->fromlen = fromlen;
+    scheduledCount++;
+    schedulerStats.scheduled++;
+    portEXIT_CRITICAL(&schedulerMux);
+    if (i == 0) {
+        arm_timer();
+    }
+    return ESP_OK;
+}
+
+void scheduler_get_stats(scheduler_stats_t* target) {
+    portENTER_CRITICAL(&schedulerMux);
+    *target = schedulerStats;
+    portEXIT_CRITICAL(&schedulerMux);
+}
@@ -0,0 +1,226 @@
+#include "settings.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_timer.h"
+#include "util.h"
+#include "astro.h"
+#include "mount.h"
+#include "string.h"
+#include "memory_budget.h"
+
+#define TAG "SETTINGS"
+
+#define NAMESPACE "storage"
+#define BLOB_KEY "settings"
+#define LEGACY_TIME_RATIO_KEY "time_ratio"
+
+#define QUIET_MILLIS (CONFIG_SETTINGS_QUIET_MILLIS)
+#define MAX_DELAY_MICROS ((int64_t)(CONFIG_SETTINGS_MAX_DELAY_MILLIS) * 1000)
+
+typedef struct setting {
+    const char* name;
+    int32_t default_value;
+    int32_t min;
+    int32_t max;
+} setting_t;
+
+const setting_t settingsSchema[SETTINGS_COUNT] = {
+    [SETTING_TIME_RATIO] = { "time_ratio", 1000000, 1, INT32_MAX },
+    [SETTING_RA_GUIDE_SPEED] = { "ra_guide_speed", 7500, -RA_SPEED_MAX, RA_SPEED_MAX },
+    [SETTING_DEC_GUIDE_SPEED] = { "dec_guide_speed", 7500, -DEC_SPEED_MAX, DEC_SPEED_MAX },
+    [SETTING_SIDE_OF_PIER] = { "side_of_pier", 0, 0, 1 },
+    [SETTING_FOCUSER_POSITION] = { "focuser_position", 0, INT32_MIN, INT32_MAX },
+    [SETTING_SYNCED] = { "synced", 0, 0, 1 },
+    [SETTING_SYNCED_RA] = { "synced_ra", 0, 0, DAY_MILLIS - 1 },
+    [SETTING_SYNCED_DEC] = { "synced_dec", 0, -DAY_MILLIS / 4, DAY_MILLIS / 4 },
+    [SETTING_CHECKPOINT_VALID] = { "checkpoint_valid", 0, 0, 1 },
+    [SETTING_CHECKPOINT_RA_OFFSET] = { "checkpoint_ra_offset", 0, 0, SIDEREAL_DAY_MILLIS - 1 },
+    [SETTING_CHECKPOINT_DEC] = { "checkpoint_dec", 0, -DAY_MILLIS, DAY_MILLIS },
+    [SETTING_CHECKPOINT_SAVED_AT] = { "checkpoint_saved_at", 0, 0, INT32_MAX },
+};
+
+typedef struct settings_blob {
+    uint16_t version;
+    uint16_t count;
+    int32_t values[SETTINGS_COUNT];
+} settings_blob_t;
+
+portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+int32_t settingsValues[SETTINGS_COUNT];
+// what flash holds, a commit is skipped when nothing differs from it
+int32_t settingsCommitted[SETTINGS_COUNT];
+bool settingsStored = false;
+uint32_t settingsDirty = 0;
+int64_t settingsDirtySince = 0;
+settings_stats_t settingsStats;
+SemaphoreHandle_t settingsChanged;
+SemaphoreHandle_t settingsCommitLock;
+StaticSemaphore_t settingsChangedBuffer, settingsCommitLockBuffer;
+STATIC_TASK(settings, 3072);
+
+_Static_assert(SETTINGS_COUNT <= 32, "dirty flags fit in 32 bits");
+
+int32_t settings_validate(setting_key_t key, int32_t value) {
+    const setting_t* s = &settingsSchema[key];
+    if (value < s->min || value > s->max) {
+        LOGE(TAG, "%s out of range: %d, using %d", s->name, value, s->default_value);
+        return s->default_value;
+    }
+    return value;
+}
+
+void settings_load() {
+    for (int i = 0; i < SETTINGS_COUNT; i++) {
+        settingsValues[i] = settingsSchema[i].default_value;
+    }
+    nvs_handle handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        LOGI(TAG, "No settings stored: %d", err);
+        return;
+    }
+    settings_blob_t blob;
+    size_t length = sizeof(blob);
+    err = nvs_get_blob(handle, BLOB_KEY, &blob, &length);
+    if (err == ESP_OK && length >= 4 && blob.version <= SETTINGS_VERSION) {
+        int count = blob.count;
+        if (count > SETTINGS_COUNT) count = SETTINGS_COUNT;
+        if (length < 4 + count * sizeof(int32_t)) count = (length - 4) / sizeof(int32_t);
+        for (int i = 0; i < count; i++) {
+            settingsValues[i] = settings_validate(i, blob.values[i]);
+        }
+        settingsStored = true;
+        LOGI(TAG, "Loaded %d settings, version %d", count, blob.version);
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // stored by firmware before the settings blob
+        int32_t timeRatio;
+        if (nvs_get_i32(handle, LEGACY_TIME_RATIO_KEY, &timeRatio) == ESP_OK) {
+            settingsValues[SETTING_TIME_RATIO] = settings_validate(SETTING_TIME_RATIO, timeRatio);
+            settingsDirty |= 1 << SETTING_TIME_RATIO;
+        }
+        LOGI(TAG, "Settings not set");
+    } else {
+        LOGE(TAG, "Settings read error: %d, version %d", err, err == ESP_OK ? blob.version : -1);
+    }
+    nvs_close(handle);
+}
+
+esp_err_t settings_commit() {
+    settings_blob_t blob;
+    xSemaphoreTake(settingsCommitLock, portMAX_DELAY);
+    portENTER_CRITICAL(&settingsMux);
+    bool changed = memcmp(settingsValues, settingsCommitted, sizeof(settingsValues)) != 0 || (!settingsStored && settingsDirty);
+    uint32_t dirty = settingsDirty;
+    int64_t dirtySince = settingsDirtySince;
+    memcpy(blob.values, settingsValues, sizeof(blob.values));
+    settingsDirty = 0;
+    portEXIT_CRITICAL(&settingsMux);
+    if (!changed) {
+        xSemaphoreGive(settingsCommitLock);
+        return ESP_OK;
+    }
+    blob.version = SETTINGS_VERSION;
+    blob.count = SETTINGS_COUNT;
+    nvs_handle handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, BLOB_KEY, &blob, sizeof(blob));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err == ESP_OK) {
+        memcpy(settingsCommitted, blob.values, sizeof(settingsCommitted));
+        settingsStored = true;
+        settingsStats.commits++;
+        LOGI(TAG, "Settings committed, dirty 0x%x", dirty);
+    } else {
+        settingsStats.failures++;
+        LOGE(TAG, "Settings commit failed: %d", err);
+        // still pending, the task tries again once settings are quiet
+        portENTER_CRITICAL(&settingsMux);
+        if (dirty) {
+            settingsDirty |= dirty;
+            settingsDirtySince = dirtySince;
+        }
+        portEXIT_CRITICAL(&settingsMux);
+        xSemaphoreGive(settingsChanged);
+    }
+    xSemaphoreGive(settingsCommitLock);
+    return err;
+}
+
+static int64_t dirty_since() {
+    portENTER_CRITICAL(&settingsMux);
+    int64_t since = settingsDirtySince;
+    portEXIT_CRITICAL(&settingsMux);
+    return since;
+}
+
+/* commits once no setting changed for QUIET_MILLIS, or MAX_DELAY after the first change */
+void settings_task(void* _) {
+    while (1) {
+        xSemaphoreTake(settingsChanged, portMAX_DELAY);
+        while (xSemaphoreTake(settingsChanged, QUIET_MILLIS / portTICK_PERIOD_MS) == pdTRUE) {
+            if (esp_timer_get_time() - dirty_since() > MAX_DELAY_MICROS) {
+                break;
+            }
+        }
+        settings_commit();
+    }
+}
+
+esp_err_t init_settings() {
+    bzero(&settingsStats, sizeof(settingsStats));
+    settingsChanged = xSemaphoreCreateBinaryStatic(&settingsChangedBuffer);
+    settingsCommitLock = xSemaphoreCreateMutexStatic(&settingsCommitLockBuffer);
+    if (!settingsChanged || !settingsCommitLock) {
+        return ESP_ERR_NO_MEM;
+    }
+    settings_load();
+    memcpy(settingsCommitted, settingsValues, sizeof(settingsCommitted));
+    // defaults are not written until something changes, migrated values are
+    if (settingsDirty) {
+        settingsDirtySince = esp_timer_get_time();
+        xSemaphoreGive(settingsChanged);
+    }
+    if (!STATIC_TASK_CREATE(settings, settings_task, "settings", NULL, 3)) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int32_t settings_get(setting_key_t key) {
+    return settingsValues[key];
+}
+
+void settings_set(setting_key_t key, int32_t value) {
+    value = settings_validate(key, value);
+    portENTER_CRITICAL(&settingsMux);
+    bool changed = settingsValues[key] != value;
+    if (changed) {
+        settingsValues[key] = value;
+        if (!settingsDirty) {
+            settingsDirtySince = esp_timer_get_time();
+        }
+        settingsDirty |= 1 << key;
+        settingsStats.sets++;
+    }
+    portEXIT_CRITICAL(&settingsMux);
+    if (changed) {
+        xSemaphoreGive(settingsChanged);
+    }
+}
+
+esp_err_t settings_flush() {
+    return settings_commit();
+}
+
+void settings_get_stats(settings_stats_t* target) {
+    portENTER_CRITICAL(&settingsMux);
+    *target = settingsStats;
+    portEXIT_CRITICAL(&settingsMux);
+}
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "sgp4.h"
+#include "stddef.h"
+#include "math.h"
+
+/* WGS-72 constants, as used to generate published element sets */
+#define RADIUS_EARTH_KM 6378.135
+#define XKE 0.0743669161331734132
+#define J2 0.001082616
+#define J3 -0.00000253881
+#define J4 -0.00000165597
+#define J3OJ2 (J3 / J2)
+#define X2O3 (2.0 / 3.0)
+#define TWO_PI 6.283185307179586
+#define MINUTES_PER_DAY 1440.0
+#define DEEP_SPACE_MINUTES 225.0
+#define VKMPERSEC ((float)(RADIUS_EARTH_KM * XKE / 60.0))
+
+int sgp4_init(sgp4_t *s, const sgp4_tle_t *tle) {
+    double no_kozai = tle->mean_motion * TWO_PI / MINUTES_PER_DAY;
+    if (TWO_PI / no_kozai >= DEEP_SPACE_MINUTES) {
+        return SGP4_ERR_DEEP_SPACE;
+    }
+    double ecco = tle->eccentricity;
+    double inclo = tle->inclination;
+    double argpo = tle->arg_perigee;
+    double bstar = tle->bstar;
+
+    /* recover original mean motion and semi-major axis from the kozai mean motion */
+    double eccsq = ecco * ecco;
+    double omeosq = 1.0 - eccsq;
+    double rteosq = sqrt(omeosq);
+    double cosio = cos(inclo);
+    double cosio2 = cosio * cosio;
+    double ak = pow(XKE / no_kozai, X2O3);
+    double d1 = 0.75 * J2 * (3.0 * cosio2 - 1.0) / (rteosq * omeosq);
+    double del = d1 / (ak * ak);
+    double adel = ak * (1.0 - del * del - del * (1.0 / 3.0 + 134.0 * del * del / 81.0));
+    del = d1 / (adel * adel);
+    double no = no_kozai / (1.0 + del);
+    double ao = pow(XKE / no, X2O3);
+    double sinio = sin(inclo);
+    double po = ao * omeosq;
+    double con42 = 1.0 - 5.0 * cosio2;
+    double con41 = -con42 - cosio2 - cosio2;
+    double posq = po * po;
+    double rp = ao * (1.0 - ecco);
+
+    /* atmospheric density model depends on perigee height */
+    double ss = 78.0 / RADIUS_EARTH_KM + 1.0;
+    double qzms2t = pow((120.0 - 78.0) / RADIUS_EARTH_KM, 4);
+    double sfour = ss;
+    double qzms24 = qzms2t;
+    double perige = (rp - 1.0) * RADIUS_EARTH_KM;
+    if (perige < 156.0) {
+        sfour = perige < 98.0 ? 20.0 : perige - 78.0;
+        qzms24 = pow((120.0 - sfour) / RADIUS_EARTH_KM, 4);
+        sfour = sfour / RADIUS_EARTH_KM + 1.0;
+    }
+    double pinvsq = 1.0 / posq;
+    double tsi = 1.0 / (ao - sfour);
+    double eta = ao * ecco * tsi;
+    double etasq = eta * eta;
+    double eeta = ecco * eta;
+    double psisq = fabs(1.0 - etasq);
+    double coef = qzms24 * pow(tsi, 4);
+    double coef1 = coef / pow(psisq, 3.5);
+    double cc2 = coef1 * no * (ao * (1.0 + 1.5 * etasq + eeta * (4.0 + etasq)) +
+        0.375 * J2 * tsi / psisq * con41 * (8.0 + 3.0 * etasq * (8.0 + etasq)));
+    double cc1 = bstar * cc2;
+    double cc3 = 0;
+    if (ecco > 1.0e-4) {
+        cc3 = -2.0 * coef * tsi * J3OJ2 * no * sinio / ecco;
+    }
+    double x1mth2 = 1.0 - cosio2;
+    double cc4 = 2.0 * no * coef1 * ao * omeosq * (eta * (2.0 + 0.5 * etasq) + ecco * (0.5 + 2.0 * etasq) -
+        J2 * tsi / (ao * psisq) * (-3.0 * con41 * (1.0 - 2.0 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+        0.75 * x1mth2 * (2.0 * etasq - eeta * (1.0 + etasq)) * cos(2.0 * argpo)));
+    double cc5 = 2.0 * coef1 * ao * omeosq * (1.0 + 2.75 * (etasq + eeta) + eeta * etasq);
+    double cosio4 = cosio2 * cosio2;
+    double temp1 = 1.5 * J2 * pinvsq * no;
+    double temp2 = 0.5 * temp1 * J2 * pinvsq;
+    double temp3 = -0.46875 * J4 * pinvsq * pinvsq * no;
+    double xhdot1 = -temp1 * cosio;
+
+    s->epoch_unix_millis = tle->epoch_unix_millis;
+    s->mo = tle->mean_anomaly;
+    s->argpo = argpo;
+    s->nodeo = tle->raan;
+    s->mdot = no + 0.5 * temp1 * rteosq * con41 + 0.0625 * temp2 * rteosq * (13.0 - 78.0 * cosio2 + 137.0 * cosio4);
+    s->argpdot = -0.5 * temp1 * con42 + 0.0625 * temp2 * (7.0 - 114.0 * cosio2 + 395.0 * cosio4) +
+        temp3 * (3.0 - 36.0 * cosio2 + 49.0 * cosio4);
+    s->nodedot = xhdot1 + (0.5 * temp2 * (4.0 - 19.0 * cosio2) + 2.0 * temp3 * (3.0 - 7.0 * cosio2)) * cosio;
+
+    s->no = no;
+    s->ecco = ecco;
+    s->inclo = inclo;
+    s->sinio = sinio;
+    s->cosio = cosio;
+    s->bstar = bstar;
+    s->eta = eta;
+    s->cc1 = cc1;
+    s->cc4 = cc4;
+    s->cc5 = cc5;
+    s->omgcof = bstar * cc3 * cos(argpo);
+    s->xmcof = ecco > 1.0e-4 ? -X2O3 * coef * bstar / eeta : 0;
+    s->nodecf = 3.5 * omeosq * xhdot1 * cc1;
+    s->t2cof = 1.5 * cc1;
+    s->xlcof = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) /
+        (fabs(cosio + 1.0) > 1.5e-12 ? 1.0 + cosio : 1.5e-12);
+    s->aycof = -0.5 * J3OJ2 * sinio;
+    s->delmo = pow(1.0 + eta * cos(s->mo), 3);
+    s->sinmao = sin(s->mo);
+    s->con41 = con41;
+    s->x1mth2 = x1mth2;
+    s->x7thm1 = 7.0 * cosio2 - 1.0;
+
+    /* very low perigee orbits drop the higher order drag terms */
+    s->simple = rp < 220.0 / RADIUS_EARTH_KM + 1.0;
+    s->d2 = s->d3 = s->d4 = 0;
+    s->t3cof = s->t4cof = s->t5cof = 0;
+    if (!s->simple) {
+        double cc1sq = cc1 * cc1;
+        double d2 = 4.0 * ao * tsi * cc1sq;
+        double temp = d2 * tsi * cc1 / 3.0;
+        double d3 = (17.0 * ao + sfour) * temp;
+        double d4 = 0.5 * temp * ao * tsi * (221.0 * ao + 31.0 * sfour) * cc1;
+        s->d2 = d2;
+        s->d3 = d3;
+        s->d4 = d4;
+        s->t3cof = d2 + 2.0 * cc1sq;
+        s->t4cof = 0.25 * (3.0 * d3 + cc1 * (12.0 * d2 + 10.0 * cc1sq));
+        s->t5cof = 0.2 * (3.0 * d4 + 12.0 * cc1 * d3 + 6.0 * d2 * d2 + 15.0 * cc1sq * (2.0 * d2 + cc1sq));
+    }
+    return SGP4_OK;
+}
+
+static float wrapf(float a) {
+    a = fmodf(a, (float) TWO_PI);
+    return a < 0 ? a + (float) TWO_PI : a;
+}
+
+static float wrapd(double a) {
+    a = fmod(a, TWO_PI);
+    return (float)(a < 0 ? a + TWO_PI : a);
+}
+
+int sgp4_propagate(const sgp4_t *s, double tsince, float r[3], float v[3]) {
+    /* secular angles grow without bound, so they are the only double precision step */
+    float xmdf = wrapd(s->mo + s->mdot * tsince);
+    float argpdf = wrapd(s->argpo + s->argpdot * tsince);
+    float nodedf = wrapd(s->nodeo + s->nodedot * tsince);
+
+    float t = (float) tsince;
+    float t2 = t * t;
+    float argpm = argpdf;
+    float mm = xmdf;
+    float nodem = nodedf + s->nodecf * t2;
+    float tempa = 1.0f - s->cc1 * t;
+    float tempe = s->bstar * s->cc4 * t;
+    float templ = s->t2cof * t2;
+
+    if (!s->simple) {
+        float delomg = s->omgcof * t;
+        float delmtemp = 1.0f + s->eta * cosf(xmdf);
+        float delm = s->xmcof * (delmtemp * delmtemp * delmtemp - s->delmo);
+        float temp = delomg + delm;
+        mm = xmdf + temp;
+        argpm = argpdf - temp;
+        float t3 = t2 * t;
+        float t4 = t3 * t;
+        tempa = tempa - s->d2 * t2 - s->d3 * t3 - s->d4 * t4;
+        tempe = tempe + s->bstar * s->cc5 * (sinf(mm) - s->sinmao);
+        templ = templ + s->t3cof * t3 + t4 * (s->t4cof + t * s->t5cof);
+    }
+
+    float am = powf((float) XKE / s->no, (float) X2O3) * tempa * tempa;
+    float nm = (float) XKE / powf(am, 1.5f);
+    float em = s->ecco - tempe;
+    if (em >= 1.0f || em < -0.001f) {
+        return SGP4_ERR_ECCENTRICITY;
+    }
+    if (em < 1.0e-6f) {
+        em = 1.0e-6f;
+    }
+    mm = mm + s->no * templ;
+    float xlm = wrapf(mm + argpm + nodem);
+    nodem = wrapf(nodem);
+    argpm = wrapf(argpm);
+    mm = wrapf(xlm - argpm - nodem);
+
+    float sinip = s->sinio;
+    float cosip = s->cosio;
+
+    /* long period periodics */
+    float axnl = em * cosf(argpm);
+    float temp = 1.0f / (am * (1.0f - em * em));
+    float aynl = em * sinf(argpm) + temp * s->aycof;
+    float xl = mm + argpm + nodem + temp * s->xlcof * axnl;
+
+    /* kepler's equation */
+    float u = wrapf(xl - nodem);
+    float eo1 = u;
+    float sineo1 = 0, coseo1 = 1;
+    for (int ktr = 0; ktr < 10; ktr++) {
+        sineo1 = sinf(eo1);
+        coseo1 = cosf(eo1);
+        float tem5 = 1.0f - coseo1 * axnl - sineo1 * aynl;
+        tem5 = (u - aynl * coseo1 + axnl * sineo1 - eo1) / tem5;
+        if (tem5 >= 0.95f) tem5 = 0.95f;
+        else if (tem5 <= -0.95f) tem5 = -0.95f;
+        eo1 += tem5;
+        if (fabsf(tem5) < 1.0e-6f) break;
+    }
+
+    /* short period preliminary quantities */
+    float ecose = axnl * coseo1 + aynl * sineo1;
+    float esine = axnl * sineo1 - aynl * coseo1;
+    float el2 = axnl * axnl + aynl * aynl;
+    float pl = am * (1.0f - el2);
+    if (pl < 0) {
+        return SGP4_ERR_SEMI_LATUS;
+    }
+    float rl = am * (1.0f - ecose);
+    float rdotl = sqrtf(am) * esine / rl;
+    float rvdotl = sqrtf(pl) / rl;
+    float betal = sqrtf(1.0f - el2);
+    temp = esine / (1.0f + betal);
+    float sinu = am / rl * (sineo1 - aynl - axnl * temp);
+    float cosu = am / rl * (coseo1 - axnl + aynl * temp);
+    float su = atan2f(sinu, cosu);
+    float sin2u = (cosu + cosu) * sinu;
+    float cos2u = 1.0f - 2.0f * sinu * sinu;
+    temp = 1.0f / pl;
+    float temp1 = 0.5f * (float) J2 * temp;
+    float temp2 = temp1 * temp;
+
+    /* update for short period periodics */
+    float mrt = rl * (1.0f - 1.5f * temp2 * betal * s->con41) + 0.5f * temp1 * s->x1mth2 * cos2u;
+    su = su - 0.25f * temp2 * s->x7thm1 * sin2u;
+    float xnode = nodem + 1.5f * temp2 * cosip * sin2u;
+    float xinc = s->inclo + 1.5f * temp2 * cosip * sinip * cos2u;
+    float mvt = rdotl - nm * temp1 * s->x1mth2 * sin2u / (float) XKE;
+    float rvdot = rvdotl + nm * temp1 * (s->x1mth2 * cos2u + 1.5f * s->con41) / (float) XKE;
+
+    /* orientation vectors */
+    float sinsu = sinf(su);
+    float cossu = cosf(su);
+    float snod = sinf(xnode);
+    float cnod = cosf(xnode);
+    float sini = sinf(xinc);
+    float cosi = cosf(xinc);
+    float xmx = -snod * cosi;
+    float xmy = cnod * cosi;
+    float ux = xmx * sinsu + cnod * cossu;
+    float uy = xmy * sinsu + snod * cossu;
+    float uz = sini * sinsu;
+    float vx = xmx * cossu - cnod * sinsu;
+    float vy = xmy * cossu - snod * sinsu;
+    float vz = sini * cossu;
+
+    float rk = mrt * (float) RADIUS_EARTH_KM;
+    r[0] = rk * ux;
+    r[1] = rk * uy;
+    r[2] = rk * uz;
+    if (v != NULL) {
+        v[0] = (mvt * ux + rvdot * vx) * VKMPERSEC;
+        v[1] = (mvt * uy + rvdot * vy) * VKMPERSEC;
+        v[2] = (mvt * uz + rvdot * vz) * VKMPERSEC;
+    }
+    if (mrt < 1.0f) {
+        return SGP4_ERR_DECAYED;
+    }
+    return SGP4_OK;
+}
+
+double sgp4_gmst(int64_t unix_millis) {
+    double jd = unix_millis / 86400000.0 + 2440587.5;
+    double tut1 = (jd - 2451545.0) / 36525.0;
+    double seconds = -6.2e-6 * tut1 * tut1 * tut1 + 0.093104 * tut1 * tut1 +
+        (876600.0 * 3600.0 + 8640184.812866) * tut1 + 67310.54841;
+    double angle = fmod(seconds * TWO_PI / 86400.0, TWO_PI);
+    return angle < 0 ? angle + TWO_PI : angle;
+}
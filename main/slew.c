@@ -1,10 +1,12 @@
-#include "esp_timer.h"
+#include "motion_loop.h"
 #include "slew.h"
 #include "mount_encoder.h"
-#include "math.h"
+#include "motion_math.h"
 #include "util.h"
 #include "astro.h"
 #include "telescope.h"
+#include "trace.h"
+#include "cpu_monitor.h"
 
 #define TAG "SLEW"
 
@@ -14,10 +16,11 @@ int32_t raStartMillis = 0, decStartMillis = 0;
 int32_t raTargetMillis = 0, decTargetMillis = 0;
 int speed;
 int checkIntervalMillis;
-double distance;
-double progress;
+uint32_t distance;
+uint32_t distanceNow;
 uint32_t timeToGoMillis;
-esp_timer_handle_t slewTimer;
+motion_timer_t slewTimer;
+timer_monitor_t slewTimerMonitor;
 
 #define MAX_SPEED 16
 #define TOLERANCE_MILLIS 1000 
@@ -26,12 +29,15 @@ esp_timer_handle_t slewTimer;
 #define MIN_SPEED 1
 
 
-double dist(double a, double b) {
-    return sqrt(a*a + b*b);
+uint32_t dist(int32_t a, int32_t b) {
+    return isqrt64((int64_t) a * a + (int64_t) b * b);
 }
 
-double get_slew_progress() {
-    return 1 - progress;
+int32_t get_slew_progress_percent() {
+    if (distance == 0) {
+        return 100;
+    }
+    return 100 - (int32_t)((int64_t) distanceNow * 100 / distance);
 }
 
 uint32_t get_slew_time_to_go_millis(){
@@ -54,6 +60,8 @@ int32_t getRaDiff(int32_t target, int32_t current) {
 }
 
 void slew_timer_callback(void* _) {
+    TRACE_BEGIN(TRACE_SLEW_TIMER, 0);
+    timer_monitor_fired(&slewTimerMonitor);
     int32_t raDiff = getRaDiff(raTargetMillis, get_ra_angle_millis());
     int32_t decDiff = decTargetMillis - get_dec_mechnical_angle_millis();
     int32_t absRaDiff;
@@ -77,18 +85,12 @@ void slew_timer_callback(void* _) {
     if (absRaDiff < TOLERANCE_MILLIS && absDecDiff < TOLERANCE_MILLIS) {
         slewing = false;
         motor_callback(0, 0);
+        TRACE_END(TRACE_SLEW_TIMER, 0);
         return;
     }
-    double raSpeedFactor, decSpeedFactor;
-    if (absRaDiff < absDecDiff) {
-        raSpeedFactor = (double)absRaDiff / (double)absDecDiff;
-        decSpeedFactor = 1;
-        timeToGoMillis = absDecDiff / speed;
-    } else {
-        raSpeedFactor = 1;
-        decSpeedFactor = (double)absDecDiff / (double)absRaDiff;
-        timeToGoMillis = absRaDiff / speed;
-    }
+    // the longer axis at full speed, the shorter one in proportion
+    int32_t longest = absRaDiff < absDecDiff ? absDecDiff : absRaDiff;
+    timeToGoMillis = longest / speed;
     while (timeToGoMillis < 16000) {
         LOGI(TAG, "Near target, slow down");
         if (speed > MIN_SPEED) {
@@ -105,41 +107,65 @@ void slew_timer_callback(void* _) {
             break;
         }
     }    
-    motor_callback(speed * raSpeedFactor * raReverse, speed * decSpeedFactor * decReverse);
-    double distanceNow = dist(raDiff, decDiff);
-    progress = distanceNow / distance;
-    LOGI(TAG, "distance: %.2f/%.2f raDiff: %d, decDiff: %d, time: %d", distanceNow, distance, raDiff, decDiff, timeToGoMillis / 1000);
-    esp_timer_start_once(slewTimer, checkIntervalMillis * 1000);
+    int64_t fullSpeed = (int64_t) speed * SPEED_PER_CYCLE;
+    motor_callback(fullSpeed * absRaDiff / longest * raReverse, fullSpeed * absDecDiff / longest * decReverse);
+    distanceNow = dist(raDiff, decDiff);
+    LOGI(TAG, "distance: %u/%u raDiff: %d, decDiff: %d, time: %d", distanceNow, distance, raDiff, decDiff, timeToGoMillis / 1000);
+    timer_monitor_armed(&slewTimerMonitor, checkIntervalMillis * 1000);
+    motion_timer_start_once(&slewTimer, checkIntervalMillis);
+    TRACE_END(TRACE_SLEW_TIMER, 0);
 }
 
 esp_err_t init_slew(slew_set_motor_speed_callback callback) {
     motor_callback = callback;
-    esp_timer_create_args_t args = {
-        .dispatch_method = ESP_TIMER_TASK,
-        .callback = slew_timer_callback
-    };
-    return esp_timer_create(&args, &slewTimer);
+    motion_timer_init(&slewTimer, slew_timer_callback, NULL);
+    timer_monitor_init(&slewTimerMonitor);
+    return ESP_OK;
+}
+
+void slew_get_timer_stats(timer_monitor_stats_t* target) {
+    timer_monitor_get(&slewTimerMonitor, target);
 }
 
 bool is_slewing(){
     return slewing;
 }
 
-void abort_slew() {
+void slew_abort_motion(const void* _) {
     slewing = false;
-    esp_timer_stop(slewTimer);
+    motion_timer_stop(&slewTimer);
+    timer_monitor_stopped(&slewTimerMonitor);
     motor_callback(0, 0);
 }
 
-void slew_to_coordinates(int32_t raMillis, int32_t decMillis){
+esp_err_t abort_slew() {
+    if (!motion_post(slew_abort_motion, NULL, 0)) return ESP_FAIL;
+    slewing = false;
+    return ESP_OK;
+}
+
+void slew_start_motion(const void* data) {
+    const int32_t* target = data;
     raStartMillis = get_ra_angle_millis();
     decStartMillis = get_dec_mechnical_angle_millis();
-    raTargetMillis = raMillis;
-    decTargetMillis = decMillis2decMecMillis(decMillis);
+    raTargetMillis = target[0];
+    decTargetMillis = decMillis2decMecMillis(target[1]);
     distance = dist(getRaDiff(raTargetMillis, raStartMillis), decTargetMillis - decStartMillis);
+    distanceNow = distance;
     slewing = true;
     speed = MAX_SPEED;
     checkIntervalMillis = CHECK_INTERVAL_MILLIS;
     slew_timer_callback(NULL);
 }
 
+/* runs on the event loop, slewing is set now so the next command already sees it */
+esp_err_t slew_to_coordinates(int32_t raMillis, int32_t decMillis){
+    int32_t target[2] = { raMillis, decMillis };
+    slewing = true;
+    if (!motion_post(slew_start_motion, target, sizeof(target))) {
+        slewing = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
@@ -32,6 +32,7 @@
 #include "stdlib.h"
 #include "string.h"
 #include "esp_log.h"
+#include "trace.h"
 
 
 /**
@@ -53,7 +54,7 @@
 #define PANEL0_RST_BIT  BIT12
 
 //! @brief Panel 1 type, define to SSD1306_NONE if not used.
-#define PANEL1_PANEL_TYPE SSD1306_128x64
+#define PANEL1_PANEL_TYPE SSD1306_NONE
 //! @brief I2C address for panel 1
 #define PANEL1_ADDR (0x3d << 1)
 //! @brief If panel 1 has external RESET pin, define this as 1
@@ -116,6 +117,16 @@ typedef struct _oled_i2c_ctx
 
 oled_i2c_ctx *_ctxs[2] = { NULL };
 
+// contexts and frame buffers live for the whole run, only configured panels get a buffer
+#define PANEL_BUFFER_SIZE(T) ((T) == SSD1306_128x32 ? 512 : 1024) // 128 * height / 8
+static oled_i2c_ctx _ctx_storage[2];
+#if (PANEL0_TYPE != 0)
+static uint8_t _panel0_buffer[PANEL_BUFFER_SIZE(PANEL0_TYPE)];
+#endif
+#if (PANEL1_PANEL_TYPE != 0)
+static uint8_t _panel1_buffer[PANEL_BUFFER_SIZE(PANEL1_PANEL_TYPE)];
+#endif
+
 
 bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
 {
@@ -131,37 +142,23 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
     // free old context (if any)
     ssd1306_term(id);
 
-    ctx = malloc(sizeof(oled_i2c_ctx));
-//    memset(&ctx,0,sizeof(oled_i2c_ctx));
-    if (ctx == NULL)
-    {
-//        dmsg_err_puts("Alloc OLED context failed.");
-        ESP_LOGE("ssd1306", "oled_init_fail at %d", __LINE__);
-        goto oled_init_fail;
-    }
+    ctx = &_ctx_storage[id];
     if (id == 0)
     {
 #if (PANEL0_TYPE != 0)
   #if (PANEL0_TYPE == SSD1306_128x64)
         ctx->type = SSD1306_128x64;
-        ctx->buffer = malloc(1024); // 128 * 64 / 8
+        ctx->buffer = _panel0_buffer;
         ctx->width = 128;
         ctx->height = 64;
   #elif (PANEL0_TYPE == SSD1306_128x32)
         ctx->type = SSD1306_128x32;
-        ctx->buffer = malloc(512);  // 128 * 32 / 8
-//        memset(&(ctx->buffer),0,512);
+        ctx->buffer = _panel0_buffer;
         ctx->width = 128;
         ctx->height = 32;
   #else
     #error "Panel 0 undefined"
   #endif
-        if (ctx->buffer == NULL)
-        {
-//            dmsg_err_puts("Alloc OLED buffer failed.");
-            ESP_LOGE("ssd1306", "oled_init_fail at %d", __LINE__);
-            goto oled_init_fail;
-        }
         ctx->address = PANEL0_ADDR;
   #if PANEL0_USE_RST
         // Panel 0 reset
@@ -172,7 +169,6 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
         GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, PANEL0_RST_BIT);
   #endif
 #else
-        dmsg_err_puts("Panel 0 not defined.");
         ESP_LOGE("ssd1306", "oled_init_fail at %d", __LINE__);
         goto oled_init_fail;
 #endif
@@ -182,24 +178,17 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
 #if (PANEL1_PANEL_TYPE != 0)
   #if (PANEL1_PANEL_TYPE ==SSD1306_128x64)
         ctx->type = SSD1306_128x64;
-        ctx->buffer = malloc(1024); // 128 * 64 / 8
-//        memset(&(ctx->buffer),0,1024);
+        ctx->buffer = _panel1_buffer;
         ctx->width = 128;
         ctx->height = 64;
   #elif (PANEL1_PANEL_TYPE == SSD1306_128x32)
         ctx->type = SSD1306_128x32;
-        ctx->buffer = zalloc(512);  // 128 * 32 / 8
+        ctx->buffer = _panel1_buffer;
         ctx->width = 128;
         ctx->height = 32;
   #else
      #error "Unknown Panel 1 type"
   #endif
-        if (ctx->buffer == NULL)
-        {
-//            dmsg_err_puts("Alloc OLED buffer failed.");
-            ESP_LOGE("ssd1306", "oled_init_fail at %d", __LINE__);
-            goto oled_init_fail;
-        }
         ctx->address = PANEL1_ADDR;
   #if PANEL1_USE_RST
         // Panel 1 reset
@@ -210,7 +199,6 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
         GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, PANEL1_RST_BIT);
   #endif
 #else
-        dmsg_err_puts("Panel 1 not defined.");
         ESP_LOGE("ssd1306", "oled_init_fail at %d", __LINE__);
         goto oled_init_fail;
 #endif
@@ -296,8 +284,6 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
     return true;
 
 oled_init_fail:
-    if (ctx && ctx->buffer) free(ctx->buffer);
-    if (ctx) free(ctx);
     return false;
 }
 
@@ -312,10 +298,6 @@ void ssd1306_term(uint8_t id)
     _command(ctx->address, 0x8d); // SSD1306_CHARGEPUMP
     _command(ctx->address, 0x10); // Charge pump off
 
-    if (ctx->buffer)
-        free(ctx->buffer);
-    free(ctx);
-
     _ctxs[id] = NULL;
 }
 
@@ -371,6 +353,7 @@ void ssd1306_refresh(uint8_t id, bool force)
     if (ctx == NULL)
         return;
 
+    TRACE_BEGIN(TRACE_DISPLAY_REFRESH, force);
     if (force)
     {
         if (ctx->type == SSD1306_128x64)
@@ -460,6 +443,7 @@ void ssd1306_refresh(uint8_t id, bool force)
     ctx->refresh_left = 255;
     ctx->refresh_right = 0;
     ctx->refresh_bottom = 0;
+    TRACE_END(TRACE_DISPLAY_REFRESH, force);
 }
 
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "sdkconfig.h"
 
@@ -16,6 +17,7 @@
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
+#include "math.h"
 
 #include "util.h"
 #include "ssd1306.h"
@@ -27,7 +29,25 @@
 #include "protocol.h"
 #include "slew.h"
 #include "mount.h"
+#include "motion_math.h"
 #include "focuser.h"
+#include "autofocus.h"
+#include "settings.h"
+#include "checkpoint.h"
+#include "boot.h"
+#include "input.h"
+#include "hand_controller.h"
+#include "memory_budget.h"
+#include "event_loop.h"
+#include "motion_loop.h"
+#include "satellite.h"
+#include "clock_sync.h"
+#include "scheduler.h"
+#include "command.h"
+#include "command_stats.h"
+#include "telescope.h"
+#include "trace.h"
+#include "cpu_monitor.h"
 
 const static char *TAG = "Telescope";
 
@@ -37,6 +57,14 @@ const static char *TAG = "Telescope";
 
 #define UDP_PORT CONFIG_SERVER_PORT
 
+#ifndef CONFIG_HAND_CONTROLLER
+#define CONFIG_HAND_CONTROLLER false
+#endif
+
+#ifndef CONFIG_HAND_ENCODER_REVERSE
+#define CONFIG_HAND_ENCODER_REVERSE false
+#endif
+
 #define DISPLAY_SCL (CONFIG_DISPLAY_SCL)
 #define DISPLAY_SDA (CONFIG_DISPLAY_SDA)
 
@@ -51,9 +79,27 @@ const static char *TAG = "Telescope";
 #define CMD_SLEW_TO_TARGET 8
 #define CMD_ABORT_SLEW 9
 #define CMD_SET_SIDE_OF_PIER 10
+#define CMD_TRACK_SATELLITE 11
+#define CMD_TIME_SYNC 12
+#define CMD_EXECUTE_AT 13
+#define CMD_GET_SCHEDULE_STATS 14
+#define CMD_GET_BOOT_TIMELINE 15
+#define CMD_GET_HAND_STATS 16
+#define CMD_GET_MEMORY_REPORT 17
+#define CMD_GET_COMMAND_STATS 18
+#define CMD_GET_TRACE 19
+#define CMD_GET_CPU_MONITOR 20
 #define CMD_SET_TIME_RATIO 101
 #define CMD_FOCUSER_MOVE 201
 #define CMD_FOCUSER_ABORT 202
+#define CMD_FOCUSER_MOVE_TO 203
+#define CMD_FOCUSER_GET_POSITION 204
+#define CMD_FOCUSER_SET_ZERO 205
+#define CMD_AUTOFOCUS_START 206
+#define CMD_AUTOFOCUS_REPORT 207
+#define CMD_AUTOFOCUS_ABORT 208
+
+#define EXECUTE_AT_CLIENT_CLOCK 1
 
 #define PULSE_GUIDING_NONE 0
 #define PULSE_GUIDING_DIR_WEST 4
@@ -72,21 +118,32 @@ typedef struct {
 
 void broadcastStatus();
 
+/*
+ * The event loop, the input loop, the WiFi event task and the probe task all
+ * draw, displayLock serializes the shared text, the framebuffer and I2C.
+ * Recursive, updateDisplayStatus holds it around its own lines.
+ */
+SemaphoreHandle_t displayLock;
+StaticSemaphore_t displayLockBuffer;
 bool displayEnabled = false;
 
 display_t displayed;
 
+char displayedText[4][32];
+
+#define DISPLAY_LOCK() xSemaphoreTakeRecursive(displayLock, portMAX_DELAY)
+#define DISPLAY_UNLOCK() xSemaphoreGiveRecursive(displayLock)
+
 void initDisplay() {
-    displayed.title = malloc(32);
-    displayed.line1 = malloc(32);
-    displayed.line2 = malloc(32);
-    displayed.line3 = malloc(32);
-    bzero(displayed.title, 32);
-    bzero(displayed.line1, 32);
-    bzero(displayed.line2, 32);
-    bzero(displayed.line3, 32);
+    displayLock = xSemaphoreCreateRecursiveMutexStatic(&displayLockBuffer);
+    bzero(displayedText, sizeof(displayedText));
+    displayed.title = displayedText[0];
+    displayed.line1 = displayedText[1];
+    displayed.line2 = displayedText[2];
+    displayed.line3 = displayedText[3];
 }
 
+/* with displayLock held */
 void updateDisplay() {
     LOGI("DISPLAY", "\n    %s\n    %s\n    %s\n    %s", displayed.title, displayed.line1, displayed.line2, displayed.line3);
     if (!displayEnabled) return;
@@ -103,17 +160,26 @@ void updateDisplay() {
 }
 
 void updateDisplayTitle(const char* title) {
+    DISPLAY_LOCK();
     strncpy(displayed.title, title, 32);
     updateDisplay();
+    DISPLAY_UNLOCK();
 }
 
 void updateDisplayContent(const char* line1, const char* line2, const char* line3) {
+    DISPLAY_LOCK();
     strncpy(displayed.line1, line1, 32);
     strncpy(displayed.line2, line2, 32);
     strncpy(displayed.line3, line3, 32);
     updateDisplay();
+    DISPLAY_UNLOCK();
 }
 
+/*
+ * What the axes run at. Written on the motion task only, other tasks post
+ * the change to it; the event loop reads them for status and may be a
+ * change behind.
+ */
 int8_t tracking = 0;
 int8_t hardware_tracking = 0;
 char pulseGuiding = 0;
@@ -135,35 +201,44 @@ display_t stepper_display = {
     .line_font = 1
 };
 
-void calcRaAndDecCycles(double *outRaCyclesPerSiderealDay, double *outDecCyclesPerDay) {
-    double raCyclesPerSiderealDay = raSpeed / 15000.0;
-    double decCyclesPerDay = decSpeed / 15000.0;
+void calcRaAndDecSpeeds(int32_t *outRaSpeed, int32_t *outDecSpeed) {
+    int32_t ra = raSpeed;
+    int32_t dec = decSpeed;
     switch (pulseGuiding) {
         case PULSE_GUIDING_DIR_NORTH:
-            decCyclesPerDay += decGuideSpeed / 15000.0;
+            dec += decGuideSpeed;
             break;
         case PULSE_GUIDING_DIR_SOUTH:
-            decCyclesPerDay -= decGuideSpeed / 15000.0;
+            dec -= decGuideSpeed;
             break;
         case PULSE_GUIDING_DIR_WEST:
-            raCyclesPerSiderealDay += raGuideSpeed / 15000.0;
+            ra += raGuideSpeed;
             break;
         case PULSE_GUIDING_DIR_EAST:
-            raCyclesPerSiderealDay -= raGuideSpeed / 15000.0;
+            ra -= raGuideSpeed;
             break;
     }
     if (tracking) {
-        raCyclesPerSiderealDay += 1;
+        ra += SPEED_PER_CYCLE;
     }
-    *outRaCyclesPerSiderealDay = raCyclesPerSiderealDay;
-    *outDecCyclesPerDay = decCyclesPerDay;
+    *outRaSpeed = ra;
+    *outDecSpeed = dec;
+}
+
+/* a speed as cycles per day like %+8.4f would, printf of a double is soft-float */
+void formatCycles(char* target, const char* label, int32_t speed) {
+    int32_t tenThousandths = (abs(speed) * 2 + 1) / 3;
+    char value[16];
+    snprintf(value, sizeof(value), "%c%d.%04d", speed < 0 ? '-' : '+', tenThousandths / 10000, tenThousandths % 10000);
+    sprintf(target, "%s%8s r/d", label, value);
 }
 
 void updateDisplayStatus(){
-    if (!is_slewing()) {
-        double raCyclesPerSiderealDay;
-        double decCyclesPerDay;
-        calcRaAndDecCycles(&raCyclesPerSiderealDay, &decCyclesPerDay);
+    // the stepper lines are shared by every caller
+    DISPLAY_LOCK();
+    if (!is_slewing() && !is_tracking_satellite()) {
+        int32_t ra, dec;
+        calcRaAndDecSpeeds(&ra, &dec);
         char* guidingstr = "   ";
         switch (pulseGuiding) {
             case PULSE_GUIDING_DIR_NORTH:
@@ -180,64 +255,128 @@ void updateDisplayStatus(){
                 break;
         }
 
-        char speedx[9];
-        speedx[8] = 0;
-        snprintf(speedx, 8, "x%1.4f", get_mount_time_ratio());
+        char speedx[13];
+        int32_t timeRatio = get_mount_time_ratio();
+        snprintf(speedx, sizeof(speedx), "x%d.%04d", timeRatio / 1000000, timeRatio % 1000000 / 100);
 
-        sprintf(stepper_line1, "R.A. %+8.4f r/d", raCyclesPerSiderealDay);
-        sprintf(stepper_line2, "Dec  %+8.4f r/d", decCyclesPerDay);
+        formatCycles(stepper_line1, "R.A. ", ra);
+        formatCycles(stepper_line2, "Dec  ", dec);
         char* trackingstr = "   ";
         if (tracking > 0) {
             trackingstr = "T/N";
         } else if (tracking < 0) {
             trackingstr = "T/W";
         }
-        sprintf(stepper_line3, "%s   %s    %s",guidingstr, speedx, trackingstr);
+        // the first seven characters of the ratio keep the line to the panel's width
+        sprintf(stepper_line3, "%s   %.7s    %s",guidingstr, speedx, trackingstr);
+    } else if (is_tracking_satellite()) {
+        // %+.1f of the degrees without the soft-float, a degree is 240000 millis
+        int32_t elevation = get_satellite_elevation_millis();
+        int32_t tenths = (abs(elevation) + 12000) / 24000;
+        sprintf(stepper_line3, "Satellite el %c%d.%d", elevation < 0 ? '-' : '+', tenths / 10, tenths % 10);
     } else {
         sprintf(stepper_line3, "                     ");
-        int progress = (int)(get_slew_progress() * 100.0);
+        int progress = get_slew_progress_percent();
         int timeToGo = get_slew_time_to_go_millis() / 1000;
         sprintf(stepper_line3, "Slew %d%% eta %02d:%02d", progress, timeToGo / 60, timeToGo % 60);
     }
     updateDisplayContent(stepper_display.line1, stepper_display.line2, stepper_display.line3);
+    DISPLAY_UNLOCK();
 }
 
-void updateStepper() {
-    double raCyclesPerSiderealDay;
-    double decCyclesPerDay;
-    calcRaAndDecCycles(&raCyclesPerSiderealDay, &decCyclesPerDay);
+/* on the motion task, where the speeds are written */
+void applySpeeds(const void* _) {
+    int32_t ra, dec;
+    calcRaAndDecSpeeds(&ra, &dec);
+    set_ra_speed(ra);
+    set_dec_speed(dec);
+    if (ra == 0 && dec == 0) {
+        checkpoint_save();
+    }
+}
 
-    set_ra_cycles_per_sidereal_day(raCyclesPerSiderealDay);
-    set_dec_cycles_per_day(decCyclesPerDay);
+/* false when the motion queue was full */
+bool applyStepper() {
+    return motion_post(applySpeeds, NULL, 0);
+}
 
+void updateDisplayStatusWork(const void* _) {
     updateDisplayStatus();
 }
 
-void slewCallback(double raCyclesPerSiderealDay, double decCyclesPerDay) {
-    raSpeed = raCyclesPerSiderealDay * 15000.0;
-    decSpeed = decCyclesPerDay * 15000.0;
+bool updateStepper() {
+    TRACE_BEGIN(TRACE_UPDATE_STEPPER, 0);
+    bool applied = applyStepper();
+    if (motion_is_current_task()) {
+        // the panel is slow I2C, it is redrawn from the event loop
+        event_loop_post(updateDisplayStatusWork, NULL, 0);
+    } else {
+        updateDisplayStatus();
+    }
+    TRACE_END(TRACE_UPDATE_STEPPER, 0);
+    return applied;
+}
+
+void slewCallback(int32_t ra, int32_t dec) {
+    raSpeed = ra;
+    decSpeed = dec;
     updateStepper();
 }
 
-void sendAck(int sock, struct sockaddr_in *addr, socklen_t addrlen) {
+/* called at the satellite update rate, too often to redraw the display */
+void satelliteCallback(int32_t ra, int32_t dec) {
+    raSpeed = ra;
+    decSpeed = dec;
+    if (ra == 0 && dec == 0) {
+        updateStepper();
+    } else {
+        applyStepper();
+    }
+}
+
+#define MICRO_DEGREES_TO_RADIANS(v) ((double)(v) * M_PI / 180000000.0)
+
+/* sendto counted in the network stats */
+int sendDatagram(int sock, const void* data, size_t len, const struct sockaddr* to, socklen_t tolen) {
+    int result = sendto(sock, data, len, 0, to, tolen);
+    command_stats_datagram_out(result);
+    return result;
+}
+
+void sendAck(int sock, struct sockaddr_in *addr, socklen_t addrlen, int64_t receivedAt) {
     ack_t ackBuffer;
-    set_ack_fields(&ackBuffer, 0);
+    set_ack_fields(&ackBuffer, 0, receivedAt, esp_timer_get_time());
     LOGI(TAG, "ack to %s:%d", inet_ntoa(addr->sin_addr), addr->sin_port);
-    sendto(sock, ackBuffer.buffer, ACK_SIZE, 0, (struct sockaddr *) addr, addrlen);    
+    sendDatagram(sock, ackBuffer.buffer, ACK_SIZE, (struct sockaddr *) addr, addrlen);    
 }
 
-esp_timer_handle_t pulseGuidingTimer;
+motion_timer_t pulseGuidingTimer;
 struct sockaddr_in lastPulseGuidingFrom;
 socklen_t lastPulseGuidingFromLen;
 int lastPulseGuidingSocket;
 
-void pulseGuidingFinished(void* args) {
-    pulseGuiding = PULSE_GUIDING_NONE;
-    updateStepper();
+void pulseGuidingReport(const void* _) {
+    updateDisplayStatus();
     LOGI(TAG, "pulseGuide finished");
     broadcastStatus();
 }
 
+/* on the motion task, pulse[0] is the direction, pulse[1] the length, the timer starts with the rates */
+void startPulseGuiding(const void* data) {
+    const int32_t* pulse = data;
+    pulseGuiding = pulse[0];
+    updateStepper();
+    motion_timer_start_once(&pulseGuidingTimer, pulse[1]);
+}
+
+/* on the motion task, the rates drop back first and the clients hear about it after */
+void pulseGuidingFinished(void* args) {
+    TRACE_INSTANT(TRACE_PULSE_GUIDE_END, 0);
+    pulseGuiding = PULSE_GUIDING_NONE;
+    applyStepper();
+    event_loop_post(pulseGuidingReport, NULL, 0);
+}
+
 const char* getPulseDirDescr(int dir){
     switch (dir) {
         case PULSE_GUIDING_DIR_WEST:
@@ -253,194 +392,573 @@ const char* getPulseDirDescr(int dir){
     }
 }
 
-int parse_command(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
-    char* cmd = buf;
-    switch(*cmd) {
-        case CMD_PING: {
-            if (len != 1) return 0;
-            LOGI(TAG, "ping");
-        } break;
-        case CMD_SET_TRACKING: {
-            if (len != 2) return 0;
-            if (is_slewing()) return 0;
-            if (hardware_tracking) return 0;
-            int8_t* newTracking = (int8_t*)(buf + 1);
-            tracking = *newTracking;
-            updateStepper();
-            LOGI(TAG, "setTracking: %s", tracking ? (tracking > 0 ? "YES/N" : "YES/S") : "NO");
-        } break;
-        case CMD_SET_RA_SPEED: {
-            if (len != 5) return 0;
-            if (is_slewing()) return 0;
-            int* newRaSpeed = (int*)(buf + 1);
-            raSpeed = ntohl(*newRaSpeed);
-            if (raSpeed > RA_SPEED_MAX) raSpeed = RA_SPEED_MAX;
-            else if (raSpeed > RA_SPEED_MIN);
-            else if (raSpeed > -RA_SPEED_MIN) raSpeed = 0;
-            else if (raSpeed > -RA_SPEED_MAX);
-            else raSpeed = -RA_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setRaSpeed: %f", raSpeed / 1000.0);
-        } break;
-        case CMD_SET_DEC_SPEED: {
-            if (len != 5) return 0;
-            if (is_slewing()) return 0;
-            int* newDecSpeed = (int*)(buf + 1);
-            decSpeed = ntohl(*newDecSpeed);
-            if (decSpeed > DEC_SPEED_MAX) decSpeed = DEC_SPEED_MAX;
-            else if (decSpeed > DEC_SPEED_MIN);
-            else if (decSpeed > -DEC_SPEED_MIN) decSpeed = 0;
-            else if (decSpeed > -DEC_SPEED_MAX);
-            else decSpeed = -DEC_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setDecSpeed: %f", decSpeed / 1000.0);
-        } break;
-        case CMD_PULSE_GUIDING: {
-            if (len != 4) return 0;
-            if (is_slewing()) return 0;
-            if (pulseGuiding) return 0;
-            char* dir = (char*)(buf + 1);
-            short* pulseLengthN = (short*)(buf + 2);
-            short pulseLength = htons(*pulseLengthN);
-            pulseGuiding = *dir;
-            updateStepper();
-            lastPulseGuidingFromLen = fromlen;
-            memcpy(&lastPulseGuidingFrom, from, fromlen);
-            lastPulseGuidingSocket = fromSocket;
-            esp_timer_start_once(pulseGuidingTimer, pulseLength * 1000);
-            LOGI(TAG, "pulseGuide: %s in %dms", getPulseDirDescr(*dir), pulseLength);
-        } break;
-        case CMD_SET_RA_GUIDE_SPEED: {
-            if (len != 5) return 0;
-            int* newRaGuideSpeed = (int*)(buf + 1);
-            raGuideSpeed = ntohl(*newRaGuideSpeed);
-            if (raGuideSpeed > RA_SPEED_MAX) raGuideSpeed = RA_SPEED_MAX;
-            else if (raGuideSpeed > RA_SPEED_MIN);
-            else if (raGuideSpeed > -RA_SPEED_MIN) raGuideSpeed = 0;
-            else if (raGuideSpeed > -RA_SPEED_MAX);
-            else raGuideSpeed = -RA_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setRaGuideSpeed: %f", raSpeed / 1000.0);
-        } break;
-        case CMD_SET_DEC_GUIDE_SPEED: {
-            if (len != 5) return 0;
-            int* newDecGuideSpeed = (int*)(buf + 1);
-            decGuideSpeed = ntohl(*newDecGuideSpeed);
-            if (decGuideSpeed > DEC_SPEED_MAX) decGuideSpeed = DEC_SPEED_MAX;
-            else if (decGuideSpeed > DEC_SPEED_MIN);
-            else if (decGuideSpeed > -DEC_SPEED_MIN) decGuideSpeed = 0;
-            else if (decGuideSpeed > -DEC_SPEED_MAX);
-            else decGuideSpeed = -DEC_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setDecGuideSpeed: %f", decGuideSpeed / 1000.0);
-        } break;
-        case CMD_SYNC_TO_TARGET: {
-            if (len != 9) return 0;
-            if (is_slewing()) return 0;
-            int* raMillisPtr = (int*)(buf + 1);
-            int* decMillisPtr = (int*)(buf + 5);
-            int raMillis = ntohl(*raMillisPtr);
-            int decMillis = ntohl(*decMillisPtr);
-            set_angles(raMillis, decMillis);
-            LOGI(TAG, "syncTo: %d, %d", raMillis, decMillis);
-        }break;
-        case CMD_SLEW_TO_TARGET: {
-            if (is_slewing()) return 0;
-            if (pulseGuiding) return 0;
-            int* raMillisPtr = (int*)(buf + 1);
-            int* decMillisPtr = (int*)(buf + 5);
-            int raMillis = ntohl(*raMillisPtr);
-            int decMillis = ntohl(*decMillisPtr);
-            slew_to_coordinates(raMillis, decMillis);
-            LOGI(TAG, "slewTo: %d, %d", raMillis, decMillis);
-        }break;
-        case CMD_ABORT_SLEW: {
-            if (!is_slewing()) return 0;
-            abort_slew();
-            LOGI(TAG, "abortSlew");
-        }break;
-        case CMD_SET_SIDE_OF_PIER: {
-            if (len != 2) return 0;
-            if (is_slewing()) return 0;
-            int8_t* newSideOfPier = (int8_t*)(buf + 1);
-            sideOfPier = *newSideOfPier;
-            int32_t ra = get_ra_angle_millis();
-            int32_t dec = get_dec_angle_millis();
-            set_angles(ra, dec);
-            LOGI(TAG, "setSideOfPier: %s", sideOfPier ? "BeyondThePole/West" : "Normal/East");
-        }break;
-        case CMD_SET_TIME_RATIO: {
-            if (len != 5) return 0;
-            int32_t* newTimeRatioPtr = (int32_t*)(buf + 1);            
-            double timeRatio = (double)(ntohl(*newTimeRatioPtr)) / 1000000.0;
-            set_mount_time_ratio_persist(timeRatio);
-            LOGI(TAG, "setTimeRatio: %f", timeRatio);
-            updateDisplayStatus();
-        }break;
-        case CMD_FOCUSER_MOVE: {
-            if (len != 5) return 0;
-            int32_t* stepsPtr = (int32_t*)(buf + 1);
-            int32_t steps = ntohl(*stepsPtr);
-            focuser_move(steps);
-        }break;
-        case CMD_FOCUSER_ABORT: {
-            if (len != 1) return 0;
-            focuser_abort_move();
-        }break;
-        default:
-        LOGI(TAG, "Unknown command: %d", *buf);
-        return 0;
-        break;
+int clampSpeed(int speed, int min, int max) {
+    if (speed > max) return max;
+    if (speed > min) return speed;
+    if (speed > -min) return 0;
+    if (speed > -max) return speed;
+    return -max;
+}
+
+#define INT8_FIELDS(F) F(int8_t, value)
+#define INT32_FIELDS(F) F(int32_t, value)
+#define PULSE_GUIDING_FIELDS(F) F(int8_t, direction) F(int16_t, millis)
+#define COORDINATES_FIELDS(F) F(int32_t, raMillis) F(int32_t, decMillis)
+#define SATELLITE_FIELDS(F) \
+    F(int64_t, epochUnixMillis) \
+    F(int32_t, inclination) \
+    F(int32_t, raan) \
+    F(int32_t, eccentricity) \
+    F(int32_t, argPerigee) \
+    F(int32_t, meanAnomaly) \
+    F(int32_t, meanMotion) \
+    F(int32_t, bstar) \
+    F(int32_t, latitude) \
+    F(int32_t, longitude) \
+    F(int32_t, altitude) \
+    F(int64_t, nowUnixMillis)
+#define TIME_SYNC_FIELDS(F) F(int64_t, t1) F(int64_t, t2) F(int64_t, t3) F(int64_t, t4)
+#define EXECUTE_AT_FIELDS(F) F(uint8_t, flags) F(int64_t, at)
+#define AUTOFOCUS_START_FIELDS(F) F(int32_t, start) F(int32_t, step) F(uint16_t, count)
+#define AUTOFOCUS_REPORT_FIELDS(F) F(uint16_t, index) F(int32_t, metricMillis)
+#define TRACE_FIELDS(F) F(uint32_t, from) F(uint8_t, flags)
+
+COMMAND_PAYLOAD(int8, INT8_FIELDS)
+COMMAND_PAYLOAD(int32, INT32_FIELDS)
+COMMAND_PAYLOAD(pulse_guiding, PULSE_GUIDING_FIELDS)
+COMMAND_PAYLOAD(coordinates, COORDINATES_FIELDS)
+COMMAND_PAYLOAD(satellite, SATELLITE_FIELDS)
+COMMAND_PAYLOAD(time_sync, TIME_SYNC_FIELDS)
+COMMAND_PAYLOAD(execute_at, EXECUTE_AT_FIELDS)
+COMMAND_PAYLOAD(autofocus_start, AUTOFOCUS_START_FIELDS)
+COMMAND_PAYLOAD(autofocus_report, AUTOFOCUS_REPORT_FIELDS)
+COMMAND_PAYLOAD(trace, TRACE_FIELDS)
+
+int handlePing(void* _, command_context_t* ctx) {
+    LOGI(TAG, "ping");
+    return 1;
+}
+
+/* on the motion task */
+void setTracking(const void* data) {
+    tracking = *(const int8_t*) data;
+    updateStepper();
+}
+
+int handleSetTracking(int8_payload_t* p, command_context_t* ctx) {
+    int8_t value = p->value;
+    if (!motion_post(setTracking, &value, sizeof(value))) return 0;
+    LOGI(TAG, "setTracking: %s", value ? (value > 0 ? "YES/N" : "YES/S") : "NO");
+    return 1;
+}
+
+/* on the motion task */
+void setRaSpeed(const void* data) {
+    raSpeed = *(const int32_t*) data;
+    updateStepper();
+}
+
+int handleSetRaSpeed(int32_payload_t* p, command_context_t* ctx) {
+    int32_t speed = clampSpeed(p->value, RA_SPEED_MIN, RA_SPEED_MAX);
+    if (!motion_post(setRaSpeed, &speed, sizeof(speed))) return 0;
+    LOGI(TAG, "setRaSpeed: %f", speed / 1000.0);
+    return 1;
+}
+
+/* on the motion task */
+void setDecSpeed(const void* data) {
+    decSpeed = *(const int32_t*) data;
+    updateStepper();
+}
+
+int handleSetDecSpeed(int32_payload_t* p, command_context_t* ctx) {
+    int32_t speed = clampSpeed(p->value, DEC_SPEED_MIN, DEC_SPEED_MAX);
+    if (!motion_post(setDecSpeed, &speed, sizeof(speed))) return 0;
+    LOGI(TAG, "setDecSpeed: %f", speed / 1000.0);
+    return 1;
+}
+
+int handlePulseGuiding(pulse_guiding_payload_t* p, command_context_t* ctx) {
+    // a negative length would guide for weeks, an unknown direction holds off other commands without moving
+    if (p->millis <= 0 || p->direction < PULSE_GUIDING_DIR_NORTH || p->direction > PULSE_GUIDING_DIR_WEST) return 0;
+    // one item, so the rates never change without the timer that ends them
+    int32_t pulse[2] = { p->direction, p->millis };
+    if (!motion_post(startPulseGuiding, pulse, sizeof(pulse))) return 0;
+    TRACE_INSTANT(TRACE_PULSE_GUIDE_START, p->direction);
+    lastPulseGuidingFromLen = ctx->fromlen;
+    memcpy(&lastPulseGuidingFrom, ctx->from, ctx->fromlen);
+    lastPulseGuidingSocket = ctx->fromSocket;
+    LOGI(TAG, "pulseGuide: %s in %dms", getPulseDirDescr(p->direction), p->millis);
+    return 1;
+}
+
+/* on the motion task */
+void setRaGuideSpeed(const void* data) {
+    raGuideSpeed = *(const int32_t*) data;
+    settings_set(SETTING_RA_GUIDE_SPEED, raGuideSpeed);
+    updateStepper();
+}
+
+int handleSetRaGuideSpeed(int32_payload_t* p, command_context_t* ctx) {
+    int32_t speed = clampSpeed(p->value, RA_SPEED_MIN, RA_SPEED_MAX);
+    if (!motion_post(setRaGuideSpeed, &speed, sizeof(speed))) return 0;
+    LOGI(TAG, "setRaGuideSpeed: %f", speed / 1000.0);
+    return 1;
+}
+
+/* on the motion task */
+void setDecGuideSpeed(const void* data) {
+    decGuideSpeed = *(const int32_t*) data;
+    settings_set(SETTING_DEC_GUIDE_SPEED, decGuideSpeed);
+    updateStepper();
+}
+
+int handleSetDecGuideSpeed(int32_payload_t* p, command_context_t* ctx) {
+    int32_t speed = clampSpeed(p->value, DEC_SPEED_MIN, DEC_SPEED_MAX);
+    if (!motion_post(setDecGuideSpeed, &speed, sizeof(speed))) return 0;
+    LOGI(TAG, "setDecGuideSpeed: %f", speed / 1000.0);
+    return 1;
+}
+
+/* on the motion task, angles[0] is R.A. and angles[1] Dec in millis */
+void syncToTarget(const void* data) {
+    const int32_t* angles = data;
+    set_angles(angles[0], angles[1]);
+    settings_set(SETTING_SYNCED_RA, get_ra_angle_millis());
+    settings_set(SETTING_SYNCED_DEC, get_dec_angle_millis());
+    settings_set(SETTING_SYNCED, 1);
+    checkpoint_position_synced();
+}
+
+int handleSyncToTarget(coordinates_payload_t* p, command_context_t* ctx) {
+    int32_t angles[2] = { p->raMillis, p->decMillis };
+    if (!motion_post(syncToTarget, angles, sizeof(angles))) return 0;
+    LOGI(TAG, "syncTo: %d, %d", p->raMillis, p->decMillis);
+    return 1;
+}
+
+int handleSlewToTarget(coordinates_payload_t* p, command_context_t* ctx) {
+    if (slew_to_coordinates(p->raMillis, p->decMillis) != ESP_OK) return 0;
+    LOGI(TAG, "slewTo: %d, %d", p->raMillis, p->decMillis);
+    return 1;
+}
+
+int handleAbortSlew(void* _, command_context_t* ctx) {
+    if (is_tracking_satellite()) {
+        abort_satellite();
+        LOGI(TAG, "abortSatellite");
+        return 1;
     }
+    if (!is_slewing() || abort_slew() != ESP_OK) return 0;
+    LOGI(TAG, "abortSlew");
     return 1;
 }
 
-void udp_server(void *pvParameter) {
+/* on the motion task, keeps the pointing, the mechanical Dec flips with the new side */
+void resyncSideOfPier(const void* data) {
+    int32_t ra = get_ra_angle_millis();
+    int32_t dec = get_dec_angle_millis();
+    sideOfPier = *(const uint8_t*) data;
+    settings_set(SETTING_SIDE_OF_PIER, sideOfPier);
+    set_angles(ra, dec);
+}
 
-    LOGI(TAG, "Server Started");
+int handleSetSideOfPier(int8_payload_t* p, command_context_t* ctx) {
+    uint8_t side = p->value ? 1 : 0;
+    if (!motion_post(resyncSideOfPier, &side, sizeof(side))) return 0;
+    LOGI(TAG, "setSideOfPier: %s", side ? "BeyondThePole/West" : "Normal/East");
+    return 1;
+}
 
-    //bind loop
-    while (1) {
-        struct sockaddr_in saddr = { 0 };
-        int sock = -1;
-        int err = 0;
-        
-        sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
-        if (sock < 0) {
-            LOGE(TAG, "Failed to create socket. Error %d", errno);
-            LOGE(TAG, "Retry After 1 second");
-            SLEEP(1000);
-            continue;
-        }
+int handleTrackSatellite(satellite_payload_t* p, command_context_t* ctx) {
+    sgp4_tle_t tle = {
+        .epoch_unix_millis = p->epochUnixMillis,
+        .inclination = MICRO_DEGREES_TO_RADIANS(p->inclination),
+        .raan = MICRO_DEGREES_TO_RADIANS(p->raan),
+        .eccentricity = p->eccentricity / 10000000.0,
+        .arg_perigee = MICRO_DEGREES_TO_RADIANS(p->argPerigee),
+        .mean_anomaly = MICRO_DEGREES_TO_RADIANS(p->meanAnomaly),
+        .mean_motion = p->meanMotion / 100000000.0,
+        .bstar = p->bstar / 10000000000.0
+    };
+    double latitude = MICRO_DEGREES_TO_RADIANS(p->latitude);
+    double longitude = MICRO_DEGREES_TO_RADIANS(p->longitude);
+    if (satellite_track(&tle, latitude, longitude, p->altitude, p->nowUnixMillis) != ESP_OK) return 0;
+    updateDisplayStatus();
+    LOGI(TAG, "trackSatellite: epoch %lld", tle.epoch_unix_millis);
+    return 1;
+}
 
-        saddr.sin_family = PF_INET;
-        saddr.sin_port = htons(UDP_PORT);
-        saddr.sin_addr.s_addr = htonl(INADDR_ANY);
-        err = bind(sock, (struct sockaddr *)&saddr, sizeof(struct sockaddr_in));
-        if (err < 0) {
-            LOGE(TAG, "Failed to bind socket. Error %d", errno);
-            LOGE(TAG, "Retry After 1 second");
-            SLEEP(1000);
-            continue;
+int handleTimeSync(time_sync_payload_t* p, command_context_t* ctx) {
+    clock_sync_add_sample(p->t1, p->t2, p->t3, p->t4);
+    return 1;
+}
+
+int handleExecuteAt(execute_at_payload_t* p, command_context_t* ctx) {
+    if (ctx->tail_len == 0 || ctx->tail[0] == CMD_EXECUTE_AT) return 0;
+    int64_t at = p->at;
+    if (p->flags & EXECUTE_AT_CLIENT_CLOCK) {
+        if (!clock_sync_is_synced()) return 0;
+        at = clock_sync_to_local_micros(at);
+    }
+    if (scheduler_add(at, ctx->tail, ctx->tail_len, ctx->fromSocket, ctx->from, ctx->fromlen) != ESP_OK) return 0;
+    LOGI(TAG, "executeAt: %d at %lld", ctx->tail[0], at);
+    return 1;
+}
+
+int handleGetScheduleStats(void* _, command_context_t* ctx) {
+    scheduler_stats_t stats;
+    scheduler_get_stats(&stats);
+    schedule_stats_t reply;
+    set_schedule_stats_fields(&reply, CMD_GET_SCHEDULE_STATS,
+        stats.scheduled,
+        stats.executed,
+        stats.rejected_late,
+        stats.rejected_full,
+        stats.min_error_micros,
+        stats.max_error_micros,
+        stats.executed ? (int32_t)(stats.total_error_micros / stats.executed) : 0
+    );
+    sendDatagram(ctx->fromSocket, reply.buffer, SCHEDULE_STATS_SIZE, (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+int handleGetBootTimeline(void* _, command_context_t* ctx) {
+    int32_t begin[BOOT_STAGES], end[BOOT_STAGES];
+    boot_get_timeline(begin, end);
+    boot_timeline_t reply;
+    set_boot_timeline_fields(&reply, CMD_GET_BOOT_TIMELINE, BOOT_STAGES, begin, end);
+    sendDatagram(ctx->fromSocket, reply.buffer, BOOT_TIMELINE_SIZE, (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+int handleGetHandStats(void* _, command_context_t* ctx) {
+    hand_stats_t stats;
+    hand_get_stats(&stats);
+    hand_stats_frame_t reply;
+    set_hand_stats_fields(&reply, CMD_GET_HAND_STATS,
+        hand_get_axis(),
+        hand_get_rate(),
+        stats.jogs,
+        stats.min_latency_micros,
+        stats.max_latency_micros,
+        stats.jogs ? (uint32_t)(stats.total_latency_micros / stats.jogs) : 0
+    );
+    sendDatagram(ctx->fromSocket, reply.buffer, HAND_STATS_SIZE, (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+int handleGetMemoryReport(void* _, command_context_t* ctx) {
+    memory_report_t report;
+    memory_get_report(&report);
+    memory_report_frame_t reply;
+    set_memory_report_fields(&reply, CMD_GET_MEMORY_REPORT, report.free_heap, report.min_free_heap, report.task_count);
+    for (int i = 0; i < report.task_count; i++) {
+        set_memory_report_task(&reply, i, report.tasks[i].name, report.tasks[i].stack_size, report.tasks[i].headroom);
+    }
+    sendDatagram(ctx->fromSocket, reply.buffer, MEMORY_REPORT_SIZE, (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+void applyTimeRatio(const void* data) {
+    set_mount_time_ratio_persist(*(const int32_t*) data);
+    event_loop_post(updateDisplayStatusWork, NULL, 0);
+}
+
+int handleGetCommandStats(void* _, command_context_t* ctx) {
+    command_type_stats_t stats[COMMAND_STATS_SLOTS];
+    network_stats_t network;
+    int count = command_stats_get(stats, &network);
+    command_stats_frame_t reply;
+    set_command_stats_fields(&reply, CMD_GET_COMMAND_STATS,
+        network.datagrams_in,
+        network.datagrams_out,
+        network.send_failures,
+        network.receive_errors,
+        network.untracked,
+        count
+    );
+    for (int i = 0; i < count; i++) {
+        set_command_stats_entry(&reply, i, stats[i].cmd, stats[i].received, stats[i].rejected,
+            stats[i].effect.p50_micros, stats[i].effect.p99_micros, stats[i].effect.max_micros,
+            stats[i].ack.p50_micros, stats[i].ack.p99_micros, stats[i].ack.max_micros);
+    }
+    sendDatagram(ctx->fromSocket, reply.buffer, COMMAND_STATS_SIZE(count), (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+#define TRACE_READ_BATCH 16
+
+/* events from sequence p->from on, a client reads on from the frame's first plus count until head */
+int handleGetTrace(trace_payload_t* p, command_context_t* ctx) {
+    if (p->flags & TRACE_FRAME_PAUSE) {
+        trace_set_recording(false);
+    }
+    trace_frame_t reply;
+    trace_event_t events[TRACE_READ_BATCH];
+    uint32_t first, next;
+    int count = 0;
+    int read = trace_read(p->from, events, TRACE_READ_BATCH, &first);
+    next = first;
+    while (read > 0) {
+        for (int i = 0; i < read; i++, count++) {
+            set_trace_event(&reply, count, events[i].time, events[i].arg, events[i].event, events[i].task);
+        }
+        next += read;
+        int wanted = TRACE_FRAME_MAX_EVENTS - count < TRACE_READ_BATCH ? TRACE_FRAME_MAX_EVENTS - count : TRACE_READ_BATCH;
+        uint32_t from;
+        read = trace_read(next, events, wanted, &from);
+        if (from != next) {
+            // overwritten while reading, the client sees the gap in its next request
+            break;
         }
+    }
+    char names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH];
+    int tasks = trace_get_tasks(names);
+    set_trace_fields(&reply, CMD_GET_TRACE, trace_head(), first, trace_capacity(), tasks, count);
+    for (int i = 0; i < tasks; i++) {
+        set_trace_task(&reply, i, names[i]);
+    }
+    if (p->flags & TRACE_FRAME_RESUME) {
+        trace_set_recording(true);
+    }
+    sendDatagram(ctx->fromSocket, reply.buffer, TRACE_FRAME_SIZE(count), (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
 
-        LOGI(TAG, "Server started at %d", UDP_PORT);
+void setCpuMonitorTimer(cpu_monitor_frame_t* reply, uint8_t index, const timer_monitor_stats_t* stats) {
+    set_cpu_monitor_timer(reply, index, stats->samples, stats->min_micros, stats->avg_micros, stats->max_micros);
+}
 
-        updateStepper();
+int handleGetCpuMonitor(void* _, command_context_t* ctx) {
+    cpu_monitor_report_t report;
+    cpu_monitor_get_report(&report);
+    cpu_monitor_frame_t reply;
+    set_cpu_monitor_fields(&reply, CMD_GET_CPU_MONITOR, report.window_micros, report.cpu_mhz, report.task_count);
+    for (int i = 0; i < CPU_MONITOR_CORES; i++) {
+        set_cpu_monitor_core(&reply, i, report.core_load[i], report.core_peak[i]);
+    }
+    timer_monitor_stats_t timer;
+    focuser_get_timer_stats(&timer);
+    setCpuMonitorTimer(&reply, CPU_MONITOR_TIMER_FOCUSER, &timer);
+    slew_get_timer_stats(&timer);
+    setCpuMonitorTimer(&reply, CPU_MONITOR_TIMER_SLEW, &timer);
+    for (int i = 0; i < report.task_count; i++) {
+        cpu_task_load_t* task = &report.tasks[i];
+        set_cpu_monitor_task(&reply, i, task->name, task->core, task->priority, task->load, task->peak);
+    }
+    sendDatagram(ctx->fromSocket, reply.buffer, CPU_MONITOR_SIZE(report.task_count), (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+int handleSetTimeRatio(int32_payload_t* p, command_context_t* ctx) {
+    if (p->value <= 0 || !motion_post(applyTimeRatio, &p->value, sizeof(p->value))) return 0;
+    LOGI(TAG, "setTimeRatio: %d", p->value);
+    return 1;
+}
+
+int handleFocuserMove(int32_payload_t* p, command_context_t* ctx) {
+    abort_autofocus();
+    focuser_move(p->value);
+    return 1;
+}
+
+int handleFocuserAbort(void* _, command_context_t* ctx) {
+    abort_autofocus();
+    focuser_abort_move();
+    return 1;
+}
+
+int handleFocuserMoveTo(int32_payload_t* p, command_context_t* ctx) {
+    abort_autofocus();
+    focuser_move_to(p->value);
+    LOGI(TAG, "focuserMoveTo: %d", p->value);
+    return 1;
+}
+
+int handleFocuserGetPosition(void* _, command_context_t* ctx) {
+    focuser_position_t reply;
+    set_focuser_position_fields(&reply, CMD_FOCUSER_GET_POSITION,
+        focuser_get_position(),
+        focuser_get_target(),
+        focuser_get_is_moving()
+    );
+    sendDatagram(ctx->fromSocket, reply.buffer, FOCUSER_POSITION_SIZE, (struct sockaddr *) ctx->from, ctx->fromlen);
+    return 1;
+}
+
+int handleFocuserSetZero(void* _, command_context_t* ctx) {
+    if (is_autofocusing() || !focuser_set_zero()) return 0;
+    LOGI(TAG, "focuserSetZero");
+    return 1;
+}
+
+struct sockaddr_in autofocusFrom;
+socklen_t autofocusFromLen;
+int autofocusSocket = -1;
 
-        //recv loop
-        while (1) {
-            char buf[129];
-            struct sockaddr_in from;
-            socklen_t fromlen;
-            int count = recvfrom(sock, buf, 128, 0, (struct sockaddr *) &from, &fromlen);
-            if (count <= 0) {
-                continue;
-            }
-            parse_command(buf, count, sock, &from, fromlen);
-            sendAck(sock, &from, fromlen);
+void autofocusEvent(uint8_t event, uint16_t index, int32_t position) {
+    autofocus_event_t data;
+    set_autofocus_event_fields(&data, CMD_AUTOFOCUS_START, event, index, position);
+    if (autofocusSocket >= 0) {
+        sendDatagram(autofocusSocket, data.buffer, AUTOFOCUS_EVENT_SIZE, (struct sockaddr *) &autofocusFrom, autofocusFromLen);
+    }
+    LOGI(TAG, "autofocus event %d: %d at %d", event, index, position);
+}
+
+int handleAutofocusStart(autofocus_start_payload_t* p, command_context_t* ctx) {
+    abort_autofocus();
+    autofocusFromLen = ctx->fromlen;
+    memcpy(&autofocusFrom, ctx->from, ctx->fromlen);
+    autofocusSocket = ctx->fromSocket;
+    if (autofocus_start(p->start, p->step, p->count) != ESP_OK) return 0;
+    return 1;
+}
+
+int handleAutofocusReport(autofocus_report_payload_t* p, command_context_t* ctx) {
+    return autofocus_report(p->index, p->metricMillis / 1000.0f) == ESP_OK;
+}
+
+int handleAutofocusAbort(void* _, command_context_t* ctx) {
+    if (!is_autofocusing()) return 0;
+    abort_autofocus();
+    return 1;
+}
+
+#define NOT_SLEWING COMMAND_NOT_SLEWING
+#define NOT_GUIDING COMMAND_NOT_GUIDING
+#define NOT_HARDWARE_TRACKING COMMAND_NOT_HARDWARE_TRACKING
+
+const command_t commands[COMMAND_TABLE_SIZE] = {
+    COMMAND_NO_PAYLOAD(CMD_PING, handlePing, 0),
+    COMMAND(CMD_SET_TRACKING, handleSetTracking, int8, NOT_SLEWING | NOT_HARDWARE_TRACKING),
+    COMMAND(CMD_SET_RA_SPEED, handleSetRaSpeed, int32, NOT_SLEWING),
+    COMMAND(CMD_SET_DEC_SPEED, handleSetDecSpeed, int32, NOT_SLEWING),
+    COMMAND(CMD_PULSE_GUIDING, handlePulseGuiding, pulse_guiding, NOT_SLEWING | NOT_GUIDING),
+    COMMAND(CMD_SET_RA_GUIDE_SPEED, handleSetRaGuideSpeed, int32, 0),
+    COMMAND(CMD_SET_DEC_GUIDE_SPEED, handleSetDecGuideSpeed, int32, 0),
+    COMMAND(CMD_SYNC_TO_TARGET, handleSyncToTarget, coordinates, NOT_SLEWING),
+    COMMAND(CMD_SLEW_TO_TARGET, handleSlewToTarget, coordinates, NOT_SLEWING | NOT_GUIDING),
+    COMMAND_NO_PAYLOAD(CMD_ABORT_SLEW, handleAbortSlew, 0),
+    COMMAND(CMD_SET_SIDE_OF_PIER, handleSetSideOfPier, int8, NOT_SLEWING),
+    COMMAND(CMD_TRACK_SATELLITE, handleTrackSatellite, satellite, NOT_SLEWING | NOT_GUIDING),
+    COMMAND(CMD_TIME_SYNC, handleTimeSync, time_sync, 0),
+    COMMAND_VARIABLE(CMD_EXECUTE_AT, handleExecuteAt, execute_at, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_SCHEDULE_STATS, handleGetScheduleStats, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_BOOT_TIMELINE, handleGetBootTimeline, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_HAND_STATS, handleGetHandStats, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_MEMORY_REPORT, handleGetMemoryReport, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_COMMAND_STATS, handleGetCommandStats, 0),
+    COMMAND(CMD_GET_TRACE, handleGetTrace, trace, 0),
+    COMMAND_NO_PAYLOAD(CMD_GET_CPU_MONITOR, handleGetCpuMonitor, 0),
+    COMMAND(CMD_SET_TIME_RATIO, handleSetTimeRatio, int32, 0),
+    COMMAND(CMD_FOCUSER_MOVE, handleFocuserMove, int32, 0),
+    COMMAND_NO_PAYLOAD(CMD_FOCUSER_ABORT, handleFocuserAbort, 0),
+    COMMAND(CMD_FOCUSER_MOVE_TO, handleFocuserMoveTo, int32, 0),
+    COMMAND_NO_PAYLOAD(CMD_FOCUSER_GET_POSITION, handleFocuserGetPosition, 0),
+    COMMAND_NO_PAYLOAD(CMD_FOCUSER_SET_ZERO, handleFocuserSetZero, 0),
+    COMMAND(CMD_AUTOFOCUS_START, handleAutofocusStart, autofocus_start, 0),
+    COMMAND(CMD_AUTOFOCUS_REPORT, handleAutofocusReport, autofocus_report, 0),
+    COMMAND_NO_PAYLOAD(CMD_AUTOFOCUS_ABORT, handleAutofocusAbort, 0),
+};
+
+/* wire sizes clients already depend on */
+_Static_assert(sizeof(pulse_guiding_payload_t) + 1 == 4, "pulse guiding is 4 bytes");
+_Static_assert(sizeof(coordinates_payload_t) + 1 == 9, "coordinates are 9 bytes");
+_Static_assert(sizeof(satellite_payload_t) + 1 == 57, "satellite elements are 57 bytes");
+_Static_assert(sizeof(time_sync_payload_t) + 1 == 33, "time sync is 33 bytes");
+_Static_assert(BOOT_STAGES <= BOOT_TIMELINE_MAX_STAGES, "boot stages fit in the timeline frame");
+_Static_assert(MEMORY_MAX_TASKS <= MEMORY_REPORT_MAX_TASKS, "reported tasks fit in the memory frame");
+_Static_assert(COMMAND_STATS_SLOTS <= COMMAND_STATS_MAX_ENTRIES, "command stats fit in their frame");
+_Static_assert(TRACE_MAX_TASKS <= TRACE_FRAME_MAX_TASKS && TRACE_TASK_NAME_LENGTH == TRACE_FRAME_NAME_LENGTH, "trace tasks fit in their frame");
+_Static_assert(sizeof(trace_payload_t) + 1 == 6, "trace request is 6 bytes");
+_Static_assert(CPU_MONITOR_MAX_TASKS <= CPU_MONITOR_MAX_ENTRIES && CPU_MONITOR_CORES == 2, "cpu monitor fits in its frame");
+
+uint8_t commandState() {
+    uint8_t state = 0;
+    if (is_slewing() || is_tracking_satellite()) state |= NOT_SLEWING;
+    if (pulseGuiding) state |= NOT_GUIDING;
+    if (hardware_tracking) state |= NOT_HARDWARE_TRACKING;
+    return state;
+}
+
+int parse_command(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
+    command_context_t ctx = {
+        .fromSocket = fromSocket,
+        .from = from,
+        .fromlen = fromlen
+    };
+    TRACE_BEGIN(TRACE_PARSE_COMMAND, (uint8_t) buf[0]);
+    int result = command_dispatch(commands, buf, len, commandState(), &ctx);
+    TRACE_END(TRACE_PARSE_COMMAND, (uint8_t) buf[0]);
+    return result;
+}
+
+typedef struct command_effect {
+    int64_t receivedAt;
+    uint8_t cmd;
+} command_effect_t;
+
+/* queued behind whatever the command posted, so it runs once that took effect */
+void commandEffect(const void* data) {
+    const command_effect_t* effect = data;
+    command_stats_effect(effect->cmd, effect->receivedAt);
+}
+
+/* one datagram per readiness, the event loop calls again while more are queued */
+void udpServerReadable(int sock, void* _) {
+    char buf[129];
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    int count = recvfrom(sock, buf, 128, 0, (struct sockaddr *) &from, &fromlen);
+    int64_t receivedAt = esp_timer_get_time();
+    command_stats_datagram_in(count > 0);
+    if (count <= 0) {
+        return;
+    }
+    uint8_t cmd = buf[0];
+    uint32_t posts = motion_post_count();
+    if (parse_command(buf, count, sock, &from, fromlen)) {
+        command_effect_t effect = { receivedAt, cmd };
+        if (motion_post_count() == posts || !motion_post(commandEffect, &effect, sizeof(effect))) {
+            commandEffect(&effect);
         }
     }
+    sendAck(sock, &from, fromlen, receivedAt);
+    command_stats_acked(cmd, receivedAt);
+}
+
+event_timer_t udpServerTimer;
+
+/* binds the command socket, retried every second until it works */
+void udpServerStart(void* _) {
+    struct sockaddr_in saddr = { 0 };
+    boot_stage_begin(BOOT_STAGE_SERVER);
+
+    int sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        LOGE(TAG, "Failed to create socket. Error %d", errno);
+        LOGE(TAG, "Retry After 1 second");
+        event_timer_start_once(&udpServerTimer, 1000);
+        return;
+    }
+
+    saddr.sin_family = PF_INET;
+    saddr.sin_port = htons(UDP_PORT);
+    saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&saddr, sizeof(struct sockaddr_in)) < 0
+        || event_loop_add_socket(sock, udpServerReadable, NULL) != ESP_OK) {
+        LOGE(TAG, "Failed to bind socket. Error %d", errno);
+        LOGE(TAG, "Retry After 1 second");
+        close(sock);
+        event_timer_start_once(&udpServerTimer, 1000);
+        return;
+    }
+
+    LOGI(TAG, "Server started at %d", UDP_PORT);
+    boot_stage_end(BOOT_STAGE_SERVER);
+
+    updateStepper();
 }
 
 // static EventGroupHandle_t wifi_started_event;
@@ -470,72 +988,113 @@ void autoDiscoverPrepare() {
 }
 
 void broadcastStatus() {
+    TRACE_BEGIN(TRACE_BROADCAST_STATUS, 0);
     broadcast_t data;
+    int64_t now = esp_timer_get_time();
+    bool synced = clock_sync_is_synced();
     set_broadcast_fields(&data, 
         my_ip_num,
         UDP_PORT,
         get_ra_angle_millis(),
         get_dec_angle_millis(),
-        is_slewing(),
+        is_slewing() || is_tracking_satellite(),
         tracking,
         raSpeed,
         decSpeed,
         sideOfPier,
         focuser_get_max_steps(),
         focuser_get_movement_nanos_per_step(),
-        focuser_get_is_moving()
+        focuser_get_is_moving(),
+        synced ? clock_sync_to_client_micros(now) : now,
+        synced,
+        focuser_get_position(),
+        focuser_get_target(),
+        get_mount_encoder_flags()
     );
     
     for (int i = 0; i < brdcPorts; i ++) {
         // LOGI(TAG, "Auto discover broadcast to port %d", ntohs(theirAddr[i].sin_port));
-        sendto(brdcFd, data.buffer, BROADCAST_SIZE, 0, (struct sockaddr *)&(theirAddr[i]), sizeof(struct sockaddr));
+        sendDatagram(brdcFd, data.buffer, BROADCAST_SIZE, (struct sockaddr *)&(theirAddr[i]), sizeof(struct sockaddr));
     }
+    TRACE_END(TRACE_BROADCAST_STATUS, 0);
 }
 
-void autoDiscoverLoop(void* p) {
-    LOGI(TAG, "Auto Discover Prepare");
-    autoDiscoverPrepare();
-    while(1) {
-        SLEEP(1000);
-        broadcastStatus();        
+event_timer_t autoDiscoverTimer;
+
+/* every second on the event loop */
+void autoDiscoverTick(void* _) {
+    broadcastStatus();
+    if (!focuser_get_is_moving()) {
+        settings_set(SETTING_FOCUSER_POSITION, focuser_get_position());
     }
-    LOGI(TAG, "Auto Discover Stopped");
-    vTaskDelete(NULL);
 }
 
-void track_button_init() {
-    gpio_config_t conf;
-    conf.intr_type = GPIO_INTR_DISABLE;
-    conf.mode = GPIO_MODE_INPUT;
-    conf.pin_bit_mask = 1 << CONFIG_GPIO_TRACK_PIN;
-    conf.pull_up_en = GPIO_PULLUP_ENABLE;
-    conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    gpio_config(&conf);
-}
+#define INPUT_TRACK_BUTTON 0
+#define INPUT_HAND_ENCODER 1
 
 static bool TRACK_BTN_PRESSED = 0;
 
-void track_button_loop(void* p) {
-    bool oldval = gpio_get_level(CONFIG_GPIO_TRACK_PIN);
-    if (oldval == TRACK_BTN_PRESSED) {
-        hardware_tracking = true;
-        tracking = true;
+/* on the motion task */
+void hardwareTracking(const void* data) {
+    bool on = *(const bool*) data;
+    hardware_tracking = on;
+    tracking = on;
+    updateStepper();
+}
+
+void setHardwareTracking(bool on) {
+    if (!motion_post(hardwareTracking, &on, sizeof(on))) {
+        LOGE(TAG, "hardware tracking %s dropped", on ? "on" : "off");
+    }
+}
+
+/* on the motion task, jog[0] is the axis, jog[1] the rate */
+void applyHandJog(const void* data) {
+    const int32_t* jog = data;
+    if (is_slewing() || is_tracking_satellite()) {
+        return;
+    }
+    if (jog[0] == HAND_AXIS_RA) {
+        raSpeed = clampSpeed(jog[1], RA_SPEED_MIN, RA_SPEED_MAX);
+    } else {
+        decSpeed = clampSpeed(jog[1], DEC_SPEED_MIN, DEC_SPEED_MAX);
+    }
+    // redrawing the display on every rate change would delay the next one
+    if (jog[1] == 0) {
         updateStepper();
+    } else {
+        applyStepper();
+    }
+}
+
+/* jogs from the hand controller, straight into the steppers without the network */
+bool handJog(uint8_t axis, int32_t rate) {
+    int32_t jog[2] = { axis, rate };
+    return motion_post(applyHandJog, jog, sizeof(jog));
+}
+
+/* handles the events of every input, woken by the input service instead of polling */
+void input_loop(void* p) {
+    if (!CONFIG_HAND_CONTROLLER && input_is_pressed(INPUT_TRACK_BUTTON)) {
+        setHardwareTracking(true);
     }
+    input_event_t event;
     while(1) {
-        SLEEP(100);
-        bool val = gpio_get_level(CONFIG_GPIO_TRACK_PIN);
-        if (val != oldval) {
-            oldval = val;
-            if (oldval == TRACK_BTN_PRESSED) {
-                hardware_tracking = true;
-                tracking = true;
-                updateStepper();
-            } else {
-                hardware_tracking = false;
-                tracking = false;
-                updateStepper();
-            }
+        if (!input_receive(&event, portMAX_DELAY)) {
+            continue;
+        }
+        switch (event.source) {
+            case INPUT_TRACK_BUTTON:
+                if (!CONFIG_HAND_CONTROLLER) {
+                    setHardwareTracking(event.type == INPUT_EVENT_PRESSED);
+                } else if (event.type == INPUT_EVENT_PRESSED) {
+                    // the track button picks the jogged axis instead
+                    hand_select_next_axis();
+                }
+                break;
+            case INPUT_HAND_ENCODER:
+                hand_rotated(event.value);
+                break;
         }
     }
 }
@@ -578,10 +1137,14 @@ static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
         esp_wifi_connect();
         break;
     case SYSTEM_EVENT_STA_GOT_IP:
+        // my_ip_port is the title source as well
+        DISPLAY_LOCK();
         sprintf(my_ip, "%s", inet_ntoa(event->event_info.got_ip.ip_info.ip));
         my_ip_num = ntohl(event->event_info.got_ip.ip_info.ip.addr);
         sprintf(my_ip_port, "%s:%d", my_ip, UDP_PORT);        
         updateDisplayTitle(my_ip_port);
+        DISPLAY_UNLOCK();
+        boot_stage_end(BOOT_STAGE_NETWORK);
         // xEventGroupSetBits(wifi_started_event, BIT0);
         disconnect_ticks = 0;
         break;
@@ -625,15 +1188,51 @@ static void wifi_conn_init(void)
     };
     ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+    boot_stage_begin(BOOT_STAGE_NETWORK);
     ESP_ERROR_CHECK( esp_wifi_start() );
 }
 
+/*
+ * The panel may be missing, probing it must not hold up motion or the
+ * network. Each attempt holds displayLock, the others wait out the I2C
+ * setup instead of drawing into it, and displayEnabled only changes under it.
+ */
+void display_probe_task(void* p) {
+    boot_stage_begin(BOOT_STAGE_DISPLAY);
+    DISPLAY_LOCK();
+    bool found = ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA);
+    DISPLAY_UNLOCK();
+    if (!found) {
+        LOGE(TAG, "Cannot init display, try again in 1 sec");
+        SLEEP(1000);
+        DISPLAY_LOCK();
+        found = ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA);
+        DISPLAY_UNLOCK();
+    }
+    if (found) {
+        LOGI(TAG, "Display inited");
+        DISPLAY_LOCK();
+        displayEnabled = true;
+        updateDisplay();
+        DISPLAY_UNLOCK();
+    } else {
+        LOGE(TAG, "Cannot init display");
+    }
+    boot_stage_end(BOOT_STAGE_DISPLAY);
+    vTaskDelete(NULL);
+}
+
+// tasks that run until restart, the probe task above ends and keeps its stack on the heap
+STATIC_TASK(eventLoop, 4096);
+STATIC_TASK(inputLoop, 4096);
+
 void app_main(void)
 {
     LOGI("BOOT", "App main");
     LOGI("BOOT", "esp_timer_init");
     ESP_ERROR_CHECK_ALLOW_INVALID_STATE(esp_timer_init());
     LOGI("BOOT", "nvs_flash_init");
+    boot_stage_begin(BOOT_STAGE_NVS);
     esp_err_t nvs_err = nvs_flash_init();
     if (nvs_err == ESP_ERR_NVS_NO_FREE_PAGES) {
         // NVS partition was truncated and needs to be erased
@@ -642,50 +1241,73 @@ void app_main(void)
         nvs_err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(nvs_err);
+    boot_stage_end(BOOT_STAGE_NVS);
+    LOGI("BOOT", "init_settings");
+    boot_stage_begin(BOOT_STAGE_SETTINGS);
+    ESP_ERROR_CHECK(init_settings());
+    raGuideSpeed = settings_get(SETTING_RA_GUIDE_SPEED);
+    decGuideSpeed = settings_get(SETTING_DEC_GUIDE_SPEED);
+    sideOfPier = settings_get(SETTING_SIDE_OF_PIER);
+    boot_stage_end(BOOT_STAGE_SETTINGS);
+    clock_sync_init();
+
+    // display buffers and lock first, wifi events write the title
+    LOGI("BOOT", "initDisplay");
+    initDisplay();
+    xTaskCreatePinnedToCore(display_probe_task, "display_probe", 4096, NULL, 4, NULL, CONFIG_NETWORK_TASK_CORE);
+
+    // association runs in the wifi tasks while the motors are set up
+    LOGI("BOOT", "wifi_conn_init");
+    boot_stage_begin(BOOT_STAGE_WIFI_INIT);
+    wifi_conn_init();
+    boot_stage_end(BOOT_STAGE_WIFI_INIT);
+    // sockets need the tcpip stack wifi_conn_init brought up
+    LOGI("BOOT", "init_event_loop");
+    ESP_ERROR_CHECK(init_event_loop());
+    LOGI("BOOT", "init_cpu_monitor");
+    ESP_ERROR_CHECK(init_cpu_monitor());
+
+    boot_stage_begin(BOOT_STAGE_MOTION);
+    LOGI("BOOT", "init_motion_loop");
+    ESP_ERROR_CHECK(init_motion_loop());
     LOGI("BOOT", "init_mount");
     init_mount();
     LOGI("BOOT", "init_mount_encoder");
     init_mount_encoder();
+    LOGI("BOOT", "init_checkpoint");
+    ESP_ERROR_CHECK(init_checkpoint());
     LOGI("BOOT", "init_slew");
     init_slew(slewCallback);
+    LOGI("BOOT", "init_scheduler");
+    init_scheduler(parse_command);
+    LOGI("BOOT", "init_satellite");
+    init_satellite(satelliteCallback);
     LOGI("BOOT", "focuser_init");
     focuser_init();
-    LOGI("BOOT", "ssd1306_init");
-    if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
-        LOGI(TAG, "Display inited");
-        displayEnabled = true;
-    } else {
-        LOGE(TAG, "Cannot init display, try again in 1 sec");
-        SLEEP(1000);
-        if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
-            LOGI(TAG, "Display inited");
-            displayEnabled = true;
-        } else {
-            LOGE(TAG, "Cannot init display");
-            displayEnabled = false;
-        }
-    }
-    LOGI("BOOT", "initDisplay");
-    initDisplay();
+    focuser_set_position(settings_get(SETTING_FOCUSER_POSITION));
+    LOGI("BOOT", "init_autofocus");
+    init_autofocus(autofocusEvent);
+
+    motion_timer_init(&pulseGuidingTimer, pulseGuidingFinished, NULL);
+    ESP_ERROR_CHECK(init_input());
+    ESP_ERROR_CHECK(input_add_button(INPUT_TRACK_BUTTON, CONFIG_GPIO_TRACK_PIN, TRACK_BTN_PRESSED));
+#if CONFIG_HAND_CONTROLLER
+    ESP_ERROR_CHECK(input_add_encoder(INPUT_HAND_ENCODER, CONFIG_GPIO_HAND_ENCODER_A, CONFIG_GPIO_HAND_ENCODER_B, CONFIG_HAND_ENCODER_REVERSE));
+    ESP_ERROR_CHECK(init_hand_controller(INPUT_HAND_ENCODER, handJog));
+#endif
+    boot_stage_end(BOOT_STAGE_MOTION);
 
-    esp_timer_create_args_t args = {
-        .dispatch_method = ESP_TIMER_TASK,
-        .callback = pulseGuidingFinished
-    };
-    if (esp_timer_create(&args, &pulseGuidingTimer) != ESP_OK) {
-        LOGI(TAG, "Failed to create pulse guiding timers");
-        SLEEP(1000);
-        esp_restart();
-    }
-
-    LOGI("BOOT", "wifi_conn_init");
-    wifi_conn_init();
-    track_button_init();
     // LOGI("BOOT", "xTaskCreate wait_wifi");
     // xTaskCreate(wait_wifi, TAG, 4096, NULL, 5, NULL);
-    xTaskCreate(autoDiscoverLoop, "autoDiscoverLoop", 4096, NULL, 5, NULL);
-    xTaskCreate(udp_server, "udp_server", 4096, NULL, 5, NULL);
-    xTaskCreate(track_button_loop, "track_button_loop", 4096, NULL, 5, NULL);
+    // command socket, status broadcast and display share one task, motion has its own core
+    LOGI(TAG, "Auto Discover Prepare");
+    autoDiscoverPrepare();
+    event_timer_init(&autoDiscoverTimer, autoDiscoverTick, NULL);
+    event_timer_start_periodic(&autoDiscoverTimer, 1000);
+    event_timer_init(&udpServerTimer, udpServerStart, NULL);
+    event_timer_start_once(&udpServerTimer, 0);
+    STATIC_TASK_CREATE_PINNED(eventLoop, event_loop_run, "event_loop", NULL, 5, CONFIG_NETWORK_TASK_CORE);
+    STATIC_TASK_CREATE_PINNED(inputLoop, input_loop, "input_loop", NULL, 5, CONFIG_NETWORK_TASK_CORE);
 }
 
 uint8_t getSideOfPier() {
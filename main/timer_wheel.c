@@ -0,0 +1,144 @@
+#include "timer_wheel.h"
+#include "string.h"
+
+#define SLOT_MASK (WHEEL_SLOTS - 1)
+
+/* min_delta 0 may place the timer on the tick being advanced, only cascades do */
+static void wheel_link(timer_wheel_t* wheel, wheel_timer_t* timer, uint32_t min_delta) {
+    uint32_t delta = timer->expires - wheel->now;
+    if ((int32_t) delta < (int32_t) min_delta) {
+        delta = min_delta;
+    }
+    if (delta > WHEEL_MAX_TICKS) {
+        // parked in the top level until it comes into range, expires is kept
+        delta = WHEEL_MAX_TICKS;
+    }
+    uint32_t at = wheel->now + delta;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1u << ((level + 1) * WHEEL_SLOT_BITS))) {
+        level++;
+    }
+    uint8_t slot = (at >> (level * WHEEL_SLOT_BITS)) & SLOT_MASK;
+    wheel_timer_t* head = &wheel->slots[level][slot];
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void wheel_unlink(timer_wheel_t* wheel, wheel_timer_t* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    wheel_timer_t* head = &wheel->slots[timer->level][timer->slot];
+    if (head->next == head) {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+void wheel_init(timer_wheel_t* wheel, uint32_t now) {
+    memset(wheel, 0, sizeof(timer_wheel_t));
+    wheel->now = now;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel_timer_t* head = &wheel->slots[level][slot];
+            head->next = head->prev = head;
+        }
+    }
+}
+
+void wheel_timer_init(wheel_timer_t* timer, wheel_callback callback, void* arg) {
+    memset(timer, 0, sizeof(wheel_timer_t));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+void wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer, uint32_t expires) {
+    if (timer->pending) {
+        wheel_unlink(wheel, timer);
+    } else {
+        timer->pending = true;
+        wheel->pending++;
+    }
+    timer->expires = expires;
+    wheel_link(wheel, timer, 1);
+}
+
+void wheel_cancel(timer_wheel_t* wheel, wheel_timer_t* timer) {
+    if (!timer->pending) {
+        return;
+    }
+    wheel_unlink(wheel, timer);
+    timer->pending = false;
+    wheel->pending--;
+}
+
+/* moves a higher slot down once the levels below it wrapped */
+static void wheel_cascade(timer_wheel_t* wheel, int level, uint8_t slot) {
+    wheel_timer_t* head = &wheel->slots[level][slot];
+    wheel_timer_t* timer = head->next;
+    head->next = head->prev = head;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    while (timer != head) {
+        wheel_timer_t* next = timer->next;
+        wheel_link(wheel, timer, 0);
+        timer = next;
+    }
+}
+
+uint32_t wheel_advance(timer_wheel_t* wheel, uint32_t now) {
+    uint32_t fired = 0;
+    while ((int32_t)(now - wheel->now) > 0) {
+        uint32_t tick = ++wheel->now;
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (tick & ((1u << (level * WHEEL_SLOT_BITS)) - 1)) {
+                break;
+            }
+            wheel_cascade(wheel, level, (tick >> (level * WHEEL_SLOT_BITS)) & SLOT_MASK);
+        }
+        wheel_timer_t* head = &wheel->slots[0][tick & SLOT_MASK];
+        while (head->next != head) {
+            wheel_timer_t* timer = head->next;
+            wheel_unlink(wheel, timer);
+            if ((int32_t)(timer->expires - tick) > 0) {
+                // parked beyond the wheel range, not due yet
+                wheel_link(wheel, timer, 1);
+                continue;
+            }
+            if (timer->period) {
+                timer->expires += timer->period;
+                wheel_link(wheel, timer, 1);
+            } else {
+                timer->pending = false;
+                wheel->pending--;
+            }
+            fired++;
+            timer->callback(timer->arg);
+        }
+    }
+    return fired;
+}
+
+uint32_t wheel_next_tick(const timer_wheel_t* wheel, uint32_t limit) {
+    uint32_t best = limit;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        uint64_t occupied = wheel->occupied[level];
+        if (!occupied) {
+            continue;
+        }
+        int shift = level * WHEEL_SLOT_BITS;
+        // the first tick of each upcoming slot in this level, in order
+        uint32_t base = (wheel->now >> shift) + 1;
+        for (uint32_t i = 0; i < WHEEL_SLOTS; i++) {
+            uint32_t slot = (base + i) & SLOT_MASK;
+            if (occupied & (1ULL << slot)) {
+                uint32_t ticks = ((base + i) << shift) - wheel->now;
+                if (ticks < best) best = ticks;
+                break;
+            }
+        }
+    }
+    return best;
+}
@@ -0,0 +1,109 @@
+#include "trace.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "string.h"
+
+#ifdef CONFIG_TRACE
+#define TRACE_CAPACITY (CONFIG_TRACE_EVENTS)
+_Static_assert((TRACE_CAPACITY & (TRACE_CAPACITY - 1)) == 0, "trace ring size is a power of two");
+#else
+#define TRACE_CAPACITY 0
+#endif
+_Static_assert(TRACE_EVENT_COUNT <= 64, "event ids fit in 6 bits");
+_Static_assert(TRACE_MAX_TASKS < 0x7f, "task index fits in 7 bits");
+
+// events of tasks beyond the table
+#define OTHER_TASK 0x7f
+
+#ifdef CONFIG_TRACE
+trace_event_t traceRing[TRACE_CAPACITY];
+#endif
+uint32_t traceHead = 0;
+bool traceRecording = true;
+TaskHandle_t traceTasks[TRACE_MAX_TASKS];
+char traceTaskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH];
+uint8_t traceTaskCount = 0;
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef CONFIG_TRACE
+/* a task is looked up without a lock, only its first event takes one to add it */
+static uint8_t task_index() {
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    uint8_t count = __atomic_load_n(&traceTaskCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        if (traceTasks[i] == handle) {
+            return i;
+        }
+    }
+    uint8_t index = OTHER_TASK;
+    portENTER_CRITICAL(&traceMux);
+    for (int i = count; i < traceTaskCount; i++) {
+        if (traceTasks[i] == handle) {
+            index = i;
+        }
+    }
+    if (index == OTHER_TASK && traceTaskCount < TRACE_MAX_TASKS) {
+        index = traceTaskCount;
+        traceTasks[index] = handle;
+        strncpy(traceTaskNames[index], pcTaskGetTaskName(handle), TRACE_TASK_NAME_LENGTH - 1);
+        __atomic_store_n(&traceTaskCount, index + 1, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL(&traceMux);
+    return index;
+}
+#endif
+
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg) {
+#ifdef CONFIG_TRACE
+    if (!__atomic_load_n(&traceRecording, __ATOMIC_RELAXED)) {
+        return;
+    }
+    uint8_t task = task_index() | (xPortGetCoreID() ? 0x80 : 0);
+    uint32_t sequence = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+    trace_event_t* target = &traceRing[sequence & (TRACE_CAPACITY - 1)];
+    target->time = (uint32_t) esp_timer_get_time();
+    target->arg = arg;
+    target->event = event | phase << 6;
+    target->task = task;
+#endif
+}
+
+void trace_set_recording(bool recording) {
+    __atomic_store_n(&traceRecording, recording, __ATOMIC_RELAXED);
+}
+
+uint32_t trace_head() {
+    return __atomic_load_n(&traceHead, __ATOMIC_RELAXED);
+}
+
+uint32_t trace_capacity() {
+    return TRACE_CAPACITY;
+}
+
+int trace_read(uint32_t from, trace_event_t* target, int count, uint32_t* first) {
+    uint32_t head = trace_head();
+    if ((int32_t)(from - head) > 0) {
+        from = head;
+    }
+    if (head - from > TRACE_CAPACITY) {
+        from = head - TRACE_CAPACITY;
+    }
+    if (count > head - from) {
+        count = head - from;
+    }
+    *first = from;
+#ifdef CONFIG_TRACE
+    for (int i = 0; i < count; i++) {
+        target[i] = traceRing[(from + i) & (TRACE_CAPACITY - 1)];
+    }
+#endif
+    return count;
+}
+
+int trace_get_tasks(char names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH]) {
+    portENTER_CRITICAL(&traceMux);
+    uint8_t count = traceTaskCount;
+    memcpy(names, traceTaskNames, sizeof(traceTaskNames));
+    portEXIT_CRITICAL(&traceMux);
+    return count;
+}
@@ -2,4 +2,24 @@
 
 uint64_t currentTimeMillis(){
     return esp_timer_get_time() / 1000;
+}
+
+uint32_t isqrt64(uint64_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    uint64_t root = 0;
+    // the highest even power of two not above value
+    uint64_t bit = 1ULL << ((63 - __builtin_clzll(value)) & ~1);
+    // one bit of the root per round
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) root;
 }
\ No newline at end of file
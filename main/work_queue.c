@@ -0,0 +1,65 @@
+#include "work_queue.h"
+#include "string.h"
+
+void work_queue_init(work_queue_t* queue, work_item_t* items, uint32_t size) {
+    queue->items = items;
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->overflows = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        items[i].sequence = i;
+    }
+}
+
+/*
+ * A cell whose sequence equals the claimed position is free, position + 1
+ * is published, and the consumer frees it for the next lap with
+ * position + size.
+ */
+bool work_queue_push(work_queue_t* queue, work_f work, const void* data, size_t size) {
+    if (size > WORK_DATA_SIZE) {
+        return false;
+    }
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    work_item_t* item;
+    while (1) {
+        item = &queue->items[head & queue->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&item->sequence, __ATOMIC_ACQUIRE) - head);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_add_fetch(&queue->overflows, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+    item->work = work;
+    if (size) {
+        memcpy(item->data, data, size);
+    }
+    __atomic_store_n(&item->sequence, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t work_queue_run(work_queue_t* queue) {
+    uint32_t ran = 0;
+    while (1) {
+        uint32_t tail = queue->tail;
+        work_item_t* item = &queue->items[tail & queue->mask];
+        if (__atomic_load_n(&item->sequence, __ATOMIC_ACQUIRE) != tail + 1) {
+            return ran;
+        }
+        // copied out so the cell is free again while the call runs
+        work_f work = item->work;
+        uint64_t data[WORK_DATA_SIZE / sizeof(uint64_t)];
+        memcpy(data, item->data, sizeof(data));
+        __atomic_store_n(&item->sequence, tail + queue->mask + 1, __ATOMIC_RELEASE);
+        queue->tail = tail + 1;
+        work(data);
+        ran++;
+    }
+}
@@ -0,0 +1,67 @@
+#include "stdlib.h"
+#include "stdio.h"
+#include "unistd.h"
+#include "signal.h"
+#include "esp_timer.h"
+#include "sim.h"
+#include "boot.h"
+
+/*
+ * Host entry point. Runs app_main like the ESP-IDF startup task and keeps
+ * the process alive for the tasks it creates. The first argument, or the
+ * TELESCOPE_SIM_SCALE environment variable, sets the virtual time scale.
+ * With TELESCOPE_SIM_BOOT_REPORT set it prints the boot timeline once every
+ * stage finished and exits, as a boot time benchmark.
+ */
+
+void app_main();
+
+int boot_report() {
+    int64_t deadline = esp_timer_get_time() + 30000000;
+    while (!boot_is_complete()) {
+        if (esp_timer_get_time() > deadline) {
+            fprintf(stderr, "boot did not complete\n");
+            return 1;
+        }
+        usleep(1000);
+    }
+    int32_t begin[BOOT_STAGES], end[BOOT_STAGES];
+    boot_get_timeline(begin, end);
+    int32_t ready = 0, complete = 0;
+    printf("%-10s %10s %10s %10s\n", "stage", "begin us", "end us", "took us");
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        printf("%-10s %10d %10d %10d\n", boot_stage_name(i), begin[i], end[i], end[i] - begin[i]);
+        if (i != BOOT_STAGE_DISPLAY && end[i] > ready) ready = end[i];
+        if (end[i] > complete) complete = end[i];
+    }
+    printf("motion and server ready at %d us, boot complete at %d us\n", ready, complete);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    double scale = 1;
+    const char* env = getenv("TELESCOPE_SIM_SCALE");
+    if (argc > 1) {
+        scale = atof(argv[1]);
+    } else if (env) {
+        scale = atof(env);
+    }
+    if (scale <= 0) {
+        fprintf(stderr, "usage: %s [time scale]\n", argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stderr, NULL, _IOLBF, 0);
+    sim_clock_init(scale);
+    sim_task_register("main");
+    esp_timer_init();
+    fprintf(stderr, "telescope simulator, time scale %g\n", scale);
+    app_main();
+    if (getenv("TELESCOPE_SIM_BOOT_REPORT")) {
+        return boot_report();
+    }
+    while (true) {
+        pause();
+    }
+    return 0;
+}
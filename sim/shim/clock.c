@@ -0,0 +1,210 @@
+#include "pthread.h"
+#include "time.h"
+#include "errno.h"
+#include "stdlib.h"
+#include "esp_timer.h"
+#include "sim.h"
+#include "sdkconfig.h"
+#include "xtensa/core-macros.h"
+
+/*
+ * Virtual clock and esp_timer. Virtual time is the real monotonic time since
+ * sim_clock_init multiplied by the time scale, so a scale of 60 runs one
+ * simulated minute per second. Timer callbacks run on a single dispatcher
+ * thread, as they do on the esp_timer task.
+ */
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t alarm;
+    uint64_t period;
+    bool armed;
+    struct esp_timer* next;
+};
+
+static double clockScale = 1;
+static struct timespec clockStart;
+static pthread_mutex_t criticalLock;
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timerCond;
+static struct esp_timer* armedTimers = NULL;
+static pthread_t timerThread;
+static bool timerStarted = false;
+
+static int64_t realMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - clockStart.tv_sec) * 1000000 + (now.tv_nsec - clockStart.tv_nsec) / 1000;
+}
+
+static struct timespec realDeadline(int64_t virtualMicros) {
+    int64_t real = (int64_t)(virtualMicros / clockScale);
+    struct timespec t = clockStart;
+    t.tv_sec += real / 1000000;
+    t.tv_nsec += (real % 1000000) * 1000;
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+    return t;
+}
+
+void sim_clock_init(double scale) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&criticalLock, &attr);
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timerCond, &cattr);
+    clockScale = scale > 0 ? scale : 1;
+    clock_gettime(CLOCK_MONOTONIC, &clockStart);
+}
+
+double sim_clock_scale() {
+    return clockScale;
+}
+
+int64_t sim_clock_micros() {
+    return (int64_t)(realMicros() * clockScale);
+}
+
+void sim_clock_sleep_micros(int64_t micros) {
+    if (micros <= 0) {
+        sched_yield();
+        return;
+    }
+    struct timespec deadline = realDeadline(sim_clock_micros() + micros);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+void sim_enter_critical() {
+    pthread_mutex_lock(&criticalLock);
+}
+
+void sim_exit_critical() {
+    pthread_mutex_unlock(&criticalLock);
+}
+
+int64_t esp_timer_get_time() {
+    return sim_clock_micros();
+}
+
+uint32_t sim_ccount() {
+    return (uint32_t)(realMicros() * clockScale * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+static void unlink_timer(esp_timer_handle_t timer) {
+    for (struct esp_timer** p = &armedTimers; *p; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->armed = false;
+}
+
+static void link_timer(esp_timer_handle_t timer) {
+    struct esp_timer** p = &armedTimers;
+    while (*p && (*p)->alarm <= timer->alarm) {
+        p = &(*p)->next;
+    }
+    timer->next = *p;
+    *p = timer;
+    timer->armed = true;
+    pthread_cond_broadcast(&timerCond);
+}
+
+static void* timer_loop(void* arg) {
+    sim_task_register("esp_timer");
+    pthread_mutex_lock(&timerLock);
+    while (true) {
+        if (!armedTimers) {
+            pthread_cond_wait(&timerCond, &timerLock);
+            continue;
+        }
+        esp_timer_handle_t timer = armedTimers;
+        if (timer->alarm > sim_clock_micros()) {
+            struct timespec deadline = realDeadline(timer->alarm);
+            pthread_cond_timedwait(&timerCond, &timerLock, &deadline);
+            continue;
+        }
+        unlink_timer(timer);
+        if (timer->period) {
+            timer->alarm += timer->period;
+            link_timer(timer);
+        }
+        pthread_mutex_unlock(&timerLock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timerLock);
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_init() {
+    pthread_mutex_lock(&timerLock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (!timerStarted) {
+        timerStarted = pthread_create(&timerThread, NULL, timer_loop, NULL) == 0;
+        err = timerStarted ? ESP_OK : ESP_FAIL;
+    }
+    pthread_mutex_unlock(&timerLock);
+    return err;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_handle_t timer = calloc(1, sizeof(struct esp_timer));
+    if (!timer) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start_timer(esp_timer_handle_t timer, uint64_t timeout, uint64_t period) {
+    pthread_mutex_lock(&timerLock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (!timer->armed) {
+        timer->alarm = sim_clock_micros() + timeout;
+        timer->period = period;
+        link_timer(timer);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&timerLock);
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return start_timer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return start_timer(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timerLock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (timer->armed) {
+        unlink_timer(timer);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&timerLock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
@@ -0,0 +1,438 @@
+#include "pthread.h"
+#include "time.h"
+#include "errno.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+/*
+ * FreeRTOS on pthreads. Tasks are detached threads, priorities and core
+ * affinity are recorded but left to the host scheduler. Blocking calls
+ * convert their tick timeout into a real deadline through the virtual clock.
+ */
+
+struct sim_task {
+    pthread_t thread;
+    TaskFunction_t code;
+    void* param;
+    const char* name;
+    UBaseType_t priority;
+    BaseType_t core;
+    bool deleted;
+    struct sim_task* next;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t* storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    bool mutex;
+    // recursive mutexes, the thread holding it and how often it took it
+    pthread_t holder;
+    UBaseType_t depth;
+};
+
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static __thread struct sim_task* currentTask = NULL;
+// every task for the system state, and the idle tasks the host does not have
+static struct sim_task* allTasks = NULL;
+static pthread_mutex_t tasksLock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task idleTasks[portNUM_PROCESSORS] = { { .name = "IDLE0", .core = 0 }, { .name = "IDLE1", .core = 1 } };
+static int64_t tasksStartedAt = 0;
+
+static void init_cond(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+}
+
+/* like the tick interrupt, a wait of n ticks ends at the n-th tick boundary from now */
+static struct timespec tick_deadline(TickType_t wait) {
+    int64_t tick = portTICK_PERIOD_MS * 1000;
+    int64_t now = sim_clock_micros();
+    int64_t real = (int64_t)(((now / tick + wait) * tick - now) / sim_clock_scale());
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    t.tv_sec += real / 1000000;
+    t.tv_nsec += (real % 1000000) * 1000;
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+    return t;
+}
+
+/* waits on cond until ready() holds, false on timeout */
+static bool wait_until(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t wait, bool (*ready)(void*), void* arg) {
+    struct timespec deadline = tick_deadline(wait);
+    while (!ready(arg)) {
+        if (wait == 0) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT) {
+            return ready(arg);
+        }
+    }
+    return true;
+}
+
+static void add_task(struct sim_task* task) {
+    pthread_mutex_lock(&tasksLock);
+    if (!tasksStartedAt) {
+        tasksStartedAt = sim_clock_micros();
+    }
+    task->next = allTasks;
+    allTasks = task;
+    pthread_mutex_unlock(&tasksLock);
+}
+
+static void* task_entry(void* arg) {
+    currentTask = arg;
+    currentTask->code(currentTask->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+    struct sim_task* task = calloc(1, sizeof(struct sim_task));
+    if (!task) {
+        return pdFAIL;
+    }
+    task->code = code;
+    task->param = param;
+    task->name = name;
+    task->priority = priority;
+    task->core = core;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&task->thread, &attr, task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    add_task(task);
+    if (created) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* created) {
+    return xTaskCreatePinnedToCore(code, name, stack_depth, param, priority, created, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack, StaticTask_t* task, BaseType_t core) {
+    TaskHandle_t created = NULL;
+    xTaskCreatePinnedToCore(code, name, stack_depth, param, priority, &created, core);
+    return created;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack, StaticTask_t* task) {
+    return xTaskCreateStaticPinnedToCore(code, name, stack_depth, param, priority, stack, task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (!task) {
+        task = currentTask;
+    }
+    if (task) {
+        task->deleted = true;
+    }
+    if (!task || task == currentTask) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_clock_sleep_micros((int64_t) ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(sim_clock_micros() / 1000 / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return currentTask;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+char* pcTaskGetTaskName(TaskHandle_t task) {
+    if (!task) {
+        task = currentTask;
+    }
+    return task ? (char*) task->name : "host";
+}
+
+/* gives a thread the shim did not start a task identity, like the main and esp_timer tasks */
+void sim_task_register(const char* name) {
+    struct sim_task* task = calloc(1, sizeof(struct sim_task));
+    if (!task) {
+        return;
+    }
+    task->thread = pthread_self();
+    task->name = name;
+    task->core = PRO_CPU_NUM;
+    currentTask = task;
+    add_task(task);
+}
+
+/*
+ * Run time on the clock sdkconfig selects like the ESP32 port, esp_timer
+ * microseconds or CPU cycles, from the thread CPU clock stretched by the
+ * time scale. A core's idle task gets what its tasks left, unpinned tasks
+ * count on PRO_CPU.
+ */
+#ifdef CONFIG_FREERTOS_RUN_TIME_STATS_USING_CPU_CLK
+#define RUN_TIME_TICKS_PER_MICRO CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#else
+#define RUN_TIME_TICKS_PER_MICRO 1
+#endif
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total_run_time) {
+    double ticks_per_micro = RUN_TIME_TICKS_PER_MICRO * sim_clock_scale();
+    int64_t busy[portNUM_PROCESSORS] = { 0 };
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&tasksLock);
+    int64_t elapsed = (int64_t)((sim_clock_micros() - tasksStartedAt) * (double) RUN_TIME_TICKS_PER_MICRO);
+    for (struct sim_task* task = allTasks; task; task = task->next) {
+        clockid_t clock;
+        struct timespec t;
+        if (task->deleted || pthread_getcpuclockid(task->thread, &clock) != 0 || clock_gettime(clock, &t) != 0) {
+            continue;
+        }
+        if (count + portNUM_PROCESSORS >= size) {
+            pthread_mutex_unlock(&tasksLock);
+            return 0;
+        }
+        int64_t run = (int64_t)((t.tv_sec * 1000000LL + t.tv_nsec / 1000) * ticks_per_micro);
+        busy[task->core == tskNO_AFFINITY ? PRO_CPU_NUM : task->core] += run;
+        status[count++] = (TaskStatus_t) { task, task->name, task->priority, task->priority, (uint32_t) run, task->core };
+    }
+    pthread_mutex_unlock(&tasksLock);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        int64_t idle = elapsed > busy[core] ? elapsed - busy[core] : 0;
+        status[count++] = (TaskStatus_t) { &idleTasks[core], idleTasks[core].name, 0, 0, (uint32_t) idle, core };
+    }
+    if (total_run_time) {
+        *total_run_time = (uint32_t) elapsed;
+    }
+    return count;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu) {
+    return cpu < portNUM_PROCESSORS ? &idleTasks[cpu] : NULL;
+}
+
+BaseType_t xPortGetCoreID() {
+    return currentTask && currentTask->core != tskNO_AFFINITY ? currentTask->core : PRO_CPU_NUM;
+}
+
+static QueueHandle_t create_queue(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->storage = calloc(length, item_size ? item_size : 1);
+    if (!queue->storage) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->changed);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return create_queue(length, item_size);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue) {
+    return create_queue(length, item_size);
+}
+
+static bool queue_not_full(void* arg) {
+    struct sim_queue* queue = arg;
+    return queue->count < queue->length;
+}
+
+static bool queue_not_empty(void* arg) {
+    struct sim_queue* queue = arg;
+    return queue->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+    pthread_mutex_lock(&queue->lock);
+    bool ok = wait_until(&queue->changed, &queue->lock, wait, queue_not_full, queue);
+    if (ok) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        if (queue->item_size) {
+            memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+        }
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    pthread_mutex_lock(&queue->lock);
+    bool ok = wait_until(&queue->changed, &queue->lock, wait, queue_not_empty, queue);
+    if (ok) {
+        if (queue->item_size && item) {
+            memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+/* semaphores are zero-size queues, a mutex starts given */
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return create_queue(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t semaphore = create_queue(1, 0);
+    if (semaphore) {
+        semaphore->mutex = true;
+        semaphore->count = 1;
+    }
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    return xQueueReceive(semaphore, NULL, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    return xQueueSendFromISR(semaphore, NULL, woken);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t wait) {
+    pthread_mutex_lock(&semaphore->lock);
+    bool held = semaphore->depth > 0 && pthread_equal(semaphore->holder, pthread_self());
+    if (held) {
+        semaphore->depth++;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    if (held) {
+        return pdTRUE;
+    }
+    if (xSemaphoreTake(semaphore, wait) != pdTRUE) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&semaphore->lock);
+    semaphore->holder = pthread_self();
+    semaphore->depth = 1;
+    pthread_mutex_unlock(&semaphore->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    pthread_mutex_lock(&semaphore->lock);
+    bool last = semaphore->depth > 0 && --semaphore->depth == 0;
+    pthread_mutex_unlock(&semaphore->lock);
+    return last ? xSemaphoreGive(semaphore) : pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    struct sim_event_group* group = calloc(1, sizeof(struct sim_event_group));
+    if (group) {
+        pthread_mutex_init(&group->lock, NULL);
+        init_cond(&group->changed);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t result = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t result = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t result = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+struct bits_wait {
+    struct sim_event_group* group;
+    EventBits_t bits;
+    bool all;
+};
+
+static bool bits_ready(void* arg) {
+    struct bits_wait* w = arg;
+    EventBits_t set = w->group->bits & w->bits;
+    return w->all ? set == w->bits : set != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait) {
+    struct bits_wait w = { group, bits, all };
+    pthread_mutex_lock(&group->lock);
+    bool ok = wait_until(&group->changed, &group->lock, wait, bits_ready, &w);
+    EventBits_t result = group->bits;
+    if (ok && clear) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
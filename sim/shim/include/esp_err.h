@@ -0,0 +1,29 @@
+#ifndef __SIM_ESP_ERR_H
+#define __SIM_ESP_ERR_H
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+
+#define ESP_ERROR_CHECK(x) do {                                             \
+    esp_err_t __err = (x);                                                  \
+    if (__err != ESP_OK) {                                                  \
+        fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x at %s:%d\n",          \
+            __err, __FILE__, __LINE__);                                     \
+        abort();                                                            \
+    }                                                                       \
+} while(0)
+
+#endif
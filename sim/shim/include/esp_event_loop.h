@@ -0,0 +1,43 @@
+#ifndef __SIM_ESP_EVENT_LOOP_H
+#define __SIM_ESP_EVENT_LOOP_H
+
+#include "stdint.h"
+#include "esp_err.h"
+
+typedef enum {
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_STA_START = 2,
+    SYSTEM_EVENT_STA_CONNECTED = 4,
+    SYSTEM_EVENT_STA_DISCONNECTED = 5,
+    SYSTEM_EVENT_STA_GOT_IP = 7,
+} system_event_id_t;
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef struct {
+    tcpip_adapter_ip_info_t ip_info;
+} system_event_sta_got_ip_t;
+
+typedef union {
+    system_event_sta_got_ip_t got_ip;
+} system_event_info_t;
+
+typedef struct {
+    system_event_id_t event_id;
+    system_event_info_t event_info;
+} system_event_t;
+
+typedef esp_err_t (*system_event_cb_t)(void* ctx, system_event_t* event);
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx);
+void tcpip_adapter_init();
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __SIM_ESP_SYSTEM_H
+#define __SIM_ESP_SYSTEM_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+void esp_restart() __attribute__((noreturn));
+uint32_t esp_random();
+uint32_t esp_get_free_heap_size();
+uint32_t esp_get_minimum_free_heap_size();
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __SIM_FREERTOS_H
+#define __SIM_FREERTOS_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "string.h"
+#include "strings.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "sdkconfig.h"
+#include "sim.h"
+#include "esp_err.h"
+#include "esp_system.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t) 0xffffffff)
+#define configTICK_RATE_HZ (CONFIG_FREERTOS_HZ)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define configMAX_PRIORITIES 25
+#define portNUM_PROCESSORS 2
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+#define tskNO_AFFINITY 0x7fffffff
+#define configTASKLIST_INCLUDE_COREID 1
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+/* there are no interrupts on the host, critical sections share one recursive lock */
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) sim_enter_critical()
+#define portEXIT_CRITICAL(mux) sim_exit_critical()
+#define portENTER_CRITICAL_ISR(mux) sim_enter_critical()
+#define portEXIT_CRITICAL_ISR(mux) sim_exit_critical()
+#define portYIELD_FROM_ISR() do {} while(0)
+
+#endif
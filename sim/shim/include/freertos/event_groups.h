@@ -0,0 +1,21 @@
+#ifndef __SIM_EVENT_GROUPS_H
+#define __SIM_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_event_group* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+typedef struct {
+    int dummy[4];
+} StaticEventGroup_t;
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait);
+
+#define xEventGroupCreateStatic(buffer) ((void)(buffer), xEventGroupCreate())
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __SIM_TASK_H
+#define __SIM_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* param);
+
+typedef struct {
+    int dummy[4];
+} StaticTask_t;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    uint32_t ulRunTimeCounter;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* created);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack, StaticTask_t* task);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack, StaticTask_t* task, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+char* pcTaskGetTaskName(TaskHandle_t task);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total_run_time);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+BaseType_t xPortGetCoreID();
+
+#endif
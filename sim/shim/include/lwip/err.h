@@ -0,0 +1,6 @@
+#ifndef __SIM_LWIP_ERR_H
+#define __SIM_LWIP_ERR_H
+
+#include "lwip/sockets.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __SIM_LWIP_NETDB_H
+#define __SIM_LWIP_NETDB_H
+
+#include "netdb.h"
+
+#endif
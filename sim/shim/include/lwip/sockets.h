@@ -0,0 +1,26 @@
+#ifndef __SIM_LWIP_SOCKETS_H
+#define __SIM_LWIP_SOCKETS_H
+
+#include "errno.h"
+#include "unistd.h"
+#include "sys/types.h"
+#include "sys/socket.h"
+#include "sys/select.h"
+#include "netinet/in.h"
+#include "arpa/inet.h"
+
+/* lwip's inet_ntoa takes both in_addr and ip4_addr_t */
+const char* sim_inet_ntoa(uint32_t addr);
+#define inet_ntoa(addr) sim_inet_ntoa(*(const uint32_t*)&(addr))
+
+/* broadcast goes to loopback so clients on the same host see the status frames */
+in_addr_t sim_inet_addr(const char* cp);
+#define inet_addr(cp) sim_inet_addr(cp)
+
+#define closesocket(s) close(s)
+
+/* the timeout is virtual time like every other wait */
+int sim_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+#define select(nfds, readfds, writefds, exceptfds, timeout) sim_select(nfds, readfds, writefds, exceptfds, timeout)
+
+#endif
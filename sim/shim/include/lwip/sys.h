@@ -0,0 +1,6 @@
+#ifndef __SIM_LWIP_SYS_H
+#define __SIM_LWIP_SYS_H
+
+#include "lwip/sockets.h"
+
+#endif
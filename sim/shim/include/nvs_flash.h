@@ -0,0 +1,9 @@
+#ifndef __SIM_NVS_FLASH_H
+#define __SIM_NVS_FLASH_H
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+
+#endif
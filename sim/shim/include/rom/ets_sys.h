@@ -0,0 +1,11 @@
+#ifndef __SIM_ETS_SYS_H
+#define __SIM_ETS_SYS_H
+
+#include "stdint.h"
+
+/* bit-banged buses need no real delay on the host */
+static inline void ets_delay_us(uint32_t us) {
+    (void) us;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __SIM_H
+#define __SIM_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/*
+ * Host simulator hooks. The virtual clock runs at real time multiplied by
+ * the time scale, esp_timer, vTaskDelay and the LEDC pulse counters all
+ * follow it.
+ */
+void sim_clock_init(double scale);
+int64_t sim_clock_micros();
+void sim_clock_sleep_micros(int64_t micros);
+double sim_clock_scale();
+
+/* the calling thread shows up as a task of that name, e.g. in traces */
+void sim_task_register(const char* name);
+
+void sim_enter_critical();
+void sim_exit_critical();
+
+/* fake peripherals */
+int sim_gpio_get_output(int gpio);
+void sim_gpio_set_input(int gpio, int level);
+uint32_t sim_gpio_get_writes(int gpio);
+uint32_t sim_ledc_get_freq(int channel);
+bool sim_ledc_is_running(int channel);
+int64_t sim_ledc_get_pulses(int channel);
+uint32_t sim_nvs_get_writes();
+
+#endif
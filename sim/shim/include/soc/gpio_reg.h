@@ -0,0 +1,15 @@
+#ifndef __SIM_GPIO_REG_H
+#define __SIM_GPIO_REG_H
+
+#include "soc/soc.h"
+
+#define GPIO_OUT_REG 0x3ff44004
+#define GPIO_OUT_W1TS_REG 0x3ff44008
+#define GPIO_OUT_W1TC_REG 0x3ff4400c
+#define GPIO_OUT1_REG 0x3ff44010
+#define GPIO_OUT1_W1TS_REG 0x3ff44014
+#define GPIO_OUT1_W1TC_REG 0x3ff44018
+#define GPIO_IN_REG 0x3ff4403c
+#define GPIO_IN1_REG 0x3ff44040
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SIM_SOC_H
+#define __SIM_SOC_H
+
+#include "stdint.h"
+
+/* peripheral registers are routed to the simulated peripherals */
+void sim_reg_write(uint32_t reg, uint32_t value);
+uint32_t sim_reg_read(uint32_t reg);
+
+#define REG_WRITE(reg, value) sim_reg_write((uint32_t)(reg), (uint32_t)(value))
+#define REG_READ(reg) sim_reg_read((uint32_t)(reg))
+
+#endif
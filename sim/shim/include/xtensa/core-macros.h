@@ -0,0 +1,11 @@
+#ifndef __SIM_XTENSA_CORE_MACROS_H
+#define __SIM_XTENSA_CORE_MACROS_H
+
+#include "stdint.h"
+
+/* cycle counter at the configured cpu frequency, derived from the virtual clock */
+uint32_t sim_ccount();
+
+#define XTHAL_GET_CCOUNT() sim_ccount()
+
+#endif
@@ -0,0 +1,105 @@
+#include "string.h"
+#include "stdio.h"
+#include "lwip/sockets.h"
+#include "sim.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Wifi and the default event loop. The station "connects" immediately to
+ * the loopback interface, events are delivered from their own task like
+ * the ESP-IDF event loop does.
+ */
+
+static system_event_cb_t eventCallback = NULL;
+static void* eventContext = NULL;
+static bool started = false;
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx) {
+    eventCallback = cb;
+    eventContext = ctx;
+    return ESP_OK;
+}
+
+void tcpip_adapter_init() {
+}
+
+static void post_event(system_event_id_t id) {
+    system_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.event_id = id;
+    if (id == SYSTEM_EVENT_STA_GOT_IP) {
+        event.event_info.got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+        event.event_info.got_ip.ip_info.netmask.addr = htonl(0xff000000);
+        event.event_info.got_ip.ip_info.gw.addr = htonl(INADDR_LOOPBACK);
+    }
+    if (eventCallback) {
+        eventCallback(eventContext, &event);
+    }
+}
+
+static void start_task(void* param) {
+    post_event(SYSTEM_EVENT_STA_START);
+    vTaskDelete(NULL);
+}
+
+static void connect_task(void* param) {
+    post_event(SYSTEM_EVENT_STA_CONNECTED);
+    post_event(SYSTEM_EVENT_STA_GOT_IP);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start() {
+    if (started) {
+        return ESP_OK;
+    }
+    started = true;
+    return xTaskCreate(start_task, "sim_wifi_start", 2048, NULL, 5, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_wifi_connect() {
+    return xTaskCreate(connect_task, "sim_wifi_connect", 2048, NULL, 5, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+#undef inet_ntoa
+#undef inet_addr
+
+const char* sim_inet_ntoa(uint32_t addr) {
+    struct in_addr in;
+    in.s_addr = addr;
+    return inet_ntoa(in);
+}
+
+in_addr_t sim_inet_addr(const char* cp) {
+    in_addr_t addr = inet_addr(cp);
+    return addr == htonl(INADDR_BROADCAST) ? htonl(INADDR_LOOPBACK) : addr;
+}
+
+#undef select
+
+int sim_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
+    if (!timeout) {
+        return select(nfds, readfds, writefds, exceptfds, NULL);
+    }
+    int64_t micros = (int64_t) timeout->tv_sec * 1000000 + timeout->tv_usec;
+    micros = (int64_t)(micros / sim_clock_scale());
+    struct timeval real = { .tv_sec = micros / 1000000, .tv_usec = micros % 1000000 };
+    return select(nfds, readfds, writefds, exceptfds, &real);
+}
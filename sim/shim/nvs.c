@@ -0,0 +1,189 @@
+#include "string.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * In-memory NVS. Every set counts as one flash write so wear-sensitive code
+ * can be checked on the host. With TELESCOPE_SIM_NVS set to a file name the
+ * entries are loaded from it at init and saved on every commit, so they
+ * survive a restart of the simulator.
+ */
+
+#define SIM_NVS_ENTRIES 64
+#define SIM_NVS_KEY_LEN 16
+#define SIM_NVS_VALUE_LEN 256
+#define SIM_NVS_NAMESPACES 8
+
+typedef struct sim_nvs_entry {
+    bool used;
+    char ns[SIM_NVS_KEY_LEN];
+    char key[SIM_NVS_KEY_LEN];
+    uint8_t value[SIM_NVS_VALUE_LEN];
+    size_t length;
+} sim_nvs_entry_t;
+
+static sim_nvs_entry_t entries[SIM_NVS_ENTRIES];
+static char namespaces[SIM_NVS_NAMESPACES][SIM_NVS_KEY_LEN];
+static bool writable[SIM_NVS_NAMESPACES];
+static bool initialized = false;
+static uint32_t writes = 0;
+
+static const char* backing_file() {
+    return getenv("TELESCOPE_SIM_NVS");
+}
+
+esp_err_t nvs_flash_init() {
+    const char* path = backing_file();
+    if (!initialized && path) {
+        FILE* f = fopen(path, "rb");
+        if (f) {
+            size_t read = fread(entries, sizeof(entries), 1, f);
+            fclose(f);
+            if (read != 1) {
+                memset(entries, 0, sizeof(entries));
+            }
+        }
+    }
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+    sim_enter_critical();
+    memset(entries, 0, sizeof(entries));
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle* out_handle) {
+    if (!initialized) return ESP_ERR_NVS_NOT_INITIALIZED;
+    sim_enter_critical();
+    esp_err_t err = ESP_ERR_NO_MEM;
+    for (int i = 0; i < SIM_NVS_NAMESPACES; i++) {
+        if (!namespaces[i][0] || !strncmp(namespaces[i], name, SIM_NVS_KEY_LEN - 1)) {
+            strncpy(namespaces[i], name, SIM_NVS_KEY_LEN - 1);
+            writable[i] = open_mode == NVS_READWRITE;
+            *out_handle = i + 1;
+            err = ESP_OK;
+            break;
+        }
+    }
+    sim_exit_critical();
+    return err;
+}
+
+void nvs_close(nvs_handle handle) {
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+    const char* path = backing_file();
+    if (!path) {
+        return ESP_OK;
+    }
+    sim_enter_critical();
+    FILE* f = fopen(path, "wb");
+    size_t written = f ? fwrite(entries, sizeof(entries), 1, f) : 0;
+    if (f) {
+        fclose(f);
+    }
+    sim_exit_critical();
+    return written == 1 ? ESP_OK : ESP_FAIL;
+}
+
+static sim_nvs_entry_t* find(nvs_handle handle, const char* key) {
+    for (int i = 0; i < SIM_NVS_ENTRIES; i++) {
+        if (entries[i].used && !strcmp(entries[i].ns, namespaces[handle - 1]) && !strncmp(entries[i].key, key, SIM_NVS_KEY_LEN - 1)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t set(nvs_handle handle, const char* key, const void* value, size_t length) {
+    if (handle < 1 || handle > SIM_NVS_NAMESPACES) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!writable[handle - 1]) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (length > SIM_NVS_VALUE_LEN) return ESP_ERR_NVS_INVALID_LENGTH;
+    sim_enter_critical();
+    esp_err_t err = ESP_OK;
+    sim_nvs_entry_t* entry = find(handle, key);
+    for (int i = 0; !entry && i < SIM_NVS_ENTRIES; i++) {
+        if (!entries[i].used) {
+            entry = &entries[i];
+            entry->used = true;
+            strcpy(entry->ns, namespaces[handle - 1]);
+            strncpy(entry->key, key, SIM_NVS_KEY_LEN - 1);
+        }
+    }
+    if (entry) {
+        memcpy(entry->value, value, length);
+        entry->length = length;
+        writes++;
+    } else {
+        err = ESP_ERR_NVS_NO_FREE_PAGES;
+    }
+    sim_exit_critical();
+    return err;
+}
+
+static esp_err_t get(nvs_handle handle, const char* key, void* value, size_t* length, bool exact) {
+    if (handle < 1 || handle > SIM_NVS_NAMESPACES) return ESP_ERR_NVS_INVALID_HANDLE;
+    sim_enter_critical();
+    esp_err_t err = ESP_OK;
+    sim_nvs_entry_t* entry = find(handle, key);
+    if (!entry) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (!value) {
+        *length = entry->length;
+    } else if (exact ? *length != entry->length : *length < entry->length) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(value, entry->value, entry->length);
+        *length = entry->length;
+    }
+    sim_exit_critical();
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key) {
+    if (handle < 1 || handle > SIM_NVS_NAMESPACES) return ESP_ERR_NVS_INVALID_HANDLE;
+    sim_enter_critical();
+    sim_nvs_entry_t* entry = find(handle, key);
+    if (entry) {
+        entry->used = false;
+        writes++;
+    }
+    sim_exit_critical();
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_i32(nvs_handle handle, const char* key, int32_t value) {
+    return set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle handle, const char* key, int32_t* out_value) {
+    size_t length = sizeof(*out_value);
+    return get(handle, key, out_value, &length, true);
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char* key, uint32_t value) {
+    return set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char* key, uint32_t* out_value) {
+    size_t length = sizeof(*out_value);
+    return get(handle, key, out_value, &length, true);
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length) {
+    return set(handle, key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length) {
+    return get(handle, key, out_value, length, false);
+}
+
+uint32_t sim_nvs_get_writes() {
+    return writes;
+}
@@ -0,0 +1,304 @@
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "soc/gpio_reg.h"
+
+/*
+ * Recording GPIO and LEDC. Outputs remember their last level and count the
+ * writes, inputs are driven with sim_gpio_set_input which also runs the
+ * registered edge handler in the caller's thread. An LEDC channel with a
+ * non-zero duty counts pulses as frequency times virtual time.
+ */
+
+typedef struct sim_pin {
+    gpio_mode_t mode;
+    int output;
+    int input;
+    bool driven;
+    uint32_t writes;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t handler;
+    void* handler_arg;
+} sim_pin_t;
+
+typedef struct sim_ledc_channel {
+    ledc_timer_t timer;
+    int gpio;
+    uint32_t duty;
+    bool running;
+    int64_t since;
+    double pulses;
+} sim_ledc_channel_t;
+
+static sim_pin_t pins[GPIO_PIN_COUNT];
+static uint32_t timerFreqs[LEDC_TIMER_MAX];
+static sim_ledc_channel_t channels[LEDC_CHANNEL_MAX];
+static bool isrServiceInstalled = false;
+
+#define VALID_PIN(gpio) ((gpio) >= 0 && (gpio) < GPIO_PIN_COUNT)
+
+esp_err_t gpio_config(const gpio_config_t* config) {
+    for (int i = 0; i < GPIO_PIN_COUNT; i++) {
+        if (config->pin_bit_mask & (1ULL << i)) {
+            sim_enter_critical();
+            pins[i].mode = config->mode;
+            pins[i].intr_type = config->intr_type;
+            pins[i].intr_enabled = config->intr_type != GPIO_INTR_DISABLE;
+            if (!pins[i].driven) {
+                pins[i].input = config->pull_down_en ? 0 : 1;
+            }
+            sim_exit_critical();
+        }
+    }
+    return ESP_OK;
+}
+
+void gpio_pad_select_gpio(uint8_t gpio) {
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio, gpio_pull_mode_t pull) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    if (!pins[gpio].driven) {
+        pins[gpio].input = pull == GPIO_PULLDOWN_ONLY ? 0 : 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    sim_enter_critical();
+    pins[gpio].output = level ? 1 : 0;
+    pins[gpio].writes++;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio) {
+    if (!VALID_PIN(gpio)) return 0;
+    sim_enter_critical();
+    /* an open-drain line reads low whenever either side pulls it */
+    int level = pins[gpio].mode == GPIO_MODE_INPUT_OUTPUT
+        ? pins[gpio].output & pins[gpio].input
+        : pins[gpio].input;
+    sim_exit_critical();
+    return level;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].intr_type = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    if (isrServiceInstalled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    isrServiceInstalled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void* args) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    if (!isrServiceInstalled) return ESP_ERR_INVALID_STATE;
+    sim_enter_critical();
+    pins[gpio].handler = handler;
+    pins[gpio].handler_arg = args;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio) {
+    if (!VALID_PIN(gpio)) return ESP_ERR_INVALID_ARG;
+    sim_enter_critical();
+    pins[gpio].handler = NULL;
+    pins[gpio].handler_arg = NULL;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+int sim_gpio_get_output(int gpio) {
+    return VALID_PIN(gpio) ? pins[gpio].output : 0;
+}
+
+uint32_t sim_gpio_get_writes(int gpio) {
+    return VALID_PIN(gpio) ? pins[gpio].writes : 0;
+}
+
+void sim_gpio_set_input(int gpio, int level) {
+    if (!VALID_PIN(gpio)) return;
+    sim_enter_critical();
+    sim_pin_t* pin = &pins[gpio];
+    int old = pin->input;
+    pin->input = level ? 1 : 0;
+    pin->driven = true;
+    bool fire = pin->handler && pin->intr_enabled && old != pin->input && (
+        pin->intr_type == GPIO_INTR_ANYEDGE ||
+        (pin->intr_type == GPIO_INTR_POSEDGE && pin->input) ||
+        (pin->intr_type == GPIO_INTR_NEGEDGE && !pin->input));
+    if (fire) {
+        pin->handler(pin->handler_arg);
+    }
+    sim_exit_critical();
+}
+
+/* output registers, every pin in a write-1-to-set/clear mask counts one write */
+static void write_pins(int base, uint32_t mask, int level) {
+    for (int i = 0; i < 32 && base + i < GPIO_PIN_COUNT; i++) {
+        if (mask & (1u << i)) {
+            pins[base + i].output = level;
+            pins[base + i].writes++;
+        }
+    }
+}
+
+static uint32_t read_pins(int base, bool output) {
+    uint32_t value = 0;
+    for (int i = 0; i < 32 && base + i < GPIO_PIN_COUNT; i++) {
+        if (output ? pins[base + i].output : pins[base + i].input) {
+            value |= 1u << i;
+        }
+    }
+    return value;
+}
+
+void sim_reg_write(uint32_t reg, uint32_t value) {
+    sim_enter_critical();
+    switch (reg) {
+    case GPIO_OUT_REG:
+        write_pins(0, value, 1);
+        write_pins(0, ~value, 0);
+        break;
+    case GPIO_OUT_W1TS_REG:
+        write_pins(0, value, 1);
+        break;
+    case GPIO_OUT_W1TC_REG:
+        write_pins(0, value, 0);
+        break;
+    case GPIO_OUT1_REG:
+        write_pins(32, value, 1);
+        write_pins(32, ~value, 0);
+        break;
+    case GPIO_OUT1_W1TS_REG:
+        write_pins(32, value, 1);
+        break;
+    case GPIO_OUT1_W1TC_REG:
+        write_pins(32, value, 0);
+        break;
+    }
+    sim_exit_critical();
+}
+
+uint32_t sim_reg_read(uint32_t reg) {
+    sim_enter_critical();
+    uint32_t value = 0;
+    switch (reg) {
+    case GPIO_OUT_REG:
+        value = read_pins(0, true);
+        break;
+    case GPIO_OUT1_REG:
+        value = read_pins(32, true);
+        break;
+    case GPIO_IN_REG:
+        value = read_pins(0, false);
+        break;
+    case GPIO_IN1_REG:
+        value = read_pins(32, false);
+        break;
+    }
+    sim_exit_critical();
+    return value;
+}
+
+/* folds the pulses since the last change into the channel total */
+static void settle_channel(sim_ledc_channel_t* channel, int64_t now) {
+    if (channel->running) {
+        channel->pulses += (double) timerFreqs[channel->timer] * (now - channel->since) / 1000000;
+    }
+    channel->since = now;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config) {
+    if (config->channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+    sim_enter_critical();
+    sim_ledc_channel_t* channel = &channels[config->channel];
+    settle_channel(channel, sim_clock_micros());
+    channel->timer = config->timer_sel;
+    channel->gpio = config->gpio_num;
+    channel->duty = config->duty;
+    channel->running = config->duty != 0;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* config) {
+    if (config->timer_num >= LEDC_TIMER_MAX) return ESP_ERR_INVALID_ARG;
+    return ledc_set_freq(config->speed_mode, config->timer_num, config->freq_hz);
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freq_hz) {
+    if (timer >= LEDC_TIMER_MAX) return ESP_ERR_INVALID_ARG;
+    sim_enter_critical();
+    int64_t now = sim_clock_micros();
+    for (int i = 0; i < LEDC_CHANNEL_MAX; i++) {
+        if (channels[i].timer == timer) {
+            settle_channel(&channels[i], now);
+        }
+    }
+    timerFreqs[timer] = freq_hz;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty) {
+    if (channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+    channels[channel].duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+    sim_enter_critical();
+    settle_channel(&channels[channel], sim_clock_micros());
+    channels[channel].running = channels[channel].duty != 0;
+    sim_exit_critical();
+    return ESP_OK;
+}
+
+uint32_t sim_ledc_get_freq(int channel) {
+    if (channel < 0 || channel >= LEDC_CHANNEL_MAX) return 0;
+    return timerFreqs[channels[channel].timer];
+}
+
+bool sim_ledc_is_running(int channel) {
+    if (channel < 0 || channel >= LEDC_CHANNEL_MAX) return false;
+    return channels[channel].running;
+}
+
+int64_t sim_ledc_get_pulses(int channel) {
+    if (channel < 0 || channel >= LEDC_CHANNEL_MAX) return 0;
+    sim_enter_critical();
+    settle_channel(&channels[channel], sim_clock_micros());
+    int64_t pulses = (int64_t) channels[channel].pulses;
+    sim_exit_critical();
+    return pulses;
+}
@@ -0,0 +1,22 @@
+#include "stdlib.h"
+#include "stdio.h"
+#include "esp_system.h"
+
+void esp_restart() {
+    fprintf(stderr, "esp_restart\n");
+    fflush(stderr);
+    exit(3);
+}
+
+uint32_t esp_random() {
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+/* the host has no meaningful heap limit, report the module's usual free heap */
+uint32_t esp_get_free_heap_size() {
+    return 200 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size() {
+    return 200 * 1024;
+}
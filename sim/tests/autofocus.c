@@ -0,0 +1,113 @@
+#include "math.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "event_loop.h"
+#include "focuser.h"
+#include "autofocus.h"
+
+/*
+ * The fit on synthetic focus curves, then a whole sweep on the event loop
+ * with the real focuser, reporting a V-curve metric at every position.
+ */
+
+static float noise() {
+    return (rand() % 2001 - 1000) / 1000.0f;
+}
+
+static void sweep(int32_t* positions, int count, int32_t from, int32_t step) {
+    for (int i = 0; i < count; i++) {
+        positions[i] = from + step * i;
+    }
+}
+
+static void test_fit() {
+    int32_t positions[AUTOFOCUS_MAX_SAMPLES];
+    float metrics[AUTOFOCUS_MAX_SAMPLES];
+    int32_t best;
+    srand(34);
+
+    // HFR grows linearly away from focus, the V-curve has to win
+    sweep(positions, 15, 0, 100);
+    for (int i = 0; i < 15; i++) {
+        metrics[i] = 2.0f + fabsf(positions[i] - 730) * 0.01f + noise() * 0.05f;
+    }
+    int fit = autofocus_fit(positions, metrics, 15, &best);
+    CHECK(fit == AUTOFOCUS_FIT_V_CURVE, "V-curve fitted as %d", fit);
+    CHECK(abs(best - 730) <= 15, "V-curve focus at %d for 730", best);
+
+    // near focus the curve rounds off like a parabola, sampled in reverse
+    sweep(positions, 11, 2000, -100);
+    for (int i = 0; i < 11; i++) {
+        float d = (positions[i] - 1440) / 100.0f;
+        metrics[i] = 3.0f + 0.2f * d * d;
+    }
+    fit = autofocus_fit(positions, metrics, 11, &best);
+    CHECK(fit == AUTOFOCUS_FIT_PARABOLA, "parabola fitted as %d", fit);
+    CHECK(abs(best - 1440) <= 2, "parabola focus at %d for 1440", best);
+
+    // focus beyond the sweep falls back to the best sample
+    sweep(positions, 8, 0, 50);
+    for (int i = 0; i < 8; i++) {
+        metrics[i] = 10.0f - i;
+    }
+    fit = autofocus_fit(positions, metrics, 8, &best);
+    CHECK(fit == AUTOFOCUS_FIT_MINIMUM && best == 350, "monotonic sweep fitted as %d at %d", fit, best);
+
+    // skipped samples do not count, two are not enough
+    sweep(positions, 5, 0, 10);
+    float skipped[5] = { 0, 3, -1, 2, 0 };
+    fit = autofocus_fit(positions, skipped, 5, &best);
+    CHECK(fit == AUTOFOCUS_FIT_NONE, "two samples fitted as %d", fit);
+}
+
+#define FOCUS 620
+volatile int sampled = 0;
+volatile int finishedAt = -1;
+volatile int failed = 0;
+volatile bool wrongPosition = false;
+
+static void event(uint8_t event, uint16_t index, int32_t position) {
+    if (event == AUTOFOCUS_EVENT_IN_POSITION) {
+        if (position != 1000 - 100 * index) wrongPosition = true;
+        sampled++;
+        autofocus_report(index, 2.0f + abs(position - FOCUS) * 0.01f);
+    } else if (event == AUTOFOCUS_EVENT_FINISHED) {
+        finishedAt = position;
+    } else {
+        failed++;
+    }
+}
+
+esp_err_t startResult;
+
+static void start(const void* _) {
+    // downwards from above the focuser, the first move takes up backlash
+    startResult = autofocus_start(1000, -100, 9);
+}
+
+static void test_sweep() {
+    focuser_init();
+    init_event_loop();
+    init_autofocus(event);
+    xTaskCreatePinnedToCore(event_loop_run, "event_loop", 4096, NULL, 5, NULL, 0);
+    event_loop_post(start, NULL, 0);
+    int64_t deadline = esp_timer_get_time() + 60000000;
+    while (finishedAt < 0 && !failed && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(20000);
+    }
+    CHECK(startResult == ESP_OK, "start %d", startResult);
+    CHECK(sampled == 9 && !wrongPosition, "%d samples, %s", sampled, wrongPosition ? "off position" : "in position");
+    CHECK(!failed, "failed");
+    CHECK(abs(finishedAt - FOCUS) <= 10 && focuser_get_position() == finishedAt, "finished at %d, focuser at %d",
+        finishedAt, focuser_get_position());
+    CHECK(!is_autofocusing(), "still sweeping");
+    printf("  sweep of 9 finished at %d for %d\n", finishedAt, FOCUS);
+}
+
+int main() {
+    test_init(20);
+    test_fit();
+    test_sweep();
+    return test_done("autofocus");
+}
@@ -0,0 +1,46 @@
+#include "test.h"
+#include "stdlib.h"
+#include "unistd.h"
+#include "boot.h"
+
+/*
+ * The boot time benchmark: app_main on the virtual clock without a display
+ * panel, the probe keeps retrying in its own task while motion and the
+ * server come up. Prints the timeline like TELESCOPE_SIM_BOOT_REPORT.
+ */
+
+void app_main();
+
+// the panel probe retries after a second, ready has to come well before
+#define MAX_READY_MICROS 100000
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(1);
+    app_main();
+    int64_t deadline = esp_timer_get_time() + 30000000;
+    while (!boot_is_complete() && esp_timer_get_time() < deadline) {
+        usleep(1000);
+    }
+    CHECK(boot_is_complete(), "boot did not complete");
+
+    int32_t begin[BOOT_STAGES], end[BOOT_STAGES];
+    boot_get_timeline(begin, end);
+    int32_t ready = 0;
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        printf("  %-10s %10d %10d %10d us\n", boot_stage_name(i), begin[i], end[i], end[i] - begin[i]);
+        CHECK(begin[i] >= 0 && end[i] >= begin[i], "%s from %d to %d", boot_stage_name(i), begin[i], end[i]);
+        if (i != BOOT_STAGE_DISPLAY && end[i] > ready) ready = end[i];
+    }
+    printf("  motion and server ready at %d us, boot complete at %d us\n", ready, end[BOOT_STAGE_DISPLAY]);
+
+    // settings need flash, motion needs settings, the server binds any address once motion is up
+    CHECK(end[BOOT_STAGE_NVS] <= begin[BOOT_STAGE_SETTINGS], "settings before flash");
+    CHECK(end[BOOT_STAGE_SETTINGS] <= begin[BOOT_STAGE_MOTION], "motion before settings");
+    CHECK(end[BOOT_STAGE_MOTION] <= begin[BOOT_STAGE_SERVER], "server before motion");
+    // association runs while the motors are set up, the panel does not hold anything up
+    CHECK(begin[BOOT_STAGE_NETWORK] < end[BOOT_STAGE_MOTION], "network started after motion");
+    CHECK(ready < end[BOOT_STAGE_DISPLAY], "ready at %d us waited for the display at %d us", ready, end[BOOT_STAGE_DISPLAY]);
+    CHECK(ready < MAX_READY_MICROS, "ready at %d us", ready);
+    return test_done("boot");
+}
@@ -0,0 +1,139 @@
+#include "test.h"
+#include "nvs_flash.h"
+#include "astro.h"
+#include "settings.h"
+#include "clock_sync.h"
+#include "motion_loop.h"
+#include "mount_encoder.h"
+#include "checkpoint.h"
+
+/*
+ * The offset arithmetic across the sidereal day, then checkpoints taken
+ * and restored through the settings across simulated reboots: restored
+ * against a later clock, never against an unsynced or pre-2020 one, and
+ * dropped against a clock behind the checkpoint.
+ */
+
+void settings_load();
+extern motion_timer_t checkpointTimer;
+
+#define HOUR_MILLIS 3600000LL
+// 2026-03-01 00:00 UTC
+#define SAVED_UNIX_MILLIS 1772323200000LL
+
+static void test_offset_math() {
+    const int64_t walls[] = { 0, 1, SIDEREAL_DAY_MILLIS - 1, SIDEREAL_DAY_MILLIS, SAVED_UNIX_MILLIS, -SAVED_UNIX_MILLIS };
+    const int32_t ras[] = { 0, 1, SIDEREAL_DAY_MILLIS / 2, SIDEREAL_DAY_MILLIS - 1 };
+    for (int w = 0; w < sizeof(walls) / sizeof(walls[0]); w++) {
+        for (int r = 0; r < sizeof(ras) / sizeof(ras[0]); r++) {
+            int32_t offset = checkpoint_ra_offset(ras[r], walls[w]);
+            CHECK(offset >= 0 && offset < SIDEREAL_DAY_MILLIS, "offset %d of ra %d at %lld", offset, ras[r], walls[w]);
+            int32_t back = checkpoint_ra_restore(offset, walls[w]);
+            CHECK(back == ras[r], "ra %d at %lld restored as %d", ras[r], walls[w], back);
+        }
+    }
+    // the axis keeps its hour angle, the RA moves on with the clock and wraps
+    int32_t offset = checkpoint_ra_offset(SIDEREAL_DAY_MILLIS - 1000, SAVED_UNIX_MILLIS);
+    CHECK(checkpoint_ra_restore(offset, SAVED_UNIX_MILLIS + 3000) == 2000, "wrapped to %d",
+        checkpoint_ra_restore(offset, SAVED_UNIX_MILLIS + 3000));
+}
+
+/* one clean exchange with a client clock reading unix_millis now */
+static void sync_client(int64_t unix_millis) {
+    clock_sync_init();
+    int64_t local = esp_timer_get_time();
+    int64_t offset = unix_millis * 1000 - local;
+    clock_sync_add_sample(local - 300 + offset, local, local + 50, local + 350 + offset);
+}
+
+static int32_t wrap(int64_t ra) {
+    ra %= SIDEREAL_DAY_MILLIS;
+    return (int32_t)(ra < 0 ? ra + SIDEREAL_DAY_MILLIS : ra);
+}
+
+static int32_t distance(int32_t a, int32_t b) {
+    int32_t d = wrap(a - b);
+    return d > SIDEREAL_DAY_MILLIS / 2 ? SIDEREAL_DAY_MILLIS - d : d;
+}
+
+static void set_position(const void* data) {
+    const int32_t* angles = data;
+    set_mechanical_angles(angles[0], angles[1]);
+    checkpoint_position_synced();
+}
+
+/* on the motion task, the poll timer is still in its wheel */
+static void restart(const void* _) {
+    motion_timer_stop(&checkpointTimer);
+    init_mount_encoder();
+    init_checkpoint();
+}
+
+/* the controller restarts, flash keeps the settings, the position is gone */
+static void reboot() {
+    settings_flush();
+    settings_load();
+    clock_sync_init();
+    motion_post(restart, NULL, 0);
+}
+
+static void polls(int count) {
+    sim_clock_sleep_micros(count * 1000000LL + 100000);
+}
+
+static void test_restore() {
+    // a sync close to the end of the sidereal day
+    sync_client(SAVED_UNIX_MILLIS);
+    int32_t angles[2] = { SIDEREAL_DAY_MILLIS - 2000, -5 * HOUR_MILLIS };
+    motion_post(set_position, angles, sizeof(angles));
+    polls(1);
+    CHECK(checkpoint_is_position_known(), "position unknown after a sync");
+    CHECK(settings_get(SETTING_CHECKPOINT_VALID) == 1, "no checkpoint after a sync");
+    int32_t savedRa = settings_get(SETTING_CHECKPOINT_RA_OFFSET);
+
+    // without a clock nothing is restored
+    reboot();
+    polls(3);
+    CHECK(!checkpoint_is_position_known(), "restored without a clock");
+    // a clock that does not read as Unix time is not the one the checkpoint belongs to
+    sync_client(HOUR_MILLIS);
+    polls(2);
+    CHECK(!checkpoint_is_position_known(), "restored against a 1970 clock");
+
+    // eight hours later the axis has not moved, the sky has
+    int64_t later = SAVED_UNIX_MILLIS + 8 * HOUR_MILLIS;
+    sync_client(later);
+    polls(2);
+    CHECK(checkpoint_is_position_known(), "not restored after a sync");
+    int64_t wall = clock_sync_to_client_micros(esp_timer_get_time()) / 1000;
+    int32_t expected = checkpoint_ra_restore(savedRa, wall);
+    int32_t ra = get_ra_sidereal_millis();
+    CHECK(distance(ra, expected) < 100, "restored ra %d for %d", ra, expected);
+    CHECK(distance(ra, wrap(angles[0] + (wall - SAVED_UNIX_MILLIS))) < 2000, "ra %d did not move on with the clock", ra);
+    CHECK(get_dec_mechnical_angle_millis() == angles[1], "restored dec %d", get_dec_mechnical_angle_millis());
+    printf("  ra %d restored as %d after %lld s\n", angles[0], ra, (wall - SAVED_UNIX_MILLIS) / 1000);
+
+    // a clock behind the checkpoint drops it for good
+    reboot();
+    sync_client(SAVED_UNIX_MILLIS - HOUR_MILLIS);
+    polls(2);
+    CHECK(!checkpoint_is_position_known(), "restored against an earlier clock");
+    CHECK(settings_get(SETTING_CHECKPOINT_VALID) == 0, "checkpoint kept for an earlier clock");
+    reboot();
+    sync_client(later);
+    polls(2);
+    CHECK(!checkpoint_is_position_known(), "a dropped checkpoint restored");
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(20);
+    test_offset_math();
+    nvs_flash_init();
+    init_settings();
+    init_motion_loop();
+    init_mount_encoder();
+    init_checkpoint();
+    test_restore();
+    return test_done("checkpoint");
+}
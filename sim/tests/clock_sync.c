@@ -0,0 +1,141 @@
+#include "math.h"
+#include "test.h"
+#include "clock_sync.h"
+
+/*
+ * Exchanges against a client clock that runs fast and sits far from the
+ * controller's, over a link whose legs queue independently. The sync
+ * should find the offset within the symmetric part of the delay and the
+ * drift within a few ppm. Over a link slower one way, the offset is off by
+ * half the difference of the legs of the exchanges it kept.
+ */
+
+#define DRIFT_PPB 40000
+#define OFFSET_MICROS 1700000000000000LL
+
+static int64_t client_at(int64_t local) {
+    return local + OFFSET_MICROS + local * DRIFT_PPB / 1000000000LL;
+}
+
+typedef int64_t (*leg_delay_f)();
+
+static int64_t leg_delay() {
+    // mostly quiet with the odd queued frame
+    int64_t delay = 300 + rand() % 100;
+    if (rand() % 4 == 0) delay += rand() % 20000;
+    return delay;
+}
+
+/* a busy uplink, 2 to 22 ms */
+static int64_t uplink_delay() {
+    return 2000 + rand() % 20000;
+}
+
+/* a quiet downlink, 2 to 5 ms */
+static int64_t downlink_delay() {
+    return 2000 + rand() % 3000;
+}
+
+/* the legs' delays and the delay the sync sees */
+typedef struct {
+    int64_t local;
+    int64_t up;
+    int64_t down;
+    int64_t delay;
+} exchange_t;
+
+static exchange_t exchange_over(int64_t local, leg_delay_f uplink, leg_delay_f downlink) {
+    exchange_t e = { .local = local, .up = uplink(), .down = downlink() };
+    int64_t t2 = local;
+    int64_t t1 = client_at(t2 - e.up);
+    int64_t t3 = t2 + 50;
+    int64_t t4 = client_at(t3 + e.down);
+    e.delay = (t4 - t1) - (t3 - t2);
+    clock_sync_add_sample(t1, t2, t3, t4);
+    return e;
+}
+
+static void exchange(int64_t local) {
+    exchange_over(local, leg_delay, leg_delay);
+}
+
+static void test_not_synced_until_a_sample() {
+    clock_sync_init();
+    CHECK(!clock_sync_is_synced(), "synced before any sample");
+    // a reply before the request, and one stuck for seconds
+    clock_sync_add_sample(1000, 0, 10, 500);
+    clock_sync_add_sample(0, 0, 10, 5000000);
+    CHECK(!clock_sync_is_synced(), "a rejected sample synced the clock");
+}
+
+static void test_offset_and_drift() {
+    clock_sync_init();
+    srand(27);
+    int64_t local = 5000000;
+    exchange(local);
+    CHECK(clock_sync_is_synced(), "one sample syncs");
+    int64_t error = clock_sync_to_client_micros(local) - client_at(local);
+    printf("  after one exchange: offset off %lld us\n", error);
+    CHECK(llabs(error) < 20000, "first offset off by %lld us", error);
+
+    // eight windows of sixteen exchanges a second apart
+    for (int i = 0; i < 8 * 16; i++) {
+        local += 1000000;
+        exchange(local);
+    }
+    int64_t worst = 0;
+    for (int64_t at = local - 60000000; at <= local + 60000000; at += 1000000) {
+        int64_t e = llabs(clock_sync_to_client_micros(at) - client_at(at));
+        if (e > worst) worst = e;
+    }
+    int32_t drift = clock_sync_get_drift_ppb();
+    printf("  after 128 exchanges: offset off %lld us at worst over +-60 s, drift %d ppb for %d\n",
+        worst, drift, DRIFT_PPB);
+    CHECK(worst < 200, "offset off by %lld us", worst);
+    CHECK(abs(drift - DRIFT_PPB) < 2000, "drift %d ppb", drift);
+
+    // scheduled commands convert back, far from the current time
+    int64_t client = client_at(local + 123456);
+    int64_t back = clock_sync_to_local_micros(client);
+    int64_t roundTrip = clock_sync_to_client_micros(back) - client;
+    CHECK(llabs(roundTrip) <= 1, "client to local and back is off by %lld us", roundTrip);
+    CHECK(llabs(back - (local + 123456)) < 200, "client to local is off by %lld us", back - (local + 123456));
+}
+
+static void test_asymmetric_legs() {
+    clock_sync_init();
+    srand(28);
+    int64_t local = 5000000;
+    // the sync keeps the exchange with the least delay of each window, its offset is off by half its legs' difference
+    double bias = 0, center = 0, worstBias = 0, allBias = 0;
+    for (int w = 0; w < 8; w++) {
+        exchange_t best = { .delay = INT64_MAX };
+        for (int i = 0; i < 16; i++) {
+            local += 1000000;
+            exchange_t e = exchange_over(local, uplink_delay, downlink_delay);
+            allBias += (e.down - e.up) / 2.0 / 128;
+            if (e.delay < best.delay) best = e;
+        }
+        double half = (best.down - best.up) / 2.0;
+        bias += half / 8;
+        center += (double)(best.local + 25) / 8;
+        if (fabs(half) > fabs(worstBias)) worstBias = half;
+    }
+    int64_t at = (int64_t) center;
+    int64_t error = clock_sync_to_client_micros(at) - client_at(at);
+    printf("  2-22 ms up, 2-5 ms down: offset off %lld us, half the kept legs' difference %.0f us, %.0f at worst, %.0f over all\n",
+        error, bias, worstBias, allBias);
+    // the fit goes through the middle of the kept exchanges
+    CHECK(fabs(error - bias) < 10, "offset off by %lld us for %.0f us", error, bias);
+    CHECK(llabs(error) <= fabs(worstBias) + 10, "offset off by %lld us, more than %.0f us", error, fabs(worstBias));
+    // every exchange alike would read the client clock milliseconds behind
+    CHECK(llabs(error) < fabs(allBias) / 4, "offset off by %lld us, %.0f us over all exchanges", error, allBias);
+}
+
+int main() {
+    test_init(1);
+    test_not_synced_until_a_sample();
+    test_offset_and_drift();
+    test_asymmetric_legs();
+    return test_done("clock_sync");
+}
@@ -0,0 +1,96 @@
+#include "string.h"
+#include "test.h"
+#include "command.h"
+
+/*
+ * The dispatch table: lengths are checked against the payload, fields are
+ * decoded from network order, preconditions reject and variable length
+ * commands get their tail.
+ */
+
+#define CMD_SPEED 2
+#define CMD_COORDINATES 7
+#define CMD_PING 0
+#define CMD_WRAPPED 13
+
+#define SPEED_FIELDS(F) F(int32_t, speed)
+#define COORDINATES_FIELDS(F) F(int32_t, ra) F(int32_t, dec)
+#define WRAPPED_FIELDS(F) F(uint8_t, flags) F(int64_t, at)
+COMMAND_PAYLOAD(speed, SPEED_FIELDS)
+COMMAND_PAYLOAD(coordinates, COORDINATES_FIELDS)
+COMMAND_PAYLOAD(wrapped, WRAPPED_FIELDS)
+
+int calls = 0;
+int32_t lastSpeed, lastRa, lastDec;
+int64_t lastAt;
+unsigned int lastTail;
+
+static int handleSpeed(speed_payload_t* p, command_context_t* ctx) {
+    calls++;
+    lastSpeed = p->speed;
+    return 1;
+}
+
+static int handleCoordinates(coordinates_payload_t* p, command_context_t* ctx) {
+    calls++;
+    lastRa = p->ra;
+    lastDec = p->dec;
+    return 1;
+}
+
+static int handlePing(void* _, command_context_t* ctx) {
+    calls++;
+    return 1;
+}
+
+static int handleWrapped(wrapped_payload_t* p, command_context_t* ctx) {
+    calls++;
+    lastAt = p->at;
+    lastTail = ctx->tail_len;
+    return ctx->tail[0] == CMD_PING;
+}
+
+const command_t table[COMMAND_TABLE_SIZE] = {
+    COMMAND_NO_PAYLOAD(CMD_PING, handlePing, 0),
+    COMMAND(CMD_SPEED, handleSpeed, speed, COMMAND_NOT_SLEWING),
+    COMMAND(CMD_COORDINATES, handleCoordinates, coordinates, COMMAND_NOT_SLEWING | COMMAND_NOT_GUIDING),
+    COMMAND_VARIABLE(CMD_WRAPPED, handleWrapped, wrapped, 0),
+};
+
+static int dispatch(const char* bytes, unsigned int len, uint8_t state) {
+    char buf[COMMAND_MAX_SIZE + 1];
+    memcpy(buf, bytes, len);
+    command_context_t ctx = { 0 };
+    return command_dispatch(table, buf, len, state, &ctx);
+}
+
+int main() {
+    test_init(1);
+    const char speed[] = { CMD_SPEED, 0xff, 0xff, 0xfe, 0x0c };
+    CHECK(dispatch(speed, sizeof(speed), 0) == 1 && lastSpeed == -500, "speed decoded as %d", lastSpeed);
+    CHECK(dispatch(speed, sizeof(speed) - 1, 0) == 0, "a short payload ran");
+    char longer[6] = { CMD_SPEED, 0, 0, 0, 1, 0 };
+    CHECK(dispatch(longer, sizeof(longer), 0) == 0, "a long payload ran");
+
+    const char coordinates[] = { CMD_COORDINATES, 0x00, 0x10, 0x00, 0x00, 0x80, 0x00, 0x00, 0x01 };
+    CHECK(dispatch(coordinates, sizeof(coordinates), 0) == 1, "coordinates");
+    CHECK(lastRa == 0x100000 && lastDec == INT32_MIN + 1, "coordinates decoded as %d %d", lastRa, lastDec);
+    int before = calls;
+    CHECK(dispatch(coordinates, sizeof(coordinates), COMMAND_NOT_GUIDING) == 0, "ran while guiding");
+    CHECK(dispatch(speed, sizeof(speed), COMMAND_NOT_HARDWARE_TRACKING) == 1, "an unrelated state rejected");
+    CHECK(calls == before + 1, "a rejected command reached its handler");
+
+    const char ping[] = { CMD_PING };
+    CHECK(dispatch(ping, 1, 0xff) == 1, "ping");
+    const char unknown[] = { 99, 0, 0 };
+    CHECK(dispatch(unknown, sizeof(unknown), 0) == 0, "an unknown command ran");
+    CHECK(dispatch(ping, 0, 0) == 0, "an empty datagram ran");
+
+    const char wrapped[] = { CMD_WRAPPED, 1, 0, 0, 0, 0, 0, 0, 0x12, 0x34, CMD_PING };
+    CHECK(dispatch(wrapped, sizeof(wrapped), 0) == 1, "wrapped");
+    CHECK(lastAt == 0x1234 && lastTail == 1, "wrapped decoded as %lld with %u tail", lastAt, lastTail);
+    CHECK(dispatch(wrapped, 9, 0) == 0, "a variable length command shorter than its payload ran");
+    char oversized[COMMAND_MAX_SIZE + 1] = { CMD_WRAPPED };
+    CHECK(dispatch(oversized, sizeof(oversized), 0) == 0, "a datagram over COMMAND_MAX_SIZE ran");
+    return test_done("command");
+}
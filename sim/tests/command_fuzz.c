@@ -0,0 +1,213 @@
+#include "string.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "sys/socket.h"
+#include "sys/time.h"
+#include "test.h"
+#include "boot.h"
+#include "event_loop.h"
+#include "telescope.h"
+
+/*
+ * Random datagrams through the firmware's own command table on the running
+ * firmware: ids mostly ones the table knows, lengths around each payload's
+ * and anywhere up to past the largest, random bytes. Nothing may crash and
+ * a handler runs exactly for the datagrams of its length that the current
+ * state allows. The datagrams go through the dispatcher on a copy of the
+ * table whose handlers count and then call the firmware's, the last ones
+ * through parse_command itself. Runs on the event loop, like every command.
+ * Pulse guides are kept short and every chunk starts with an abort, so the
+ * commands that wait for guiding and slews to end get their turn.
+ */
+
+#define DATAGRAMS 2000000
+#define ENTRY_DATAGRAMS 200000
+#define CHUNK 10000
+#define CMD_PING 0
+#define CMD_PULSE_GUIDING 4
+#define CMD_ABORT_SLEW 9
+
+void app_main();
+
+command_t checkedCommands[COMMAND_TABLE_SIZE];
+uint8_t known[COMMAND_TABLE_SIZE];
+int knownCount = 0;
+
+const char* currentBuf;
+unsigned int currentLen;
+int handledBy[COMMAND_TABLE_SIZE];
+int allowedFor[COMMAND_TABLE_SIZE];
+int wrongLength = 0;
+
+int replySocket;
+struct sockaddr_in replyAddr;
+volatile int chunksDone = 0;
+double fuzzSeconds = 0;
+
+static int checked_handler(void* payload, command_context_t* ctx) {
+    uint8_t id = currentBuf[0];
+    const command_t* cmd = &commands[id];
+    unsigned int size = cmd->payload_size + 1;
+    if (cmd->variable_length ? currentLen < size : currentLen != size) {
+        wrongLength++;
+    } else if (ctx->tail != currentBuf + size || ctx->tail_len != currentLen - size) {
+        // the tail is whatever follows the payload
+        wrongLength++;
+    }
+    handledBy[id]++;
+    return cmd->handler(payload, ctx);
+}
+
+static void check_table() {
+    for (int i = 0; i < COMMAND_TABLE_SIZE; i++) {
+        checkedCommands[i] = commands[i];
+        if (commands[i].handler) {
+            checkedCommands[i].handler = checked_handler;
+            known[knownCount++] = i;
+        }
+    }
+}
+
+/* whether the dispatcher has to hand the datagram to its handler */
+static bool allowed(const char* buf, unsigned int len, uint8_t state) {
+    if (len == 0 || len > COMMAND_MAX_SIZE) return false;
+    const command_t* cmd = &commands[(uint8_t) buf[0]];
+    unsigned int size = cmd->payload_size + 1;
+    if (!cmd->handler || (cmd->variable_length ? len < size : len != size)) return false;
+    return !(cmd->preconditions & state);
+}
+
+static unsigned int random_datagram(char* buf) {
+    uint8_t id = rand() % 4 ? known[rand() % knownCount] : rand() % 256;
+    int len;
+    if (rand() % 4 == 0) {
+        len = rand() % (COMMAND_MAX_SIZE + 16);
+    } else {
+        // the payload's size give or take two
+        len = commands[id].payload_size + 1 + rand() % 5 - 2;
+        if (len < 0) len = 0;
+    }
+    buf[0] = id;
+    for (int i = 1; i < len; i++) {
+        buf[i] = rand();
+    }
+    if (id == CMD_PULSE_GUIDING && len == 4) {
+        // -100 to 100 ms
+        int16_t millis = htons(rand() % 201 - 100);
+        memcpy(buf + 2, &millis, 2);
+    }
+    return len;
+}
+
+static void fuzz_chunk(const void* data) {
+    bool entry = *(const bool*) data;
+    char buf[COMMAND_MAX_SIZE + 16];
+    struct sockaddr_in abortFrom = replyAddr;
+    buf[0] = CMD_ABORT_SLEW;
+    parse_command(buf, 1, replySocket, &abortFrom, sizeof(abortFrom));
+    double started = test_seconds();
+    for (int i = 0; i < CHUNK; i++) {
+        unsigned int len = random_datagram(buf);
+        struct sockaddr_in from = replyAddr;
+        if (entry) {
+            parse_command(buf, len, replySocket, &from, sizeof(from));
+            continue;
+        }
+        currentBuf = buf;
+        currentLen = len;
+        uint8_t state = commandState();
+        if (allowed(buf, len, state)) allowedFor[(uint8_t) buf[0]]++;
+        command_context_t ctx = { .fromSocket = replySocket, .from = &from, .fromlen = sizeof(from) };
+        command_dispatch(checkedCommands, buf, len, state, &ctx);
+    }
+    fuzzSeconds += test_seconds() - started;
+    __atomic_add_fetch(&chunksDone, 1, __ATOMIC_RELEASE);
+}
+
+/* chunks one after the other, the loop keeps its timers and sockets in between */
+static void fuzz(int datagrams, bool entry) {
+    // the firmware logs every datagram it turns away, that log is left out
+    fflush(stderr);
+    int log = dup(STDERR_FILENO), null = open("/dev/null", O_WRONLY);
+    dup2(null, STDERR_FILENO);
+    chunksDone = 0;
+    for (int i = 0; i < datagrams / CHUNK; i++) {
+        while (!event_loop_post(fuzz_chunk, &entry, sizeof(entry))) {
+            sim_clock_sleep_micros(1000);
+        }
+        while (__atomic_load_n(&chunksDone, __ATOMIC_ACQUIRE) <= i) {
+            sim_clock_sleep_micros(1000);
+        }
+    }
+    fflush(stderr);
+    dup2(log, STDERR_FILENO);
+    close(log);
+    close(null);
+}
+
+/* the server still answers */
+static bool ping(int sock) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(CONFIG_SERVER_PORT) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint8_t cmd = CMD_PING, reply[64];
+    sendto(sock, &cmd, 1, 0, (struct sockaddr *) &addr, sizeof(addr));
+    int len;
+    do {
+        len = recv(sock, reply, sizeof(reply), 0);
+    } while (len > 0 && reply[0] != CMD_PING);
+    return len > 0;
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(1);
+    srand(29);
+    app_main();
+    int64_t deadline = esp_timer_get_time() + 2000000;
+    while (!boot_is_complete() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    CHECK(boot_is_complete(), "not booted");
+    check_table();
+
+    // replies go to a socket nobody reads
+    replySocket = socket(AF_INET, SOCK_DGRAM, 0);
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    replyAddr = (struct sockaddr_in) { .sin_family = AF_INET };
+    replyAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(replyAddr);
+    bind(sink, (struct sockaddr *) &replyAddr, sizeof(replyAddr));
+    getsockname(sink, (struct sockaddr *) &replyAddr, &len);
+
+    fuzz(DATAGRAMS, false);
+    CHECK(wrongLength == 0, "%d handlers ran on a wrong length", wrongLength);
+    int handled = 0, unreached = 0, miscounted = 0;
+    for (int i = 0; i < knownCount; i++) {
+        handled += handledBy[known[i]];
+        if (handledBy[known[i]] != allowedFor[known[i]]) {
+            printf("  %s ran %d times for %d\n", commands[known[i]].name, handledBy[known[i]], allowedFor[known[i]]);
+            miscounted++;
+        }
+        if (handledBy[known[i]] == 0) {
+            printf("  %s never ran\n", commands[known[i]].name);
+            unreached++;
+        }
+    }
+    CHECK(miscounted == 0, "%d commands ran on datagrams they should not have or missed some", miscounted);
+    CHECK(unreached == 0, "%d of %d commands never ran", unreached, knownCount);
+    double dispatchSeconds = fuzzSeconds;
+    fuzzSeconds = 0;
+    fuzz(ENTRY_DATAGRAMS, true);
+    printf("  %d datagrams, %d handled by %d commands: %.0f ns per datagram, %.0f through parse_command\n", DATAGRAMS,
+        handled, knownCount, dispatchSeconds * 1e9 / DATAGRAMS, fuzzSeconds * 1e9 / ENTRY_DATAGRAMS);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    CHECK(ping(sock), "no answer after the fuzzing");
+    close(sock);
+    close(sink);
+    close(replySocket);
+    return test_done("command_fuzz");
+}
@@ -0,0 +1,192 @@
+#include "math.h"
+#include "string.h"
+#include "arpa/inet.h"
+#include "sys/socket.h"
+#include "sys/time.h"
+#include "test.h"
+#include "boot.h"
+#include "command_stats.h"
+#include "protocol.h"
+
+/*
+ * Bucket bounds against every latency up to seconds, percentiles of known
+ * distributions, the halving that follows recent traffic and the slot
+ * limit. First the counters as the running server keeps them, read back
+ * through GET_COMMAND_STATS.
+ */
+
+#define CMD_PING 0
+#define CMD_GET_COMMAND_STATS 18
+#define CMD_UNKNOWN 250
+
+void app_main();
+
+static int find(const uint8_t* b, uint8_t cmd) {
+    for (int i = 0; i < COMMAND_STATS_COUNT(b); i++) {
+        if (COMMAND_STATS_ENTRY_CMD(b, i) == cmd) return i;
+    }
+    return -1;
+}
+
+static void test_server() {
+    app_main();
+    int64_t deadline = esp_timer_get_time() + 2000000;
+    while (!boot_is_complete() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(CONFIG_SERVER_PORT) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t cmd = CMD_PING;
+    uint8_t reply[COMMAND_STATS_SIZE(COMMAND_STATS_MAX_ENTRIES)];
+    for (int i = 0; i < 20; i++) {
+        sendto(sock, &cmd, 1, 0, (struct sockaddr *) &addr, sizeof(addr));
+        CHECK(recv(sock, reply, sizeof(reply), 0) > 0, "no ack for ping %d", i);
+    }
+    cmd = CMD_UNKNOWN;
+    sendto(sock, &cmd, 1, 0, (struct sockaddr *) &addr, sizeof(addr));
+    recv(sock, reply, sizeof(reply), 0);
+
+    cmd = CMD_GET_COMMAND_STATS;
+    sendto(sock, &cmd, 1, 0, (struct sockaddr *) &addr, sizeof(addr));
+    int len;
+    do {
+        len = recv(sock, reply, sizeof(reply), 0);
+    } while (len > 0 && reply[0] != CMD_GET_COMMAND_STATS);
+    CHECK(len >= COMMAND_STATS_SIZE(0) && len == COMMAND_STATS_SIZE(COMMAND_STATS_COUNT(reply)), "reply of %d bytes", len);
+    if (len < COMMAND_STATS_SIZE(0)) return;
+    const uint8_t* b = reply;
+    // the query itself was received and is counted, acked after the reply
+    CHECK(ntohl(COMMAND_STATS_DATAGRAMS_IN(b)) >= 22, "%u datagrams in", ntohl(COMMAND_STATS_DATAGRAMS_IN(b)));
+    CHECK(ntohl(COMMAND_STATS_DATAGRAMS_OUT(b)) >= 21, "%u datagrams out", ntohl(COMMAND_STATS_DATAGRAMS_OUT(b)));
+    CHECK(ntohl(COMMAND_STATS_SEND_FAILURES(b)) == 0, "%u send failures", ntohl(COMMAND_STATS_SEND_FAILURES(b)));
+    CHECK(find(b, CMD_UNKNOWN) < 0, "an unknown command took a slot");
+    int ping = find(b, CMD_PING);
+    CHECK(ping >= 0, "no ping entry");
+    if (ping < 0) return;
+    uint32_t effect50 = ntohl(COMMAND_STATS_ENTRY_EFFECT_P50(b, ping));
+    uint32_t effect99 = ntohl(COMMAND_STATS_ENTRY_EFFECT_P99(b, ping));
+    uint32_t effectMax = ntohl(COMMAND_STATS_ENTRY_EFFECT_MAX(b, ping));
+    uint32_t ack50 = ntohl(COMMAND_STATS_ENTRY_ACK_P50(b, ping));
+    uint32_t ack99 = ntohl(COMMAND_STATS_ENTRY_ACK_P99(b, ping));
+    uint32_t ackMax = ntohl(COMMAND_STATS_ENTRY_ACK_MAX(b, ping));
+    CHECK(ntohl(COMMAND_STATS_ENTRY_RECEIVED(b, ping)) == 20, "%u pings", ntohl(COMMAND_STATS_ENTRY_RECEIVED(b, ping)));
+    CHECK(ntohl(COMMAND_STATS_ENTRY_REJECTED(b, ping)) == 0, "pings rejected");
+    CHECK(effect50 <= effect99 && effect99 <= effectMax, "effect %u %u %u", effect50, effect99, effectMax);
+    CHECK(ack50 <= ack99 && ack99 <= ackMax, "ack %u %u %u", ack50, ack99, ackMax);
+    // the ack goes out after the effect
+    CHECK(effectMax <= ackMax && ackMax < 1000000, "effect max %u, ack max %u", effectMax, ackMax);
+    printf("  ping: effect p50 %u us, ack p50 %u us, ack max %u us\n", effect50, ack50, ackMax);
+}
+
+static void test_buckets() {
+    int previous = 0, wrong = 0;
+    for (uint32_t micros = 0; micros < 4000000; micros += micros < 100000 ? 1 : 97) {
+        int bucket = command_stats_bucket(micros);
+        if (bucket < previous || bucket >= COMMAND_STATS_BUCKETS) wrong++;
+        previous = bucket;
+        // the middle stands for the bucket within its 1/8 half width
+        if (bucket < COMMAND_STATS_BUCKETS - 1) {
+            uint32_t middle = command_stats_bucket_middle(bucket);
+            if (command_stats_bucket(middle) != bucket) wrong++;
+            if (micros >= 4 && fabs((double) middle - micros) > micros / 8.0) wrong++;
+        }
+    }
+    CHECK(wrong == 0, "%d latencies in the wrong bucket", wrong);
+    CHECK(command_stats_bucket(UINT32_MAX) == COMMAND_STATS_BUCKETS - 1, "the largest latency");
+    // everything from 7/4 of 2^20 us on shares the last bucket
+    CHECK(command_stats_bucket(1835007) == COMMAND_STATS_BUCKETS - 2 && command_stats_bucket(1835008) == COMMAND_STATS_BUCKETS - 1,
+        "the last bucket starts elsewhere");
+}
+
+/* a latency measured from a receive that many micros ago */
+static void effect(uint8_t cmd, uint32_t micros) {
+    command_stats_effect(cmd, esp_timer_get_time() - micros);
+}
+
+static command_type_stats_t* entry(command_type_stats_t* stats, int count, uint8_t cmd) {
+    for (int i = 0; i < count; i++) {
+        if (stats[i].cmd == cmd) return &stats[i];
+    }
+    return NULL;
+}
+
+static bool near(uint32_t value, uint32_t expected) {
+    return fabs((double) value - expected) <= expected / 8.0;
+}
+
+static void test_percentiles() {
+    command_type_stats_t stats[COMMAND_STATS_SLOTS];
+    network_stats_t network;
+
+    // evenly spread from 1 to 1000 ms
+    for (int i = 1; i <= 1000; i++) {
+        command_stats_received(50);
+        effect(50, i * 1000);
+    }
+    // mostly fast with a slow tail
+    command_stats_received(51);
+    command_stats_rejected(51);
+    for (int i = 0; i < 1000; i++) {
+        effect(51, i < 980 ? 100 : 50000);
+    }
+    // a rejected command that never arrived takes no slot
+    command_stats_rejected(52);
+    int count = command_stats_get(stats, &network);
+    command_type_stats_t* even = entry(stats, count, 50);
+    command_type_stats_t* tail = entry(stats, count, 51);
+    CHECK(even && tail && !entry(stats, count, 52), "slots");
+    if (!even || !tail) return;
+    CHECK(even->received == 1000 && tail->received == 1 && tail->rejected == 1, "counters");
+    CHECK(near(even->effect.p50_micros, 500000), "even p50 %u", even->effect.p50_micros);
+    CHECK(near(even->effect.p99_micros, 990000), "even p99 %u", even->effect.p99_micros);
+    CHECK(even->effect.max_micros >= 1000000 && even->effect.max_micros < 1001000, "even max %u", even->effect.max_micros);
+    CHECK(even->effect.p99_micros <= even->effect.max_micros, "p99 past the max");
+    CHECK(near(tail->effect.p50_micros, 100), "tail p50 %u", tail->effect.p50_micros);
+    CHECK(near(tail->effect.p99_micros, 50000), "tail p99 %u", tail->effect.p99_micros);
+    CHECK(tail->ack.p50_micros == 0 && tail->ack.max_micros == 0, "ack without acks");
+    printf("  1..1000 ms: p50 %u us, p99 %u us; 2%% slow: p50 %u us, p99 %u us\n", even->effect.p50_micros,
+        even->effect.p99_micros, tail->effect.p50_micros, tail->effect.p99_micros);
+
+    // a saturated bucket halves the histogram, newer traffic outweighs the old
+    command_stats_received(53);
+    for (int i = 0; i < 70000; i++) {
+        command_stats_acked(53, esp_timer_get_time() - 100);
+    }
+    for (int i = 0; i < 40000; i++) {
+        command_stats_acked(53, esp_timer_get_time() - 10000);
+    }
+    count = command_stats_get(stats, &network);
+    command_type_stats_t* halved = entry(stats, count, 53);
+    CHECK(halved && near(halved->ack.p50_micros, 10000), "p50 %u after the halving", halved ? halved->ack.p50_micros : 0);
+}
+
+static void test_slots() {
+    command_type_stats_t stats[COMMAND_STATS_SLOTS];
+    network_stats_t network;
+    int used = command_stats_get(stats, &network);
+    uint32_t untracked = network.untracked;
+    for (int cmd = 100; cmd < 100 + COMMAND_STATS_SLOTS; cmd++) {
+        command_stats_received(cmd);
+    }
+    int count = command_stats_get(stats, &network);
+    CHECK(count == COMMAND_STATS_SLOTS, "%d slots", count);
+    CHECK(network.untracked - untracked == used, "%u untracked for %d beyond the slots", network.untracked - untracked, used);
+    // a command with a slot keeps counting
+    command_stats_received(100);
+    command_stats_get(stats, &network);
+    CHECK(entry(stats, count, 100)->received == 2, "a tracked command went untracked");
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(1);
+    test_server();
+    test_buckets();
+    test_percentiles();
+    test_slots();
+    return test_done("command_stats");
+}
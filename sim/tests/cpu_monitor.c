@@ -0,0 +1,147 @@
+#include "time.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "event_loop.h"
+#include "cpu_monitor.h"
+#include "focuser.h"
+
+/*
+ * Timer lateness against sleeps of known length, then task and core loads
+ * of tasks that burn a known share of a core, sampled by the monitor on the
+ * running event loop. The shim counts a task's run time on its thread's
+ * CPU clock, a busy host gives a spinning task less than it asked for, so
+ * the loads are checked against the burners' own CPU clocks.
+ */
+
+static void test_timer_monitor() {
+    timer_monitor_t monitor;
+    timer_monitor_init(&monitor);
+    timer_monitor_stats_t stats;
+    timer_monitor_get(&monitor, &stats);
+    CHECK(stats.samples == 0 && stats.max_micros == 0, "fresh monitor");
+
+    // due in 2 ms, fired after 5
+    timer_monitor_armed(&monitor, 2000);
+    sim_clock_sleep_micros(5000);
+    timer_monitor_fired(&monitor);
+    timer_monitor_get(&monitor, &stats);
+    CHECK(stats.samples == 1 && stats.min_micros >= 3000 && stats.max_micros < 3000 + 2000, "late %d us", stats.max_micros);
+
+    // not armed, stopped, fired twice: nothing counted
+    timer_monitor_fired(&monitor);
+    timer_monitor_armed(&monitor, 1000);
+    timer_monitor_stopped(&monitor);
+    timer_monitor_fired(&monitor);
+    timer_monitor_get(&monitor, &stats);
+    CHECK(stats.samples == 1, "%u samples", stats.samples);
+
+    // early reads negative, only the last window counts
+    for (int i = 0; i < TIMER_MONITOR_WINDOW; i++) {
+        timer_monitor_armed(&monitor, 1000000);
+        timer_monitor_fired(&monitor);
+    }
+    timer_monitor_get(&monitor, &stats);
+    CHECK(stats.samples == TIMER_MONITOR_WINDOW + 1, "%u samples", stats.samples);
+    CHECK(stats.max_micros <= -999000 && stats.min_micros > -1000001, "early %d..%d us", stats.min_micros, stats.max_micros);
+    CHECK(stats.avg_micros >= stats.min_micros && stats.avg_micros <= stats.max_micros, "avg %d", stats.avg_micros);
+}
+
+static void test_focuser_timer() {
+    focuser_init();
+    focuser_move(200);
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    while (focuser_get_is_moving() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    timer_monitor_stats_t stats;
+    focuser_get_timer_stats(&stats);
+    CHECK(!focuser_get_is_moving() && focuser_get_position() == 200, "at %d", focuser_get_position());
+    // one firing per step and the last that stops it
+    CHECK(stats.samples >= 200 && stats.samples <= 202, "%u firings for 200 steps", stats.samples);
+    CHECK(stats.min_micros >= 0 && stats.max_micros < 20000, "late %d..%d us", stats.min_micros, stats.max_micros);
+    printf("  focuser step timer late %d..%d us, %d on average\n", stats.min_micros, stats.max_micros, stats.avg_micros);
+}
+
+volatile bool burning = true;
+int64_t burnStarted;
+volatile int64_t spun[2];
+
+/* spins for the given share of every 10 ms */
+static void burn(void* arg) {
+    int permille = (int)(intptr_t) arg;
+    volatile int64_t* total = &spun[permille == 500 ? 0 : 1];
+    struct timespec t;
+    while (burning) {
+        int64_t until = esp_timer_get_time() + permille * 10;
+        while (esp_timer_get_time() < until) {
+        }
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        *total = t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+        sim_clock_sleep_micros((1000 - permille) * 10);
+    }
+    vTaskDelete(NULL);
+}
+
+/* the share the burner really spun for */
+static int duty(int which) {
+    return (int)(spun[which] * 1000 / (esp_timer_get_time() - burnStarted));
+}
+
+static const cpu_task_load_t* find(const cpu_monitor_report_t* report, const char* name, int* at) {
+    for (int i = 0; i < report->task_count; i++) {
+        if (!strcmp(report->tasks[i].name, name)) {
+            *at = i;
+            return &report->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_loads() {
+    CHECK(init_event_loop() == ESP_OK, "event loop");
+    xTaskCreatePinnedToCore(event_loop_run, "event_loop", 4096, NULL, 5, NULL, 0);
+    burnStarted = esp_timer_get_time();
+    xTaskCreatePinnedToCore(burn, "half", 4096, (void*) 500, 5, NULL, 1);
+    xTaskCreatePinnedToCore(burn, "tenth", 4096, (void*) 100, 5, NULL, 1);
+    CHECK(init_cpu_monitor() == ESP_OK, "monitor");
+    cpu_monitor_report_t report;
+    cpu_monitor_get_report(&report);
+    CHECK(report.window_micros == 0 && report.cpu_mhz == CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, "before the first window");
+
+    // the second window is a steady one
+    sim_clock_sleep_micros(CONFIG_CPU_MONITOR_WINDOW_MILLIS * 2500);
+    cpu_monitor_get_report(&report);
+    int halfDuty = duty(0), tenthDuty = duty(1);
+    burning = false;
+    int halfAt = -1, tenthAt = -1;
+    const cpu_task_load_t* half = find(&report, "half", &halfAt);
+    const cpu_task_load_t* tenth = find(&report, "tenth", &tenthAt);
+    CHECK(half && tenth, "burners not in the report");
+    if (!half || !tenth) return;
+    CHECK(abs((int) report.window_micros - CONFIG_CPU_MONITOR_WINDOW_MILLIS * 1000) < 20000, "window %u us", report.window_micros);
+    CHECK(abs(half->load - halfDuty) < 100, "%d permille read as %d", halfDuty, half->load);
+    CHECK(abs(tenth->load - tenthDuty) < 50, "%d permille read as %d", tenthDuty, tenth->load);
+    CHECK(half->core == 1 && half->priority == 5 && half->peak >= half->load, "core %d prio %d peak %d",
+        half->core, half->priority, half->peak);
+    // busiest first, the core carries both
+    bool sorted = true;
+    for (int i = 1; i < report.task_count; i++) {
+        sorted &= report.tasks[i - 1].load >= report.tasks[i].load;
+    }
+    CHECK(sorted && halfAt < tenthAt, "not sorted by load");
+    CHECK(report.core_load[1] >= half->load + tenth->load - 50 && report.core_load[1] <= 1000, "core 1 at %d permille",
+        report.core_load[1]);
+    CHECK(report.core_load[0] < report.core_load[1] && report.core_peak[1] >= report.core_load[1], "core 0 at %d",
+        report.core_load[0]);
+    printf("  core 0 %d, core 1 %d permille: spun %d read %d, spun %d read %d\n", report.core_load[0], report.core_load[1],
+        halfDuty, half->load, tenthDuty, tenth->load);
+}
+
+int main() {
+    test_init(1);
+    test_timer_monitor();
+    test_focuser_timer();
+    test_loads();
+    return test_done("cpu_monitor");
+}
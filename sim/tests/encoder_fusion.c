@@ -0,0 +1,132 @@
+#include "math.h"
+#include "test.h"
+
+/*
+ * The RA axis with an encoder on simulated pins: the motor is commanded
+ * through the step rate, the encoder follows what the axis really did.
+ * Steps are dropped on the way, a few for the filter to take out, then a
+ * stall that has to read as a slip. Four pulses per count so the counts
+ * line up with the steps. The Makefile leaves the firmware's own
+ * mount_encoder object out of this test.
+ */
+#define CONFIG_RA_ENCODER 1
+#define CONFIG_GPIO_RA_ENCODER_A 34
+#define CONFIG_GPIO_RA_ENCODER_B 35
+#define CONFIG_RA_ENCODER_REVERSE false
+#define PULSES_PER_COUNT 4
+#define RA_UAS_PER_COUNT (PULSES_PER_COUNT * RA_UAS_PER_PULSE)
+#include "../../main/mount_encoder.c"
+
+#define FREQ 4000
+#define UAS_PER_PULSE ((double) RA_UAS_PER_PULSE / 4294967296.0)
+
+static void test_filter() {
+    bool slip;
+    // a tenth of the difference per update
+    int64_t c = axis_fusion_update(0, 1000000, 1100000, 100, 50000000, &slip);
+    CHECK(c == 10000 && !slip, "correction %lld", c);
+    c = axis_fusion_update(c, 1000000, 1100000, 100, 50000000, &slip);
+    CHECK(c == 19000 && !slip, "correction %lld", c);
+    // beyond the threshold the correction jumps to the encoder
+    c = axis_fusion_update(c, 1000000, -60000000, 100, 50000000, &slip);
+    CHECK(c == -61000000 && slip, "slip correction %lld", c);
+}
+
+/* quadrature phase of the encoder pins */
+int encoderPhase = 0;
+int32_t encoderCounts = 0;
+static const uint8_t gray[4] = { 0x0, 0x1, 0x3, 0x2 };
+
+static void encoder_to(int32_t counts) {
+    while (encoderCounts != counts) {
+        int dir = counts > encoderCounts ? 1 : -1;
+        encoderPhase = (encoderPhase + dir) & 3;
+        encoderCounts += dir;
+        sim_gpio_set_input(CONFIG_GPIO_RA_ENCODER_A, gray[encoderPhase] >> 1);
+        sim_gpio_set_input(CONFIG_GPIO_RA_ENCODER_B, gray[encoderPhase] & 1);
+        // let the worker drain the ring now and then
+        if ((encoderCounts & 63) == 0) sim_clock_sleep_micros(200);
+    }
+}
+
+static int64_t commanded() {
+    portENTER_CRITICAL(&positionMux);
+    int64_t pulses = axis_pulses(&position.ra, currentTimeMillis());
+    portEXIT_CRITICAL(&positionMux);
+    return pulses;
+}
+
+/* runs the axis for a while, the encoder follows the commanded steps less the missed ones */
+static void run(int32_t freq, int64_t millis, int64_t missedBefore, int64_t missedAfter) {
+    ra_pulse_freq_changed(freq);
+    int64_t started = esp_timer_get_time();
+    int64_t end = started + millis * 1000;
+    while (esp_timer_get_time() < end) {
+        double done = (double)(esp_timer_get_time() - started) / (end - started);
+        int64_t missed = missedBefore + (int64_t)((missedAfter - missedBefore) * done);
+        encoder_to((int32_t)((commanded() - missed) / PULSES_PER_COUNT));
+        sim_clock_sleep_micros(5000);
+    }
+    ra_pulse_freq_changed(0);
+    encoder_to((int32_t)((commanded() - missedAfter) / PULSES_PER_COUNT));
+}
+
+static double correction_pulses() {
+    portENTER_CRITICAL(&positionMux);
+    int64_t correction = position.ra.correction;
+    portEXIT_CRITICAL(&positionMux);
+    return correction / UAS_PER_PULSE;
+}
+
+static void sync_axes(const void* _) {
+    set_angles(0, 0);
+}
+
+static void test_missed_steps() {
+    init_motion_loop();
+    init_mount_encoder();
+    CHECK(get_mount_encoder_flags() == MOUNT_ENCODER_RA, "flags %x", get_mount_encoder_flags());
+
+    // all steps made, the correction stays within a count
+    run(FREQ, 1000, 0, 0);
+    sim_clock_sleep_micros(1000000);
+    CHECK(fabs(correction_pulses()) <= PULSES_PER_COUNT, "%.1f pulses corrected with no step lost", correction_pulses());
+
+    // 400 steps lost along the way, the fused position follows the encoder
+    run(FREQ, 1000, 0, 400);
+    sim_clock_sleep_micros(4000000);
+    CHECK(fabs(correction_pulses() + 400) <= 16, "%.1f pulses corrected for 400 lost", correction_pulses());
+    CHECK(get_mount_encoder_flags() == MOUNT_ENCODER_RA, "a slow loss read as a slip, flags %x", get_mount_encoder_flags());
+    printf("  400 steps lost: corrected by %.1f\n", correction_pulses());
+
+    // a stall, the axis stands while commanded to move ten times as fast
+    int64_t stalled = commanded();
+    int64_t missed = stalled - (int64_t) encoderCounts * PULSES_PER_COUNT;
+    ra_pulse_freq_changed(FREQ * 10);
+    sim_clock_sleep_micros(1000000);
+    ra_pulse_freq_changed(0);
+    // the filter takes out what the axis was told after the last slip
+    sim_clock_sleep_micros(3000000);
+    uint32_t raSlips, decSlips;
+    get_mount_encoder_slips(&raSlips, &decSlips);
+    CHECK(raSlips >= 1 && decSlips == 0, "%u slips", raSlips);
+    CHECK(get_mount_encoder_flags() & MOUNT_ENCODER_RA_SLIPPED, "stall not flagged, flags %x", get_mount_encoder_flags());
+    double lost = commanded() - stalled + missed;
+    CHECK(fabs(correction_pulses() + lost) <= lost * 0.02, "%.1f pulses corrected for %.0f lost", correction_pulses(), lost);
+    printf("  stall of %.0f steps: %u slips, corrected by %.1f\n", lost, raSlips, correction_pulses());
+
+    // a sync starts over and clears the flag
+    motion_post(sync_axes, NULL, 0);
+    sim_clock_sleep_micros(200000);
+    CHECK(get_mount_encoder_flags() == MOUNT_ENCODER_RA, "flags %x after a sync", get_mount_encoder_flags());
+    CHECK(fabs(correction_pulses()) <= PULSES_PER_COUNT, "%.1f pulses corrected after a sync", correction_pulses());
+}
+
+int main() {
+    test_init(1);
+    sim_gpio_set_input(CONFIG_GPIO_RA_ENCODER_A, 0);
+    sim_gpio_set_input(CONFIG_GPIO_RA_ENCODER_B, 0);
+    test_filter();
+    test_missed_steps();
+    return test_done("encoder_fusion");
+}
@@ -0,0 +1,335 @@
+#include "string.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "event_loop.h"
+#include "timer_wheel.h"
+
+/*
+ * The timer wheel against a plain model: random timers from the next tick
+ * to beyond the wheel's range, cancelled and moved at random, must fire on
+ * their exact tick, and the loop's wait must never step over one. Then the
+ * running loop: timers and posts from other tasks, and a socket. Timed are
+ * the wheel's add, cancel and advance and a loopback datagram's way to its
+ * readable callback.
+ */
+
+#define TIMERS 100
+
+typedef struct {
+    wheel_timer_t timer;
+    uint32_t due; // next tick it has to fire on
+    bool pending;
+    int fired;
+} model_t;
+
+model_t models[TIMERS];
+timer_wheel_t wheel;
+int misfires = 0;
+
+static void fire(void* arg) {
+    model_t* m = arg;
+    if (!m->pending || wheel.now != m->due) {
+        if (misfires++ < 5) printf("  timer %d fired at %u, due %u%s\n", (int)(m - models), wheel.now, m->due, m->pending ? "" : " cancelled");
+    }
+    m->fired++;
+    if (m->timer.period) {
+        m->due += m->timer.period;
+    } else {
+        m->pending = false;
+    }
+}
+
+static uint32_t distance() {
+    // mostly short, some across every level, a few beyond the range
+    switch (rand() % 8) {
+    case 0: return 1 + rand() % 4;
+    case 1: return 1 + rand() % 64;
+    case 2: return 1 + rand() % 4096;
+    case 3: return 1 + rand() % 262144;
+    case 4: return 1 + (rand() % 1024) * 16384 + rand() % 16384;
+    case 5: return WHEEL_MAX_TICKS + 1 + rand() % 2000000;
+    default: return 1 + rand() % 1000;
+    }
+}
+
+static void test_wheel() {
+    srand(44);
+    // close to the tick counter wrapping
+    wheel_init(&wheel, UINT32_MAX - 5000000);
+    for (int i = 0; i < TIMERS; i++) {
+        models[i] = (model_t) { 0 };
+        wheel_timer_init(&models[i].timer, fire, &models[i]);
+    }
+    uint32_t end = wheel.now + 20000000;
+    int jumps = 0, changes = 0, badCounts = 0, overshots = 0;
+    while ((int32_t)(end - wheel.now) > 0) {
+        // a few timers added, moved or cancelled between advances
+        for (int n = rand() % 3; n > 0; n--) {
+            model_t* m = &models[rand() % TIMERS];
+            if (m->pending && rand() % 4 == 0) {
+                wheel_cancel(&wheel, &m->timer);
+                m->pending = false;
+            } else {
+                m->timer.period = rand() % 5 == 0 ? 1 + rand() % 5000 : 0;
+                m->due = wheel.now + distance();
+                m->pending = true;
+                wheel_add(&wheel, &m->timer, m->due);
+            }
+            changes++;
+        }
+        uint32_t pending = 0, soonest = UINT32_MAX;
+        for (int i = 0; i < TIMERS; i++) {
+            if (models[i].pending) {
+                pending++;
+                if (models[i].due - wheel.now < soonest) soonest = models[i].due - wheel.now;
+            }
+        }
+        if (wheel.pending != pending) badCounts++;
+        uint32_t wait = wheel_next_tick(&wheel, 1000000);
+        if (wait < 1 || wait > soonest) overshots++;
+        wheel_advance(&wheel, wheel.now + wait);
+        jumps++;
+    }
+    CHECK(misfires == 0, "%d timers fired off their tick", misfires);
+    CHECK(badCounts == 0, "pending count wrong %d times", badCounts);
+    CHECK(overshots == 0, "the wait stepped over a timer %d times", overshots);
+    int fired = 0;
+    for (int i = 0; i < TIMERS; i++) fired += models[i].fired;
+    printf("  %d timers fired over %d jumps and %d changes\n", fired, jumps, changes);
+}
+
+/* same tick, same order as they reached it */
+static int order[4], orderCount = 0;
+
+static void record(void* arg) {
+    order[orderCount++] = (int)(intptr_t) arg;
+}
+
+static void test_same_tick() {
+    wheel_init(&wheel, 100);
+    wheel_timer_t t[4];
+    for (int i = 0; i < 4; i++) {
+        wheel_timer_init(&t[i], record, (void*)(intptr_t) i);
+        wheel_add(&wheel, &t[i], 200);
+    }
+    // moving a timer puts it at the back
+    wheel_add(&wheel, &t[1], 200);
+    // one in the past fires on the next tick
+    CHECK(wheel_advance(&wheel, 199) == 0, "fired early");
+    CHECK(wheel_advance(&wheel, 200) == 4, "not all fired");
+    CHECK(order[0] == 0 && order[1] == 2 && order[2] == 3 && order[3] == 1, "order %d %d %d %d", order[0], order[1], order[2], order[3]);
+    wheel_add(&wheel, &t[0], 150);
+    CHECK(wheel_advance(&wheel, 201) == 1 && wheel.pending == 0, "a past timer did not fire on the next tick");
+}
+
+#define BENCH_TIMERS 4096
+#define BENCH_ROUNDS 64
+wheel_timer_t benchTimers[BENCH_TIMERS];
+int benchFired = 0;
+
+static void count_fired(void* arg) {
+    benchFired++;
+}
+
+static void test_wheel_speed() {
+    srand(45);
+    static uint32_t due[BENCH_TIMERS];
+    wheel_init(&wheel, 0);
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        wheel_timer_init(&benchTimers[i], count_fired, NULL);
+    }
+    double addSeconds = 0, cancelSeconds = 0, advanceSeconds = 0;
+    uint32_t ticks = 0;
+    int expected = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        // spread over the lower three levels, the way the loop's timers are
+        for (int i = 0; i < BENCH_TIMERS; i++) {
+            due[i] = wheel.now + 1 + rand() % 200000;
+        }
+        double started = test_seconds();
+        for (int i = 0; i < BENCH_TIMERS; i++) {
+            wheel_add(&wheel, &benchTimers[i], due[i]);
+        }
+        addSeconds += test_seconds() - started;
+        // half cancelled, the rest fire
+        started = test_seconds();
+        for (int i = 0; i < BENCH_TIMERS; i += 2) {
+            wheel_cancel(&wheel, &benchTimers[i]);
+        }
+        cancelSeconds += test_seconds() - started;
+        expected += BENCH_TIMERS / 2;
+        uint32_t end = wheel.now + 200001;
+        started = test_seconds();
+        while (wheel.now != end) {
+            uint32_t wait = wheel_next_tick(&wheel, end - wheel.now);
+            wheel_advance(&wheel, wheel.now + wait);
+        }
+        advanceSeconds += test_seconds() - started;
+        ticks += 200001;
+    }
+    CHECK(benchFired == expected && wheel.pending == 0, "%d of %d fired, %u pending", benchFired, expected, wheel.pending);
+    int ops = BENCH_ROUNDS * BENCH_TIMERS;
+    printf("  wheel ns: add %.1f, cancel %.1f, advance %.1f per fire, %.2f per tick\n", addSeconds * 1e9 / ops,
+        cancelSeconds * 2e9 / ops, advanceSeconds * 1e9 / expected, advanceSeconds * 1e9 / ticks);
+}
+
+TaskHandle_t loopTask;
+volatile bool offLoop = false;
+volatile int64_t onceAt = 0;
+volatile int periodicCount = 0;
+volatile int stoppedCount = 0;
+volatile int received = 0;
+
+static void once(void* arg) {
+    if (xTaskGetCurrentTaskHandle() != loopTask) offLoop = true;
+    onceAt = esp_timer_get_time();
+}
+
+static void periodic(void* arg) {
+    if (xTaskGetCurrentTaskHandle() != loopTask) offLoop = true;
+    periodicCount++;
+}
+
+static void stopped(void* arg) {
+    stoppedCount++;
+}
+
+#define PRODUCERS 3
+#define POSTS 1000
+int lastSeen[PRODUCERS];
+volatile int posted = 0, outOfOrder = 0, dropped = 0;
+
+typedef struct {
+    int producer, n;
+} post_t;
+
+static void work(const void* data) {
+    const post_t* p = data;
+    if (xTaskGetCurrentTaskHandle() != loopTask) offLoop = true;
+    if (p->n <= lastSeen[p->producer]) outOfOrder++;
+    lastSeen[p->producer] = p->n;
+    posted++;
+}
+
+static void producer(void* arg) {
+    int id = (int)(intptr_t) arg;
+    for (int i = 1; i <= POSTS; i++) {
+        post_t p = { id, i };
+        // a full queue refuses, the producer tries again
+        while (!event_loop_post(work, &p, sizeof(p))) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            vTaskDelay(1);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static void readable(int fd, void* arg) {
+    char buf[16];
+    if (xTaskGetCurrentTaskHandle() != loopTask) offLoop = true;
+    if (recv(fd, buf, sizeof(buf), 0) > 0) received++;
+}
+
+#define PINGS 2000
+int64_t pingLatency[PINGS];
+volatile int pingCount = 0;
+
+/* the datagram carries its send time */
+static void ping_readable(int fd, void* arg) {
+    int64_t sent;
+    if (recv(fd, &sent, sizeof(sent), 0) == sizeof(sent) && pingCount < PINGS) {
+        pingLatency[pingCount] = esp_timer_get_time() - sent;
+        pingCount++;
+    }
+}
+
+static int compare_latency(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/* one datagram in flight at a time, sent from another task while the loop waits in select */
+static void test_socket_latency() {
+    int fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr*) &addr, sizeof(addr));
+    getsockname(fd, (struct sockaddr*) &addr, &len);
+    CHECK(event_loop_add_socket(fd, ping_readable, NULL) == ESP_OK, "add socket");
+    int out = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    for (int i = 0; i < PINGS; i++) {
+        int64_t deadline = esp_timer_get_time() + 100000;
+        int64_t sent = esp_timer_get_time();
+        sendto(out, &sent, sizeof(sent), 0, (struct sockaddr*) &addr, sizeof(addr));
+        while (pingCount <= i && esp_timer_get_time() < deadline) {
+            sim_clock_sleep_micros(50);
+        }
+    }
+    CHECK(pingCount == PINGS, "%d of %d datagrams", pingCount, PINGS);
+    qsort(pingLatency, pingCount, sizeof(int64_t), compare_latency);
+    CHECK(pingCount == 0 || pingLatency[0] >= 0, "a datagram read before it was sent");
+    if (pingCount == 0) return;
+    printf("  loopback datagram to callback us: p50 %lld, p90 %lld, p99 %lld, max %lld\n", pingLatency[pingCount / 2],
+        pingLatency[pingCount * 9 / 10], pingLatency[pingCount * 99 / 100], pingLatency[pingCount - 1]);
+}
+
+static void test_loop() {
+    CHECK(init_event_loop() == ESP_OK, "init");
+    xTaskCreatePinnedToCore(event_loop_run, "event_loop", 4096, NULL, 5, &loopTask, 0);
+
+    event_timer_t a, b, c;
+    event_timer_init(&a, once, NULL);
+    event_timer_init(&b, periodic, NULL);
+    event_timer_init(&c, stopped, NULL);
+    int64_t started = esp_timer_get_time();
+    // started from this task while the loop waits in select
+    event_timer_start_once(&a, 150);
+    event_timer_start_periodic(&b, 50);
+    event_timer_start_once(&c, 100);
+    sim_clock_sleep_micros(50000);
+    event_timer_stop(&c);
+    sim_clock_sleep_micros(1000000 - 50000);
+    event_timer_stop(&b);
+    int64_t late = onceAt - started - 150000;
+    CHECK(late >= 0 && late < 20000, "a 150 ms timer fired %lld us late", late);
+    CHECK(periodicCount >= 18 && periodicCount <= 20, "%d periods of 50 ms in a second", periodicCount);
+    CHECK(stoppedCount == 0, "a stopped timer fired");
+    printf("  150 ms timer %lld us late, %d periods of 50 ms in 1 s\n", late, periodicCount);
+
+    for (int i = 0; i < PRODUCERS; i++) {
+        xTaskCreatePinnedToCore(producer, "producer", 4096, (void*)(intptr_t) i, 5, NULL, 1);
+    }
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    while (posted < PRODUCERS * POSTS && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    CHECK(posted == PRODUCERS * POSTS, "%d of %d posts ran", posted, PRODUCERS * POSTS);
+    CHECK(outOfOrder == 0, "%d posts out of order", outOfOrder);
+    printf("  %d posts from %d tasks, %d refused on a full queue\n", posted, PRODUCERS, dropped);
+
+    int fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr*) &addr, sizeof(addr));
+    getsockname(fd, (struct sockaddr*) &addr, &len);
+    CHECK(event_loop_add_socket(fd, readable, NULL) == ESP_OK, "add socket");
+    int out = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+    for (int i = 0; i < 3; i++) {
+        sendto(out, "x", 1, 0, (struct sockaddr*) &addr, sizeof(addr));
+        sim_clock_sleep_micros(20000);
+    }
+    CHECK(received == 3, "%d of 3 datagrams", received);
+    test_socket_latency();
+    CHECK(!offLoop, "a callback ran off the loop task");
+}
+
+int main() {
+    test_init(1);
+    test_wheel();
+    test_same_tick();
+    test_wheel_speed();
+    test_loop();
+    return test_done("event_loop");
+}
@@ -0,0 +1,270 @@
+#include "test.h"
+
+/*
+ * The focuser built into the test so the ramp state is visible and the
+ * full-step option can be switched per case. The Makefile leaves the
+ * firmware's own focuser object out of this test.
+ */
+bool fullStep = false;
+#define CONFIG_FOCUS_FULL_STEP fullStep
+#include "../../main/focuser.c"
+
+/* one move through focuser_advance alone, the speed of every tick in steps per second */
+typedef struct {
+    int ticks;
+    float speed[20000];
+    int32_t position[20000];
+} ramp_t;
+
+ramp_t ramp;
+
+static void reset(int32_t from, int32_t to) {
+    focuser_step = from;
+    focuser_target_step = to;
+    focuser_phase_offset = 0;
+    focuser_speed = 0;
+    focuser_direction = 1;
+}
+
+static void run(int32_t reverseAt, int32_t reverseTo) {
+    ramp.ticks = 0;
+    while (ramp.ticks < 20000) {
+        if (ramp.ticks == reverseAt) {
+            focuser_target_step = reverseTo;
+        }
+        int32_t before = focuser_step;
+        uint32_t interval = focuser_advance();
+        if (interval == 0) {
+            return;
+        }
+        // the interval truncates to whole micros, the ramp itself is checked
+        ramp.speed[ramp.ticks] = focuser_speed;
+        CHECK(interval == (uint32_t)(1000000 * abs(focuser_step - before) / focuser_speed), "tick %d interval %u", ramp.ticks, interval);
+        ramp.position[ramp.ticks] = focuser_step;
+        ramp.ticks++;
+    }
+}
+
+/* speed stays between start and cruise and changes by at most the acceleration */
+static void check_profile(const char* name) {
+    float worst = 0;
+    for (int i = 1; i < ramp.ticks; i++) {
+        float v = ramp.speed[i], u = ramp.speed[i - 1];
+        int32_t stride = abs(ramp.position[i] - ramp.position[i - 1]);
+        float allowed = 2 * ACCELERATION * stride * 1.001f;
+        float change = fabsf(v * v - u * u);
+        // the first tick and a reversal jump to the start speed
+        if (change > allowed && v > START_SPEED * 1.001f && u > START_SPEED * 1.001f) {
+            worst = change / allowed > worst ? change / allowed : worst;
+        }
+        CHECK(v >= START_SPEED * 0.999f && v <= CRUISE_SPEED * 1.001f, "%s: tick %d at %f steps/s", name, i, v);
+    }
+    CHECK(worst == 0, "%s: speed changed %.2f times faster than the acceleration allows", name, worst);
+    CHECK(ramp.speed[ramp.ticks - 1] <= START_SPEED * 1.05f, "%s: arrives at %f steps/s", name, ramp.speed[ramp.ticks - 1]);
+}
+
+static void test_ramp() {
+    fullStep = false;
+    reset(0, 3000);
+    run(-1, 0);
+    CHECK(focuser_step == 3000, "stopped at %d", focuser_step);
+    CHECK(ramp.ticks == 3000, "%d ticks for 3000 steps", ramp.ticks);
+    check_profile("long move");
+    float peak = 0;
+    double seconds = 0;
+    for (int i = 0; i < ramp.ticks; i++) {
+        if (ramp.speed[i] > peak) peak = ramp.speed[i];
+        seconds += 1 / ramp.speed[i];
+    }
+    CHECK(peak >= CRUISE_SPEED * 0.999f, "a long move peaks at %f of %f", peak, (float) CRUISE_SPEED);
+    printf("  3000 steps in %.2f s, start %.0f, cruise %.0f steps/s\n", seconds, (float) START_SPEED, (float) CRUISE_SPEED);
+
+    // too short to reach the cruise speed
+    reset(100, 60);
+    run(-1, 0);
+    CHECK(focuser_step == 60 && ramp.ticks == 40, "short move stopped at %d after %d ticks", focuser_step, ramp.ticks);
+    check_profile("short move");
+}
+
+/* a target behind the moving focuser first brakes, then comes back */
+static void test_reversal() {
+    fullStep = false;
+    reset(0, 3000);
+    run(800, 200);
+    CHECK(focuser_step == 200, "reversed move stopped at %d", focuser_step);
+    check_profile("reversal");
+    int32_t furthest = 0;
+    for (int i = 0; i < ramp.ticks; i++) {
+        if (ramp.position[i] > furthest) furthest = ramp.position[i];
+    }
+    // braking from cruise takes (cruise^2 - start^2) / 2a
+    int32_t braking = (int32_t)((CRUISE_SPEED * CRUISE_SPEED - START_SPEED * START_SPEED) / (2 * ACCELERATION)) + 2;
+    CHECK(furthest > 800 && furthest <= 800 + braking, "overshot to %d braking from 800, %d allowed", furthest, braking);
+}
+
+/* two coils all the way, half steps only for the final approach */
+static void test_full_step() {
+    fullStep = true;
+    reset(1, 2001);
+    run(-1, 0);
+    fullStep = false;
+    CHECK(focuser_step == 2001, "full-step move stopped at %d", focuser_step);
+    check_profile("full-step");
+    int halfSteps = 0;
+    for (int i = 1; i < ramp.ticks; i++) {
+        int32_t stride = ramp.position[i] - ramp.position[i - 1];
+        if (stride == 1) {
+            halfSteps++;
+            CHECK(2001 - ramp.position[i] < CONFIG_FOCUS_FINAL_APPROACH_STEPS, "half step at %d", ramp.position[i]);
+        } else {
+            CHECK(stride == 2 && (ramp.position[i] & 1), "stride %d to %d", stride, ramp.position[i]);
+        }
+    }
+    printf("  full-step: %d ticks, %d of them half steps\n", ramp.ticks, halfSteps);
+}
+
+static int coils(uint32_t low, uint32_t high, const int pins[4]) {
+    int n = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t bit = 1u << (pins[i] & 31);
+        n += ((pins[i] >= 32 ? high : low) & bit) != 0;
+    }
+    return n;
+}
+
+/* every phase drives all four pins, and a change never energizes three coils */
+static void test_masks(const int pins[4]) {
+    focuser_phase_mask_t masks[8], release;
+    focuser_build_masks(pins, masks, &release);
+    uint32_t all = 0, allHigh = 0;
+    for (int i = 0; i < 4; i++) {
+        *(pins[i] >= 32 ? &allHigh : &all) |= 1u << (pins[i] & 31);
+    }
+    CHECK(release.clear == all && release.clear_high == allHigh && !release.set && !release.set_high, "release");
+    for (int phase = 0; phase < 8; phase++) {
+        focuser_phase_mask_t* m = &masks[phase];
+        CHECK((m->set | m->clear) == all && (m->set_high | m->clear_high) == allHigh, "phase %d leaves a pin", phase);
+        CHECK(!(m->set & m->clear) && !(m->set_high & m->clear_high), "phase %d sets and clears a pin", phase);
+        CHECK(coils(m->set, m->set_high, pins) == (phase & 1 ? 2 : 1), "phase %d energizes %d coils", phase, coils(m->set, m->set_high, pins));
+        for (int i = 0; i < 4; i++) {
+            uint32_t bit = 1u << (pins[i] & 31);
+            CHECK((((pins[i] >= 32 ? m->set_high : m->set) & bit) != 0) == focuser_step_config[phase][i], "phase %d pin %d", phase, pins[i]);
+        }
+    }
+    // half and full-step transitions in both directions, clear first then set
+    for (int from = 0; from < 8; from++) {
+        for (int stride = -2; stride <= 2; stride++) {
+            focuser_phase_mask_t* a = &masks[from];
+            focuser_phase_mask_t* b = &masks[(from + stride) & 7];
+            uint32_t low = a->set & ~b->clear, high = a->set_high & ~b->clear_high;
+            CHECK(coils(low, high, pins) <= 2, "%d to %d passes three coils", from, from + stride);
+        }
+    }
+}
+
+/* the register writes reach the pins, the bank above 31 included */
+static void test_register_writes() {
+    const int pins[4] = { 5, 31, 32, 39 };
+    focuser_phase_mask_t masks[8], release;
+    focuser_build_masks(pins, masks, &release);
+    for (int phase = 0; phase < 8; phase++) {
+        focuser_apply(&masks[phase]);
+        for (int i = 0; i < 4; i++) {
+            CHECK(sim_gpio_get_output(pins[i]) == focuser_step_config[phase][i], "phase %d pin %d is %d", phase, pins[i], sim_gpio_get_output(pins[i]));
+        }
+    }
+    focuser_apply(&release);
+    for (int i = 0; i < 4; i++) {
+        CHECK(sim_gpio_get_output(pins[i]) == 0, "pin %d left on", pins[i]);
+    }
+}
+
+int arrivedAt = -1;
+
+static void arrived(int32_t position) {
+    arrivedAt = position;
+}
+
+/* the real timer drives the coils to the target and releases them */
+static void test_timer_move() {
+    focuser_init();
+    focuser_set_arrived_callback(arrived);
+    focuser_move_to(500);
+    CHECK(focuser_get_is_moving(), "not moving after move_to");
+    int64_t deadline = esp_timer_get_time() + 10000000;
+    while (focuser_get_is_moving() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    CHECK(!focuser_get_is_moving() && focuser_get_position() == 500, "at %d", focuser_get_position());
+    CHECK(arrivedAt == 500, "arrived callback got %d", arrivedAt);
+    for (int i = 0; i < 4; i++) {
+        CHECK(sim_gpio_get_output(focuser_gpio_nums[i]) == 0, "coil %d still energized", i);
+    }
+}
+
+static void wait_idle() {
+    int64_t deadline = esp_timer_get_time() + 10000000;
+    while (focuser_get_is_moving() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+}
+
+static int phase_pins() {
+    int pins = 0;
+    for (int i = 0; i < 4; i++) {
+        pins |= sim_gpio_get_output(focuser_gpio_nums[i]) << i;
+    }
+    return pins;
+}
+
+/* absolute targets, re-zeroing and the travel limit */
+static void test_positioning() {
+    focuser_init();
+    focuser_move_to(300);
+    CHECK(focuser_get_target() == 300, "target %d", focuser_get_target());
+    CHECK(!focuser_set_position(0), "re-zeroed while moving");
+    // a relative move adds to the target, not to where the focuser is now
+    focuser_move(-100);
+    CHECK(focuser_get_target() == 200, "relative target %d", focuser_get_target());
+    wait_idle();
+    CHECK(focuser_get_position() == 200, "at %d", focuser_get_position());
+
+    // the coils keep their phase across a re-zero, the next step is one phase on
+    focuser_output(focuser_get_position());
+    int before = phase_pins();
+    CHECK(focuser_set_position(1000), "re-zero while idle");
+    CHECK(focuser_get_position() == 1000 && focuser_get_target() == 1000, "re-zeroed to %d", focuser_get_position());
+    focuser_output(focuser_get_position());
+    CHECK(phase_pins() == before, "phase changed from %x to %x", before, phase_pins());
+    focuser_output(focuser_get_position() + 1);
+    int next = 0;
+    for (int i = 0; i < 4; i++) {
+        next |= focuser_step_config[(200 + 1) & 7][i] << i;
+    }
+    CHECK(phase_pins() == next, "the step after the re-zero drives %x, not %x", phase_pins(), next);
+    focuser_release();
+
+    focuser_move_to(INT32_MAX);
+    CHECK(focuser_get_target() == (int32_t) focuser_get_max_steps(), "clamped to %d", focuser_get_target());
+    focuser_abort_move();
+    CHECK(!focuser_get_is_moving() && focuser_get_target() == focuser_get_position(), "abort keeps the target %d at %d",
+        focuser_get_target(), focuser_get_position());
+    focuser_move(INT32_MIN);
+    CHECK(focuser_get_target() >= -(int32_t) focuser_get_max_steps(), "relative move clamped to %d", focuser_get_target());
+    focuser_abort_move();
+}
+
+int main() {
+    test_init(10);
+    test_ramp();
+    test_reversal();
+    test_full_step();
+    const int configured[4] = { CONFIG_GPIO_FOCUS_IN1, CONFIG_GPIO_FOCUS_IN2, CONFIG_GPIO_FOCUS_IN3, CONFIG_GPIO_FOCUS_IN4 };
+    const int edges[4] = { 0, 31, 32, 39 };
+    test_masks(configured);
+    test_masks(edges);
+    test_register_writes();
+    test_timer_move();
+    test_positioning();
+    return test_done("focuser");
+}
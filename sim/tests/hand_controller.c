@@ -0,0 +1,155 @@
+#include "math.h"
+#include "string.h"
+#include "test.h"
+#include "input.h"
+#include "focuser.h"
+#include "hand_controller.h"
+
+/*
+ * The velocity to rate mapping on its own, then the knob on simulated pins
+ * through the input queue as the input loop feeds it: a steady spin jogs
+ * at the mapped rate, the rate decays to a stop once the knob rests, and
+ * on the focuser a slow turn moves one step per count. A jog the motion
+ * queue turns away is retried and holds the axis until it gets through.
+ */
+
+#define MIN_RATE (CONFIG_HAND_MIN_RATE)
+#define MAX_RATE (CONFIG_HAND_MAX_RATE)
+#define FULL_SPEED ((float)(CONFIG_HAND_FULL_SPEED_COUNTS_PER_SECOND))
+
+static void test_mapping() {
+    CHECK(hand_jog_rate(0, MIN_RATE, MAX_RATE, FULL_SPEED) == 0, "stopped");
+    CHECK(hand_jog_rate(0.4f, MIN_RATE, MAX_RATE, FULL_SPEED) == 0, "a creeping knob jogs");
+    CHECK(hand_jog_rate(-0.4f, MIN_RATE, MAX_RATE, FULL_SPEED) == 0, "a creeping knob jogs back");
+    int32_t slowest = hand_jog_rate(1, MIN_RATE, MAX_RATE, FULL_SPEED);
+    CHECK(slowest >= MIN_RATE && slowest < MIN_RATE + 100, "one count a second jogs at %d", slowest);
+    int32_t half = hand_jog_rate(FULL_SPEED / 2, MIN_RATE, MAX_RATE, FULL_SPEED);
+    CHECK(abs(half - (MIN_RATE + (MAX_RATE - MIN_RATE) / 4)) <= 1, "half speed jogs at %d", half);
+    CHECK(hand_jog_rate(FULL_SPEED, MIN_RATE, MAX_RATE, FULL_SPEED) == MAX_RATE, "full speed");
+    CHECK(hand_jog_rate(FULL_SPEED * 5, MIN_RATE, MAX_RATE, FULL_SPEED) == MAX_RATE, "past full speed");
+    int32_t previous = 0;
+    for (float v = 0.5f; v <= FULL_SPEED * 1.5f; v += 0.25f) {
+        int32_t rate = hand_jog_rate(v, MIN_RATE, MAX_RATE, FULL_SPEED);
+        CHECK(rate >= previous && rate <= MAX_RATE, "%d at %f counts/s after %d", rate, v, previous);
+        CHECK(hand_jog_rate(-v, MIN_RATE, MAX_RATE, FULL_SPEED) == -rate, "not symmetric at %f", v);
+        previous = rate;
+    }
+}
+
+#define ENCODER_ID 3
+#define PIN_A 25
+#define PIN_B 26
+
+uint8_t jogAxis = 0xff;
+int32_t jogRate = 0;
+int jogCalls = 0;
+bool jogRefused = false; // as on a full motion queue
+
+static bool jog(uint8_t axis, int32_t rate) {
+    if (jogRefused) return false;
+    jogAxis = axis;
+    jogRate = rate;
+    jogCalls++;
+    return true;
+}
+
+int knobPhase = 0;
+int64_t edgeAt[RENCODER_VELOCITY_STEPS]; // of the last counts, the host may oversleep
+
+/* the input loop's part: every encoder event to the controller */
+static void feed() {
+    input_event_t event;
+    while (input_receive(&event, 0)) {
+        if (event.type == INPUT_EVENT_ROTATED && event.source == ENCODER_ID) {
+            hand_rotated(event.value);
+        }
+    }
+}
+
+static void spin(int counts, int64_t interval) {
+    static const uint8_t gray[4] = { 0x0, 0x1, 0x3, 0x2 };
+    for (int i = 0; i < abs(counts); i++) {
+        knobPhase = (knobPhase + (counts > 0 ? 1 : -1)) & 3;
+        sim_gpio_set_input(PIN_A, gray[knobPhase] >> 1);
+        sim_gpio_set_input(PIN_B, gray[knobPhase] & 1);
+        memmove(edgeAt, edgeAt + 1, sizeof(edgeAt) - sizeof(edgeAt[0]));
+        edgeAt[RENCODER_VELOCITY_STEPS - 1] = esp_timer_get_time();
+        // the worker decodes the edge, then the input loop picks it up
+        int64_t settle = interval < 5000 ? interval / 2 : 1000;
+        sim_clock_sleep_micros(settle);
+        feed();
+        sim_clock_sleep_micros(interval - settle);
+    }
+}
+
+static void test_knob() {
+    sim_gpio_set_input(PIN_A, 0);
+    sim_gpio_set_input(PIN_B, 0);
+    CHECK(init_input() == ESP_OK, "input");
+    CHECK(input_add_encoder(ENCODER_ID, PIN_A, PIN_B, false) == ESP_OK, "encoder");
+    CHECK(init_hand_controller(ENCODER_ID, jog) == ESP_OK, "hand controller");
+    CHECK(hand_get_axis() == HAND_AXIS_RA, "starts on axis %d", hand_get_axis());
+
+    // half of full speed, steadily, the rate follows the speed the knob really turned at
+    spin(30, (int64_t)(1000000 / (FULL_SPEED / 2)));
+    float turned = (RENCODER_VELOCITY_STEPS - 1) * 1e6f / (edgeAt[RENCODER_VELOCITY_STEPS - 1] - edgeAt[0]);
+    int32_t expected = hand_jog_rate(turned, MIN_RATE, MAX_RATE, FULL_SPEED);
+    CHECK(jogAxis == HAND_AXIS_RA && fabsf(jogRate - expected) < expected * 0.05f, "RA jogs at %d for %d", jogRate, expected);
+    CHECK(hand_get_rate() == jogRate, "rate %d, last jog %d", hand_get_rate(), jogRate);
+    printf("  %.0f counts/s jogs RA at %d\n", turned, jogRate);
+
+    // the knob rests, the rate comes down to a stop without another event
+    sim_clock_sleep_micros(RENCODER_STOP_MICROS + 200000);
+    CHECK(jogRate == 0 && hand_get_rate() == 0, "still jogging at %d", jogRate);
+
+    // turned back the other way on the next axis
+    hand_select_next_axis();
+    CHECK(hand_get_axis() == HAND_AXIS_DEC, "axis %d", hand_get_axis());
+    spin(-20, 10000);
+    CHECK(jogAxis == HAND_AXIS_DEC && jogRate < 0, "Dec jogs at %d", jogRate);
+    // switching axes stops the running jog first
+    int calls = jogCalls;
+    hand_select_next_axis();
+    CHECK(jogCalls == calls + 1 && jogAxis == HAND_AXIS_DEC && jogRate == 0, "Dec left jogging at %d", jogRate);
+
+    // after a rest the focuser moves a step per count when turned slowly
+    CHECK(hand_get_axis() == HAND_AXIS_FOCUSER, "axis %d", hand_get_axis());
+    sim_clock_sleep_micros(RENCODER_STOP_MICROS);
+    int32_t target = focuser_get_target();
+    spin(-5, 400000);
+    CHECK(focuser_get_target() == target - 5, "focuser target moved by %d", focuser_get_target() - target);
+    calls = jogCalls;
+    spin(5, 5000);
+    CHECK(focuser_get_target() > target, "a fast turn moved the focuser to %d", focuser_get_target() - target);
+    CHECK(jogCalls == calls, "the focuser jogged a mount axis");
+    focuser_abort_move();
+
+    // the stop is turned away, the rate stays and the axis with it until the retry gets through
+    hand_select_next_axis();
+    CHECK(hand_get_axis() == HAND_AXIS_RA, "axis %d", hand_get_axis());
+    spin(20, 10000);
+    int32_t rate = hand_get_rate();
+    CHECK(rate > 0 && jogRate == rate, "RA jogs at %d", rate);
+    jogRefused = true;
+    sim_clock_sleep_micros(RENCODER_STOP_MICROS + 200000);
+    CHECK(hand_get_rate() == rate, "rate %d kept as %d", rate, hand_get_rate());
+    hand_select_next_axis();
+    CHECK(hand_get_axis() == HAND_AXIS_RA, "switched to axis %d while RA jogs", hand_get_axis());
+    jogRefused = false;
+    sim_clock_sleep_micros(200000);
+    CHECK(jogRate == 0 && hand_get_rate() == 0, "still jogging at %d", hand_get_rate());
+
+    hand_stats_t stats;
+    hand_get_stats(&stats);
+    CHECK(stats.jogs > 0 && stats.min_latency_micros <= stats.max_latency_micros, "%u jogs, latency %u..%u us",
+        stats.jogs, stats.min_latency_micros, stats.max_latency_micros);
+    printf("  %u jogs, encoder edge to motion %u..%u us\n", stats.jogs, stats.min_latency_micros, stats.max_latency_micros);
+}
+
+int main() {
+    test_init(1);
+    test_mapping();
+    focuser_init();
+    test_knob();
+    return test_done("hand_controller");
+}
@@ -0,0 +1,135 @@
+#include "test.h"
+#include "input.h"
+
+/*
+ * Bounce traces through the debounce state machine, then the same traces
+ * on a simulated pin through the edge interrupt, the settle timer and the
+ * event queue. A contact that bounces reports once, a glitch shorter than
+ * the settling time not at all.
+ */
+
+#define SETTLE_MICROS ((int64_t)(CONFIG_INPUT_DEBOUNCE_MILLIS) * 1000)
+#define BUTTON_PIN 34
+#define BUTTON_ID 7
+
+typedef struct {
+    int64_t at; // micros from the start of the trace
+    bool level;
+} edge_t;
+
+// a press that chatters for 1.2 ms, a release that chatters for 0.8 ms
+static const edge_t pressTrace[] = { { 0, 0 }, { 150, 1 }, { 300, 0 }, { 700, 1 }, { 900, 0 }, { 1200, 1 } };
+static const edge_t releaseTrace[] = { { 0, 1 }, { 100, 0 }, { 350, 1 }, { 800, 0 } };
+// a 2 ms spike that comes back to where it started
+static const edge_t glitchTrace[] = { { 0, 1 }, { 2000, 0 } };
+
+#define TRACE(t) t, sizeof(t) / sizeof(t[0])
+
+/* runs a trace against the state machine, polling every 100 us like a timer would, returns the flips */
+static int replay(input_debounce_t* d, const edge_t* trace, int count, int64_t* settledAt) {
+    int flips = 0;
+    bool raw = d->level;
+    int next = 0;
+    int64_t end = trace[count - 1].at + 3 * SETTLE_MICROS;
+    for (int64_t now = 0; now <= end; now += 100) {
+        while (next < count && trace[next].at <= now) {
+            raw = trace[next++].level;
+            input_debounce_edge(d, now, SETTLE_MICROS);
+        }
+        bool changed;
+        int64_t left = input_debounce_poll(d, raw, now, &changed);
+        CHECK(left >= 0 && left <= SETTLE_MICROS, "%lld us left at %lld", left, now);
+        if (changed) {
+            flips++;
+            *settledAt = now;
+        }
+    }
+    return flips;
+}
+
+static void test_state_machine() {
+    input_debounce_t d = { .level = 0 };
+    int64_t settledAt = -1;
+    int flips = replay(&d, TRACE(pressTrace), &settledAt);
+    CHECK(flips == 1 && d.level == 1, "press: %d flips to %d", flips, d.level);
+    // the raw level only counts once it held for the whole settling time
+    CHECK(settledAt >= 1200 + SETTLE_MICROS && settledAt <= 1300 + SETTLE_MICROS, "press settled at %lld", settledAt);
+
+    flips = replay(&d, TRACE(releaseTrace), &settledAt);
+    CHECK(flips == 1 && d.level == 0, "release: %d flips to %d", flips, d.level);
+    CHECK(settledAt >= 800 + SETTLE_MICROS, "release settled at %lld", settledAt);
+
+    flips = replay(&d, TRACE(glitchTrace), &settledAt);
+    CHECK(flips == 0 && d.level == 0, "glitch: %d flips to %d", flips, d.level);
+
+    // an edge that leaves the level as it was settles without a flip
+    bool changed;
+    input_debounce_edge(&d, 0, SETTLE_MICROS);
+    CHECK(input_debounce_poll(&d, 0, SETTLE_MICROS - 1, &changed) == 1, "settled early");
+    CHECK(input_debounce_poll(&d, 0, SETTLE_MICROS, &changed) == 0 && !changed && !d.settling, "no flip");
+}
+
+/* drives the pin through a trace on the virtual clock */
+static void drive(const edge_t* trace, int count) {
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < count; i++) {
+        int64_t wait = start + trace[i].at - esp_timer_get_time();
+        if (wait > 0) sim_clock_sleep_micros(wait);
+        sim_gpio_set_input(BUTTON_PIN, trace[i].level);
+    }
+}
+
+static int drain(input_event_t* events, int max) {
+    int n = 0;
+    while (n < max && input_receive(&events[n], 0)) n++;
+    return n;
+}
+
+static void test_button() {
+    // active low with a pull-up, released at start
+    sim_gpio_set_input(BUTTON_PIN, 1);
+    CHECK(init_input() == ESP_OK, "init");
+    CHECK(input_add_button(BUTTON_ID, BUTTON_PIN, 0) == ESP_OK, "add button");
+    CHECK(!input_is_pressed(BUTTON_ID), "pressed at start");
+
+    // the press trace inverted, the pin pulls low when pressed
+    edge_t press[sizeof(pressTrace) / sizeof(pressTrace[0])];
+    for (int i = 0; i < sizeof(press) / sizeof(press[0]); i++) {
+        press[i] = (edge_t) { pressTrace[i].at, !pressTrace[i].level };
+    }
+    int64_t start = esp_timer_get_time();
+    drive(TRACE(press));
+    sim_clock_sleep_micros(3 * SETTLE_MICROS);
+    input_event_t events[8];
+    int n = drain(events, 8);
+    CHECK(n == 1 && events[0].source == BUTTON_ID && events[0].type == INPUT_EVENT_PRESSED,
+        "press: %d events, first %d", n, n ? events[0].type : -1);
+    CHECK(n && events[0].at - start >= 1200 + SETTLE_MICROS, "press reported %lld us after the first edge", events[0].at - start);
+    CHECK(input_is_pressed(BUTTON_ID), "not pressed");
+
+    // released with chatter, then pressed by a spike on the line
+    edge_t release[sizeof(releaseTrace) / sizeof(releaseTrace[0])];
+    for (int i = 0; i < sizeof(release) / sizeof(release[0]); i++) {
+        release[i] = (edge_t) { releaseTrace[i].at, !releaseTrace[i].level };
+    }
+    drive(TRACE(release));
+    sim_clock_sleep_micros(3 * SETTLE_MICROS);
+    n = drain(events, 8);
+    CHECK(n == 1 && events[0].type == INPUT_EVENT_RELEASED, "release: %d events, first %d", n, n ? events[0].type : -1);
+    CHECK(!input_is_pressed(BUTTON_ID), "still pressed");
+
+    const edge_t spike[] = { { 0, 0 }, { 2000, 1 } };
+    drive(TRACE(spike));
+    sim_clock_sleep_micros(3 * SETTLE_MICROS);
+    n = drain(events, 8);
+    CHECK(n == 0, "a spike reported %d events", n);
+    CHECK(!input_is_pressed(BUTTON_ID), "a spike pressed the button");
+}
+
+int main() {
+    // slower than real time, host sleep jitter stays well inside the settling time
+    test_init(0.1);
+    test_state_machine();
+    test_button();
+    return test_done("input");
+}
@@ -0,0 +1,124 @@
+#include "math.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/wait.h"
+#include "test.h"
+#include "astro.h"
+#include "focuser.h"
+#include "motion_math.h"
+
+/*
+ * The generated constants against the Kconfig integers they come from:
+ * rationals equal and reduced, fixed point constants the exactly rounded
+ * value, the focuser's derived numbers. Then the generator itself on
+ * configurations it has to reject. The Makefile passes the command that
+ * runs it as GEN_KINEMATICS.
+ */
+
+typedef unsigned __int128 u128;
+
+static int64_t gcd(int64_t a, int64_t b) {
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* num/den reduced from the value */
+static bool reduced(int64_t num, int64_t den, u128 value_num, u128 value_den) {
+    return gcd(num, den) == 1 && (u128) num * value_den == (u128) den * value_num;
+}
+
+/* num/den * 2^bits rounded to nearest */
+static uint64_t rounded(u128 num, u128 den, int bits) {
+    u128 scaled = bits == 64 ? num << 64 : num << bits;
+    return (uint64_t)((scaled * 2 + den) / (2 * den));
+}
+
+static void test_axes() {
+    int64_t ra = (int64_t) CONFIG_RA_CYCLE_STEPS * CONFIG_RA_RESOLUTION * CONFIG_RA_GEAR_RATIO;
+    int64_t dec = (int64_t) CONFIG_DEC_CYCLE_STEPS * CONFIG_DEC_RESOLUTION * CONFIG_DEC_GEAR_RATIO;
+    CHECK(RA_PULSES_PER_CYCLE == ra && DEC_PULSES_PER_CYCLE == dec, "pulses per cycle");
+
+    CHECK(reduced(UAS_PER_SIDEREAL_MILLI_NUM, UAS_PER_SIDEREAL_MILLI_DEN, UAS_PER_CYCLE, SIDEREAL_DAY_MILLIS), "uas per sidereal milli");
+    CHECK(reduced(SIDEREAL_MILLIS_PER_UAS_NUM, SIDEREAL_MILLIS_PER_UAS_DEN, SIDEREAL_DAY_MILLIS, UAS_PER_CYCLE), "sidereal millis per uas");
+    CHECK(UAS_PER_SIDEREAL_MILLI == rounded(UAS_PER_CYCLE, SIDEREAL_DAY_MILLIS, 32), "UAS_PER_SIDEREAL_MILLI");
+
+    CHECK(reduced(RA_UAS_PER_PULSE_NUM, RA_UAS_PER_PULSE_DEN, UAS_PER_CYCLE, ra), "RA uas per pulse");
+    CHECK(reduced(DEC_UAS_PER_PULSE_NUM, DEC_UAS_PER_PULSE_DEN, UAS_PER_CYCLE, dec), "Dec uas per pulse");
+    CHECK(RA_UAS_PER_PULSE == rounded(UAS_PER_CYCLE, ra, 32), "RA_UAS_PER_PULSE");
+    CHECK(DEC_UAS_PER_PULSE == rounded(UAS_PER_CYCLE, dec, 32), "DEC_UAS_PER_PULSE");
+
+    // a unit of speed is 1/15000 of a cycle per (sidereal) day, in pulses per microsecond
+    u128 raSpeedDen = (u128) SPEED_PER_CYCLE * SIDEREAL_DAY_MILLIS * 1000;
+    u128 decSpeedDen = (u128) SPEED_PER_CYCLE * DAY_MILLIS * 1000;
+    CHECK(reduced(RA_RATE_PER_SPEED_NUM, RA_RATE_PER_SPEED_DEN, ra, raSpeedDen), "RA rate per speed");
+    CHECK(reduced(DEC_RATE_PER_SPEED_NUM, DEC_RATE_PER_SPEED_DEN, dec, decSpeedDen), "Dec rate per speed");
+    CHECK(RA_RATE_PER_SPEED == rounded(ra, raSpeedDen, 64), "RA_RATE_PER_SPEED");
+    CHECK(DEC_RATE_PER_SPEED == rounded(dec, decSpeedDen, 64), "DEC_RATE_PER_SPEED");
+    // the sidereal rate is the pulses per sidereal day
+    int64_t rate = speed_to_rate(SPEED_PER_CYCLE, RA_RATE_PER_SPEED, 1ULL << 32);
+    CHECK(llabs(rate_to_millihertz(rate) - ra * 1000000 / SIDEREAL_DAY_MILLIS) <= 1, "sidereal rate");
+}
+
+static void test_focuser() {
+    CHECK(reduced(FOCUS_STEPS_PER_MICRON_NUM, FOCUS_STEPS_PER_MICRON_DEN, CONFIG_FOCUS_STEPS_PER_CYCLE,
+        CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE), "steps per micron");
+    // whole steps, rounded down so a move never passes the end
+    int64_t steps = (int64_t) CONFIG_FOCUS_TOTAL_MOVEMENT_MICRONS * CONFIG_FOCUS_STEPS_PER_CYCLE / CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE;
+    CHECK(FOCUS_MAX_STEPS == steps && focuser_get_max_steps() == steps, "%u max steps", focuser_get_max_steps());
+    double nanos = CONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE * 1000.0 / CONFIG_FOCUS_STEPS_PER_CYCLE;
+    CHECK(fabs(FOCUS_NANOS_PER_STEP - nanos) <= 0.5 && focuser_get_movement_nanos_per_step() == FOCUS_NANOS_PER_STEP,
+        "%u nanos per step for %f", focuser_get_movement_nanos_per_step(), nanos);
+}
+
+#define VALID_AXES \
+    "CONFIG_RA_CYCLE_STEPS=200\nCONFIG_RA_RESOLUTION=16\nCONFIG_RA_GEAR_RATIO=144\n" \
+    "CONFIG_DEC_CYCLE_STEPS=200\nCONFIG_DEC_RESOLUTION=16\nCONFIG_DEC_GEAR_RATIO=144\n"
+#define VALID_FOCUSER \
+    "CONFIG_FOCUS_TOTAL_MOVEMENT_MICRONS=48000\nCONFIG_FOCUS_MOVEMENT_MICRONS_PER_CYCLE=12566\nCONFIG_FOCUS_STEPS_PER_CYCLE=4096\n"
+
+/* exit status of the generator on a configuration */
+static int generate(const char* config) {
+    char path[] = "/tmp/kinematics-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    write(fd, config, strlen(config));
+    close(fd);
+    char command[512];
+    snprintf(command, sizeof(command), "%s %s > /dev/null 2>&1", GEN_KINEMATICS, path);
+    int status = system(command);
+    unlink(path);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void test_generator() {
+    CHECK(generate(VALID_AXES VALID_FOCUSER) == 0, "a valid configuration rejected");
+    // the step counters take up to 2^31 pulses a turn
+    CHECK(generate("CONFIG_RA_CYCLE_STEPS=200\nCONFIG_RA_RESOLUTION=256\nCONFIG_RA_GEAR_RATIO=50000\n"
+        "CONFIG_DEC_CYCLE_STEPS=200\nCONFIG_DEC_RESOLUTION=16\nCONFIG_DEC_GEAR_RATIO=144\n" VALID_FOCUSER) == 1,
+        "2^31 pulses a turn taken");
+    // with a single pulse a turn the angle of a pulse does not fit Q32
+    CHECK(generate("CONFIG_RA_CYCLE_STEPS=1\nCONFIG_RA_RESOLUTION=1\nCONFIG_RA_GEAR_RATIO=1\n"
+        "CONFIG_DEC_CYCLE_STEPS=200\nCONFIG_DEC_RESOLUTION=16\nCONFIG_DEC_GEAR_RATIO=144\n" VALID_FOCUSER) == 1,
+        "an angle per pulse beyond 64 bits taken");
+    CHECK(generate("CONFIG_RA_CYCLE_STEPS=0\nCONFIG_RA_RESOLUTION=16\nCONFIG_RA_GEAR_RATIO=144\n"
+        "CONFIG_DEC_CYCLE_STEPS=200\nCONFIG_DEC_RESOLUTION=16\nCONFIG_DEC_GEAR_RATIO=144\n" VALID_FOCUSER) == 1,
+        "zero steps taken");
+    CHECK(generate(VALID_AXES) == 1, "a missing focuser setting taken");
+    // an encoder brings its counts
+    CHECK(generate(VALID_AXES VALID_FOCUSER "CONFIG_RA_ENCODER=y\n") == 1, "an encoder without counts taken");
+    CHECK(generate(VALID_AXES VALID_FOCUSER "CONFIG_RA_ENCODER=y\nCONFIG_RA_ENCODER_COUNTS_PER_CYCLE=2400\n") == 0, "encoder counts rejected");
+}
+
+int main() {
+    test_init(1);
+    test_axes();
+    test_focuser();
+    test_generator();
+    return test_done("kinematics");
+}
@@ -0,0 +1,75 @@
+#include "string.h"
+#include "arpa/inet.h"
+#include "test.h"
+#include "memory_budget.h"
+#include "protocol.h"
+
+/*
+ * Every task the firmware keeps until restart is registered for the memory
+ * report after boot, and the report frame carries it in network order.
+ * The shim has no stack to measure, headroom reads 0 here.
+ */
+
+void app_main();
+
+// the UDP server and discovery run on the event loop
+static const char* longLived[] = { "event_loop", "input_loop", "motion", "settings", "rencoder" };
+
+static const memory_task_t* find(const memory_report_t* report, const char* name) {
+    for (int i = 0; i < report->task_count; i++) {
+        if (!strcmp(report->tasks[i].name, name)) return &report->tasks[i];
+    }
+    return NULL;
+}
+
+static void test_boot_tasks() {
+    app_main();
+    int64_t deadline = esp_timer_get_time() + 2000000;
+    memory_report_t report;
+    do {
+        sim_clock_sleep_micros(10000);
+        memory_get_report(&report);
+    } while (!find(&report, "input_loop") && esp_timer_get_time() < deadline);
+
+    // a full table would mean a task went missing from the report
+    CHECK(report.task_count < MEMORY_MAX_TASKS, "%d tasks fill the table", report.task_count);
+    for (int i = 0; i < sizeof(longLived) / sizeof(longLived[0]); i++) {
+        const memory_task_t* task = find(&report, longLived[i]);
+        CHECK(task != NULL, "%s not in the report", longLived[i]);
+        if (task) {
+            CHECK(task->stack_size >= 2048 && task->headroom <= task->stack_size, "%s stack %u headroom %u",
+                task->name, task->stack_size, task->headroom);
+        }
+    }
+    for (int i = 0; i < report.task_count; i++) {
+        printf("  %-12s %5u bytes\n", report.tasks[i].name, report.tasks[i].stack_size);
+    }
+    CHECK(report.min_free_heap <= report.free_heap, "min free heap %u above free heap %u", report.min_free_heap, report.free_heap);
+}
+
+static void test_frame() {
+    memory_report_frame_t frame;
+    memset(frame.buffer, 0xaa, sizeof(frame.buffer));
+    set_memory_report_fields(&frame, 17, 0x01020304, 0x0a0b0c0d, MEMORY_REPORT_MAX_TASKS + 3);
+    set_memory_report_task(&frame, 0, "motion", 4096, 1234);
+    set_memory_report_task(&frame, 1, "a_name_longer_than_the_field", 2048, 0);
+    set_memory_report_task(&frame, MEMORY_REPORT_MAX_TASKS, "beyond", 1, 1);
+    const uint8_t* b = frame.buffer;
+    CHECK(b[0] == 17, "command %d", b[0]);
+    CHECK(b[1] == 1 && b[2] == 2 && b[3] == 3 && b[4] == 4, "free heap not big endian");
+    CHECK(ntohl(MEMORY_REPORT_MIN_FREE_HEAP(b)) == 0x0a0b0c0d, "min free heap");
+    CHECK(MEMORY_REPORT_COUNT(b) == MEMORY_REPORT_MAX_TASKS, "count %d not clamped", MEMORY_REPORT_COUNT(b));
+    CHECK(!strcmp(MEMORY_REPORT_NAME(b, 0), "motion"), "name %s", MEMORY_REPORT_NAME(b, 0));
+    CHECK(ntohs(MEMORY_REPORT_STACK_SIZE(b, 0)) == 4096 && ntohs(MEMORY_REPORT_HEADROOM(b, 0)) == 1234, "task 0 sizes");
+    CHECK(strlen(MEMORY_REPORT_NAME(b, 1)) == MEMORY_REPORT_NAME_LENGTH - 1, "long name not cut to the field");
+    // unused entries stay zero
+    CHECK(MEMORY_REPORT_NAME(b, 2)[0] == 0 && MEMORY_REPORT_STACK_SIZE(b, 2) == 0, "entry 2 not cleared");
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(1);
+    test_frame();
+    test_boot_tasks();
+    return test_done("memory_budget");
+}
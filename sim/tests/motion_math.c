@@ -0,0 +1,223 @@
+#include "math.h"
+#include "test.h"
+#include "astro.h"
+#include "util.h"
+#include "mount.h"
+#include "motion_math.h"
+
+/*
+ * The integer rate and angle path against an exact rational reference in
+ * 128 bits, next to the double code it replaced, on random cases across
+ * the speed, time ratio and position ranges. The fixed path has to be no
+ * less accurate than the double one. Then the time per call of both: the
+ * host has hardware doubles, the ESP32 does not, so the numbers show the
+ * cost of the integer path rather than the gain.
+ */
+
+#define CASES 1000000
+// largest time ratio in millionths, as set_mount_time_ratio_persist takes it
+#define RATIO_MAX INT32_MAX
+
+/* ---------- the double code before ---------- */
+#define RA_FREQ(cyclesPerSiderealDay) ((double) CONFIG_RA_CYCLE_STEPS * CONFIG_RA_GEAR_RATIO * CONFIG_RA_RESOLUTION * (cyclesPerSiderealDay) * 1000 / SIDEREAL_DAY_MILLIS)
+#define DEC_FREQ(cyclesPerDay) ((double) CONFIG_DEC_CYCLE_STEPS * CONFIG_DEC_GEAR_RATIO * CONFIG_DEC_RESOLUTION * (cyclesPerDay) * 1000 / DAY_MILLIS)
+
+double ra_pulse_ratio = ((double) SIDEREAL_DAY_MILLIS) / (CONFIG_RA_CYCLE_STEPS * CONFIG_RA_RESOLUTION * CONFIG_RA_GEAR_RATIO);
+double ra_time_ratio = ((double) DAY_MILLIS / (double) SIDEREAL_DAY_MILLIS);
+
+__attribute__((noinline)) static int double_ra_hz(int32_t speed, int32_t ratio) {
+    return (int) round(ratio / 1000000.0 * RA_FREQ((double) speed / SPEED_PER_CYCLE));
+}
+
+__attribute__((noinline)) static int double_dec_hz(int32_t speed, int32_t ratio) {
+    return (int) round(ratio / 1000000.0 * DEC_FREQ((double) speed / SPEED_PER_CYCLE));
+}
+
+__attribute__((noinline)) static int32_t double_ra_millis(int32_t reset, int64_t offset, int64_t pulses) {
+    int32_t resetSidereal = (int32_t)((double) reset / ra_time_ratio);
+    return (int32_t)(ra_time_ratio * (resetSidereal + (double) offset - ra_pulse_ratio * pulses));
+}
+
+__attribute__((noinline)) static double double_dist(double a, double b) {
+    return sqrt(a * a + b * b);
+}
+
+/* ---------- the integer code now ---------- */
+__attribute__((noinline)) static int fixed_hz(int32_t speed, uint64_t rate_per_speed, int32_t ratio) {
+    uint64_t ratioQ32 = (((uint64_t) ratio << 32) + 500000) / 1000000;
+    return rate_to_hz(speed_to_rate(speed, rate_per_speed, ratioQ32));
+}
+
+__attribute__((noinline)) static int32_t fixed_ra_millis(int32_t reset, int64_t offset, int64_t pulses) {
+    return uas_to_millis((int64_t) reset * UAS_PER_MILLI + mul_q32(offset, UAS_PER_SIDEREAL_MILLI)
+        - mul_q32(pulses, RA_UAS_PER_PULSE));
+}
+
+__attribute__((noinline)) static uint32_t fixed_dist(int32_t a, int32_t b) {
+    return isqrt64((int64_t) a * a + (int64_t) b * b);
+}
+
+/* ---------- exact ---------- */
+
+/* |value - num / den| */
+static double error(int64_t value, __int128 num, __int128 den) {
+    __int128 diff = value * den - num;
+    return fabs((double) diff / (double) den);
+}
+
+/* pulses per second of a speed at a time ratio in millionths */
+static double hz_error(int hz, int32_t speed, int32_t ratio, int64_t pulses_per_cycle, int64_t day_millis) {
+    __int128 num = (__int128) speed * pulses_per_cycle * ratio * 1000;
+    __int128 den = (__int128) SPEED_PER_CYCLE * day_millis * 1000000;
+    return error(hz, num, den);
+}
+
+/* R.A. day millis of a sync at reset, time offset millis later and pulses moved */
+static double ra_error(int32_t millis, int32_t reset, int64_t offset, int64_t pulses) {
+    // uas: reset * 15000 + offset * 36e9 / 2393447 - pulses * 1406250 / 13
+    __int128 den = (__int128) UAS_PER_SIDEREAL_MILLI_DEN * RA_UAS_PER_PULSE_DEN;
+    __int128 num = (__int128) reset * UAS_PER_MILLI * den
+        + (__int128) offset * UAS_PER_SIDEREAL_MILLI_NUM * RA_UAS_PER_PULSE_DEN
+        - (__int128) pulses * RA_UAS_PER_PULSE_NUM * UAS_PER_SIDEREAL_MILLI_DEN;
+    return error(millis, num, den * UAS_PER_MILLI);
+}
+
+static uint64_t random64() {
+    return (uint64_t) rand() << 62 ^ (uint64_t) rand() << 31 ^ rand();
+}
+
+/* log-uniform, small ratios as often as large ones */
+static int32_t random_ratio() {
+    return (int32_t) fmin(RATIO_MAX, exp(log(10000) + (log(RATIO_MAX) - log(10000)) * rand() / RAND_MAX));
+}
+
+static void test_rates() {
+    srand(49);
+    double fixedMax = 0, doubleMax = 0;
+    int differ = 0;
+    for (int i = 0; i < CASES; i++) {
+        int32_t speed = RA_SPEED_MIN + rand() % (RA_SPEED_MAX - RA_SPEED_MIN + 1);
+        int32_t ratio = i % 4 ? random_ratio() : 1000000;
+        bool ra = i & 1;
+        int fixed = fixed_hz(speed, ra ? RA_RATE_PER_SPEED : DEC_RATE_PER_SPEED, ratio);
+        int old = ra ? double_ra_hz(speed, ratio) : double_dec_hz(speed, ratio);
+        int64_t pulses = ra ? RA_PULSES_PER_CYCLE : DEC_PULSES_PER_CYCLE;
+        int64_t day = ra ? SIDEREAL_DAY_MILLIS : DAY_MILLIS;
+        fixedMax = fmax(fixedMax, hz_error(fixed, speed, ratio, pulses, day));
+        doubleMax = fmax(doubleMax, hz_error(old, speed, ratio, pulses, day));
+        differ += fixed != old;
+    }
+    // both round, the Q32 rate adds at most 2^-32 pulses per microsecond
+    CHECK(fixedMax <= 0.5 + 0.00024, "step Hz off by %f", fixedMax);
+    CHECK(fixedMax <= doubleMax + 0.00024, "step Hz off by %f, double %f", fixedMax, doubleMax);
+    CHECK(differ < CASES / 1000, "%d of %d rates differ from the double code", differ, CASES);
+    printf("  step Hz: fixed off by %.6f, double by %.6f at worst, %d of %d differ\n", fixedMax, doubleMax, differ, CASES);
+
+    // the sidereal rate to the millihertz
+    int64_t rate = speed_to_rate(SPEED_PER_CYCLE, RA_RATE_PER_SPEED, 1ULL << 32);
+    int32_t milli = rate_to_millihertz(rate);
+    CHECK(error(milli, (__int128) RA_PULSES_PER_CYCLE * 1000000, SIDEREAL_DAY_MILLIS) < 1, "sidereal rate %d mHz", milli);
+}
+
+static void test_angles() {
+    srand(4949);
+    double fixedMax = 0, doubleMax = 0, fixedTotal = 0, doubleTotal = 0;
+    for (int i = 0; i < CASES; i++) {
+        int32_t reset = rand() % DAY_MILLIS;
+        // up to 10 days since the sync, up to 10 turns moved either way
+        int64_t offset = rand() % (10 * DAY_MILLIS);
+        int64_t pulses = (int64_t)(random64() % (20 * RA_PULSES_PER_CYCLE)) - 10 * RA_PULSES_PER_CYCLE;
+        double fixed = ra_error(fixed_ra_millis(reset, offset, pulses), reset, offset, pulses);
+        double old = ra_error(double_ra_millis(reset, offset, pulses), reset, offset, pulses);
+        fixedMax = fmax(fixedMax, fixed);
+        doubleMax = fmax(doubleMax, old);
+        fixedTotal += fixed;
+        doubleTotal += old;
+    }
+    // to the nearest milli, the two Q32 products each truncate less than a micro arcsecond
+    CHECK(fixedMax <= 0.5 + 2.0 / UAS_PER_MILLI, "R.A. millis off by %f", fixedMax);
+    CHECK(fixedMax <= doubleMax && fixedTotal <= doubleTotal, "R.A. millis off by %f, double %f", fixedMax, doubleMax);
+    printf("  R.A. millis: fixed off by %.3f at worst %.3f on average, double %.3f and %.3f\n",
+        fixedMax, fixedTotal / CASES, doubleMax, doubleTotal / CASES);
+
+    // uas_to_millis rounds halves away from zero, for turns beyond a day too
+    int wrong = 0;
+    for (int i = 0; i < CASES; i++) {
+        int64_t uas = (int64_t)(random64() % (20 * UAS_PER_CYCLE)) - 10 * UAS_PER_CYCLE;
+        int64_t m = uas < 0 ? -uas : uas;
+        int64_t expected = (m + UAS_PER_MILLI / 2) / UAS_PER_MILLI;
+        wrong += uas_to_millis(uas) != (uas < 0 ? -expected : expected);
+    }
+    CHECK(wrong == 0, "%d micro arcseconds rounded wrong", wrong);
+    CHECK(uas_to_millis(7500) == 1 && uas_to_millis(-7500) == -1 && uas_to_millis(7499) == 0, "halves");
+
+    // mul_q32 rounds toward zero on both sides
+    CHECK(mul_q32(3, 1ULL << 31) == 1 && mul_q32(-3, 1ULL << 31) == -1, "mul_q32 of halves");
+    wrong = 0;
+    for (int i = 0; i < CASES; i++) {
+        int64_t a = (int64_t)(random64() >> 2) * (rand() & 1 ? 1 : -1);
+        uint64_t q = random64() >> (rand() % 32);
+        __int128 exact = (__int128) a * q;
+        exact = exact < 0 ? -((-exact) >> 32) : exact >> 32;
+        if ((int64_t) exact == exact) wrong += mul_q32(a, q) != (int64_t) exact;
+    }
+    CHECK(wrong == 0, "%d products wrong", wrong);
+}
+
+static void test_isqrt() {
+    srand(64);
+    int wrong = 0;
+    for (int i = 0; i < CASES; i++) {
+        uint64_t x = random64() >> (rand() % 64);
+        unsigned __int128 r = isqrt64(x);
+        wrong += r * r > x || (r + 1) * (r + 1) <= x;
+    }
+    CHECK(wrong == 0, "%d square roots wrong", wrong);
+    CHECK(isqrt64(UINT64_MAX) == UINT32_MAX && isqrt64(0) == 0 && isqrt64(15) == 3 && isqrt64(16) == 4, "edges");
+    // a slew across the sky, as dist takes it
+    CHECK(fixed_dist(DAY_MILLIS, DAY_MILLIS / 2) == (uint32_t) double_dist(DAY_MILLIS, DAY_MILLIS / 2), "dist");
+}
+
+#define CALLS 2000000
+int32_t speeds[1024], ratios[1024], resets[1024];
+int64_t offsets[1024], pulseCounts[1024];
+volatile int64_t sink;
+
+/* nanoseconds per call of an expression over the inputs */
+#define BENCH(EXPR) ({ \
+    double started = test_seconds(); \
+    int64_t sum = 0; \
+    for (int i = 0; i < CALLS; i++) { \
+        int k = i & 1023; \
+        sum += (EXPR); \
+    } \
+    sink = sum; \
+    (test_seconds() - started) * 1e9 / CALLS; \
+})
+
+static void bench() {
+    for (int k = 0; k < 1024; k++) {
+        speeds[k] = RA_SPEED_MIN + rand() % (RA_SPEED_MAX - RA_SPEED_MIN);
+        ratios[k] = random_ratio();
+        resets[k] = rand() % DAY_MILLIS;
+        offsets[k] = rand() % DAY_MILLIS;
+        pulseCounts[k] = rand() % RA_PULSES_PER_CYCLE;
+    }
+    double hzDouble = BENCH(double_ra_hz(speeds[k], ratios[k]));
+    double hzFixed = BENCH(fixed_hz(speeds[k], RA_RATE_PER_SPEED, ratios[k]));
+    double angleDouble = BENCH(double_ra_millis(resets[k], offsets[k], pulseCounts[k]));
+    double angleFixed = BENCH(fixed_ra_millis(resets[k], offsets[k], pulseCounts[k]));
+    double distDouble = BENCH((int64_t) double_dist(resets[k], speeds[k]));
+    double distFixed = BENCH(fixed_dist(resets[k], speeds[k]));
+    printf("  ns per call on this host, double against fixed: step Hz %.1f / %.1f, R.A. millis %.1f / %.1f, dist %.1f / %.1f\n",
+        hzDouble, hzFixed, angleDouble, angleFixed, distDouble, distFixed);
+}
+
+int main() {
+    test_init(1);
+    test_rates();
+    test_angles();
+    test_isqrt();
+    bench();
+    return test_done("motion_math");
+}
@@ -0,0 +1,114 @@
+#include "test.h"
+#include "rencoder.h"
+
+/*
+ * Synthetic quadrature streams through the transition table: four counts
+ * per cycle, reversals mid-cycle, contact chatter on one pin that has to
+ * net out, and edges lost between reads that count as illegal. Ends with
+ * the decode time per edge on this host.
+ */
+
+// B leads A counting up
+static const uint8_t forward[4] = { 0x0, 0x1, 0x3, 0x2 };
+
+int directionChanges = 0;
+
+static void direction_changed(rencoder_t* target, bool next_direction, void* args) {
+    directionChanges++;
+}
+
+static void reset(rencoder_t* r, bool reverse) {
+    *r = (rencoder_t) { .state = 0, .direction = true, .working = true, .reverse = reverse,
+        .direction_callback = direction_changed };
+    directionChanges = 0;
+}
+
+/* steps through the states, a negative count goes backwards, returns the phase reached */
+static int walk(rencoder_t* r, int phase, int steps, uint32_t* cycles) {
+    int dir = steps < 0 ? -1 : 1;
+    for (int i = 0; i < abs(steps); i++) {
+        phase = (phase + dir) & 3;
+        rencoder_feed(r, forward[phase], *cycles += 1000);
+    }
+    return phase;
+}
+
+static void test_counts() {
+    rencoder_t r;
+    uint32_t cycles = 0;
+    reset(&r, false);
+    int phase = walk(&r, 0, 400, &cycles);
+    CHECK(rencoder_value(&r) == 400 && rencoder_getdirection(&r), "100 cycles forward counted %d", rencoder_value(&r));
+    // a reversal in the middle of a cycle loses nothing
+    phase = walk(&r, phase, 3, &cycles);
+    phase = walk(&r, phase, -250, &cycles);
+    CHECK(rencoder_value(&r) == 153 && !rencoder_getdirection(&r), "after the reversal at %d", rencoder_value(&r));
+    CHECK(directionChanges == 1, "%d direction changes", directionChanges);
+    // back and forth on every edge, as at a standstill on an edge
+    for (int i = 0; i < 50; i++) {
+        phase = walk(&r, phase, 1, &cycles);
+        phase = walk(&r, phase, -1, &cycles);
+    }
+    CHECK(rencoder_value(&r) == 153, "dithering moved to %d", rencoder_value(&r));
+    CHECK(rencoder_illegal_transitions(&r) == 0, "%u illegal", rencoder_illegal_transitions(&r));
+
+    reset(&r, true);
+    walk(&r, 0, 40, &cycles);
+    CHECK(rencoder_value(&r) == -40 && !rencoder_getdirection(&r), "a reversed encoder counted %d", rencoder_value(&r));
+}
+
+static void test_noise() {
+    rencoder_t r;
+    uint32_t cycles = 0;
+    reset(&r, false);
+    srand(39);
+    int phase = 0, expected = 0;
+    // chatter on whichever pin changes next: extra edge pairs that return to the same state
+    for (int i = 0; i < 10000; i++) {
+        int dir = rand() % 8 == 0 ? -1 : 1;
+        int next = (phase + dir) & 3;
+        int bounces = rand() % 4;
+        for (int j = 0; j < bounces; j++) {
+            rencoder_feed(&r, forward[next], cycles += 50);
+            rencoder_feed(&r, forward[phase], cycles += 50);
+        }
+        rencoder_feed(&r, forward[next], cycles += 1000);
+        phase = next;
+        expected += dir;
+    }
+    CHECK(rencoder_value(&r) == expected, "with chatter counted %d for %d", rencoder_value(&r), expected);
+    CHECK(rencoder_illegal_transitions(&r) == 0, "chatter read as %u illegal", rencoder_illegal_transitions(&r));
+
+    // a missed edge shows both pins changed, the step is lost and counted
+    reset(&r, false);
+    phase = walk(&r, 0, 4, &cycles);
+    rencoder_feed(&r, forward[(phase + 2) & 3], cycles += 1000);
+    phase = (phase + 2) & 3;
+    walk(&r, phase, 4, &cycles);
+    CHECK(rencoder_illegal_transitions(&r) == 1, "%u illegal", rencoder_illegal_transitions(&r));
+    CHECK(rencoder_value(&r) == 8, "after a skipped state counted %d", rencoder_value(&r));
+}
+
+static void test_benchmark() {
+    rencoder_t r;
+    uint32_t cycles = 0;
+    reset(&r, false);
+    const int edges = 4 << 20; // whole runs of 1024 edges each way
+    double started = test_seconds();
+    int phase = 0;
+    for (int i = 0; i < edges; i++) {
+        phase = (phase + ((i >> 10) & 1 ? -1 : 1)) & 3;
+        rencoder_feed(&r, forward[phase], cycles += 1000);
+    }
+    double elapsed = test_seconds() - started;
+    CHECK(rencoder_value(&r) == 0, "benchmark counted %d", rencoder_value(&r));
+    printf("  decode: %.1f ns per edge on this host\n", elapsed * 1e9 / edges);
+}
+
+int main() {
+    test_init(1);
+    test_counts();
+    test_noise();
+    test_benchmark();
+    return test_done("quadrature");
+}
@@ -0,0 +1,171 @@
+#include "math.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/core-macros.h"
+#include "rencoder.h"
+
+/*
+ * Edge traces through the capture ring: a recorded spin of the hand
+ * encoder, synthetic traces at known rates for the 1/T velocity, a ring
+ * overrun, and at the end the pin interrupts with the worker decoding off
+ * the interrupt.
+ */
+
+#define CYCLES_PER_SECOND (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000.0)
+
+typedef struct {
+    uint8_t ab;
+    uint32_t cycles;
+} edge_t;
+
+/*
+ * A flick of the hand encoder at 160 MHz, one detent is a full cycle: up
+ * two detents speeding up, one contact chatter at 0x01, then back one.
+ */
+static const edge_t recorded[] = {
+    { 0x1, 1200000 }, { 0x3, 1935000 }, { 0x2, 2580000 }, { 0x0, 3102000 },
+    { 0x1, 3521000 }, { 0x0, 3522300 }, { 0x1, 3524100 }, { 0x3, 3864000 },
+    { 0x2, 4176000 }, { 0x0, 4470000 }, { 0x2, 9850000 }, { 0x3, 10630000 },
+    { 0x1, 11310000 }, { 0x0, 12090000 },
+};
+
+int counted = 0;
+int8_t lastDifference = 0;
+
+static void count(rencoder_t* target, int32_t next_count, int8_t difference, void* args) {
+    counted++;
+    lastDifference = difference;
+}
+
+static void fresh(rencoder_t* r) {
+    *r = (rencoder_t) { .state = 0, .direction = true, .working = true, .count_callback = count };
+}
+
+static void test_recorded() {
+    rencoder_t r;
+    fresh(&r);
+    int n = sizeof(recorded) / sizeof(recorded[0]);
+    for (int i = 0; i < n; i++) {
+        CHECK(rencoder_capture(&r, recorded[i].ab, recorded[i].cycles), "edge %d not captured", i);
+    }
+    // nothing is decoded until the worker runs
+    CHECK(rencoder_value(&r) == 0 && counted == 0, "decoded in the capture");
+    CHECK(rencoder_process() == n, "processed a different number of edges");
+    CHECK(rencoder_value(&r) == 4, "recorded trace counted %d", rencoder_value(&r));
+    // the chatter is a step back and forth again
+    CHECK(counted == 14 && lastDifference == -1, "%d callbacks, last %d", counted, lastDifference);
+    CHECK(rencoder_illegal_transitions(&r) == 0, "%u illegal", rencoder_illegal_transitions(&r));
+    // four steps backwards, three intervals since the reversal
+    float v = rencoder_velocity_at(&r, 12090000);
+    CHECK(fabs(v + 3 * CYCLES_PER_SECOND / (12090000 - 9850000)) < 1, "recorded velocity %f", v);
+}
+
+/* steps at a fixed interval, from a cycle count close to the counter wrapping */
+static uint32_t steps(rencoder_t* r, int* phase, int count, uint32_t interval, uint32_t cycles) {
+    static const uint8_t gray[4] = { 0x0, 0x1, 0x3, 0x2 };
+    for (int i = 0; i < abs(count); i++) {
+        *phase = (*phase + (count > 0 ? 1 : -1)) & 3;
+        cycles += interval;
+        rencoder_capture(r, gray[*phase], cycles);
+    }
+    rencoder_process();
+    return cycles;
+}
+
+static void test_velocity() {
+    rencoder_t r;
+    fresh(&r);
+    int phase = 0;
+    // a thousand counts per second across the cycle counter wrap
+    uint32_t interval = (uint32_t)(CYCLES_PER_SECOND / 1000);
+    uint32_t at = steps(&r, &phase, 40, interval, UINT32_MAX - 20 * interval);
+    float v = rencoder_velocity_at(&r, at);
+    CHECK(fabs(v - 1000) < 1, "1000 counts/s read as %f", v);
+    // slowing down, the time since the last step bounds it
+    v = rencoder_velocity_at(&r, at + 10 * interval);
+    CHECK(fabs(v - 100) < 1, "ten intervals after the last step %f", v);
+
+    // the first step back has no interval, then the speed in the new direction
+    at = steps(&r, &phase, -1, interval, at);
+    CHECK(rencoder_velocity_at(&r, at) == 0, "velocity %f right after a reversal", rencoder_velocity_at(&r, at));
+    at = steps(&r, &phase, -10, interval / 4, at);
+    v = rencoder_velocity_at(&r, at);
+    CHECK(fabs(v + 4000) < 4, "-4000 counts/s read as %f", v);
+    CHECK(rencoder_value(&r) == 29, "counted %d", rencoder_value(&r));
+}
+
+static void test_overflow() {
+    rencoder_t a, b;
+    fresh(&a);
+    fresh(&b);
+    uint32_t before = rencoder_overflows();
+    int phase = 0, accepted = 0;
+    static const uint8_t gray[4] = { 0x0, 0x1, 0x3, 0x2 };
+    // two encoders sharing the ring, the worker stalled
+    for (int i = 0; i < 300; i++) {
+        rencoder_t* r = i & 1 ? &b : &a;
+        if (i & 1) phase = (phase + 1) & 3;
+        accepted += rencoder_capture(r, gray[(i & 1) ? phase : (phase + 1) & 3], i * 1000);
+    }
+    CHECK(accepted == RENCODER_RING_SIZE, "%d edges accepted", accepted);
+    CHECK(rencoder_overflows() - before == 300 - RENCODER_RING_SIZE, "%u overflows", rencoder_overflows() - before);
+    CHECK(rencoder_process() == RENCODER_RING_SIZE, "drained a different number");
+    CHECK(rencoder_value(&a) == RENCODER_RING_SIZE / 2 && rencoder_value(&b) == RENCODER_RING_SIZE / 2,
+        "interleaved counts %d %d", rencoder_value(&a), rencoder_value(&b));
+
+    // a paused encoder's edges are drained and dropped
+    rencoder_pause(&a);
+    rencoder_capture(&a, 0x3, 0);
+    CHECK(rencoder_process() == 1 && rencoder_value(&a) == RENCODER_RING_SIZE / 2, "a paused encoder counted");
+    CHECK(rencoder_process() == 0, "an empty ring processed");
+}
+
+#define PIN_A 25
+#define PIN_B 26
+
+TaskHandle_t mainTask;
+volatile int callbacks = 0;
+volatile bool inInterrupt = false;
+volatile bool onCaller = false;
+
+static void worker_count(rencoder_t* target, int32_t next_count, int8_t difference, void* args) {
+    if (xTaskGetCurrentTaskHandle() == mainTask) onCaller = true;
+    callbacks++;
+}
+
+static void test_interrupts() {
+    mainTask = xTaskGetCurrentTaskHandle();
+    sim_gpio_set_input(PIN_A, 0);
+    sim_gpio_set_input(PIN_B, 0);
+    CHECK(rencoder_init() == ESP_OK, "init");
+    rencoder_t r;
+    CHECK(rencoder_start(&r, PIN_A, PIN_B, worker_count, NULL, false) == ESP_OK, "start");
+    static const uint8_t gray[4] = { 0x0, 0x1, 0x3, 0x2 };
+    int phase = 0;
+    for (int i = 0; i < 200; i++) {
+        phase = (phase + 1) & 3;
+        sim_gpio_set_input(PIN_A, gray[phase] >> 1);
+        sim_gpio_set_input(PIN_B, gray[phase] & 1);
+        sim_clock_sleep_micros(500);
+    }
+    sim_clock_sleep_micros(20000);
+    CHECK(rencoder_value(&r) == 200 && callbacks == 200, "counted %d with %d callbacks", rencoder_value(&r), callbacks);
+    CHECK(!onCaller, "decoded in the interrupt");
+    // 1/T at the last step, the host sleeps at least the 500 us asked
+    uint32_t since = rencoder_cycles_since_step(&r);
+    float v = rencoder_velocity_at(&r, XTHAL_GET_CCOUNT() - since);
+    CHECK(v > 1000 && v <= 2001, "%f counts/s for 2000", v);
+    // stopped since, the time since the last step bounds it
+    CHECK(rencoder_velocity(&r) < v / 5, "%f counts/s 20 ms after the last step", rencoder_velocity(&r));
+    rencoder_stop(&r);
+}
+
+int main() {
+    test_init(1);
+    test_recorded();
+    test_velocity();
+    test_overflow();
+    test_interrupts();
+    return test_done("rencoder");
+}
@@ -0,0 +1,109 @@
+#include "string.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "event_loop.h"
+#include "scheduler.h"
+
+/*
+ * Commands scheduled out of order on the running event loop must execute
+ * in deadline order, on the loop task, shortly after their deadline. Late
+ * and surplus commands are rejected and counted, a command the busy loop
+ * only gets to past the tolerance is dropped.
+ */
+
+#define COMMANDS 12
+#define SPACING_MICROS 20000
+// the host is not a real-time system, this only catches gross misses
+#define MAX_LATE_MICROS 50000
+
+TaskHandle_t loopTask;
+char executedOrder[COMMANDS + SCHEDULER_CAPACITY];
+int64_t executedLate[COMMANDS + SCHEDULER_CAPACITY];
+volatile int executedCount = 0;
+volatile bool offLoop = false;
+int64_t startedAt;
+esp_err_t results[4];
+
+static int execute(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
+    if (xTaskGetCurrentTaskHandle() != loopTask) {
+        offLoop = true;
+    }
+    int n = executedCount;
+    executedOrder[n] = buf[0];
+    executedLate[n] = esp_timer_get_time() - (startedAt + buf[0] * SPACING_MICROS);
+    executedCount = n + 1;
+    return 1;
+}
+
+static esp_err_t add(char id, int64_t at) {
+    struct sockaddr_in from = { 0 };
+    char command[2] = { id, 0 };
+    return scheduler_add(at, command, sizeof(command), -1, &from, sizeof(from));
+}
+
+/* scheduler_add is event loop only, like the command handler */
+static void add_commands(const void* _) {
+    startedAt = esp_timer_get_time() + 50000;
+    // odd ones first, then the even ones, the queue has to sort them
+    for (int i = 1; i <= COMMANDS; i += 2) {
+        add(i, startedAt + i * SPACING_MICROS);
+    }
+    for (int i = 2; i <= COMMANDS; i += 2) {
+        add(i, startedAt + i * SPACING_MICROS);
+    }
+    results[0] = add(100, esp_timer_get_time() - 5000);
+    results[1] = add(101, esp_timer_get_time() + 61000000);
+    // fill up the rest far behind the others, one more does not fit
+    for (int i = COMMANDS; i < SCHEDULER_CAPACITY; i++) {
+        add(50, startedAt + 10000000);
+    }
+    results[2] = add(51, startedAt + 10000000);
+}
+
+/* due in 2 ms, the loop is held up for 10 */
+static void hold_up_loop(const void* _) {
+    add(60, esp_timer_get_time() + 2000);
+    sim_clock_sleep_micros(10000);
+}
+
+int main() {
+    test_init(1);
+    CHECK(init_event_loop() == ESP_OK, "event loop");
+    CHECK(init_scheduler(execute) == ESP_OK, "scheduler");
+    xTaskCreatePinnedToCore(event_loop_run, "event_loop", 4096, NULL, 5, &loopTask, 0);
+    event_loop_post(add_commands, NULL, 0);
+    sim_clock_sleep_micros(50000 + (COMMANDS + 5) * SPACING_MICROS);
+
+    CHECK(executedCount == COMMANDS, "%d of %d executed", executedCount, COMMANDS);
+    CHECK(!offLoop, "a command ran off the event loop");
+    int64_t worst = 0;
+    for (int i = 0; i < executedCount; i++) {
+        CHECK(executedOrder[i] == i + 1, "command %d ran as number %d", executedOrder[i], i + 1);
+        CHECK(executedLate[i] >= 0, "command %d ran %lld us early", executedOrder[i], -executedLate[i]);
+        if (executedLate[i] > worst) worst = executedLate[i];
+    }
+    printf("  %d commands in order, %lld us late at worst\n", executedCount, worst);
+    CHECK(worst < MAX_LATE_MICROS, "%lld us late", worst);
+
+    CHECK(results[0] == ESP_ERR_TIMEOUT, "a late command got %d", results[0]);
+    CHECK(results[1] == ESP_ERR_INVALID_ARG, "a command a minute ahead got %d", results[1]);
+    CHECK(results[2] == ESP_ERR_NO_MEM, "a command past the capacity got %d", results[2]);
+
+    scheduler_stats_t stats;
+    scheduler_get_stats(&stats);
+    CHECK(stats.scheduled == SCHEDULER_CAPACITY, "scheduled %u", stats.scheduled);
+    CHECK(stats.executed == COMMANDS, "executed %u", stats.executed);
+    CHECK(stats.rejected_late == 1, "rejected late %u", stats.rejected_late);
+    CHECK(stats.rejected_full == 1, "rejected full %u", stats.rejected_full);
+    // measured when the command is taken off the queue, just before it runs
+    CHECK(stats.min_error_micros >= 0 && stats.max_error_micros <= worst,
+        "error %d..%d us, %lld us seen", stats.min_error_micros, stats.max_error_micros, worst);
+
+    event_loop_post(hold_up_loop, NULL, 0);
+    sim_clock_sleep_micros(50000);
+    scheduler_get_stats(&stats);
+    CHECK(executedCount == COMMANDS && stats.executed == COMMANDS, "a command ran 8 ms late");
+    CHECK(stats.rejected_late == 2, "rejected late %u", stats.rejected_late);
+    return test_done("scheduler");
+}
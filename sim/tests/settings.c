@@ -0,0 +1,169 @@
+#include "string.h"
+#include "test.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "settings.h"
+#include "astro.h"
+#include "mount.h"
+
+/*
+ * The settings store on the in-memory flash: a legacy value migrates, a
+ * burst of changes is one commit, unchanged values are not written, the
+ * maximum delay holds under constant changes, a failed commit is tried
+ * again and older blobs keep their values with the appended keys at their
+ * defaults.
+ */
+
+void settings_load();
+extern int32_t settingsValues[SETTINGS_COUNT];
+
+typedef struct {
+    uint16_t version;
+    uint16_t count;
+    int32_t values[SETTINGS_COUNT];
+} blob_t;
+
+static uint32_t commits() {
+    settings_stats_t stats;
+    settings_get_stats(&stats);
+    return stats.commits;
+}
+
+static void store(const char* key, const void* value, size_t length) {
+    nvs_handle handle;
+    nvs_open("storage", NVS_READWRITE, &handle);
+    if (length == sizeof(int32_t)) {
+        nvs_set_i32(handle, key, *(const int32_t*) value);
+    } else {
+        nvs_set_blob(handle, key, value, length);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void test_migration() {
+    int32_t legacy = 2500000;
+    store("time_ratio", &legacy, sizeof(legacy));
+    CHECK(init_settings() == ESP_OK, "init");
+    CHECK(settings_get(SETTING_TIME_RATIO) == legacy, "time ratio %d", settings_get(SETTING_TIME_RATIO));
+    CHECK(settings_get(SETTING_RA_GUIDE_SPEED) == 7500, "default guide speed %d", settings_get(SETTING_RA_GUIDE_SPEED));
+    // the migrated value goes to the blob once settings are quiet
+    CHECK(commits() == 0, "committed during init");
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(commits() == 1, "%u commits after the migration", commits());
+}
+
+static void test_coalescing() {
+    uint32_t writes = sim_nvs_get_writes();
+    uint32_t before = commits();
+    // fourteen commands a tenth of a second apart
+    for (int i = 0; i < 14; i++) {
+        settings_set(SETTING_FOCUSER_POSITION, 1000 + i * 10);
+        settings_set(SETTING_RA_GUIDE_SPEED, 5000 + i);
+        sim_clock_sleep_micros(100000);
+    }
+    CHECK(commits() == before, "committed while changing");
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(commits() == before + 1, "%u commits for a burst", commits() - before);
+    CHECK(sim_nvs_get_writes() - writes == 1, "%u flash writes for a burst", sim_nvs_get_writes() - writes);
+    printf("  28 changes in 1.4 s: %u commit, %u flash write\n", commits() - before, sim_nvs_get_writes() - writes);
+
+    // setting what is stored, or changing and changing back, writes nothing
+    writes = sim_nvs_get_writes();
+    settings_set(SETTING_FOCUSER_POSITION, 1130);
+    settings_set(SETTING_SIDE_OF_PIER, 1);
+    settings_set(SETTING_SIDE_OF_PIER, 0);
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(sim_nvs_get_writes() == writes, "%u flash writes for no change", sim_nvs_get_writes() - writes);
+
+    // a flush does not wait for quiet
+    settings_set(SETTING_DEC_GUIDE_SPEED, 3000);
+    CHECK(settings_flush() == ESP_OK && sim_nvs_get_writes() == writes + 1, "flush");
+}
+
+static void test_max_delay() {
+    uint32_t before = commits();
+    int64_t started = esp_timer_get_time();
+    int64_t committedAfter = -1;
+    for (int i = 0; i < 45 && committedAfter < 0; i++) {
+        settings_set(SETTING_FOCUSER_POSITION, 2000 + i);
+        sim_clock_sleep_micros(1000000);
+        if (commits() != before) committedAfter = esp_timer_get_time() - started;
+    }
+    CHECK(committedAfter > 0 && committedAfter <= (CONFIG_SETTINGS_MAX_DELAY_MILLIS + 2000) * 1000LL,
+        "constant changes committed after %lld ms", committedAfter / 1000);
+    printf("  a change every second committed after %lld ms\n", committedAfter / 1000);
+    settings_flush();
+}
+
+static void test_validation() {
+    settings_set(SETTING_SIDE_OF_PIER, 5);
+    CHECK(settings_get(SETTING_SIDE_OF_PIER) == 0, "side of pier %d", settings_get(SETTING_SIDE_OF_PIER));
+    settings_set(SETTING_SYNCED_DEC, DAY_MILLIS / 4 + 1);
+    CHECK(settings_get(SETTING_SYNCED_DEC) == 0, "synced dec %d", settings_get(SETTING_SYNCED_DEC));
+    settings_set(SETTING_SYNCED_DEC, -DAY_MILLIS / 4);
+    CHECK(settings_get(SETTING_SYNCED_DEC) == -DAY_MILLIS / 4, "synced dec %d", settings_get(SETTING_SYNCED_DEC));
+    settings_flush();
+}
+
+static uint32_t failures() {
+    settings_stats_t stats;
+    settings_get_stats(&stats);
+    return stats.failures;
+}
+
+static void test_failure() {
+    uint32_t before = commits(), failed = failures();
+    // the shim fails the commit when it cannot save to the backing file
+    setenv("TELESCOPE_SIM_NVS", "/nonexistent/nvs", 1);
+    settings_set(SETTING_FOCUSER_POSITION, 3000);
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(failures() > failed && commits() == before, "%u failures, %u commits", failures() - failed, commits() - before);
+    // kept pending and retried after another quiet period
+    failed = failures();
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(failures() > failed, "not retried");
+    unsetenv("TELESCOPE_SIM_NVS");
+    sim_clock_sleep_micros((CONFIG_SETTINGS_QUIET_MILLIS + 1000) * 1000LL);
+    CHECK(commits() == before + 1, "%u commits once the flash works", commits() - before);
+    settingsValues[SETTING_FOCUSER_POSITION] = 0;
+    settings_load();
+    CHECK(settings_get(SETTING_FOCUSER_POSITION) == 3000, "stored %d", settings_get(SETTING_FOCUSER_POSITION));
+}
+
+static void test_reload() {
+    int32_t saved[SETTINGS_COUNT];
+    memcpy(saved, settingsValues, sizeof(saved));
+    memset(settingsValues, 0x55, sizeof(saved));
+    settings_load();
+    CHECK(memcmp(saved, settingsValues, sizeof(saved)) == 0, "reloaded values differ");
+
+    // a version 1 blob had five settings, out of range ones fall back too
+    blob_t old = { 1, 5, { 3000000, 100, RA_SPEED_MAX + 1, 1, -42 } };
+    store("settings", &old, 4 + 5 * sizeof(int32_t));
+    settings_load();
+    CHECK(settings_get(SETTING_TIME_RATIO) == 3000000 && settings_get(SETTING_RA_GUIDE_SPEED) == 100,
+        "version 1 values %d %d", settings_get(SETTING_TIME_RATIO), settings_get(SETTING_RA_GUIDE_SPEED));
+    CHECK(settings_get(SETTING_DEC_GUIDE_SPEED) == 7500, "out of range stored value %d", settings_get(SETTING_DEC_GUIDE_SPEED));
+    CHECK(settings_get(SETTING_SIDE_OF_PIER) == 1 && settings_get(SETTING_FOCUSER_POSITION) == -42, "version 1 tail");
+    CHECK(settings_get(SETTING_SYNCED) == 0 && settings_get(SETTING_CHECKPOINT_SAVED_AT) == 0, "appended keys not at their defaults");
+
+    // a blob from newer firmware is not trusted
+    blob_t newer = { SETTINGS_VERSION + 1, SETTINGS_COUNT, { 123 } };
+    store("settings", &newer, sizeof(newer));
+    settings_load();
+    CHECK(settings_get(SETTING_TIME_RATIO) == 1000000, "newer blob loaded a time ratio of %d", settings_get(SETTING_TIME_RATIO));
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(50);
+    nvs_flash_init();
+    test_migration();
+    test_coalescing();
+    test_max_delay();
+    test_validation();
+    test_failure();
+    test_reload();
+    return test_done("settings");
+}
@@ -0,0 +1,163 @@
+#include "math.h"
+#include "string.h"
+#include "test.h"
+
+/*
+ * The same propagator built in double: sgp4.c again with every float type
+ * and function widened and the symbols renamed, as the accuracy reference
+ * for the single precision step and the other side of the benchmark.
+ */
+#define float double
+#define sinf sin
+#define cosf cos
+#define powf pow
+#define sqrtf sqrt
+#define atan2f atan2
+#define fabsf fabs
+#define fmodf fmod
+#define sgp4 sgp4_double
+#define sgp4_t sgp4_double_t
+#define sgp4_tle sgp4_tle_double
+#define sgp4_tle_t sgp4_tle_double_t
+#define sgp4_init sgp4_init_double
+#define sgp4_propagate sgp4_propagate_double
+#define sgp4_gmst sgp4_gmst_double
+#include "../../main/sgp4.c"
+#undef float
+#undef sinf
+#undef cosf
+#undef powf
+#undef sqrtf
+#undef atan2f
+#undef fabsf
+#undef fmodf
+#undef sgp4
+#undef sgp4_t
+#undef sgp4_tle
+#undef sgp4_tle_t
+#undef sgp4_init
+#undef sgp4_propagate
+#undef sgp4_gmst
+#undef __SGP4_H
+#include "sgp4.h"
+
+#define DEG (M_PI / 180.0)
+#define UNIX_2000_MILLIS 946684800000LL
+
+typedef struct {
+    double tsince; // minutes
+    double r[3];   // km, TEME
+    double v[3];   // km/s
+} reference_t;
+
+/*
+ * Catalog 00005 from the SGP4 verification set (Vallado et al., "Revisiting
+ * Spacetrack Report #3", AIAA 2006-6753), near-earth with drag:
+ * 1 00005U 58002B   00179.78495062  .00000023  00000-0  28098-4 0  4753
+ * 2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667
+ */
+const reference_t vanguard[] = {
+    { 0, { 7022.46529266, -1400.08296755, 0.03995155 }, { 1.893841015, 6.405893759, 4.534807250 } },
+    { 360, { -7154.03120202, -3783.17682504, -3536.19412294 }, { 4.741887409, -4.151817765, -2.093935425 } },
+    { 720, { -7134.59340119, 6531.68641334, 3260.27186483 }, { -4.113793027, -2.911922039, -2.557327851 } },
+    { 1080, { 5568.53901181, 4492.06992591, 3863.87641983 }, { -4.209106476, 5.159719888, 2.744852980 } },
+    { 1440, { -938.55923943, -6268.18748831, -4294.02924751 }, { 7.536105209, -0.427127707, 0.989878080 } },
+};
+
+static double distance(const double a[3], const float b[3]) {
+    double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+static void vanguard_tle(sgp4_tle_t* tle) {
+    tle->epoch_unix_millis = UNIX_2000_MILLIS + llround((179.78495062 - 1) * 86400000.0);
+    tle->inclination = 34.2682 * DEG;
+    tle->raan = 348.7242 * DEG;
+    tle->eccentricity = 0.1859667;
+    tle->arg_perigee = 331.7664 * DEG;
+    tle->mean_anomaly = 19.3264 * DEG;
+    tle->mean_motion = 10.82419157;
+    tle->bstar = 0.28098e-4;
+}
+
+static void test_reference_vectors() {
+    sgp4_tle_t tle;
+    vanguard_tle(&tle);
+    sgp4_t s;
+    CHECK(sgp4_init(&s, &tle) == SGP4_OK, "init");
+    for (int i = 0; i < sizeof(vanguard) / sizeof(vanguard[0]); i++) {
+        float r[3], v[3];
+        CHECK(sgp4_propagate(&s, vanguard[i].tsince, r, v) == SGP4_OK, "propagate %g", vanguard[i].tsince);
+        double dr = distance(vanguard[i].r, r);
+        double dv = distance(vanguard[i].v, v);
+        printf("  %6.0f min: position off %7.4f km, velocity off %8.6f km/s\n", vanguard[i].tsince, dr, dv);
+        // single precision keeps a few metres of the 7000 km radius over the day
+        CHECK(dr < 0.05, "position at %g min off by %f km", vanguard[i].tsince, dr);
+        CHECK(dv < 5e-5, "velocity at %g min off by %f km/s", vanguard[i].tsince, dv);
+    }
+}
+
+static void test_rejects() {
+    sgp4_tle_t tle;
+    vanguard_tle(&tle);
+    sgp4_t s;
+    tle.mean_motion = 2.0; // twelve hour orbit
+    CHECK(sgp4_init(&s, &tle) == SGP4_ERR_DEEP_SPACE, "deep space is not propagated");
+}
+
+static void test_gmst() {
+    // 2000-01-01 12:00 UT, 280.46061837 degrees
+    double gmst = sgp4_gmst(UNIX_2000_MILLIS + 12 * 3600000LL);
+    CHECK(fabs(gmst - 280.46061837 * DEG) < 1e-8, "gmst at J2000 is %.9f", gmst / DEG);
+}
+
+/* float against the double build over a day at the tracking update rate */
+static void test_float_against_double() {
+    sgp4_tle_t tle;
+    sgp4_tle_double_t tled;
+    vanguard_tle(&tle);
+    memcpy(&tled, &tle, sizeof(tled));
+    sgp4_t s;
+    sgp4_double_t sd;
+    sgp4_init(&s, &tle);
+    sgp4_init_double(&sd, &tled);
+
+    double worst = 0;
+    for (double t = 0; t <= 1440; t += 0.5) {
+        float r[3], v[3];
+        double rd[3], vd[3];
+        sgp4_propagate(&s, t, r, v);
+        sgp4_propagate_double(&sd, t, rd, vd);
+        double d = distance(rd, r);
+        if (d > worst) worst = d;
+    }
+    printf("  float against double over a day: %.4f km at worst\n", worst);
+    CHECK(worst < 0.05, "float path drifts %f km from double", worst);
+
+    const int rounds = 200000;
+    float r[3], v[3];
+    double rd[3], vd[3];
+    volatile double sink = 0;
+    double start = test_seconds();
+    for (int i = 0; i < rounds; i++) {
+        sgp4_propagate(&s, i * 0.01, r, v);
+        sink += r[0];
+    }
+    double single = test_seconds() - start;
+    start = test_seconds();
+    for (int i = 0; i < rounds; i++) {
+        sgp4_propagate_double(&sd, i * 0.01, rd, vd);
+        sink += rd[0];
+    }
+    double dbl = test_seconds() - start;
+    // on the host both run in hardware, on the ESP32 only float does
+    printf("  propagate: float %.0f ns, double %.0f ns on this host\n", single / rounds * 1e9, dbl / rounds * 1e9);
+}
+
+int main() {
+    test_reference_vectors();
+    test_rejects();
+    test_gmst();
+    test_float_against_double();
+    return test_done("sgp4");
+}
@@ -0,0 +1,54 @@
+#ifndef __TEST_H
+#define __TEST_H
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "time.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+/*
+ * Host unit tests. Each file under tests/ is one program linked against the
+ * firmware and the shim, checks count failures and main returns
+ * test_done(), so make test fails if any file had one. Results go to
+ * stdout, the firmware logs to stderr, which make test only shows for a
+ * failed test. Benchmarks print their timings and only check results.
+ */
+
+static int testChecks = 0;
+static int testFailures = 0;
+
+#define CHECK(condition, ...) do { \
+    testChecks++; \
+    if (!(condition)) { \
+        testFailures++; \
+        printf("%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+/* the virtual clock and the calling thread as the main task, as sim/main.c sets them up */
+static inline void test_init(double scale) {
+    sim_clock_init(scale);
+    sim_task_register("main");
+    esp_timer_init();
+}
+
+/* host wall clock for benchmarks, the virtual clock may be scaled */
+static inline double test_seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static inline int test_done(const char* name) {
+    if (testFailures) {
+        printf("%s: %d of %d checks failed\n", name, testFailures, testChecks);
+        return 1;
+    }
+    printf("%s: %d checks passed\n", name, testChecks);
+    return 0;
+}
+
+#endif
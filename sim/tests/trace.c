@@ -0,0 +1,182 @@
+#include "string.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "sys/socket.h"
+#include "sys/time.h"
+#include "test.h"
+
+/*
+ * The ring with tracing built in and a small capacity: fields round trip,
+ * the oldest events are overwritten and reads skip ahead to them, a paused
+ * ring keeps what it has, tasks racing each other lose nothing. Then the
+ * ring read out through GET_TRACE as the trace tool does. The Makefile
+ * leaves the firmware's own trace object out of this test.
+ */
+#define CONFIG_TRACE 1
+#define CONFIG_TRACE_EVENTS 64
+#include "../../main/trace.c"
+#include "freertos/task.h"
+#include "boot.h"
+#include "protocol.h"
+
+#define CMD_GET_TRACE 19
+
+void app_main();
+
+static void test_fields() {
+    uint32_t head = trace_head();
+    trace_record(TRACE_SLEW_TIMER, TRACE_PHASE_BEGIN, 0xbeef);
+    sim_clock_sleep_micros(100);
+    trace_record(TRACE_SLEW_TIMER, TRACE_PHASE_END, 0xbeef);
+    trace_record(TRACE_PULSE_GUIDE_END, TRACE_PHASE_INSTANT, 7);
+    trace_event_t events[4];
+    uint32_t first;
+    CHECK(trace_read(head, events, 4, &first) == 3 && first == head, "read back");
+    CHECK(TRACE_EVENT_OF(events[0].event) == TRACE_SLEW_TIMER && TRACE_PHASE_OF(events[0].event) == TRACE_PHASE_BEGIN, "begin");
+    CHECK(TRACE_PHASE_OF(events[1].event) == TRACE_PHASE_END && events[1].arg == 0xbeef, "end");
+    CHECK(TRACE_EVENT_OF(events[2].event) == TRACE_PULSE_GUIDE_END && TRACE_PHASE_OF(events[2].event) == TRACE_PHASE_INSTANT, "instant");
+    CHECK(events[1].time - events[0].time >= 100, "%u us apart", events[1].time - events[0].time);
+    char names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH];
+    int tasks = trace_get_tasks(names);
+    int task = TRACE_TASK_OF(events[0].task);
+    CHECK(task < tasks && !strcmp(names[task], "main") && TRACE_CORE_OF(events[0].task) == 0, "task %d of %d", task, tasks);
+    CHECK(trace_capacity() == CONFIG_TRACE_EVENTS, "capacity %u", trace_capacity());
+}
+
+static void test_wrap() {
+    uint32_t head = trace_head();
+    for (int i = 0; i < CONFIG_TRACE_EVENTS + 40; i++) {
+        trace_record(TRACE_UPDATE_STEPPER, TRACE_PHASE_INSTANT, i);
+    }
+    trace_event_t events[CONFIG_TRACE_EVENTS];
+    uint32_t first;
+    // the first 40 were overwritten, the read starts at the oldest left
+    int count = trace_read(head, events, CONFIG_TRACE_EVENTS, &first);
+    CHECK(count == CONFIG_TRACE_EVENTS && first == head + 40, "%d from %u", count, first - head);
+    bool inOrder = true;
+    for (int i = 0; i < count; i++) {
+        inOrder &= events[i].arg == 40 + i;
+    }
+    CHECK(inOrder, "events out of order after the wrap");
+    // a read from past the head is empty
+    CHECK(trace_read(trace_head() + 5, events, 4, &first) == 0 && first == trace_head(), "read past the head");
+    CHECK(trace_read(trace_head() - 2, events, 4, &first) == 2, "the last two");
+
+    trace_set_recording(false);
+    head = trace_head();
+    trace_record(TRACE_UPDATE_STEPPER, TRACE_PHASE_INSTANT, 0);
+    CHECK(trace_head() == head, "recorded while paused");
+    trace_set_recording(true);
+    trace_record(TRACE_UPDATE_STEPPER, TRACE_PHASE_INSTANT, 0);
+    CHECK(trace_head() == head + 1, "not recording after the resume");
+}
+
+#define RACERS 4
+#define RACE_EVENTS 20000
+volatile int racersDone = 0;
+
+static void racer(void* arg) {
+    for (int i = 0; i < RACE_EVENTS; i++) {
+        trace_record(TRACE_FOCUSER_TIMER, TRACE_PHASE_INSTANT, i);
+    }
+    __atomic_add_fetch(&racersDone, 1, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+static void test_race() {
+    uint32_t head = trace_head();
+    char name[RACERS][8];
+    for (int i = 0; i < RACERS; i++) {
+        snprintf(name[i], sizeof(name[i]), "racer%d", i);
+        xTaskCreatePinnedToCore(racer, name[i], 4096, NULL, 5, NULL, i & 1);
+    }
+    while (__atomic_load_n(&racersDone, __ATOMIC_ACQUIRE) < RACERS) {
+        sim_clock_sleep_micros(1000);
+    }
+    CHECK(trace_head() - head == RACERS * RACE_EVENTS, "%u events for %d", trace_head() - head, RACERS * RACE_EVENTS);
+    char names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LENGTH];
+    int tasks = trace_get_tasks(names);
+    trace_event_t events[CONFIG_TRACE_EVENTS];
+    uint32_t first;
+    int count = trace_read(head, events, CONFIG_TRACE_EVENTS, &first);
+    // what is left is each racer's last events, in order per racer, on its own core
+    int last[TRACE_MAX_TASKS], wrong = 0;
+    memset(last, -1, sizeof(last));
+    for (int i = 0; i < count; i++) {
+        int task = TRACE_TASK_OF(events[i].task);
+        if (task >= tasks || strncmp(names[task], "racer", 5)) {
+            wrong++;
+            continue;
+        }
+        if (events[i].arg <= last[task]) wrong++;
+        last[task] = events[i].arg;
+        if (TRACE_CORE_OF(events[i].task) != (names[task][5] - '0') % 2) wrong++;
+    }
+    CHECK(count == CONFIG_TRACE_EVENTS && wrong == 0, "%d events, %d wrong", count, wrong);
+}
+
+static void test_query() {
+    app_main();
+    int64_t deadline = esp_timer_get_time() + 2000000;
+    while (!boot_is_complete() && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    for (int i = 0; i < 10; i++) {
+        trace_record(TRACE_BROADCAST_STATUS, TRACE_PHASE_INSTANT, 1000 + i);
+    }
+    uint32_t head = trace_head();
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(CONFIG_SERVER_PORT) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // the last ten, recording paused for the read
+    uint8_t request[6] = { CMD_GET_TRACE, 0, 0, 0, 0, TRACE_FRAME_PAUSE };
+    uint32_t from = htonl(head - 10);
+    memcpy(request + 1, &from, 4);
+    sendto(sock, request, sizeof(request), 0, (struct sockaddr *) &addr, sizeof(addr));
+    trace_frame_t frame;
+    uint8_t* b = frame.buffer;
+    int len;
+    do {
+        len = recv(sock, b, sizeof(frame.buffer), 0);
+    } while (len > 0 && b[0] != CMD_GET_TRACE);
+    CHECK(len == TRACE_FRAME_SIZE(10) && TRACE_FRAME_COUNT(b) == 10, "reply of %d bytes", len);
+    CHECK(ntohl(TRACE_FRAME_FIRST(b)) == head - 10 && ntohl(TRACE_FRAME_HEAD(b)) == head, "first %u head %u",
+        ntohl(TRACE_FRAME_FIRST(b)), ntohl(TRACE_FRAME_HEAD(b)));
+    CHECK(ntohl(TRACE_FRAME_CAPACITY(b)) == CONFIG_TRACE_EVENTS, "capacity");
+    bool same = true;
+    for (int i = 0; i < 10 && i < TRACE_FRAME_COUNT(b); i++) {
+        same &= ntohs(TRACE_FRAME_EVENT_ARG(b, i)) == 1000 + i;
+        same &= TRACE_EVENT_OF(TRACE_FRAME_EVENT_ID(b, i)) == TRACE_BROADCAST_STATUS;
+        int task = TRACE_TASK_OF(TRACE_FRAME_EVENT_TASK(b, i));
+        same &= task < TRACE_FRAME_TASK_COUNT(b) && !strncmp(TRACE_FRAME_TASK_NAME(b, task), "main", TRACE_FRAME_NAME_LENGTH);
+    }
+    CHECK(same, "events differ from the ring");
+    trace_record(TRACE_BROADCAST_STATUS, TRACE_PHASE_INSTANT, 0);
+    CHECK(trace_head() == head, "recorded while the client reads");
+
+    // resumed by the last request
+    request[5] = TRACE_FRAME_RESUME;
+    from = htonl(head);
+    memcpy(request + 1, &from, 4);
+    sendto(sock, request, sizeof(request), 0, (struct sockaddr *) &addr, sizeof(addr));
+    do {
+        len = recv(sock, b, sizeof(frame.buffer), 0);
+    } while (len > 0 && b[0] != CMD_GET_TRACE);
+    CHECK(len == TRACE_FRAME_SIZE(0), "reply of %d bytes at the head", len);
+    trace_record(TRACE_BROADCAST_STATUS, TRACE_PHASE_INSTANT, 0);
+    CHECK(trace_head() == head + 1, "not recording after the resume");
+    close(sock);
+}
+
+int main() {
+    unsetenv("TELESCOPE_SIM_NVS");
+    test_init(1);
+    test_fields();
+    test_wrap();
+    test_race();
+    test_query();
+    return test_done("trace");
+}
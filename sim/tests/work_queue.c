@@ -0,0 +1,187 @@
+#include "string.h"
+#include "sched.h"
+#include "test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "work_queue.h"
+#include "motion_loop.h"
+
+/*
+ * The lock-free queue under several producers racing one consumer: every
+ * call runs once, with its data intact and in order per producer, and a
+ * refused push is counted. Then posts and timers on the motion task.
+ */
+
+#define PRODUCERS 4
+#define PUSHES 200000
+#define QUEUE_SIZE 64
+
+typedef struct {
+    uint32_t producer;
+    uint32_t n;
+    uint64_t check;
+} call_t;
+
+work_item_t items[QUEUE_SIZE];
+work_queue_t queue;
+uint32_t nextExpected[PRODUCERS];
+volatile uint32_t ran = 0, corrupt = 0, outOfOrder = 0;
+volatile uint32_t refused = 0;
+volatile int producersDone = 0;
+
+static uint64_t check(uint32_t producer, uint32_t n) {
+    return ((uint64_t) producer << 48) ^ ((uint64_t) n * 0x9e3779b97f4a7c15ULL);
+}
+
+static void consume(const void* data) {
+    const call_t* c = data;
+    if (c->producer >= PRODUCERS || c->check != check(c->producer, c->n)) {
+        corrupt++;
+        return;
+    }
+    if (c->n != nextExpected[c->producer]) outOfOrder++;
+    nextExpected[c->producer] = c->n + 1;
+    ran++;
+}
+
+static void producer(void* arg) {
+    uint32_t id = (uint32_t)(intptr_t) arg;
+    for (uint32_t n = 0; n < PUSHES; n++) {
+        call_t c = { id, n, check(id, n) };
+        while (!work_queue_push(&queue, consume, &c, sizeof(c))) {
+            __atomic_add_fetch(&refused, 1, __ATOMIC_RELAXED);
+            sched_yield();
+        }
+    }
+    __atomic_add_fetch(&producersDone, 1, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+static void noop(const void* data) {
+}
+
+static void test_single_thread() {
+    work_queue_init(&queue, items, QUEUE_SIZE);
+    char big[WORK_DATA_SIZE + 1] = { 0 };
+    CHECK(!work_queue_push(&queue, noop, big, sizeof(big)), "data over WORK_DATA_SIZE taken");
+    // full after exactly the size, empty again after a run, over many laps
+    bool ok = true;
+    for (int lap = 0; lap < 100; lap++) {
+        for (int i = 0; i < QUEUE_SIZE; i++) {
+            ok &= work_queue_push(&queue, noop, NULL, 0);
+        }
+        ok &= !work_queue_push(&queue, noop, NULL, 0);
+        ok &= work_queue_run(&queue) == QUEUE_SIZE;
+        ok &= work_queue_run(&queue) == 0;
+    }
+    CHECK(ok, "a lap did not fill and drain at the size");
+    CHECK(queue.overflows == 100, "%u overflows for 100 refused pushes", queue.overflows);
+}
+
+static void test_producers() {
+    work_queue_init(&queue, items, QUEUE_SIZE);
+    double started = test_seconds();
+    for (int i = 0; i < PRODUCERS; i++) {
+        xTaskCreatePinnedToCore(producer, "producer", 4096, (void*)(intptr_t) i, 5, NULL, i & 1);
+    }
+    // this task is the single consumer
+    while (__atomic_load_n(&producersDone, __ATOMIC_ACQUIRE) < PRODUCERS || work_queue_run(&queue)) {
+        if (!work_queue_run(&queue)) sched_yield();
+    }
+    double elapsed = test_seconds() - started;
+    CHECK(ran == PRODUCERS * PUSHES, "%u of %u calls ran", ran, PRODUCERS * PUSHES);
+    CHECK(corrupt == 0, "%u calls with corrupt data", corrupt);
+    CHECK(outOfOrder == 0, "%u calls out of order", outOfOrder);
+    CHECK(queue.overflows == refused, "%u overflows for %u refused pushes", queue.overflows, refused);
+    printf("  %d producers, %u calls in %.2f s, %u pushes refused on a full queue\n", PRODUCERS, ran, elapsed, refused);
+}
+
+#define POSTERS 3
+#define POSTS 300
+int lastPost[POSTERS];
+volatile int motionCalls = 0, offMotion = 0, postsOutOfOrder = 0, nested = 0, inline_ = 0;
+volatile uint32_t postsRefused = 0, postersDone = 0;
+
+static void on_motion(const void* data) {
+    const call_t* c = data;
+    if (!motion_is_current_task()) offMotion++;
+    if ((int) c->n <= lastPost[c->producer]) postsOutOfOrder++;
+    lastPost[c->producer] = c->n;
+    motionCalls++;
+}
+
+static void poster(void* arg) {
+    uint32_t id = (uint32_t)(intptr_t) arg;
+    for (uint32_t n = 1; n <= POSTS; n++) {
+        call_t c = { id, n, 0 };
+        // the motion queue is small, a full one refuses and the poster tries again
+        while (!motion_post(on_motion, &c, sizeof(c))) {
+            __atomic_add_fetch(&postsRefused, 1, __ATOMIC_RELAXED);
+            vTaskDelay(1);
+        }
+    }
+    __atomic_add_fetch(&postersDone, 1, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+static void inner(const void* data) {
+    inline_ = nested;
+}
+
+static void outer(const void* data) {
+    // a post from the motion task runs right away
+    nested = 1;
+    motion_post(inner, NULL, 0);
+    nested = 0;
+}
+
+volatile int ticks = 0;
+
+static void tick(void* arg) {
+    ticks++;
+}
+
+static void test_motion() {
+    CHECK(init_motion_loop() == ESP_OK, "motion loop");
+    for (int i = 0; i < POSTERS; i++) {
+        xTaskCreatePinnedToCore(poster, "poster", 4096, (void*)(intptr_t) i, 5, NULL, 1);
+    }
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    while (__atomic_load_n(&postersDone, __ATOMIC_ACQUIRE) < POSTERS && esp_timer_get_time() < deadline) {
+        sim_clock_sleep_micros(10000);
+    }
+    CHECK(motion_post(outer, NULL, 0), "post refused");
+    sim_clock_sleep_micros(50000);
+    CHECK(motionCalls == POSTERS * POSTS, "%d of %d posts ran", motionCalls, POSTERS * POSTS);
+    CHECK(offMotion == 0 && postsOutOfOrder == 0, "%d off the motion task, %d out of order", offMotion, postsOutOfOrder);
+    CHECK(inline_ == 1, "a post from the motion task was queued");
+    printf("  %d posts from %d tasks, %u refused on a full queue\n", motionCalls, POSTERS, postsRefused);
+
+    motion_timer_t timer;
+    motion_timer_init(&timer, tick, NULL);
+    motion_timer_start_periodic(&timer, 20);
+    sim_clock_sleep_micros(1000000);
+    motion_timer_stop(&timer);
+    sim_clock_sleep_micros(50000);
+    int stoppedAt = ticks;
+    sim_clock_sleep_micros(100000);
+    CHECK(ticks >= 48 && ticks <= 51, "%d periods of 20 ms in a second", ticks);
+    CHECK(ticks == stoppedAt, "ticked after the stop");
+    motion_stats_t stats;
+    motion_get_stats(&stats);
+    CHECK(stats.intervals >= 47 && stats.max_jitter_micros < 20000, "%u intervals, %u us jitter at worst",
+        stats.intervals, stats.max_jitter_micros);
+    // the inline post is not queued, the timer requests are
+    CHECK(stats.posts >= POSTERS * POSTS + 1, "%u posts", stats.posts);
+    CHECK(stats.overflows == postsRefused, "%u overflows for %u refused posts", stats.overflows, postsRefused);
+    printf("  20 ms motion timer: %u intervals, jitter %u us at worst, %llu us mean\n", stats.intervals,
+        stats.max_jitter_micros, stats.intervals ? stats.total_jitter_micros / stats.intervals : 0);
+}
+
+int main() {
+    test_init(1);
+    test_single_thread();
+    test_producers();
+    test_motion();
+    return test_done("work_queue");
+}
@@ -0,0 +1,152 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "sys/socket.h"
+#include "sys/time.h"
+#include "protocol.h"
+#include "cpu_monitor.h"
+
+/*
+ * Asks a controller, or the simulator, for its command statistics and CPU
+ * loads and prints them as tables.
+ *
+ *   ./sim/build/telescope-stats [host] [port]
+ */
+
+#define CMD_GET_COMMAND_STATS 18
+#define CMD_GET_CPU_MONITOR 20
+
+const char* command_name(uint8_t cmd) {
+    switch (cmd) {
+        case 0: return "ping";
+        case 1: return "set_tracking";
+        case 2: return "set_ra_speed";
+        case 3: return "set_dec_speed";
+        case 4: return "pulse_guiding";
+        case 5: return "set_ra_guide_speed";
+        case 6: return "set_dec_guide_speed";
+        case 7: return "sync_to_target";
+        case 8: return "slew_to_target";
+        case 9: return "abort_slew";
+        case 10: return "set_side_of_pier";
+        case 11: return "track_satellite";
+        case 12: return "time_sync";
+        case 13: return "execute_at";
+        case 14: return "get_schedule_stats";
+        case 15: return "get_boot_timeline";
+        case 16: return "get_hand_stats";
+        case 17: return "get_memory_report";
+        case 18: return "get_command_stats";
+        case 19: return "get_trace";
+        case 20: return "get_cpu_monitor";
+        case 101: return "set_time_ratio";
+        case 201: return "focuser_move";
+        case 202: return "focuser_abort";
+        case 203: return "focuser_move_to";
+        case 204: return "focuser_get_position";
+        case 205: return "focuser_set_zero";
+        case 206: return "autofocus_start";
+        case 207: return "autofocus_report";
+        case 208: return "autofocus_abort";
+        default: return "?";
+    }
+}
+
+/* sends cmd and waits for the reply starting with it, the ack arrives too */
+int query(int sock, struct sockaddr_in* addr, uint8_t cmd, uint8_t* buffer, size_t size) {
+    sendto(sock, &cmd, 1, 0, (struct sockaddr *) addr, sizeof(*addr));
+    int len;
+    do {
+        len = recv(sock, buffer, size, 0);
+    } while (len >= 0 && (len < 1 || buffer[0] != cmd));
+    return len;
+}
+
+void print_timer(const char* name, uint8_t* b, int index) {
+    printf("%-8s %8u %8d %8d %8d\n", name, ntohl(CPU_MONITOR_TIMER_SAMPLES(b, index)),
+        (int32_t) ntohl(CPU_MONITOR_TIMER_MIN(b, index)), (int32_t) ntohl(CPU_MONITOR_TIMER_AVG(b, index)),
+        (int32_t) ntohl(CPU_MONITOR_TIMER_MAX(b, index)));
+}
+
+/* permille as percent */
+double percent(uint16_t permille) {
+    return ntohs(permille) / 10.0;
+}
+
+int print_cpu_monitor(int sock, struct sockaddr_in* addr) {
+    cpu_monitor_frame_t frame;
+    uint8_t* b = frame.buffer;
+    int len = query(sock, addr, CMD_GET_CPU_MONITOR, b, sizeof(frame.buffer));
+    if (len < CPU_MONITOR_SIZE(0) || len < CPU_MONITOR_SIZE(CPU_MONITOR_TASK_COUNT(b))) {
+        fprintf(stderr, "no cpu monitor reply\n");
+        return 1;
+    }
+    int count = CPU_MONITOR_TASK_COUNT(b);
+    printf("\nCPU at %d MHz, loads over %.1f ms\n", ntohs(CPU_MONITOR_CPU_MHZ(b)), ntohl(CPU_MONITOR_WINDOW(b)) / 1000.0);
+    for (int i = 0; i < 2; i++) {
+        printf("core %d   %5.1f%%, peak %5.1f%%\n", i, percent(CPU_MONITOR_CORE_LOAD(b, i)), percent(CPU_MONITOR_CORE_PEAK(b, i)));
+    }
+    printf("\n%-16s %4s %4s %7s %7s\n", "task", "core", "prio", "load", "peak");
+    for (int i = 0; i < count; i++) {
+        char name[CPU_MONITOR_FRAME_NAME_LENGTH + 1] = { 0 };
+        memcpy(name, CPU_MONITOR_TASK_NAME(b, i), CPU_MONITOR_FRAME_NAME_LENGTH);
+        uint8_t core = CPU_MONITOR_TASK_CORE(b, i);
+        char coreName[8];
+        snprintf(coreName, sizeof(coreName), core == 0xff ? "any" : "%d", core);
+        printf("%-16s %4s %4d %6.1f%% %6.1f%%\n", name, coreName, CPU_MONITOR_TASK_PRIORITY(b, i),
+            percent(CPU_MONITOR_TASK_LOAD(b, i)), percent(CPU_MONITOR_TASK_PEAK(b, i)));
+    }
+    printf("\n%-8s %8s %8s %8s %8s\n", "timer", "fired", "min us", "avg us", "max us");
+    printf("(late against due, last %d firings)\n", TIMER_MONITOR_WINDOW);
+    print_timer("focuser", b, CPU_MONITOR_TIMER_FOCUSER);
+    print_timer("slew", b, CPU_MONITOR_TIMER_SLEW);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : CONFIG_SERVER_PORT;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (sock < 0 || inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", host);
+        return 1;
+    }
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    command_stats_frame_t frame;
+    uint8_t* b = frame.buffer;
+    int len = query(sock, &addr, CMD_GET_COMMAND_STATS, b, sizeof(frame.buffer));
+    if (len < COMMAND_STATS_SIZE(0)) {
+        fprintf(stderr, "no reply from %s:%d\n", host, port);
+        return 1;
+    }
+    int count = COMMAND_STATS_COUNT(b);
+    if (len < COMMAND_STATS_SIZE(count)) {
+        fprintf(stderr, "short reply: %d bytes for %d commands\n", len, count);
+        return 1;
+    }
+
+    printf("datagrams in %u, out %u, send failures %u, receive errors %u, untracked commands %u\n\n",
+        ntohl(COMMAND_STATS_DATAGRAMS_IN(b)), ntohl(COMMAND_STATS_DATAGRAMS_OUT(b)),
+        ntohl(COMMAND_STATS_SEND_FAILURES(b)), ntohl(COMMAND_STATS_RECEIVE_ERRORS(b)),
+        ntohl(COMMAND_STATS_UNTRACKED(b)));
+    printf("%-22s %8s %8s | %27s | %27s\n", "", "", "", "effect (us)", "ack (us)");
+    printf("%-22s %8s %8s | %8s %8s %9s | %8s %8s %9s\n", "command", "received", "rejected",
+        "p50", "p99", "max", "p50", "p99", "max");
+    for (int i = 0; i < count; i++) {
+        uint8_t id = COMMAND_STATS_ENTRY_CMD(b, i);
+        char name[32];
+        snprintf(name, sizeof(name), "%s (%d)", command_name(id), id);
+        printf("%-22s %8u %8u | %8u %8u %9u | %8u %8u %9u\n", name,
+            ntohl(COMMAND_STATS_ENTRY_RECEIVED(b, i)), ntohl(COMMAND_STATS_ENTRY_REJECTED(b, i)),
+            ntohl(COMMAND_STATS_ENTRY_EFFECT_P50(b, i)), ntohl(COMMAND_STATS_ENTRY_EFFECT_P99(b, i)),
+            ntohl(COMMAND_STATS_ENTRY_EFFECT_MAX(b, i)), ntohl(COMMAND_STATS_ENTRY_ACK_P50(b, i)),
+            ntohl(COMMAND_STATS_ENTRY_ACK_P99(b, i)), ntohl(COMMAND_STATS_ENTRY_ACK_MAX(b, i)));
+    }
+    int result = print_cpu_monitor(sock, &addr);
+    close(sock);
+    return result;
+}
@@ -0,0 +1,128 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "sys/socket.h"
+#include "sys/time.h"
+#include "protocol.h"
+#include "trace.h"
+
+/*
+ * Reads the trace ring of a controller, or the simulator, built with
+ * CONFIG_TRACE and writes it as Chrome trace JSON, one row per task. Open
+ * the file in chrome://tracing or ui.perfetto.dev.
+ *
+ *   ./sim/build/telescope-trace [host] [port] > trace.json
+ *
+ * Recording pauses while the ring is read and resumes after.
+ */
+
+#define CMD_GET_TRACE 19
+#define OTHER_TASK 0x7f
+#define RETRIES 3
+
+#define TRACE_EVENT_NAME(id, name) name,
+const char* eventNames[TRACE_EVENT_COUNT] = { TRACE_EVENTS(TRACE_EVENT_NAME) };
+
+int sock;
+struct sockaddr_in addr;
+trace_frame_t frame;
+
+/* sends a request and waits for its frame, the ack is skipped */
+int request(uint32_t from, uint8_t flags) {
+    uint8_t buf[6];
+    buf[0] = CMD_GET_TRACE;
+    uint32_t n = htonl(from);
+    memcpy(buf + 1, &n, 4);
+    buf[5] = flags;
+    for (int attempt = 0; attempt < RETRIES; attempt++) {
+        sendto(sock, buf, sizeof(buf), 0, (struct sockaddr *) &addr, sizeof(addr));
+        int len;
+        while ((len = recv(sock, frame.buffer, sizeof(frame.buffer), 0)) >= 0) {
+            if (len >= TRACE_FRAME_SIZE(0) && TRACE_FRAME_CMD(frame.buffer) == CMD_GET_TRACE
+                && len >= TRACE_FRAME_SIZE(TRACE_FRAME_COUNT(frame.buffer))) {
+                return len;
+            }
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : CONFIG_SERVER_PORT;
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (sock < 0 || inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", host);
+        return 1;
+    }
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t* b = frame.buffer;
+    if (request(0, TRACE_FRAME_PAUSE) < 0) {
+        fprintf(stderr, "no reply from %s:%d\n", host, port);
+        return 1;
+    }
+    if (ntohl(TRACE_FRAME_CAPACITY(b)) == 0) {
+        fprintf(stderr, "tracing is not built in, enable CONFIG_TRACE\n");
+        return 1;
+    }
+    uint32_t head = ntohl(TRACE_FRAME_HEAD(b));
+    uint32_t next = ntohl(TRACE_FRAME_FIRST(b));
+    uint32_t lost = next;
+    int64_t time = 0, start = 0;
+    uint32_t lastTime = 0;
+    int events = 0;
+
+    printf("{\"traceEvents\":[\n");
+    printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"telescope\"}}");
+    while (1) {
+        int count = TRACE_FRAME_COUNT(b);
+        uint32_t first = ntohl(TRACE_FRAME_FIRST(b));
+        if (first != next) {
+            lost += first - next;
+        }
+        for (int i = 0; i < count; i++, events++) {
+            uint32_t t = ntohl(TRACE_FRAME_EVENT_TIME(b, i));
+            // 32 bit micros, unwrapped against the event before
+            if (events == 0) {
+                time = start = t;
+            } else {
+                time += (int32_t)(t - lastTime);
+            }
+            lastTime = t;
+            uint8_t event = TRACE_FRAME_EVENT_ID(b, i);
+            uint8_t task = TRACE_FRAME_EVENT_TASK(b, i);
+            uint8_t id = TRACE_EVENT_OF(event);
+            uint8_t phase = TRACE_PHASE_OF(event);
+            const char* ph = phase == TRACE_PHASE_BEGIN ? "B" : (phase == TRACE_PHASE_END ? "E" : "i\",\"s\":\"t");
+            printf(",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%lld,\"pid\":0,\"tid\":%d,\"args\":{\"arg\":%d,\"core\":%d}}",
+                id < TRACE_EVENT_COUNT ? eventNames[id] : "?", ph, (long long)(time - start),
+                TRACE_TASK_OF(task), ntohs(TRACE_FRAME_EVENT_ARG(b, i)), TRACE_CORE_OF(task));
+        }
+        next = first + count;
+        if (count == 0 || (int32_t)(next - head) >= 0) {
+            break;
+        }
+        if (request(next, 0) < 0) {
+            fprintf(stderr, "no reply from %s:%d at event %u\n", host, port, next);
+            break;
+        }
+    }
+    int tasks = TRACE_FRAME_TASK_COUNT(b);
+    for (int i = 0; i < tasks; i++) {
+        char name[TRACE_FRAME_NAME_LENGTH + 1] = { 0 };
+        memcpy(name, TRACE_FRAME_TASK_NAME(b, i), TRACE_FRAME_NAME_LENGTH);
+        printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, name);
+    }
+    printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"other\"}}", OTHER_TASK);
+    printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+    request(head, TRACE_FRAME_RESUME);
+    fprintf(stderr, "%d events, %u recorded since boot, %u overwritten before they were read\n", events, head, lost);
+    close(sock);
+    return 0;
+}